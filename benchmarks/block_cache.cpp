@@ -0,0 +1,191 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "../util/timing_util.hpp"
+
+#include <stdext/lru_cache.h>
+#include <stdext/concurrent_cache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Choosen by a fair W20 dice roll (this value is completely arbitrary)
+constexpr unsigned RANDOM_SEED = 13;
+constexpr unsigned BLOCK_COUNT = 65536;
+constexpr unsigned CACHE_SIZE = 8192;
+constexpr unsigned BLOCK_SIZE = 4096;
+constexpr unsigned LOOKUPS_PER_THREAD = 200000;
+
+using Block = std::vector<unsigned char>;
+using BlockPtr = std::shared_ptr<Block>;
+
+// Simulates decoding a block on cache miss
+BlockPtr LoadBlock(unsigned key)
+{
+    auto block = std::make_shared<Block>(BLOCK_SIZE);
+    for (unsigned i = 0; i < BLOCK_SIZE; i++)
+    {
+        (*block)[i] = static_cast<unsigned char>(key * 31 + i);
+    }
+    return block;
+}
+
+// Previous RoutingGraph scheme: a single LRU cache guarded by one graph-wide mutex
+class LockedLRUCache
+{
+  public:
+    LockedLRUCache() : cache(CACHE_SIZE) {}
+
+    BlockPtr Get(unsigned key)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        BlockPtr block;
+        if (!cache.read(key, block))
+        {
+            misses++;
+            block = LoadBlock(key);
+            cache.put(key, block);
+        }
+        return block;
+    }
+
+    std::atomic<std::size_t> misses{0};
+
+  private:
+    cache::lru_cache<unsigned, BlockPtr> cache;
+    std::recursive_mutex mutex;
+};
+
+class ShardedCache
+{
+  public:
+    ShardedCache() : cache(CACHE_SIZE) {}
+
+    BlockPtr Get(unsigned key)
+    {
+        BlockPtr block;
+        if (!cache.read(key, block))
+        {
+            misses++;
+            block = LoadBlock(key);
+            cache.put(key, block);
+        }
+        return block;
+    }
+
+    std::atomic<std::size_t> misses{0};
+
+  private:
+    cache::concurrent_cache<unsigned, BlockPtr> cache;
+};
+
+// Skewed key sequence: a small set of hot blocks with a long tail, like urban vs. rural road blocks.
+// With scan enabled every fourth lookup is part of a sequential sweep over all blocks, like a long distance query.
+std::vector<unsigned> GenerateKeys(unsigned seed, bool scan)
+{
+    std::mt19937 mt_rand(seed);
+    std::uniform_real_distribution<> udist(0.0, 1.0);
+    std::vector<unsigned> keys;
+    keys.reserve(LOOKUPS_PER_THREAD);
+    for (unsigned i = 0; i < LOOKUPS_PER_THREAD; i++)
+    {
+        if (scan && i % 4 == 0)
+        {
+            keys.push_back((seed * BLOCK_COUNT / 8 + i / 4) % BLOCK_COUNT);
+            continue;
+        }
+        keys.push_back(static_cast<unsigned>(BLOCK_COUNT * std::pow(udist(mt_rand), 4.0)));
+    }
+    return keys;
+}
+
+template <typename CacheT>
+void Benchmark(const std::string &name, unsigned thread_count, bool scan)
+{
+    CacheT cache;
+    std::vector<std::vector<unsigned>> keys;
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        keys.push_back(GenerateKeys(RANDOM_SEED + i, scan));
+    }
+
+    TIMER_START(lookups);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        threads.emplace_back([&cache, &keys, i]()
+                             {
+                                 std::size_t checksum = 0;
+                                 for (unsigned key : keys[i])
+                                 {
+                                     checksum += cache.Get(key)->front();
+                                 }
+                                 volatile std::size_t sink = checksum;
+                                 (void)sink;
+                             });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    TIMER_STOP(lookups);
+
+    const double lookups_per_sec = thread_count * LOOKUPS_PER_THREAD / TIMER_SEC(lookups);
+    const double miss_rate = static_cast<double>(cache.misses) / (thread_count * LOOKUPS_PER_THREAD);
+    std::cout << name << (scan ? " (with scans)" : "") << ", " << thread_count
+              << " threads: " << TIMER_MSEC(lookups) << "ms  ->  "
+              << static_cast<std::size_t>(lookups_per_sec) << " lookups/s, miss rate "
+              << miss_rate * 100.0 << "%" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1)
+    {
+        max_threads = static_cast<unsigned>(std::max(1, std::atoi(argv[1])));
+    }
+
+    for (unsigned thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+    {
+        for (bool scan : {false, true})
+        {
+            Benchmark<LockedLRUCache>("locked lru_cache", thread_count, scan);
+            Benchmark<ShardedCache>("concurrent_cache", thread_count, scan);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "../util/timing_util.hpp"
+
+#include <stdext/bitstream.h>
+#include <stdext/eiff_file.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reference reader: the byte-at-a-time implementation that RoutingGraph used before the buffered reader
+class LegacyInputBitstream
+{
+  public:
+    LegacyInputBitstream(const unsigned char *data, std::size_t size)
+        : bits(0), offset(0), data(data, data + size)
+    {
+    }
+
+    bool read_bit()
+    {
+        bool bit = ((data.at(offset) >> bits) & 1) != 0;
+        bits += 1;
+        offset += bits >> 3;
+        bits = bits & 7;
+        return bit;
+    }
+
+    template <typename T> T read_bits(int num_bits)
+    {
+        T val = 0;
+        int shift = 0;
+        while (num_bits > 0)
+        {
+            int block = std::min(8 - bits, num_bits);
+            unsigned int mask = (1 << block) - 1;
+            val |= static_cast<T>((data.at(offset) >> bits) & mask) << shift;
+            bits += block;
+            offset += bits >> 3;
+            bits = bits & 7;
+            shift += block;
+            num_bits -= block;
+        }
+        return val;
+    }
+
+    template <typename T, int Bits> T read_bits() { return read_bits<T>(Bits); }
+
+    int read_zigzag(int num_bits)
+    {
+        unsigned int val = read_bits<unsigned int>(num_bits);
+        return ((val & 1) != 0 ? -static_cast<int>((val + 1) >> 1) : static_cast<int>(val >> 1));
+    }
+
+    template <typename OutputIt> void read_bytes(OutputIt out, std::size_t count)
+    {
+        while (count-- > 0)
+        {
+            *out++ = read_bits<unsigned char>(8);
+        }
+    }
+
+  private:
+    int bits;
+    std::size_t offset;
+    std::vector<unsigned char> data;
+};
+
+using BufferedInputBitstream = bitstreams::input_bitstream;
+
+// The decoders below mirror the block layouts read by Nuti::Routing::RoutingGraph::load*Block
+template <typename Bitstream> std::size_t DecodeNodeBlock(Bitstream &bs)
+{
+    int header[18];
+    for (int &bits : header)
+    {
+        bits = bs.template read_bits<int, 6>();
+    }
+    const int maxInternalNodeIndexBits = header[0], maxExternalNodeBlockBits = header[1],
+              maxExternalNodeIndexBits = header[2], maxGlobalNodeBlockBits = header[3],
+              maxGlobalNodeIndexBits = header[4], maxContractedNodeBlockBits = header[5],
+              maxContractedNodeIndexBits = header[6], maxGeometryBlockBits = header[7],
+              maxGeometryBlockDiffBits = header[8], maxGeometryIndexBits = header[9],
+              maxNameBlockBits = header[10], maxNameBlockDiffBits = header[11],
+              maxNameIndexBits = header[12], maxNodeOutDegreeBits = header[13],
+              maxTravelModeBits = header[14], maxInstructionBits = header[15],
+              smallWeightBits = header[16], largeWeightBits = header[17];
+    bs.template read_bits<unsigned int>(maxGeometryBlockBits);
+    bs.template read_bits<unsigned int>(maxNameBlockBits);
+
+    std::size_t checksum = 0;
+    auto nodeCount = bs.template read_bits<int, 32>();
+    for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+    {
+        auto edgeCount = bs.template read_bits<int>(maxNodeOutDegreeBits);
+        checksum += bs.template read_bits<unsigned int>(maxGeometryBlockDiffBits);
+        checksum += bs.template read_bits<unsigned int>(maxGeometryIndexBits);
+        checksum += bs.read_bit();
+        checksum += bs.template read_bits<unsigned int>(maxNameBlockDiffBits);
+        checksum += bs.template read_bits<unsigned int>(maxNameIndexBits);
+        checksum += bs.template read_bits<unsigned char>(maxTravelModeBits);
+        checksum += bs.template read_bits<unsigned int>(bs.read_bit() ? largeWeightBits : smallWeightBits);
+        while (edgeCount-- > 0)
+        {
+            if (bs.read_bit())
+            {
+                checksum += bs.template read_bits<unsigned int>(maxExternalNodeBlockBits);
+                checksum += bs.template read_bits<unsigned int>(maxExternalNodeIndexBits);
+            }
+            else if (bs.template read_bits<unsigned int>(maxInternalNodeIndexBits) == 0)
+            {
+                checksum += bs.template read_bits<unsigned int>(maxGlobalNodeBlockBits);
+                checksum += bs.template read_bits<unsigned int>(maxGlobalNodeIndexBits);
+            }
+            checksum += bs.read_bit();
+            checksum += bs.read_bit();
+            checksum += bs.template read_bits<unsigned int>(bs.read_bit() ? largeWeightBits : smallWeightBits);
+            if (bs.read_bit())
+            {
+                if (bs.read_bit())
+                {
+                    checksum += bs.read_zigzag(maxContractedNodeBlockBits);
+                    checksum += bs.template read_bits<unsigned int>(maxContractedNodeIndexBits);
+                }
+                else if (bs.template read_bits<unsigned int>(maxInternalNodeIndexBits) == 0)
+                {
+                    checksum += bs.template read_bits<unsigned int>(maxGlobalNodeBlockBits);
+                    checksum += bs.template read_bits<unsigned int>(maxGlobalNodeIndexBits);
+                }
+            }
+            else
+            {
+                checksum += bs.template read_bits<unsigned char>(maxInstructionBits);
+            }
+        }
+    }
+    return checksum;
+}
+
+template <typename Bitstream> std::size_t DecodeGeometryBlock(Bitstream &bs)
+{
+    auto maxLatDiffBits = bs.template read_bits<int, 6>();
+    auto maxLonDiffBits = bs.template read_bits<int, 6>();
+    auto maxGeometrySizeBits = bs.template read_bits<int, 6>();
+    auto minLat = bs.template read_bits<int, 32>();
+    auto minLon = bs.template read_bits<int, 32>();
+
+    std::size_t checksum = 0;
+    std::vector<std::pair<int, int>> geometry;
+    auto geometryCount = bs.template read_bits<int, 32>();
+    while (geometryCount-- > 0)
+    {
+        auto maxLatZigZagBits = bs.template read_bits<int, 6>();
+        auto maxLonZigZagBits = bs.template read_bits<int, 6>();
+        auto lat = minLat + bs.template read_bits<int>(maxLatDiffBits);
+        auto lon = minLon + bs.template read_bits<int>(maxLonDiffBits);
+        auto geometrySize = bs.template read_bits<int>(maxGeometrySizeBits);
+        geometry.clear();
+        geometry.emplace_back(lat, lon);
+        while (geometrySize-- > 0)
+        {
+            lat += bs.read_zigzag(maxLatZigZagBits);
+            lon += bs.read_zigzag(maxLonZigZagBits);
+            geometry.emplace_back(lat, lon);
+        }
+        checksum += geometry.size() + static_cast<std::size_t>(lat ^ lon);
+    }
+    return checksum;
+}
+
+template <typename Bitstream> std::size_t DecodeNameBlock(Bitstream &bs)
+{
+    auto maxLengthBits = bs.template read_bits<int, 6>();
+
+    std::size_t checksum = 0;
+    auto nameCount = bs.template read_bits<int, 32>();
+    while (nameCount-- > 0)
+    {
+        auto length = bs.template read_bits<int>(maxLengthBits);
+        std::string name;
+        name.reserve(length);
+        bs.read_bytes(std::back_inserter(name), length);
+        checksum += name.size();
+    }
+    return checksum;
+}
+
+template <typename Bitstream> std::size_t DecodeRTreeBlock(Bitstream &bs)
+{
+    auto maxRTreeBlockBits = bs.template read_bits<int, 6>();
+    auto maxRTreeIndexBits = bs.template read_bits<int, 6>();
+    auto maxNodeBlockBits = bs.template read_bits<int, 6>();
+    auto maxSizeBits = bs.template read_bits<int, 6>();
+    auto maxLatDiffBits = bs.template read_bits<int, 6>();
+    auto maxLonDiffBits = bs.template read_bits<int, 6>();
+    auto maxLatDiffBits2 = bs.template read_bits<int, 6>();
+    auto maxLonDiffBits2 = bs.template read_bits<int, 6>();
+    bs.template read_bits<int, 32>();
+    bs.template read_bits<int, 32>();
+
+    std::size_t checksum = 0;
+    auto nodeCount = bs.template read_bits<int, 32>();
+    while (nodeCount-- > 0)
+    {
+        bool leaf = bs.read_bit();
+        auto childCount = bs.template read_bits<int>(maxSizeBits);
+        while (childCount-- > 0)
+        {
+            checksum += bs.template read_bits<int>(maxLatDiffBits);
+            checksum += bs.template read_bits<int>(maxLonDiffBits);
+            checksum += bs.template read_bits<int>(maxLatDiffBits2);
+            checksum += bs.template read_bits<int>(maxLonDiffBits2);
+            if (leaf)
+            {
+                checksum += bs.template read_bits<unsigned int>(maxNodeBlockBits);
+            }
+            else
+            {
+                checksum += bs.template read_bits<unsigned int>(maxRTreeBlockBits);
+                checksum += bs.template read_bits<unsigned int>(maxRTreeIndexBits);
+            }
+        }
+    }
+    return checksum;
+}
+
+struct Block
+{
+    const unsigned char *data;
+    std::size_t size;
+};
+
+// Split a chunk into blocks using its offset table (uint32 header followed by uint64 block offsets)
+std::vector<Block> GetBlocks(const std::vector<unsigned char> &chunk)
+{
+    std::vector<Block> blocks;
+    if (chunk.size() < sizeof(std::uint32_t) + sizeof(std::uint64_t))
+    {
+        return blocks;
+    }
+    std::uint64_t first_offset = 0;
+    std::memcpy(&first_offset, chunk.data() + sizeof(std::uint32_t), sizeof(first_offset));
+    const std::size_t block_count = static_cast<std::size_t>((first_offset - sizeof(std::uint32_t)) / sizeof(std::uint64_t) - 1);
+    for (std::size_t i = 0; i < block_count; i++)
+    {
+        std::uint64_t offsets[2];
+        std::memcpy(offsets, chunk.data() + sizeof(std::uint32_t) + i * sizeof(std::uint64_t), sizeof(offsets));
+        blocks.push_back(Block{chunk.data() + offsets[0], static_cast<std::size_t>(offsets[1] - offsets[0])});
+    }
+    return blocks;
+}
+
+template <typename Bitstream, typename DecoderT>
+void BenchmarkDecoder(const std::string &name, const std::vector<Block> &blocks, unsigned iterations, DecoderT decoder)
+{
+    std::size_t total_bytes = 0;
+    std::size_t checksum = 0;
+
+    TIMER_START(decode);
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        for (const Block &block : blocks)
+        {
+            Bitstream bs(block.data, block.size);
+            checksum += decoder(bs);
+            total_bytes += block.size;
+        }
+    }
+    TIMER_STOP(decode);
+
+    const double seconds = std::max(TIMER_SEC(decode), 1.0e-6);
+    std::cout << name << ": " << TIMER_MSEC(decode) << "ms  ->  "
+              << (total_bytes / seconds / (1024 * 1024)) << " MB/s, "
+              << static_cast<std::size_t>(blocks.size() * iterations / seconds) << " blocks/s"
+              << " (checksum " << checksum << ")" << std::endl;
+}
+
+template <typename DecoderT, typename DecoderU>
+void Benchmark(const std::string &name, const std::vector<Block> &blocks, unsigned iterations, DecoderT legacy_decoder, DecoderU buffered_decoder)
+{
+    std::cout << "Decoding " << blocks.size() << " " << name << " blocks " << iterations << " times" << std::endl;
+    BenchmarkDecoder<LegacyInputBitstream>("  byte-at-a-time reader", blocks, iterations, legacy_decoder);
+    BenchmarkDecoder<BufferedInputBitstream>("  buffered 64-bit reader", blocks, iterations, buffered_decoder);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "./nutigraph-decode-bench file.nutigraph [iterations]" << std::endl;
+        return 1;
+    }
+    const unsigned iterations = argc > 2 ? static_cast<unsigned>(std::max(1, std::atoi(argv[2]))) : 3;
+
+    auto file = std::make_shared<std::ifstream>();
+    file->exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    file->open(argv[1], std::ios::binary);
+    auto graph_chunk = std::dynamic_pointer_cast<eiff::form_chunk>(eiff::read_chunk(file, false));
+    if (!graph_chunk)
+    {
+        std::cout << "Illegal graph file" << std::endl;
+        return 1;
+    }
+
+    auto load_chunk = [&graph_chunk](const eiff::chunk::tag_type &tag)
+    {
+        std::vector<unsigned char> data;
+        if (auto chunk = graph_chunk->get<eiff::data_chunk>(tag))
+        {
+            chunk->read(data);
+        }
+        return data;
+    };
+    const std::vector<unsigned char> node_chunk = load_chunk({{'N', 'O', 'D', 'E'}});
+    const std::vector<unsigned char> geometry_chunk = load_chunk({{'G', 'E', 'O', 'M'}});
+    const std::vector<unsigned char> name_chunk = load_chunk({{'N', 'A', 'M', 'E'}});
+    const std::vector<unsigned char> rtree_chunk = load_chunk({{'R', 'T', 'R', 'E'}});
+
+    Benchmark("node", GetBlocks(node_chunk), iterations, DecodeNodeBlock<LegacyInputBitstream>, DecodeNodeBlock<BufferedInputBitstream>);
+    Benchmark("geometry", GetBlocks(geometry_chunk), iterations, DecodeGeometryBlock<LegacyInputBitstream>, DecodeGeometryBlock<BufferedInputBitstream>);
+    Benchmark("name", GetBlocks(name_chunk), iterations, DecodeNameBlock<LegacyInputBitstream>, DecodeNameBlock<BufferedInputBitstream>);
+    Benchmark("rtree", GetBlocks(rtree_chunk), iterations, DecodeRTreeBlock<LegacyInputBitstream>, DecodeRTreeBlock<BufferedInputBitstream>);
+
+    return 0;
+}
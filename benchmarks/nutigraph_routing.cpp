@@ -0,0 +1,404 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "../util/timing_util.hpp"
+
+#include "Routing/RouteFinder.h"
+#include "Routing/RoutingGraph.h"
+#include "Routing/RoutingObjects.h"
+#include "Routing/SegmentProjector.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using Nuti::Routing::RouteFinder;
+using Nuti::Routing::RoutingGraph;
+using Nuti::Routing::RoutingQuery;
+using Nuti::Routing::RoutingResult;
+using Nuti::Routing::WGSPos;
+
+namespace
+{
+// Choosen by a fair W20 dice roll (this value is completely arbitrary)
+constexpr unsigned RANDOM_SEED = 13;
+constexpr double EARTH_RADIUS = 6378137.0;
+constexpr double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+constexpr unsigned MAX_GENERATOR_ATTEMPTS = 100;
+
+// Great circle distance ranges of the stratified generator, in meters. Pairs are spread evenly over the classes.
+const std::vector<std::pair<double, double>> DISTANCE_CLASSES = {
+    {1000.0, 10000.0}, {10000.0, 100000.0}, {100000.0, 1000000.0}};
+
+struct QueryPair
+{
+    WGSPos source;
+    WGSPos target;
+};
+
+struct RunResult
+{
+    std::vector<double> latencies; // in milliseconds, sorted
+    std::size_t failures = 0;
+    double seconds = 0;
+    RoutingGraph::CacheStats cache_stats;
+};
+
+std::shared_ptr<RoutingGraph> LoadGraph(const boost::filesystem::path &path,
+                                        const RoutingGraph::Settings &settings)
+{
+    auto graph = std::make_shared<RoutingGraph>(settings);
+    if (boost::filesystem::is_directory(path))
+    {
+        for (boost::filesystem::directory_iterator it(path);
+             it != boost::filesystem::directory_iterator(); ++it)
+        {
+            if (boost::filesystem::is_regular_file(it->path()) &&
+                it->path().extension() == ".nutigraph")
+            {
+                graph->import(it->path().string());
+            }
+        }
+    }
+    else
+    {
+        graph->import(path.string());
+    }
+    if (graph->getPackageInfos().empty())
+    {
+        throw std::runtime_error("No .nutigraph packages found in " + path.string());
+    }
+    return graph;
+}
+
+std::vector<QueryPair> ReadQueries(const boost::filesystem::path &path)
+{
+    std::ifstream input(path.string());
+    if (!input)
+    {
+        throw std::runtime_error("Could not open " + path.string());
+    }
+    std::vector<QueryPair> queries;
+    QueryPair query;
+    while (input >> query.source(0) >> query.source(1) >> query.target(0) >> query.target(1))
+    {
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+void WriteQueries(const boost::filesystem::path &path, const std::vector<QueryPair> &queries)
+{
+    std::ofstream output(path.string());
+    output.precision(9);
+    for (const QueryPair &query : queries)
+    {
+        output << query.source(0) << " " << query.source(1) << " " << query.target(0) << " "
+               << query.target(1) << "\n";
+    }
+    if (!output)
+    {
+        throw std::runtime_error("Could not write " + path.string());
+    }
+}
+
+// Random pairs inside the package bounds. With stratification the target is placed at a random bearing and at a
+// distance drawn from one of the distance classes, pairs leaving the package bounds are regenerated.
+std::vector<QueryPair> GenerateQueries(const std::vector<RoutingGraph::PackageInfo> &package_infos,
+                                       std::size_t count,
+                                       bool stratified,
+                                       unsigned seed)
+{
+    std::mt19937 mt_rand(seed);
+    std::uniform_real_distribution<> udist(0.0, 1.0);
+    std::uniform_int_distribution<std::size_t> package_dist(0, package_infos.size() - 1);
+
+    const auto random_pos = [&]()
+    {
+        const auto &bbox = package_infos[package_dist(mt_rand)].bbox;
+        return WGSPos(bbox.min(0) + udist(mt_rand) * (bbox.max(0) - bbox.min(0)),
+                      bbox.min(1) + udist(mt_rand) * (bbox.max(1) - bbox.min(1)));
+    };
+    const auto inside = [&](const WGSPos &pos)
+    {
+        return std::any_of(package_infos.begin(), package_infos.end(),
+                           [&pos](const RoutingGraph::PackageInfo &package_info)
+                           {
+                               return package_info.bbox.inside(pos);
+                           });
+    };
+
+    std::vector<QueryPair> queries;
+    queries.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        QueryPair query{random_pos(), random_pos()};
+        if (stratified)
+        {
+            const auto &distance_class = DISTANCE_CLASSES[i % DISTANCE_CLASSES.size()];
+            for (unsigned attempt = 0; attempt < MAX_GENERATOR_ATTEMPTS; attempt++)
+            {
+                query.source = random_pos();
+                // Log-uniform distance, so that the short end of each class is not underrepresented
+                const double distance =
+                    distance_class.first *
+                    std::pow(distance_class.second / distance_class.first, udist(mt_rand));
+                const double bearing = udist(mt_rand) * 360.0 * DEG_TO_RAD;
+                const double lat = query.source(0) + distance * std::cos(bearing) / EARTH_RADIUS / DEG_TO_RAD;
+                const double lon = query.source(1) +
+                                   distance * std::sin(bearing) /
+                                       (EARTH_RADIUS * std::cos(query.source(0) * DEG_TO_RAD)) /
+                                       DEG_TO_RAD;
+                query.target = WGSPos(lat, lon);
+                if (inside(query.target))
+                {
+                    break;
+                }
+            }
+        }
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+RoutingGraph::CacheStats GetStatsDelta(const RoutingGraph::CacheStats &before,
+                                       const RoutingGraph::CacheStats &after)
+{
+    const auto delta = [](const cache::cache_stats &stats0, const cache::cache_stats &stats1)
+    {
+        cache::cache_stats stats = stats1;
+        stats.hits -= stats0.hits;
+        stats.misses -= stats0.misses;
+        stats.insertions -= stats0.insertions;
+        stats.evictions -= stats0.evictions;
+        return stats;
+    };
+    RoutingGraph::CacheStats stats = after;
+    stats.nodeBlocks = delta(before.nodeBlocks, after.nodeBlocks);
+    stats.geometryBlocks = delta(before.geometryBlocks, after.geometryBlocks);
+    stats.nameBlocks = delta(before.nameBlocks, after.nameBlocks);
+    stats.rtreeNodeBlocks = delta(before.rtreeNodeBlocks, after.rtreeNodeBlocks);
+    stats.blocksRead -= before.blocksRead;
+    stats.bytesRead -= before.bytesRead;
+    return stats;
+}
+
+// Replays all queries once, the threads take the next query from a shared counter
+RunResult Replay(const std::shared_ptr<RoutingGraph> &graph,
+                 const RouteFinder &route_finder,
+                 const std::vector<QueryPair> &queries,
+                 unsigned thread_count)
+{
+    RunResult result;
+    result.latencies.resize(queries.size());
+    std::atomic<std::size_t> next_query(0);
+    std::atomic<std::size_t> failures(0);
+
+    const RoutingGraph::CacheStats stats_before = graph->getCacheStats();
+    TIMER_START(replay);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 for (std::size_t index = next_query++; index < queries.size();
+                                      index = next_query++)
+                                 {
+                                     const auto start = std::chrono::steady_clock::now();
+                                     RoutingResult routing_result = route_finder.find(
+                                         RoutingQuery(queries[index].source, queries[index].target));
+                                     const auto stop = std::chrono::steady_clock::now();
+                                     if (routing_result.getStatus() != RoutingResult::Status::SUCCESS)
+                                     {
+                                         failures++;
+                                     }
+                                     result.latencies[index] =
+                                         std::chrono::duration<double, std::milli>(stop - start).count();
+                                 }
+                             });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    TIMER_STOP(replay);
+
+    result.seconds = TIMER_SEC(replay);
+    result.failures = failures;
+    result.cache_stats = GetStatsDelta(stats_before, graph->getCacheStats());
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+double Percentile(const std::vector<double> &sorted_values, double fraction)
+{
+    if (sorted_values.empty())
+    {
+        return 0;
+    }
+    const std::size_t index = static_cast<std::size_t>(fraction * sorted_values.size());
+    return sorted_values[std::min(index, sorted_values.size() - 1)];
+}
+
+double HitRatio(const cache::cache_stats &stats)
+{
+    const std::uint64_t lookups = stats.hits + stats.misses;
+    return lookups > 0 ? 100.0 * stats.hits / lookups : 100.0;
+}
+
+void PrintResult(const std::string &name, const RunResult &result)
+{
+    const std::size_t query_count = std::max(result.latencies.size(), static_cast<std::size_t>(1));
+    const RoutingGraph::CacheStats &stats = result.cache_stats;
+    std::cout << name << ": " << result.latencies.size() << " queries (" << result.failures
+              << " failed) in " << result.seconds << "s  ->  "
+              << result.latencies.size() / result.seconds << " queries/s" << std::endl;
+    std::cout << "  latency p50 " << Percentile(result.latencies, 0.50) << "ms, p95 "
+              << Percentile(result.latencies, 0.95) << "ms, p99 "
+              << Percentile(result.latencies, 0.99) << "ms" << std::endl;
+    std::cout << "  blocks decoded per query " << static_cast<double>(stats.blocksRead) / query_count
+              << ", bytes read per query " << static_cast<double>(stats.bytesRead) / query_count
+              << std::endl;
+    std::cout << "  cache hit ratio: node " << HitRatio(stats.nodeBlocks) << "%, geometry "
+              << HitRatio(stats.geometryBlocks) << "%, name " << HitRatio(stats.nameBlocks)
+              << "%, rtree " << HitRatio(stats.rtreeNodeBlocks) << "%" << std::endl;
+}
+}
+
+int main(int argc, char *argv[]) try
+{
+    boost::filesystem::path package_path;
+    boost::filesystem::path queries_path;
+    boost::filesystem::path save_path;
+    std::size_t query_count = 1000;
+    std::string mode;
+    unsigned seed = RANDOM_SEED;
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t cache_budget_mb = 0;
+    bool memory_mapping = false;
+
+    boost::program_options::options_description options("Options");
+    options.add_options()("help,h", "Show this help message")(
+        "packages,p", boost::program_options::value<boost::filesystem::path>(&package_path),
+        ".nutigraph file or directory of .nutigraph files")(
+        "queries,q", boost::program_options::value<boost::filesystem::path>(&queries_path),
+        "File of 'lat0 lon0 lat1 lon1' lines to replay, generated if not given")(
+        "save", boost::program_options::value<boost::filesystem::path>(&save_path),
+        "Write the replayed queries to file")(
+        "count,n", boost::program_options::value<std::size_t>(&query_count)->default_value(query_count),
+        "Number of generated queries")(
+        "mode", boost::program_options::value<std::string>(&mode)->default_value("stratified"),
+        "Generator mode: random or stratified (by distance)")(
+        "seed", boost::program_options::value<unsigned>(&seed)->default_value(seed),
+        "Generator random seed")(
+        "threads,t", boost::program_options::value<unsigned>(&max_threads)->default_value(max_threads),
+        "Threads of the multi-threaded runs")(
+        "cache-budget", boost::program_options::value<std::size_t>(&cache_budget_mb)->default_value(cache_budget_mb),
+        "Block cache memory budget in MB, 0 for the default entry limits")(
+        "mmap", boost::program_options::bool_switch(&memory_mapping),
+        "Map package files into memory");
+
+    boost::program_options::positional_options_description positional_options;
+    positional_options.add("packages", 1);
+    boost::program_options::variables_map option_variables;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv)
+                                      .options(options)
+                                      .positional(positional_options)
+                                      .run(),
+                                  option_variables);
+    boost::program_options::notify(option_variables);
+
+    if (option_variables.count("help") || package_path.empty())
+    {
+        std::cout << "Usage: " << argv[0] << " <packages> [options]\n" << options;
+        return package_path.empty() && !option_variables.count("help") ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (mode != "random" && mode != "stratified")
+    {
+        std::cerr << "Unknown generator mode " << mode << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    RoutingGraph::Settings settings;
+    settings.blockCacheMemoryBudget = cache_budget_mb * 1024 * 1024;
+    settings.useMemoryMapping = memory_mapping;
+
+    std::vector<QueryPair> queries;
+    if (!queries_path.empty())
+    {
+        queries = ReadQueries(queries_path);
+    }
+    else
+    {
+        queries = GenerateQueries(LoadGraph(package_path, settings)->getPackageInfos(), query_count,
+                                  mode == "stratified", seed);
+    }
+    if (!save_path.empty())
+    {
+        WriteQueries(save_path, queries);
+    }
+    std::cout << "Replaying " << queries.size() << " queries, segment kernel "
+              << Nuti::Routing::SegmentProjector::getImplementationName() << std::endl;
+
+    // Cold runs start with a freshly loaded graph and empty caches. The OS page cache is not dropped,
+    // so cold numbers measure decoding, not disk access.
+    std::vector<unsigned> thread_counts{1};
+    if (max_threads > 1)
+    {
+        thread_counts.push_back(max_threads);
+    }
+    for (unsigned thread_count : thread_counts)
+    {
+        auto graph = LoadGraph(package_path, settings);
+        RouteFinder route_finder(graph);
+        const std::string name = std::to_string(thread_count) + (thread_count == 1 ? " thread" : " threads");
+        PrintResult(name + ", cold", Replay(graph, route_finder, queries, thread_count));
+        PrintResult(name + ", warm", Replay(graph, route_finder, queries, thread_count));
+    }
+
+    return EXIT_SUCCESS;
+}
+catch (const std::exception &e)
+{
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -37,7 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 RouteParameters::RouteParameters()
     : zoom_level(18), print_instructions(false), alternate_route(true), geometry(true),
       compression(true), deprecatedAPI(false), uturn_default(false), classify(false),
-      matching_beta(5), gps_precision(5), check_sum(-1), num_results(1)
+      debug(false), matching_beta(5), gps_precision(5), check_sum(-1), num_results(1)
 {
 }
 
@@ -87,6 +87,8 @@ void RouteParameters::setService(const std::string &service_string) { service =
 
 void RouteParameters::setClassify(const bool flag) { classify = flag; }
 
+void RouteParameters::setDebugFlag(const bool flag) { debug = flag; }
+
 void RouteParameters::setMatchingBeta(const double beta) { matching_beta = beta; }
 
 void RouteParameters::setGPSPrecision(const double precision) { gps_precision = precision; }
@@ -116,6 +118,14 @@ void RouteParameters::addTimestamp(const unsigned timestamp)
     }
 }
 
+void RouteParameters::addIsochroneTime(const double time)
+{
+    if (time > 0)
+    {
+        isochrone_times.push_back(time);
+    }
+}
+
 void RouteParameters::addBearing(
     const boost::fusion::vector<int, boost::optional<int>> &received_bearing,
         boost::spirit::qi::unused_type /* unused */, bool& pass)
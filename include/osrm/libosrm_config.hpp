@@ -40,6 +40,12 @@ struct LibOSRMConfig
     int max_locations_viaroute = -1;
     int max_locations_distance_table = -1;
     int max_locations_map_matching = -1;
+    int package_watch_interval = 0; // seconds between .nutigraph directory rescans, 0 disables watching
+    bool package_reload_service = false; // register the 'reloadpackages' admin service
+    bool collect_stats = false; // accumulate routing engine counters of all queries for the stats service
+    int route_cache_size = 0; // megabytes of viaroute results kept by the route result cache, 0 disables the cache
+    int max_isochrone_times = -1; // travel times per isochrone query
+    int max_isochrone_time = -1; // longest isochrone travel time, in seconds
     bool use_shared_memory = true;
 };
 
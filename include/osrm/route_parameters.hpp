@@ -52,6 +52,8 @@ struct RouteParameters
 
     void setClassify(const bool classify);
 
+    void setDebugFlag(const bool flag);
+
     void setMatchingBeta(const double beta);
 
     void setGPSPrecision(const double precision);
@@ -72,6 +74,8 @@ struct RouteParameters
 
     void addTimestamp(const unsigned timestamp);
 
+    void addIsochroneTime(const double time);
+
     void addBearing(const boost::fusion::vector<int, boost::optional<int>> &received_bearing, boost::spirit::qi::unused_type unused, bool& pass);
 
     void setLanguage(const std::string &language);
@@ -96,6 +100,7 @@ struct RouteParameters
     bool deprecatedAPI;
     bool uturn_default;
     bool classify;
+    bool debug;
     double matching_beta;
     double gps_precision;
     unsigned check_sum;
@@ -106,6 +111,7 @@ struct RouteParameters
     std::string language;
     std::vector<std::string> hints;
     std::vector<unsigned> timestamps;
+    std::vector<double> isochrone_times;
     std::vector<std::pair<const int,const boost::optional<int>>> bearings;
     std::vector<bool> uturns;
     std::vector<FixedPointCoordinate> coordinates;
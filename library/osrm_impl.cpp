@@ -43,7 +43,13 @@ class named_mutex;
 #include "../plugins/viaroute.hpp"
 #include "../plugins/match.hpp"
 #ifdef NUTISERVER
+#include "../plugins/nuti_routing_graph.hpp"
+#include "../plugins/nuti_route_cache.hpp"
 #include "../plugins/nuti_viaroute.hpp"
+#include "../plugins/nuti_distance_table.hpp"
+#include "../plugins/nuti_isochrone.hpp"
+#include "../plugins/nuti_packages.hpp"
+#include "../plugins/nuti_stats.hpp"
 #endif
 #include "../server/data_structures/datafacade_base.hpp"
 #include "../server/data_structures/internal_datafacade.hpp"
@@ -94,7 +100,24 @@ OSRM::OSRM_impl::OSRM_impl(LibOSRMConfig& lib_config)
     RegisterPlugin(new RoundTripPlugin<BaseDataFacade<QueryEdge::EdgeData>>(query_data_facade,
                 lib_config.max_locations_trip));
 #else
-    RegisterPlugin(new NutiViaRoutePlugin(lib_config.server_paths["base"], lib_config.max_locations_viaroute));
+    auto routing_graph = CreateNutiRoutingGraph();
+    auto package_directory = std::make_shared<NutiPackageDirectory>(routing_graph, lib_config.server_paths["base"], lib_config.package_watch_interval);
+    std::shared_ptr<NutiRouteCache> route_cache;
+    if (lib_config.route_cache_size > 0)
+    {
+        route_cache = std::make_shared<NutiRouteCache>(std::size_t(lib_config.route_cache_size) * 1024 * 1024);
+    }
+    RegisterPlugin(new NutiViaRoutePlugin(routing_graph, route_cache, lib_config.max_locations_viaroute));
+    RegisterPlugin(new NutiDistanceTablePlugin(routing_graph, lib_config.max_locations_distance_table));
+    RegisterPlugin(new NutiIsochronePlugin(routing_graph, lib_config.max_locations_distance_table,
+                                           lib_config.max_isochrone_times, lib_config.max_isochrone_time));
+    RegisterPlugin(new NutiPackagesPlugin(package_directory, false));
+    if (lib_config.package_reload_service)
+    {
+        RegisterPlugin(new NutiPackagesPlugin(package_directory, true));
+    }
+    Nuti::Routing::RoutingStats::setTotalsEnabled(lib_config.collect_stats);
+    RegisterPlugin(new NutiStatsPlugin(routing_graph, route_cache));
 #endif
 }
 
@@ -0,0 +1,365 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// Converts prepared OSRM data (.hsgr, .edges, .geometry, .nodes, .names) into a .nutigraph package,
+// readable by Nuti::Routing::RoutingGraph. Nodes of the package are the edge-based nodes of the contracted graph.
+
+#include "data_structures/original_edge_data.hpp"
+#include "data_structures/query_edge.hpp"
+#include "data_structures/query_node.hpp"
+#include "data_structures/range_table.hpp"
+#include "data_structures/static_graph.hpp"
+#include "data_structures/travel_mode.hpp"
+#include "util/graph_loader.hpp"
+#include "util/osrm_exception.hpp"
+#include "util/simple_logger.hpp"
+#include "util/timing_util.hpp"
+
+#include "Routing/PackageBuilder.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/program_options.hpp>
+
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+using Nuti::Routing::PackageBuilder;
+using QueryGraph = StaticGraph<QueryEdge::EdgeData>;
+
+namespace
+{
+template <typename T> std::vector<T> readVector(boost::filesystem::ifstream &input_stream)
+{
+    unsigned count = 0;
+    input_stream.read(reinterpret_cast<char *>(&count), sizeof(unsigned));
+    std::vector<T> result(count);
+    if (count > 0)
+    {
+        input_stream.read(reinterpret_cast<char *>(result.data()), count * sizeof(T));
+    }
+    if (!input_stream)
+    {
+        throw osrm::exception("unexpected end of file");
+    }
+    return result;
+}
+
+boost::filesystem::path checkInput(const boost::filesystem::path &path)
+{
+    if (!boost::filesystem::is_regular_file(path))
+    {
+        throw osrm::exception(path.string() + " not found");
+    }
+    return path;
+}
+
+// OSRM and nutiteq enumerate the first travel modes differently, turn instructions match
+unsigned char convertTravelMode(TravelMode travel_mode)
+{
+    switch (travel_mode)
+    {
+    case TRAVEL_MODE_INACCESSIBLE:
+        return 1;
+    case TRAVEL_MODE_DEFAULT:
+        return 0;
+    default:
+        return travel_mode;
+    }
+}
+}
+
+int main(int argc, char *argv[]) try
+{
+    LogPolicy::GetInstance().Unmute();
+
+    boost::filesystem::path input_path;
+    boost::filesystem::path output_path;
+    std::string package_name;
+    std::string node_order;
+    bool no_node_bounds = false;
+    bool no_node_lengths = false;
+    bool no_incoming_edges = false;
+    PackageBuilder::Settings settings;
+
+    boost::program_options::options_description options("Options");
+    options.add_options()("help,h", "Show this help message")(
+        "input,i", boost::program_options::value<boost::filesystem::path>(&input_path),
+        "Prepared .osrm file")(
+        "output,o", boost::program_options::value<boost::filesystem::path>(&output_path),
+        "Output .nutigraph file, by default the input file with .nutigraph extension")(
+        "name,n", boost::program_options::value<std::string>(&package_name),
+        "Package name, by default the input file stem")(
+        "node-block-size", boost::program_options::value<unsigned int>(&settings.nodeBlockSize)
+                               ->default_value(settings.nodeBlockSize),
+        "Nodes per node block")(
+        "geometry-block-size", boost::program_options::value<unsigned int>(&settings.geometryBlockSize)
+                                   ->default_value(settings.geometryBlockSize),
+        "Geometries per geometry block")(
+        "name-block-size", boost::program_options::value<unsigned int>(&settings.nameBlockSize)
+                               ->default_value(settings.nameBlockSize),
+        "Names per name block")(
+        "rtree-fanout", boost::program_options::value<unsigned int>(&settings.rtreeFanout)
+                            ->default_value(settings.rtreeFanout),
+        "Children per r-tree node")(
+        "order", boost::program_options::value<std::string>(&node_order)->default_value("hilbert"),
+        "Node order: input or hilbert")(
+        "no-node-bounds", boost::program_options::bool_switch(&no_node_bounds),
+        "Do not write per node geometry bounds")(
+        "no-node-lengths", boost::program_options::bool_switch(&no_node_lengths),
+        "Do not write per node geometry lengths")(
+        "no-incoming-edges", boost::program_options::bool_switch(&no_incoming_edges),
+        "Do not write per node incoming edges");
+
+    boost::program_options::positional_options_description positional_options;
+    positional_options.add("input", 1);
+
+    boost::program_options::variables_map option_variables;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv)
+                                      .options(options)
+                                      .positional(positional_options)
+                                      .run(),
+                                  option_variables);
+    boost::program_options::notify(option_variables);
+
+    if (option_variables.count("help") || input_path.empty())
+    {
+        SimpleLogger().Write() << "Usage: " << argv[0] << " <data.osrm> [options]\n" << options;
+        return input_path.empty() && !option_variables.count("help") ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (node_order == "input")
+    {
+        settings.nodeOrder = PackageBuilder::NodeOrder::INPUT;
+    }
+    else if (node_order != "hilbert")
+    {
+        SimpleLogger().Write(logWARNING) << "Unknown node order " << node_order;
+        return EXIT_FAILURE;
+    }
+    settings.nodeBounds = !no_node_bounds;
+    settings.nodeLengths = !no_node_lengths;
+    settings.incomingEdges = !no_incoming_edges;
+    if (output_path.empty())
+    {
+        output_path = input_path;
+        output_path.replace_extension(".nutigraph");
+    }
+    if (package_name.empty())
+    {
+        package_name = input_path.stem().string();
+    }
+
+    TIMER_START(loading);
+    std::vector<QueryGraph::NodeArrayEntry> node_list;
+    std::vector<QueryGraph::EdgeArrayEntry> edge_list;
+    unsigned check_sum = 0;
+    readHSGRFromStream(input_path.string() + ".hsgr", node_list, edge_list, &check_sum);
+
+    std::vector<QueryNode> coordinates;
+    std::vector<OriginalEdgeData> original_edges;
+    std::vector<unsigned> geometry_indices;
+    std::vector<unsigned> geometry_list;
+    {
+        boost::filesystem::ifstream nodes_stream(checkInput(input_path.string() + ".nodes"), std::ios::binary);
+        coordinates = readVector<QueryNode>(nodes_stream);
+        boost::filesystem::ifstream edges_stream(checkInput(input_path.string() + ".edges"), std::ios::binary);
+        original_edges = readVector<OriginalEdgeData>(edges_stream);
+        boost::filesystem::ifstream geometry_stream(checkInput(input_path.string() + ".geometry"), std::ios::binary);
+        geometry_indices = readVector<unsigned>(geometry_stream);
+        geometry_list = readVector<unsigned>(geometry_stream);
+    }
+
+    RangeTable<16, false> name_table;
+    std::vector<char> name_chars;
+    {
+        boost::filesystem::ifstream names_stream(checkInput(input_path.string() + ".names"), std::ios::binary);
+        names_stream >> name_table;
+        name_chars = readVector<char>(names_stream);
+    }
+    TIMER_STOP(loading);
+    SimpleLogger().Write() << "Loaded " << node_list.size() - 1 << " nodes and " << edge_list.size()
+                           << " edges in " << TIMER_SEC(loading) << "s";
+
+    const auto get_name = [&](unsigned name_id) -> std::string
+    {
+        if (name_id == std::numeric_limits<unsigned>::max())
+        {
+            return std::string();
+        }
+        auto range = name_table.GetRange(name_id);
+        std::string result;
+        if (range.begin() != range.end())
+        {
+            result.assign(name_chars.begin() + range.front(), name_chars.begin() + range.back() + 1);
+        }
+        return result;
+    };
+    const auto get_point = [&](NodeID node_id)
+    {
+        return PackageBuilder::Point(coordinates.at(node_id).lat, coordinates.at(node_id).lon);
+    };
+
+    // The original (not shortcut) edges describe their source node: the geometry up to the turn,
+    // name and travel mode. The source node ends where its successors start. The node weight is not
+    // stored by OSRM, it is approximated by the cheapest turn out of the node.
+    const unsigned number_of_nodes = static_cast<unsigned>(node_list.size() - 1);
+    std::vector<PackageBuilder::Node> nodes(number_of_nodes);
+    std::vector<bool> described(number_of_nodes, false);
+    std::vector<NodeID> start_nodes(number_of_nodes, SPECIAL_NODEID);
+    for (unsigned node = 0; node < number_of_nodes; ++node)
+    {
+        for (unsigned edge = node_list[node].first_edge; edge < node_list[node + 1].first_edge; ++edge)
+        {
+            const QueryGraph::EdgeArrayEntry &entry = edge_list[edge];
+            if (entry.data.shortcut)
+            {
+                continue;
+            }
+            const unsigned source = entry.data.forward ? node : entry.target;
+            const unsigned target = entry.data.forward ? entry.target : node;
+            const OriginalEdgeData &original_edge = original_edges.at(entry.data.id);
+
+            std::vector<NodeID> via_nodes;
+            if (original_edge.compressed_geometry)
+            {
+                via_nodes.assign(geometry_list.begin() + geometry_indices.at(original_edge.via_node),
+                                 geometry_list.begin() + geometry_indices.at(original_edge.via_node + 1));
+            }
+            else
+            {
+                via_nodes.push_back(original_edge.via_node);
+            }
+            start_nodes[target] = via_nodes.back();
+
+            PackageBuilder::Node &source_node = nodes[source];
+            if (!described[source])
+            {
+                described[source] = true;
+                source_node.name = get_name(original_edge.name_id);
+                source_node.travelMode = convertTravelMode(original_edge.travel_mode);
+                source_node.weight = entry.data.distance;
+                for (NodeID via_node : via_nodes)
+                {
+                    source_node.geometry.push_back(get_point(via_node));
+                }
+            }
+            source_node.weight = std::min(source_node.weight, static_cast<unsigned>(entry.data.distance));
+        }
+    }
+
+    // Nodes without any known position can not be snapped to or routed through, these are dropped
+    PackageBuilder builder(package_name, settings);
+    std::vector<std::uint32_t> node_indices(number_of_nodes, std::numeric_limits<std::uint32_t>::max());
+    for (unsigned node = 0; node < number_of_nodes; ++node)
+    {
+        if (start_nodes[node] != SPECIAL_NODEID)
+        {
+            nodes[node].geometry.insert(nodes[node].geometry.begin(), get_point(start_nodes[node]));
+        }
+        if (!nodes[node].geometry.empty())
+        {
+            node_indices[node] = builder.addNode(std::move(nodes[node]));
+        }
+    }
+    std::size_t dropped_edges = 0;
+    for (unsigned node = 0; node < number_of_nodes; ++node)
+    {
+        for (unsigned edge = node_list[node].first_edge; edge < node_list[node + 1].first_edge; ++edge)
+        {
+            const QueryGraph::EdgeArrayEntry &entry = edge_list[edge];
+            PackageBuilder::Edge package_edge;
+            package_edge.sourceNode = node_indices[node];
+            package_edge.targetNode = node_indices[entry.target];
+            package_edge.weight = entry.data.distance;
+            package_edge.forward = entry.data.forward;
+            package_edge.backward = entry.data.backward;
+            package_edge.contracted = entry.data.shortcut;
+            if (entry.data.shortcut)
+            {
+                package_edge.contractedNode = node_indices[entry.data.id];
+            }
+            else
+            {
+                package_edge.turnInstruction =
+                    static_cast<unsigned char>(original_edges.at(entry.data.id).turn_instruction);
+            }
+            if (package_edge.sourceNode == std::numeric_limits<std::uint32_t>::max() ||
+                package_edge.targetNode == std::numeric_limits<std::uint32_t>::max() ||
+                (package_edge.contracted &&
+                 package_edge.contractedNode == std::numeric_limits<std::uint32_t>::max()))
+            {
+                ++dropped_edges;
+                continue;
+            }
+            builder.addEdge(package_edge);
+        }
+    }
+    if (dropped_edges > 0)
+    {
+        SimpleLogger().Write(logWARNING) << "Dropped " << dropped_edges
+                                         << " edges of nodes without geometry";
+    }
+
+    TIMER_START(writing);
+    boost::filesystem::ofstream output_stream(output_path, std::ios::binary);
+    builder.write(output_stream);
+    output_stream.close();
+    if (!output_stream)
+    {
+        throw osrm::exception("failed to write " + output_path.string());
+    }
+    TIMER_STOP(writing);
+
+    const PackageBuilder::Stats &stats = builder.getStats();
+    SimpleLogger().Write() << "Wrote " << output_path.string() << " in " << TIMER_SEC(writing) << "s";
+    SimpleLogger().Write() << stats.nodeCount << " nodes in " << stats.nodeBlockCount << " blocks, "
+                           << stats.edgeCount << " edges (" << stats.externalEdgeCount
+                           << " crossing blocks), " << stats.geometryCount << " geometries, "
+                           << stats.nameCount << " names";
+    SimpleLogger().Write() << "Chunk sizes: nodes " << stats.nodeChunkSize << ", geometries "
+                           << stats.geometryChunkSize << ", names " << stats.nameChunkSize
+                           << ", r-tree " << stats.rtreeChunkSize << ", node bounds "
+                           << stats.nodeBoundsChunkSize << ", node lengths "
+                           << stats.nodeLengthsChunkSize << ", incoming edges "
+                           << stats.incomingEdgesChunkSize;
+    return EXIT_SUCCESS;
+}
+catch (const std::bad_alloc &e)
+{
+    SimpleLogger().Write(logWARNING) << "[exception] " << e.what();
+    SimpleLogger().Write(logWARNING) << "Please provide more memory or consider using a larger swapfile";
+    return EXIT_FAILURE;
+}
+catch (const std::exception &e)
+{
+    SimpleLogger().Write(logWARNING) << "[exception] " << e.what();
+    return EXIT_FAILURE;
+}
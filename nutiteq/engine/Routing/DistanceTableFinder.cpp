@@ -0,0 +1,105 @@
+#include "DistanceTableFinder.h"
+#include "SearchWorkspace.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+namespace Nuti { namespace Routing {
+    std::vector<float> DistanceTableFinder::find(const std::vector<std::vector<RoutingGraph::NearestNode>>& sourceNodes, const std::vector<std::vector<RoutingGraph::NearestNode>>& targetNodes) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        static thread_local SearchSpace searchSpace;
+
+        // Backward searches from targets. The end point weights are calculated the same way as in RouteFinder
+        std::vector<Bucket> buckets;
+        for (unsigned int targetIndex = 0; targetIndex < targetNodes.size(); targetIndex++) {
+            searchSpace.clear();
+            for (const RoutingGraph::NearestNode& nearestNode : targetNodes[targetIndex]) {
+                RoutingGraph::NodePtr node = _graph->getNode(nearestNode.nodeId);
+                searchSpace.push(nearestNode.nodeId, RoutingGraph::NodeId(), nearestNode.geometryRelPos * node->nodeData.weight);
+            }
+            search(searchSpace, false, [&buckets, targetIndex](RoutingGraph::NodeId nodeId, float weight) {
+                buckets.emplace_back(nodeId, targetIndex, weight);
+            });
+        }
+
+        // Group buckets by node, so that forward searches need a single lookup per settled node
+        std::sort(buckets.begin(), buckets.end(), [](const Bucket& bucket1, const Bucket& bucket2) {
+            return bucket1.nodeId.packedId() < bucket2.nodeId.packedId();
+        });
+        std::unordered_map<RoutingGraph::NodeId, std::pair<std::size_t, std::size_t>, RoutingGraph::NodeId::Hash> bucketRanges;
+        for (std::size_t i = 0; i < buckets.size(); ) {
+            std::size_t j = i + 1;
+            while (j < buckets.size() && buckets[j].nodeId == buckets[i].nodeId) {
+                j++;
+            }
+            bucketRanges.emplace(buckets[i].nodeId, std::make_pair(i, j));
+            i = j;
+        }
+
+        // Forward searches from sources, scanning the buckets of all settled nodes
+        std::vector<float> weights(sourceNodes.size() * targetNodes.size(), std::numeric_limits<float>::infinity());
+        for (unsigned int sourceIndex = 0; sourceIndex < sourceNodes.size(); sourceIndex++) {
+            searchSpace.clear();
+            for (const RoutingGraph::NearestNode& nearestNode : sourceNodes[sourceIndex]) {
+                RoutingGraph::NodePtr node = _graph->getNode(nearestNode.nodeId);
+                searchSpace.push(nearestNode.nodeId, RoutingGraph::NodeId(), -nearestNode.geometryRelPos * node->nodeData.weight);
+            }
+            float* row = weights.data() + sourceIndex * targetNodes.size();
+            search(searchSpace, true, [&buckets, &bucketRanges, row](RoutingGraph::NodeId nodeId, float weight) {
+                auto it = bucketRanges.find(nodeId);
+                if (it == bucketRanges.end()) {
+                    return;
+                }
+                for (std::size_t i = it->second.first; i < it->second.second; i++) {
+                    float totalWeight = weight + buckets[i].weight;
+                    if (totalWeight >= 0 && totalWeight < row[buckets[i].targetIndex]) {
+                        row[buckets[i].targetIndex] = totalWeight;
+                    }
+                }
+            });
+        }
+        return weights;
+    }
+
+    template <typename SettleFunc>
+    void DistanceTableFinder::search(SearchSpace& searchSpace, bool forward, SettleFunc settle) const {
+        const std::uint8_t forwardFlag = (forward ? RoutingGraph::NodeBlock::FORWARD_FLAG : RoutingGraph::NodeBlock::BACKWARD_FLAG);
+        const std::uint8_t backwardFlag = (forward ? RoutingGraph::NodeBlock::BACKWARD_FLAG : RoutingGraph::NodeBlock::FORWARD_FLAG);
+        while (!searchSpace.empty()) {
+            const SearchSpace::Entry& searchNode = searchSpace.pop();
+            RoutingGraph::NodeId nodeId = searchNode.nodeId;
+            float nodeWeight = searchNode.weight;
+
+            // Stall-on-demand, same as in RouteFinder. Stalled nodes are not on any shortest path, so these are not reported either
+            RoutingGraph::NodePtr node = _graph->getNode(nodeId);
+            const RoutingGraph::NodeBlock& nodeBlock = node.block();
+            bool stall = false;
+            for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+                if (nodeBlock.edgeFlags[edgeIndex] & backwardFlag) {
+                    const SearchSpace::Entry* entry = searchSpace.find(nodeBlock.getEdgeTargetNodeId(edgeIndex));
+                    if (entry && entry->weight + nodeBlock.edgeWeights[edgeIndex] < nodeWeight) {
+                        stall = true;
+                        break;
+                    }
+                }
+            }
+            if (stall) {
+                continue;
+            }
+
+            settle(nodeId, nodeWeight);
+
+            for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+                if (nodeBlock.edgeFlags[edgeIndex] & forwardFlag) {
+                    RoutingGraph::NodeId targetNodeId = nodeBlock.getEdgeTargetNodeId(edgeIndex);
+                    if (targetNodeId.valid()) {
+                        searchSpace.push(targetNodeId, nodeId, nodeWeight + nodeBlock.edgeWeights[edgeIndex]);
+                    }
+                }
+            }
+        }
+    }
+} }
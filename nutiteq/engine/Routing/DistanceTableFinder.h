@@ -0,0 +1,46 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_DISTANCETABLEFINDER_H_
+#define _NUTI_ROUTING_DISTANCETABLEFINDER_H_
+
+#include "RoutingObjects.h"
+#include "RoutingGraph.h"
+
+#include <memory>
+#include <vector>
+
+namespace Nuti { namespace Routing {
+    class SearchSpace;
+
+    // Many-to-many route weights using bucket based CH search: backward searches from all targets store
+    // the settled nodes in buckets, forward searches from sources scan the buckets.
+    class DistanceTableFinder {
+    public:
+        explicit DistanceTableFinder(std::shared_ptr<RoutingGraph> graph) : _graph(std::move(graph)) { }
+
+        // Calculate weights between snapped sources and targets. The result is stored row by row (one row per source),
+        // unreachable pairs have infinite weight.
+        std::vector<float> find(const std::vector<std::vector<RoutingGraph::NearestNode>>& sourceNodes, const std::vector<std::vector<RoutingGraph::NearestNode>>& targetNodes) const;
+
+    private:
+        struct Bucket {
+            RoutingGraph::NodeId nodeId;
+            unsigned int targetIndex = 0;
+            float weight = 0.0f;
+
+            Bucket() = default;
+            Bucket(RoutingGraph::NodeId nodeId, unsigned int targetIndex, float weight) : nodeId(nodeId), targetIndex(targetIndex), weight(weight) { }
+        };
+
+        template <typename SettleFunc>
+        void search(SearchSpace& searchSpace, bool forward, SettleFunc settle) const;
+
+        const std::shared_ptr<RoutingGraph> _graph;
+    };
+} }
+
+#endif
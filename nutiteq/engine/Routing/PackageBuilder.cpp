@@ -0,0 +1,928 @@
+#include "PackageBuilder.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <stdext/bitstream.h>
+
+namespace Nuti { namespace Routing {
+    std::uint32_t PackageBuilder::addNode(Node node) {
+        if (node.geometry.empty()) {
+            throw std::runtime_error("Node geometry is empty");
+        }
+        if (_nodes.size() >= std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Too many nodes");
+        }
+        _nodes.push_back(std::move(node));
+        return static_cast<std::uint32_t>(_nodes.size() - 1);
+    }
+
+    void PackageBuilder::addEdge(const Edge& edge) {
+        if (edge.sourceNode >= _nodes.size() || edge.targetNode >= _nodes.size() || (edge.contracted && edge.contractedNode >= _nodes.size())) {
+            throw std::runtime_error("Edge refers to undefined node");
+        }
+        _edges.push_back(edge);
+    }
+
+    void PackageBuilder::addNodeLink(std::uint32_t node, const NodeLink& link) {
+        if (node >= _nodes.size()) {
+            throw std::runtime_error("Node link refers to undefined node");
+        }
+        if (link.packageName == _packageName || link.blockIndex > static_cast<std::uint32_t>(RoutingGraph::ElementId::MAX_BLOCK_INDEX) || link.nodeIndex > static_cast<std::uint32_t>(RoutingGraph::ElementId::MAX_ELEMENT_INDEX)) {
+            throw std::runtime_error("Illegal node link");
+        }
+        _nodeLinks[node].push_back(link);
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> PackageBuilder::getNodeLocations() const {
+        if (_settings.nodeBlockSize < 1) {
+            throw std::runtime_error("Illegal block size");
+        }
+        std::vector<std::uint32_t> order = orderNodes();
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> locations(_nodes.size());
+        for (std::uint32_t rank = 0; rank < order.size(); rank++) {
+            locations[order[rank]] = std::make_pair(rank / _settings.nodeBlockSize, rank % _settings.nodeBlockSize);
+        }
+        return locations;
+    }
+
+    std::shared_ptr<eiff::form_chunk> PackageBuilder::build() {
+        for (unsigned int blockSize : { _settings.nodeBlockSize, _settings.geometryBlockSize, _settings.nameBlockSize, _settings.rtreeNodeBlockSize }) {
+            if (blockSize < 1 || blockSize > static_cast<unsigned int>(RoutingGraph::ElementId::MAX_ELEMENT_INDEX) + 1) {
+                throw std::runtime_error("Illegal block size");
+            }
+        }
+        if (_settings.rtreeFanout < 2) {
+            throw std::runtime_error("Illegal r-tree fanout");
+        }
+        if (_settings.nodeBoundsQuantizationBits < 0 || _settings.nodeBoundsQuantizationBits > 16) {
+            throw std::runtime_error("Illegal node bounds quantization");
+        }
+
+        _stats = Stats();
+        _stats.nodeCount = _nodes.size();
+        _stats.edgeCount = _edges.size();
+
+        // Assign nodes to blocks
+        Layout layout;
+        layout.order = orderNodes();
+        layout.ranks.resize(_nodes.size());
+        for (std::uint32_t rank = 0; rank < layout.order.size(); rank++) {
+            layout.ranks[layout.order[rank]] = rank;
+        }
+        std::uint32_t nodeBlockCount = static_cast<std::uint32_t>((_nodes.size() + _settings.nodeBlockSize - 1) / _settings.nodeBlockSize);
+        if (nodeBlockCount > static_cast<std::uint32_t>(RoutingGraph::ElementId::MAX_BLOCK_INDEX) + 1) {
+            throw std::runtime_error("Too many node blocks");
+        }
+        _stats.nodeBlockCount = nodeBlockCount;
+
+        // Linked nodes become global nodes, numbered in node order. The package's own copy is listed first,
+        // so that a loaded copy in a linked package takes precedence.
+        std::vector<std::vector<NodeLink>> globalNodeLinks;
+        for (std::uint32_t rank = 0; rank < layout.order.size(); rank++) {
+            auto linkIt = _nodeLinks.find(layout.order[rank]);
+            if (linkIt == _nodeLinks.end()) {
+                continue;
+            }
+            layout.globalNodeIndices[layout.order[rank]] = static_cast<std::uint32_t>(globalNodeLinks.size());
+            std::vector<NodeLink> links(1, NodeLink(_packageName, rank / _settings.nodeBlockSize, rank % _settings.nodeBlockSize));
+            links.insert(links.end(), linkIt->second.begin(), linkIt->second.end());
+            globalNodeLinks.push_back(std::move(links));
+        }
+        if ((globalNodeLinks.size() + _settings.nodeBlockSize - 1) / _settings.nodeBlockSize > static_cast<std::size_t>(RoutingGraph::ElementId::MAX_BLOCK_INDEX) + 1) {
+            throw std::runtime_error("Too many global node blocks");
+        }
+        _stats.globalNodeCount = globalNodeLinks.size();
+
+        // Group edges by source node
+        layout.edgeOrder.resize(_edges.size());
+        std::iota(layout.edgeOrder.begin(), layout.edgeOrder.end(), 0);
+        std::stable_sort(layout.edgeOrder.begin(), layout.edgeOrder.end(), [&](std::uint32_t edgeIndex1, std::uint32_t edgeIndex2) {
+            return layout.ranks[_edges[edgeIndex1].sourceNode] < layout.ranks[_edges[edgeIndex2].sourceNode];
+        });
+        layout.edgeOffsets.assign(_nodes.size() + 1, 0);
+        for (const Edge& edge : _edges) {
+            layout.edgeOffsets[layout.ranks[edge.sourceNode] + 1]++;
+        }
+        std::partial_sum(layout.edgeOffsets.begin(), layout.edgeOffsets.end(), layout.edgeOffsets.begin());
+
+        // Deduplicate geometries (also reversed ones) and names. These are numbered in node order,
+        // so that the nodes of a block refer to a few consecutive geometry and name blocks.
+        std::map<std::vector<int>, std::uint32_t> geometryIdMap;
+        std::unordered_map<std::string, std::uint32_t> nameIdMap;
+        std::vector<const std::vector<Point>*> geometries;
+        std::vector<const std::string*> names;
+        layout.geometryIds.resize(_nodes.size());
+        layout.geometryReversed.resize(_nodes.size());
+        layout.nameIds.resize(_nodes.size());
+        std::vector<int> geometryKey;
+        for (std::uint32_t rank = 0; rank < layout.order.size(); rank++) {
+            const Node& node = _nodes[layout.order[rank]];
+
+            geometryKey.clear();
+            for (auto it = node.geometry.rbegin(); it != node.geometry.rend(); it++) {
+                geometryKey.push_back(it->lat);
+                geometryKey.push_back(it->lon);
+            }
+            auto geometryIt = geometryIdMap.find(geometryKey);
+            if (geometryIt != geometryIdMap.end()) {
+                layout.geometryIds[rank] = geometryIt->second;
+                layout.geometryReversed[rank] = true;
+            }
+            else {
+                geometryKey.clear();
+                for (const Point& point : node.geometry) {
+                    geometryKey.push_back(point.lat);
+                    geometryKey.push_back(point.lon);
+                }
+                geometryIt = geometryIdMap.emplace(geometryKey, static_cast<std::uint32_t>(geometries.size())).first;
+                if (geometryIt->second == geometries.size()) {
+                    geometries.push_back(&node.geometry);
+                }
+                layout.geometryIds[rank] = geometryIt->second;
+                layout.geometryReversed[rank] = false;
+            }
+
+            auto nameIt = nameIdMap.emplace(node.name, static_cast<std::uint32_t>(names.size())).first;
+            if (nameIt->second == names.size()) {
+                names.push_back(&node.name);
+            }
+            layout.nameIds[rank] = nameIt->second;
+        }
+        _stats.geometryCount = geometries.size();
+        _stats.nameCount = names.size();
+
+        // Node blocks
+        std::vector<std::vector<unsigned char>> nodeBlocks;
+        for (std::uint32_t blockIndex = 0; blockIndex < nodeBlockCount; blockIndex++) {
+            nodeBlocks.push_back(buildNodeBlock(layout, blockIndex));
+        }
+
+        // Geometry and name blocks
+        std::vector<std::vector<unsigned char>> geometryBlocks;
+        for (std::size_t i = 0; i < geometries.size(); i += _settings.geometryBlockSize) {
+            std::size_t last = std::min(geometries.size(), i + _settings.geometryBlockSize);
+            geometryBlocks.push_back(buildGeometryBlock(std::vector<const std::vector<Point>*>(geometries.begin() + i, geometries.begin() + last)));
+        }
+        std::vector<std::vector<unsigned char>> nameBlocks;
+        for (std::size_t i = 0; i < names.size(); i += _settings.nameBlockSize) {
+            std::size_t last = std::min(names.size(), i + _settings.nameBlockSize);
+            nameBlocks.push_back(buildNameBlock(std::vector<const std::string*>(names.begin() + i, names.begin() + last)));
+        }
+        if (geometryBlocks.size() > static_cast<std::size_t>(RoutingGraph::ElementId::MAX_BLOCK_INDEX) + 1 || nameBlocks.size() > static_cast<std::size_t>(RoutingGraph::ElementId::MAX_BLOCK_INDEX) + 1) {
+            throw std::runtime_error("Too many geometry or name blocks");
+        }
+
+        // Global node blocks, at least one even if there are no linked nodes
+        std::vector<std::vector<unsigned char>> globalNodeBlocks;
+        for (std::size_t i = 0; i < globalNodeLinks.size() || globalNodeBlocks.empty(); i += _settings.nodeBlockSize) {
+            std::size_t last = std::min(globalNodeLinks.size(), i + _settings.nodeBlockSize);
+            globalNodeBlocks.push_back(buildGlobalNodeBlock(std::vector<std::vector<NodeLink>>(globalNodeLinks.begin() + i, globalNodeLinks.begin() + last)));
+        }
+
+        // Node geometry bounds, per node and per node block
+        std::vector<Bounds> nodeBounds;
+        nodeBounds.reserve(_nodes.size());
+        for (std::uint32_t rank = 0; rank < layout.order.size(); rank++) {
+            nodeBounds.push_back(getBounds(_nodes[layout.order[rank]].geometry));
+        }
+        std::vector<Bounds> nodeBlockBounds;
+        for (std::size_t i = 0; i < nodeBounds.size(); i += _settings.nodeBlockSize) {
+            std::size_t last = std::min(nodeBounds.size(), i + _settings.nodeBlockSize);
+            nodeBlockBounds.push_back(std::accumulate(nodeBounds.begin() + i + 1, nodeBounds.begin() + last, nodeBounds[i], mergeBounds));
+        }
+        Bounds bbox = nodeBlockBounds.empty() ? Bounds() : std::accumulate(nodeBlockBounds.begin() + 1, nodeBlockBounds.end(), nodeBlockBounds.front(), mergeBounds);
+
+        std::vector<std::vector<unsigned char>> nodeBoundsBlocks;
+        if (_settings.nodeBounds) {
+            for (std::size_t i = 0; i < nodeBounds.size(); i += _settings.nodeBlockSize) {
+                std::size_t last = std::min(nodeBounds.size(), i + _settings.nodeBlockSize);
+                nodeBoundsBlocks.push_back(buildNodeBoundsBlock(std::vector<Bounds>(nodeBounds.begin() + i, nodeBounds.begin() + last)));
+            }
+        }
+
+        // Node geometry lengths, so that route summaries need no geometry
+        std::vector<std::vector<unsigned char>> nodeLengthsBlocks;
+        if (_settings.nodeLengths) {
+            for (std::size_t i = 0; i < layout.order.size(); i += _settings.nodeBlockSize) {
+                std::size_t last = std::min(layout.order.size(), i + _settings.nodeBlockSize);
+                std::vector<double> nodeLengths;
+                for (std::size_t rank = i; rank < last; rank++) {
+                    nodeLengths.push_back(getLength(_nodes[layout.order[rank]].geometry));
+                }
+                nodeLengthsBlocks.push_back(buildNodeLengthsBlock(nodeLengths));
+            }
+        }
+
+        // Edges leading to each node, so that the incoming edges of a node are found without a spatial query.
+        // Edges are given by their positions in edgeOrder, grouped by target node rank.
+        std::vector<std::vector<unsigned char>> incomingEdgesBlocks;
+        if (_settings.incomingEdges) {
+            std::vector<std::uint32_t> incomingEdgeOffsets(_nodes.size() + 1, 0);
+            for (const Edge& edge : _edges) {
+                incomingEdgeOffsets[layout.ranks[edge.targetNode] + 1]++;
+            }
+            std::partial_sum(incomingEdgeOffsets.begin(), incomingEdgeOffsets.end(), incomingEdgeOffsets.begin());
+            std::vector<std::uint32_t> incomingEdges(_edges.size());
+            std::vector<std::uint32_t> nextIncomingEdges(incomingEdgeOffsets.begin(), incomingEdgeOffsets.end() - 1);
+            for (std::uint32_t i = 0; i < layout.edgeOrder.size(); i++) {
+                incomingEdges[nextIncomingEdges[layout.ranks[_edges[layout.edgeOrder[i]].targetNode]]++] = i;
+            }
+            for (std::uint32_t blockIndex = 0; blockIndex < nodeBlockCount; blockIndex++) {
+                incomingEdgesBlocks.push_back(buildIncomingEdgesBlock(layout, incomingEdgeOffsets, incomingEdges, blockIndex));
+            }
+        }
+
+        // Build R-tree bottom up over node blocks. The root must be the first node of the first block,
+        // so the nodes are numbered in breadth-first order from the root.
+        std::vector<RTreeNode> rtreeNodes;
+        std::vector<Bounds> rtreeNodeBounds;
+        for (std::uint32_t blockIndex = 0; blockIndex < nodeBlockCount || rtreeNodes.empty(); blockIndex += _settings.rtreeFanout) {
+            RTreeNode rtreeNode;
+            rtreeNode.leaf = true;
+            for (std::uint32_t i = blockIndex; i < std::min(nodeBlockCount, blockIndex + _settings.rtreeFanout); i++) {
+                rtreeNode.children.emplace_back(nodeBlockBounds[i], i);
+            }
+            rtreeNodeBounds.push_back(rtreeNode.children.empty() ? Bounds() : std::accumulate(rtreeNode.children.begin(), rtreeNode.children.end(), rtreeNode.children.front().first, [](const Bounds& bounds, const std::pair<Bounds, std::uint32_t>& child) { return mergeBounds(bounds, child.first); }));
+            rtreeNodes.push_back(std::move(rtreeNode));
+        }
+        for (std::size_t levelBegin = 0, levelEnd = rtreeNodes.size(); levelEnd - levelBegin > 1; levelBegin = levelEnd, levelEnd = rtreeNodes.size()) {
+            for (std::size_t i = levelBegin; i < levelEnd; i += _settings.rtreeFanout) {
+                RTreeNode rtreeNode;
+                for (std::size_t j = i; j < std::min(levelEnd, i + _settings.rtreeFanout); j++) {
+                    rtreeNode.children.emplace_back(rtreeNodeBounds[j], static_cast<std::uint32_t>(j));
+                }
+                rtreeNodeBounds.push_back(std::accumulate(rtreeNode.children.begin(), rtreeNode.children.end(), rtreeNode.children.front().first, [](const Bounds& bounds, const std::pair<Bounds, std::uint32_t>& child) { return mergeBounds(bounds, child.first); }));
+                rtreeNodes.push_back(std::move(rtreeNode));
+            }
+        }
+        std::vector<std::uint32_t> rtreeNodeOrder(1, static_cast<std::uint32_t>(rtreeNodes.size() - 1));
+        std::vector<std::uint32_t> rtreeNodeRanks(rtreeNodes.size());
+        for (std::size_t i = 0; i < rtreeNodeOrder.size(); i++) {
+            rtreeNodeRanks[rtreeNodeOrder[i]] = static_cast<std::uint32_t>(i);
+            const RTreeNode& rtreeNode = rtreeNodes[rtreeNodeOrder[i]];
+            if (!rtreeNode.leaf) {
+                for (const std::pair<Bounds, std::uint32_t>& child : rtreeNode.children) {
+                    rtreeNodeOrder.push_back(child.second);
+                }
+            }
+        }
+        std::vector<RTreeNode> orderedRTreeNodes;
+        orderedRTreeNodes.reserve(rtreeNodes.size());
+        for (std::uint32_t rtreeNodeIndex : rtreeNodeOrder) {
+            RTreeNode rtreeNode = rtreeNodes[rtreeNodeIndex];
+            if (!rtreeNode.leaf) {
+                for (std::pair<Bounds, std::uint32_t>& child : rtreeNode.children) {
+                    child.second = rtreeNodeRanks[child.second];
+                }
+            }
+            orderedRTreeNodes.push_back(std::move(rtreeNode));
+        }
+        std::vector<std::vector<unsigned char>> rtreeBlocks;
+        for (std::size_t i = 0; i < orderedRTreeNodes.size(); i += _settings.rtreeNodeBlockSize) {
+            rtreeBlocks.push_back(buildRTreeBlock(orderedRTreeNodes, i, std::min(orderedRTreeNodes.size(), i + _settings.rtreeNodeBlockSize)));
+        }
+
+        // Assemble the package
+        auto graphChunk = std::make_shared<eiff::form_chunk>();
+        graphChunk->insert(std::make_shared<eiff::memory_data_chunk>(eiff::chunk::tag_type {{ 'H', 'E', 'A', 'D' }}, buildHeader(bbox)));
+        auto nodeChunk = createBlockChunk(eiff::chunk::tag_type {{ 'N', 'O', 'D', 'E' }}, nodeBlocks);
+        auto geometryChunk = createBlockChunk(eiff::chunk::tag_type {{ 'G', 'E', 'O', 'M' }}, geometryBlocks);
+        auto nameChunk = createBlockChunk(eiff::chunk::tag_type {{ 'N', 'A', 'M', 'E' }}, nameBlocks);
+        auto globalNodeChunk = createBlockChunk(eiff::chunk::tag_type {{ 'L', 'I', 'N', 'K' }}, globalNodeBlocks);
+        auto rtreeChunk = createBlockChunk(eiff::chunk::tag_type {{ 'R', 'T', 'R', 'E' }}, rtreeBlocks);
+        graphChunk->insert(nodeChunk);
+        graphChunk->insert(geometryChunk);
+        graphChunk->insert(nameChunk);
+        graphChunk->insert(globalNodeChunk);
+        graphChunk->insert(rtreeChunk);
+        _stats.nodeChunkSize = static_cast<std::size_t>(nodeChunk->size());
+        _stats.geometryChunkSize = static_cast<std::size_t>(geometryChunk->size());
+        _stats.nameChunkSize = static_cast<std::size_t>(nameChunk->size());
+        _stats.globalNodeChunkSize = static_cast<std::size_t>(globalNodeChunk->size());
+        _stats.rtreeChunkSize = static_cast<std::size_t>(rtreeChunk->size());
+        if (_settings.nodeBounds) {
+            auto nodeBoundsChunk = createBlockChunk(eiff::chunk::tag_type {{ 'N', 'B', 'O', 'X' }}, nodeBoundsBlocks);
+            graphChunk->insert(nodeBoundsChunk);
+            _stats.nodeBoundsChunkSize = static_cast<std::size_t>(nodeBoundsChunk->size());
+        }
+        if (_settings.nodeLengths) {
+            auto nodeLengthsChunk = createBlockChunk(eiff::chunk::tag_type {{ 'N', 'L', 'E', 'N' }}, nodeLengthsBlocks);
+            graphChunk->insert(nodeLengthsChunk);
+            _stats.nodeLengthsChunkSize = static_cast<std::size_t>(nodeLengthsChunk->size());
+        }
+        if (_settings.incomingEdges) {
+            auto incomingEdgesChunk = createBlockChunk(eiff::chunk::tag_type {{ 'R', 'A', 'D', 'J' }}, incomingEdgesBlocks);
+            graphChunk->insert(incomingEdgesChunk);
+            _stats.incomingEdgesChunkSize = static_cast<std::size_t>(incomingEdgesChunk->size());
+        }
+        return graphChunk;
+    }
+
+    void PackageBuilder::write(std::ostream& os) {
+        eiff::write_chunk(os, std::static_pointer_cast<eiff::chunk>(build()));
+    }
+
+    std::vector<std::uint32_t> PackageBuilder::orderNodes() const {
+        std::vector<std::uint32_t> order(_nodes.size());
+        std::iota(order.begin(), order.end(), 0);
+        if (_settings.nodeOrder != NodeOrder::HILBERT || _nodes.empty()) {
+            return order;
+        }
+
+        // Map node geometry centers to 16-bit grid covering all nodes
+        std::vector<Point> centers;
+        centers.reserve(_nodes.size());
+        for (const Node& node : _nodes) {
+            Bounds bounds = getBounds(node.geometry);
+            centers.emplace_back(static_cast<int>((static_cast<long long>(bounds.min.lat) + bounds.max.lat) / 2), static_cast<int>((static_cast<long long>(bounds.min.lon) + bounds.max.lon) / 2));
+        }
+        Bounds bbox(centers.front(), centers.front());
+        for (const Point& center : centers) {
+            bbox = mergeBounds(bbox, Bounds(center, center));
+        }
+        double latScale = 65535.0 / std::max(1, bbox.max.lat - bbox.min.lat);
+        double lonScale = 65535.0 / std::max(1, bbox.max.lon - bbox.min.lon);
+        std::vector<std::uint64_t> keys;
+        keys.reserve(centers.size());
+        for (const Point& center : centers) {
+            std::uint32_t x = static_cast<std::uint32_t>((center.lon - bbox.min.lon) * lonScale);
+            std::uint32_t y = static_cast<std::uint32_t>((center.lat - bbox.min.lat) * latScale);
+            keys.push_back(getHilbertIndex(x, y));
+        }
+        std::stable_sort(order.begin(), order.end(), [&keys](std::uint32_t nodeIndex1, std::uint32_t nodeIndex2) {
+            return keys[nodeIndex1] < keys[nodeIndex2];
+        });
+        return order;
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildHeader(const Bounds& bbox) const {
+        if (_packageName.size() > 65535) {
+            throw std::runtime_error("Package name too long");
+        }
+        bitstreams::output_bitstream bs;
+        bs.write_bits(static_cast<std::uint32_t>(RoutingGraph::VERSION), 32);
+        bs.write_bits(static_cast<std::uint32_t>(_packageName.size()), 16);
+        for (char c : _packageName) {
+            bs.write_bits(static_cast<unsigned char>(c), 8);
+        }
+        bs.write_bits(static_cast<std::uint32_t>(bbox.min.lat), 32);
+        bs.write_bits(static_cast<std::uint32_t>(bbox.min.lon), 32);
+        bs.write_bits(static_cast<std::uint32_t>(bbox.max.lat), 32);
+        bs.write_bits(static_cast<std::uint32_t>(bbox.max.lon), 32);
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildNodeBlock(const Layout& layout, std::uint32_t blockIndex) {
+        // Node reference, as stored in the block: either a delta to preceding node in the same block,
+        // or block delta and node index. Contracted node block deltas are signed, target block deltas are
+        // subtracted from the block index modulo 2^32. Linked nodes are referenced by global node block and
+        // index, written after internal delta 0.
+        struct NodeRef {
+            bool external;
+            bool global;
+            std::uint32_t delta; // global node block index for global references
+            std::uint32_t index;
+        };
+        auto getNodeRef = [this, &layout, blockIndex](std::uint32_t nodeIndex, std::uint32_t localIndex, bool signedBlockDelta) -> NodeRef {
+            auto globalIt = layout.globalNodeIndices.find(nodeIndex);
+            if (globalIt != layout.globalNodeIndices.end()) {
+                return NodeRef { false, true, globalIt->second / _settings.nodeBlockSize, globalIt->second % _settings.nodeBlockSize };
+            }
+            std::uint32_t rank = layout.ranks[nodeIndex];
+            std::uint32_t nodeBlockIndex = rank / _settings.nodeBlockSize;
+            std::uint32_t nodeLocalIndex = rank % _settings.nodeBlockSize;
+            if (nodeBlockIndex == blockIndex && nodeLocalIndex < localIndex) {
+                return NodeRef { false, false, localIndex - nodeLocalIndex, 0 };
+            }
+            std::uint32_t delta = signedBlockDelta ? zigzag(static_cast<int>(nodeBlockIndex) - static_cast<int>(blockIndex)) : blockIndex - nodeBlockIndex;
+            return NodeRef { true, false, delta, nodeLocalIndex };
+        };
+
+        std::uint32_t firstRank = blockIndex * _settings.nodeBlockSize;
+        std::uint32_t lastRank = std::min(static_cast<std::uint32_t>(_nodes.size()), firstRank + _settings.nodeBlockSize);
+
+        // Find the value ranges of all fields
+        std::uint32_t minGeometryBlockIndex = std::numeric_limits<std::uint32_t>::max(), maxGeometryBlockIndex = 0, maxGeometryIndex = 0;
+        std::uint32_t minNameBlockIndex = std::numeric_limits<std::uint32_t>::max(), maxNameBlockIndex = 0, maxNameIndex = 0;
+        std::uint32_t maxInternalDelta = 0, maxExternalBlockDelta = 0, maxExternalIndex = 0, maxGlobalBlockIndex = 0, maxGlobalIndex = 0, maxContractedBlockDelta = 0, maxContractedIndex = 0;
+        std::uint32_t maxOutDegree = 0, maxTravelMode = 0, maxInstruction = 0;
+        std::vector<unsigned int> weights;
+        for (std::uint32_t rank = firstRank; rank < lastRank; rank++) {
+            const Node& node = _nodes[layout.order[rank]];
+            std::uint32_t localIndex = rank - firstRank;
+            minGeometryBlockIndex = std::min(minGeometryBlockIndex, layout.geometryIds[rank] / _settings.geometryBlockSize);
+            maxGeometryBlockIndex = std::max(maxGeometryBlockIndex, layout.geometryIds[rank] / _settings.geometryBlockSize);
+            maxGeometryIndex = std::max(maxGeometryIndex, layout.geometryIds[rank] % _settings.geometryBlockSize);
+            minNameBlockIndex = std::min(minNameBlockIndex, layout.nameIds[rank] / _settings.nameBlockSize);
+            maxNameBlockIndex = std::max(maxNameBlockIndex, layout.nameIds[rank] / _settings.nameBlockSize);
+            maxNameIndex = std::max(maxNameIndex, layout.nameIds[rank] % _settings.nameBlockSize);
+            maxOutDegree = std::max(maxOutDegree, layout.edgeOffsets[rank + 1] - layout.edgeOffsets[rank]);
+            maxTravelMode = std::max(maxTravelMode, static_cast<std::uint32_t>(node.travelMode));
+            weights.push_back(node.weight);
+
+            for (std::uint32_t i = layout.edgeOffsets[rank]; i < layout.edgeOffsets[rank + 1]; i++) {
+                const Edge& edge = _edges[layout.edgeOrder[i]];
+                NodeRef targetRef = getNodeRef(edge.targetNode, localIndex, false);
+                if (targetRef.global) {
+                    maxGlobalBlockIndex = std::max(maxGlobalBlockIndex, targetRef.delta);
+                    maxGlobalIndex = std::max(maxGlobalIndex, targetRef.index);
+                }
+                else if (targetRef.external) {
+                    maxExternalBlockDelta = std::max(maxExternalBlockDelta, targetRef.delta);
+                    maxExternalIndex = std::max(maxExternalIndex, targetRef.index);
+                    if (targetRef.delta != 0) {
+                        _stats.externalEdgeCount++;
+                    }
+                }
+                else {
+                    maxInternalDelta = std::max(maxInternalDelta, targetRef.delta);
+                }
+                if (edge.contracted) {
+                    NodeRef contractedRef = getNodeRef(edge.contractedNode, localIndex, true);
+                    if (contractedRef.global) {
+                        maxGlobalBlockIndex = std::max(maxGlobalBlockIndex, contractedRef.delta);
+                        maxGlobalIndex = std::max(maxGlobalIndex, contractedRef.index);
+                    }
+                    else if (contractedRef.external) {
+                        maxContractedBlockDelta = std::max(maxContractedBlockDelta, contractedRef.delta);
+                        maxContractedIndex = std::max(maxContractedIndex, contractedRef.index);
+                    }
+                    else {
+                        maxInternalDelta = std::max(maxInternalDelta, contractedRef.delta);
+                    }
+                }
+                else {
+                    maxInstruction = std::max(maxInstruction, static_cast<std::uint32_t>(edge.turnInstruction));
+                }
+                weights.push_back(edge.weight);
+            }
+        }
+        if (firstRank == lastRank) {
+            minGeometryBlockIndex = minNameBlockIndex = 0;
+        }
+        std::pair<int, int> weightBits = selectWeightBits(weights);
+
+        int internalNodeIndexBits = bitstreams::get_required_bits(maxInternalDelta);
+        int externalNodeBlockBits = bitstreams::get_required_bits(maxExternalBlockDelta);
+        int externalNodeIndexBits = bitstreams::get_required_bits(maxExternalIndex);
+        int globalNodeBlockBits = bitstreams::get_required_bits(maxGlobalBlockIndex);
+        int globalNodeIndexBits = bitstreams::get_required_bits(maxGlobalIndex);
+        int contractedNodeBlockBits = bitstreams::get_required_bits(maxContractedBlockDelta);
+        int contractedNodeIndexBits = bitstreams::get_required_bits(maxContractedIndex);
+        int geometryBlockBits = bitstreams::get_required_bits(maxGeometryBlockIndex);
+        int geometryBlockDiffBits = bitstreams::get_required_bits(maxGeometryBlockIndex - minGeometryBlockIndex);
+        int geometryIndexBits = bitstreams::get_required_bits(maxGeometryIndex);
+        int nameBlockBits = bitstreams::get_required_bits(maxNameBlockIndex);
+        int nameBlockDiffBits = bitstreams::get_required_bits(maxNameBlockIndex - minNameBlockIndex);
+        int nameIndexBits = bitstreams::get_required_bits(maxNameIndex);
+        int nodeOutDegreeBits = bitstreams::get_required_bits(maxOutDegree);
+        int travelModeBits = bitstreams::get_required_bits(maxTravelMode);
+        int instructionBits = bitstreams::get_required_bits(maxInstruction);
+
+        auto writeWeight = [&weightBits](bitstreams::output_bitstream& bs, unsigned int weight) {
+            bool large = bitstreams::get_required_bits(weight) > weightBits.first;
+            bs.write_bit(large);
+            bs.write_bits(weight, large ? weightBits.second : weightBits.first);
+        };
+        auto writeNodeRef = [globalNodeBlockBits, globalNodeIndexBits](bitstreams::output_bitstream& bs, const NodeRef& nodeRef, int internalBits, int blockBits, int indexBits) {
+            bs.write_bit(nodeRef.external);
+            if (nodeRef.external) {
+                bs.write_bits(nodeRef.delta, blockBits);
+                bs.write_bits(nodeRef.index, indexBits);
+            }
+            else if (nodeRef.global) {
+                bs.write_bits(0U, internalBits);
+                bs.write_bits(nodeRef.delta, globalNodeBlockBits);
+                bs.write_bits(nodeRef.index, globalNodeIndexBits);
+            }
+            else {
+                bs.write_bits(nodeRef.delta, internalBits);
+            }
+        };
+
+        // Write block header
+        bitstreams::output_bitstream bs;
+        for (int bits : { internalNodeIndexBits, externalNodeBlockBits, externalNodeIndexBits, globalNodeBlockBits, globalNodeIndexBits, contractedNodeBlockBits, contractedNodeIndexBits, geometryBlockBits, geometryBlockDiffBits, geometryIndexBits, nameBlockBits, nameBlockDiffBits, nameIndexBits, nodeOutDegreeBits, travelModeBits, instructionBits, weightBits.first, weightBits.second }) {
+            bs.write_bits(static_cast<unsigned int>(bits), 6);
+        }
+        bs.write_bits(minGeometryBlockIndex, geometryBlockBits);
+        bs.write_bits(minNameBlockIndex, nameBlockBits);
+
+        // Write nodes and their outgoing edges
+        bs.write_bits(lastRank - firstRank, 32);
+        for (std::uint32_t rank = firstRank; rank < lastRank; rank++) {
+            const Node& node = _nodes[layout.order[rank]];
+            std::uint32_t localIndex = rank - firstRank;
+            bs.write_bits(layout.edgeOffsets[rank + 1] - layout.edgeOffsets[rank], nodeOutDegreeBits);
+            bs.write_bits(layout.geometryIds[rank] / _settings.geometryBlockSize - minGeometryBlockIndex, geometryBlockDiffBits);
+            bs.write_bits(layout.geometryIds[rank] % _settings.geometryBlockSize, geometryIndexBits);
+            bs.write_bit(layout.geometryReversed[rank]);
+            bs.write_bits(layout.nameIds[rank] / _settings.nameBlockSize - minNameBlockIndex, nameBlockDiffBits);
+            bs.write_bits(layout.nameIds[rank] % _settings.nameBlockSize, nameIndexBits);
+            bs.write_bits(static_cast<unsigned int>(node.travelMode), travelModeBits);
+            writeWeight(bs, node.weight);
+
+            for (std::uint32_t i = layout.edgeOffsets[rank]; i < layout.edgeOffsets[rank + 1]; i++) {
+                const Edge& edge = _edges[layout.edgeOrder[i]];
+                writeNodeRef(bs, getNodeRef(edge.targetNode, localIndex, false), internalNodeIndexBits, externalNodeBlockBits, externalNodeIndexBits);
+                bs.write_bit(edge.forward);
+                bs.write_bit(edge.backward);
+                writeWeight(bs, edge.weight);
+                bs.write_bit(edge.contracted);
+                if (edge.contracted) {
+                    writeNodeRef(bs, getNodeRef(edge.contractedNode, localIndex, true), internalNodeIndexBits, contractedNodeBlockBits, contractedNodeIndexBits);
+                }
+                else {
+                    bs.write_bits(static_cast<unsigned int>(edge.turnInstruction), instructionBits);
+                }
+            }
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildGeometryBlock(const std::vector<const std::vector<Point>*>& geometries) const {
+        Point min(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        std::uint32_t maxGeometrySize = 0;
+        for (const std::vector<Point>* geometry : geometries) {
+            min = Point(std::min(min.lat, geometry->front().lat), std::min(min.lon, geometry->front().lon));
+            maxGeometrySize = std::max(maxGeometrySize, static_cast<std::uint32_t>(geometry->size() - 1));
+        }
+        std::uint32_t maxLatDiff = 0, maxLonDiff = 0;
+        for (const std::vector<Point>* geometry : geometries) {
+            maxLatDiff = std::max(maxLatDiff, static_cast<std::uint32_t>(geometry->front().lat - min.lat));
+            maxLonDiff = std::max(maxLonDiff, static_cast<std::uint32_t>(geometry->front().lon - min.lon));
+        }
+        int latDiffBits = bitstreams::get_required_bits(maxLatDiff);
+        int lonDiffBits = bitstreams::get_required_bits(maxLonDiff);
+        int geometrySizeBits = bitstreams::get_required_bits(maxGeometrySize);
+
+        bitstreams::output_bitstream bs;
+        bs.write_bits(static_cast<unsigned int>(latDiffBits), 6);
+        bs.write_bits(static_cast<unsigned int>(lonDiffBits), 6);
+        bs.write_bits(static_cast<unsigned int>(geometrySizeBits), 6);
+        bs.write_bits(static_cast<std::uint32_t>(geometries.empty() ? 0 : min.lat), 32);
+        bs.write_bits(static_cast<std::uint32_t>(geometries.empty() ? 0 : min.lon), 32);
+
+        // Vertices are delta coded, with per geometry delta widths
+        bs.write_bits(static_cast<std::uint32_t>(geometries.size()), 32);
+        for (const std::vector<Point>* geometry : geometries) {
+            std::uint32_t maxLatZigZag = 0, maxLonZigZag = 0;
+            for (std::size_t i = 1; i < geometry->size(); i++) {
+                maxLatZigZag = std::max(maxLatZigZag, zigzag((*geometry)[i].lat - (*geometry)[i - 1].lat));
+                maxLonZigZag = std::max(maxLonZigZag, zigzag((*geometry)[i].lon - (*geometry)[i - 1].lon));
+            }
+            int latZigZagBits = bitstreams::get_required_bits(maxLatZigZag);
+            int lonZigZagBits = bitstreams::get_required_bits(maxLonZigZag);
+            bs.write_bits(static_cast<unsigned int>(latZigZagBits), 6);
+            bs.write_bits(static_cast<unsigned int>(lonZigZagBits), 6);
+            bs.write_bits(static_cast<std::uint32_t>(geometry->front().lat - min.lat), latDiffBits);
+            bs.write_bits(static_cast<std::uint32_t>(geometry->front().lon - min.lon), lonDiffBits);
+            bs.write_bits(static_cast<std::uint32_t>(geometry->size() - 1), geometrySizeBits);
+            for (std::size_t i = 1; i < geometry->size(); i++) {
+                bs.write_zigzag((*geometry)[i].lat - (*geometry)[i - 1].lat, latZigZagBits);
+                bs.write_zigzag((*geometry)[i].lon - (*geometry)[i - 1].lon, lonZigZagBits);
+            }
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildNameBlock(const std::vector<const std::string*>& names) const {
+        std::uint32_t maxLength = 0;
+        for (const std::string* name : names) {
+            maxLength = std::max(maxLength, static_cast<std::uint32_t>(name->size()));
+        }
+        int lengthBits = bitstreams::get_required_bits(maxLength);
+
+        bitstreams::output_bitstream bs;
+        bs.write_bits(static_cast<unsigned int>(lengthBits), 6);
+        bs.write_bits(static_cast<std::uint32_t>(names.size()), 32);
+        for (const std::string* name : names) {
+            bs.write_bits(static_cast<std::uint32_t>(name->size()), lengthBits);
+            for (char c : *name) {
+                bs.write_bits(static_cast<unsigned char>(c), 8);
+            }
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildGlobalNodeBlock(const std::vector<std::vector<NodeLink>>& globalNodeLinks) const {
+        // Package names are listed once per block, links refer to them by index. The reader uses the same width
+        // for link counts and package indices.
+        std::vector<const std::string*> packageNames;
+        std::unordered_map<std::string, std::uint32_t> packageIndices;
+        std::uint32_t maxPackageNameLength = 0, maxPackagesPerNode = 0, maxBlockIndex = 0, maxNodeIndex = 0;
+        for (const std::vector<NodeLink>& links : globalNodeLinks) {
+            maxPackagesPerNode = std::max(maxPackagesPerNode, static_cast<std::uint32_t>(links.size()));
+            for (const NodeLink& link : links) {
+                if (packageIndices.emplace(link.packageName, static_cast<std::uint32_t>(packageNames.size())).second) {
+                    packageNames.push_back(&link.packageName);
+                    maxPackageNameLength = std::max(maxPackageNameLength, static_cast<std::uint32_t>(link.packageName.size()));
+                }
+                maxBlockIndex = std::max(maxBlockIndex, link.blockIndex);
+                maxNodeIndex = std::max(maxNodeIndex, link.nodeIndex);
+            }
+        }
+        int packageNameBits = bitstreams::get_required_bits(maxPackageNameLength);
+        int packagesPerNodeBits = bitstreams::get_required_bits(std::max(maxPackagesPerNode, static_cast<std::uint32_t>(packageNames.size())));
+        int blockIndexBits = bitstreams::get_required_bits(maxBlockIndex);
+        int nodeIndexBits = bitstreams::get_required_bits(maxNodeIndex);
+
+        bitstreams::output_bitstream bs;
+        for (int bits : { packageNameBits, packagesPerNodeBits, blockIndexBits, nodeIndexBits }) {
+            bs.write_bits(static_cast<unsigned int>(bits), 6);
+        }
+        bs.write_bits(static_cast<std::uint32_t>(packageNames.size()), 32);
+        for (const std::string* packageName : packageNames) {
+            bs.write_bits(static_cast<std::uint32_t>(packageName->size()), packageNameBits);
+            for (char c : *packageName) {
+                bs.write_bits(static_cast<unsigned char>(c), 8);
+            }
+        }
+        bs.write_bits(static_cast<std::uint32_t>(globalNodeLinks.size()), 32);
+        for (const std::vector<NodeLink>& links : globalNodeLinks) {
+            bs.write_bits(static_cast<std::uint32_t>(links.size()), packagesPerNodeBits);
+            for (const NodeLink& link : links) {
+                bs.write_bits(packageIndices[link.packageName], packagesPerNodeBits);
+                bs.write_bits(link.blockIndex, blockIndexBits);
+                bs.write_bits(link.nodeIndex, nodeIndexBits);
+            }
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildRTreeBlock(const std::vector<RTreeNode>& rtreeNodes, std::size_t first, std::size_t last) const {
+        Point min(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        std::uint32_t maxRTreeBlockIndex = 0, maxRTreeIndex = 0, maxNodeBlockIndex = 0, maxSize = 0;
+        for (std::size_t i = first; i < last; i++) {
+            maxSize = std::max(maxSize, static_cast<std::uint32_t>(rtreeNodes[i].children.size()));
+            for (const std::pair<Bounds, std::uint32_t>& child : rtreeNodes[i].children) {
+                min = Point(std::min(min.lat, child.first.min.lat), std::min(min.lon, child.first.min.lon));
+                if (rtreeNodes[i].leaf) {
+                    maxNodeBlockIndex = std::max(maxNodeBlockIndex, child.second);
+                }
+                else {
+                    maxRTreeBlockIndex = std::max(maxRTreeBlockIndex, child.second / _settings.rtreeNodeBlockSize);
+                    maxRTreeIndex = std::max(maxRTreeIndex, child.second % _settings.rtreeNodeBlockSize);
+                }
+            }
+        }
+        if (maxSize == 0) {
+            min = Point(0, 0);
+        }
+        std::uint32_t maxLatDiff = 0, maxLonDiff = 0, maxLatSize = 0, maxLonSize = 0;
+        for (std::size_t i = first; i < last; i++) {
+            for (const std::pair<Bounds, std::uint32_t>& child : rtreeNodes[i].children) {
+                maxLatDiff = std::max(maxLatDiff, static_cast<std::uint32_t>(child.first.min.lat - min.lat));
+                maxLonDiff = std::max(maxLonDiff, static_cast<std::uint32_t>(child.first.min.lon - min.lon));
+                maxLatSize = std::max(maxLatSize, static_cast<std::uint32_t>(child.first.max.lat - child.first.min.lat));
+                maxLonSize = std::max(maxLonSize, static_cast<std::uint32_t>(child.first.max.lon - child.first.min.lon));
+            }
+        }
+        int rtreeBlockBits = bitstreams::get_required_bits(maxRTreeBlockIndex);
+        int rtreeIndexBits = bitstreams::get_required_bits(maxRTreeIndex);
+        int nodeBlockBits = bitstreams::get_required_bits(maxNodeBlockIndex);
+        int sizeBits = bitstreams::get_required_bits(maxSize);
+        int latDiffBits = bitstreams::get_required_bits(maxLatDiff);
+        int lonDiffBits = bitstreams::get_required_bits(maxLonDiff);
+        int latSizeBits = bitstreams::get_required_bits(maxLatSize);
+        int lonSizeBits = bitstreams::get_required_bits(maxLonSize);
+
+        bitstreams::output_bitstream bs;
+        for (int bits : { rtreeBlockBits, rtreeIndexBits, nodeBlockBits, sizeBits, latDiffBits, lonDiffBits, latSizeBits, lonSizeBits }) {
+            bs.write_bits(static_cast<unsigned int>(bits), 6);
+        }
+        bs.write_bits(static_cast<std::uint32_t>(min.lat), 32);
+        bs.write_bits(static_cast<std::uint32_t>(min.lon), 32);
+
+        bs.write_bits(static_cast<std::uint32_t>(last - first), 32);
+        for (std::size_t i = first; i < last; i++) {
+            const RTreeNode& rtreeNode = rtreeNodes[i];
+            bs.write_bit(rtreeNode.leaf);
+            bs.write_bits(static_cast<std::uint32_t>(rtreeNode.children.size()), sizeBits);
+            for (const std::pair<Bounds, std::uint32_t>& child : rtreeNode.children) {
+                bs.write_bits(static_cast<std::uint32_t>(child.first.min.lat - min.lat), latDiffBits);
+                bs.write_bits(static_cast<std::uint32_t>(child.first.min.lon - min.lon), lonDiffBits);
+                bs.write_bits(static_cast<std::uint32_t>(child.first.max.lat - child.first.min.lat), latSizeBits);
+                bs.write_bits(static_cast<std::uint32_t>(child.first.max.lon - child.first.min.lon), lonSizeBits);
+                if (rtreeNode.leaf) {
+                    bs.write_bits(child.second, nodeBlockBits);
+                }
+                else {
+                    bs.write_bits(child.second / _settings.rtreeNodeBlockSize, rtreeBlockBits);
+                    bs.write_bits(child.second % _settings.rtreeNodeBlockSize, rtreeIndexBits);
+                }
+            }
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildNodeBoundsBlock(const std::vector<Bounds>& nodeBounds) const {
+        // Bounds are quantized outwards: the lower corner is floored, the stored size excludes the last unit
+        int quantizationBits = _settings.nodeBoundsQuantizationBits;
+        std::vector<Bounds> quantizedBounds;
+        quantizedBounds.reserve(nodeBounds.size());
+        Point min(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        for (const Bounds& bounds : nodeBounds) {
+            Point min0(floorDiv(bounds.min.lat, 1 << quantizationBits), floorDiv(bounds.min.lon, 1 << quantizationBits));
+            Point max0(floorDiv(bounds.max.lat, 1 << quantizationBits), floorDiv(bounds.max.lon, 1 << quantizationBits));
+            quantizedBounds.emplace_back(min0, max0);
+            min = Point(std::min(min.lat, min0.lat), std::min(min.lon, min0.lon));
+        }
+        if (nodeBounds.empty()) {
+            min = Point(0, 0);
+        }
+        std::uint32_t maxLatDiff = 0, maxLonDiff = 0, maxLatSize = 0, maxLonSize = 0;
+        for (const Bounds& bounds : quantizedBounds) {
+            maxLatDiff = std::max(maxLatDiff, static_cast<std::uint32_t>(bounds.min.lat - min.lat));
+            maxLonDiff = std::max(maxLonDiff, static_cast<std::uint32_t>(bounds.min.lon - min.lon));
+            maxLatSize = std::max(maxLatSize, static_cast<std::uint32_t>(bounds.max.lat - bounds.min.lat));
+            maxLonSize = std::max(maxLonSize, static_cast<std::uint32_t>(bounds.max.lon - bounds.min.lon));
+        }
+        int latDiffBits = bitstreams::get_required_bits(maxLatDiff);
+        int lonDiffBits = bitstreams::get_required_bits(maxLonDiff);
+        int latSizeBits = bitstreams::get_required_bits(maxLatSize);
+        int lonSizeBits = bitstreams::get_required_bits(maxLonSize);
+
+        bitstreams::output_bitstream bs;
+        for (int bits : { quantizationBits, latDiffBits, lonDiffBits, latSizeBits, lonSizeBits }) {
+            bs.write_bits(static_cast<unsigned int>(bits), 6);
+        }
+        bs.write_bits(static_cast<std::uint32_t>(min.lat), 32);
+        bs.write_bits(static_cast<std::uint32_t>(min.lon), 32);
+        bs.write_bits(static_cast<std::uint32_t>(quantizedBounds.size()), 32);
+        for (const Bounds& bounds : quantizedBounds) {
+            bs.write_bits(static_cast<std::uint32_t>(bounds.min.lat - min.lat), latDiffBits);
+            bs.write_bits(static_cast<std::uint32_t>(bounds.min.lon - min.lon), lonDiffBits);
+            bs.write_bits(static_cast<std::uint32_t>(bounds.max.lat - bounds.min.lat), latSizeBits);
+            bs.write_bits(static_cast<std::uint32_t>(bounds.max.lon - bounds.min.lon), lonSizeBits);
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildNodeLengthsBlock(const std::vector<double>& nodeLengths) const {
+        // Lengths in decimeters, with common bit width for the block
+        std::vector<std::uint32_t> quantizedLengths;
+        quantizedLengths.reserve(nodeLengths.size());
+        for (double length : nodeLengths) {
+            quantizedLengths.push_back(static_cast<std::uint32_t>(std::min(std::round(length * 10.0), static_cast<double>(std::numeric_limits<std::uint32_t>::max()))));
+        }
+        int lengthBits = bitstreams::get_required_bits(quantizedLengths.empty() ? 0 : *std::max_element(quantizedLengths.begin(), quantizedLengths.end()));
+
+        bitstreams::output_bitstream bs;
+        bs.write_bits(static_cast<unsigned int>(lengthBits), 6);
+        bs.write_bits(static_cast<std::uint32_t>(quantizedLengths.size()), 32);
+        for (std::uint32_t length : quantizedLengths) {
+            bs.write_bits(length, lengthBits);
+        }
+        return bs.data();
+    }
+
+    std::vector<unsigned char> PackageBuilder::buildIncomingEdgesBlock(const Layout& layout, const std::vector<std::uint32_t>& incomingEdgeOffsets, const std::vector<std::uint32_t>& incomingEdges, std::uint32_t blockIndex) const {
+        // Source node as signed block delta and node index, then the edge index within the source node block
+        struct IncomingEdge {
+            std::uint32_t blockDelta;
+            std::uint32_t nodeIndex;
+            std::uint32_t edgeIndex;
+        };
+
+        std::uint32_t firstRank = blockIndex * _settings.nodeBlockSize;
+        std::uint32_t lastRank = std::min(static_cast<std::uint32_t>(_nodes.size()), firstRank + _settings.nodeBlockSize);
+
+        std::vector<IncomingEdge> blockIncomingEdges;
+        std::uint32_t maxEdgeCount = 0, maxBlockDelta = 0, maxNodeIndex = 0, maxEdgeIndex = 0;
+        for (std::uint32_t rank = firstRank; rank < lastRank; rank++) {
+            maxEdgeCount = std::max(maxEdgeCount, incomingEdgeOffsets[rank + 1] - incomingEdgeOffsets[rank]);
+            for (std::uint32_t i = incomingEdgeOffsets[rank]; i < incomingEdgeOffsets[rank + 1]; i++) {
+                std::uint32_t sourceRank = layout.ranks[_edges[layout.edgeOrder[incomingEdges[i]]].sourceNode];
+                std::uint32_t sourceBlockIndex = sourceRank / _settings.nodeBlockSize;
+                IncomingEdge incomingEdge;
+                incomingEdge.blockDelta = zigzag(static_cast<int>(sourceBlockIndex) - static_cast<int>(blockIndex));
+                incomingEdge.nodeIndex = sourceRank % _settings.nodeBlockSize;
+                incomingEdge.edgeIndex = incomingEdges[i] - layout.edgeOffsets[sourceBlockIndex * _settings.nodeBlockSize];
+                maxBlockDelta = std::max(maxBlockDelta, incomingEdge.blockDelta);
+                maxNodeIndex = std::max(maxNodeIndex, incomingEdge.nodeIndex);
+                maxEdgeIndex = std::max(maxEdgeIndex, incomingEdge.edgeIndex);
+                blockIncomingEdges.push_back(incomingEdge);
+            }
+        }
+        int edgeCountBits = bitstreams::get_required_bits(maxEdgeCount);
+        int blockDeltaBits = bitstreams::get_required_bits(maxBlockDelta);
+        int nodeIndexBits = bitstreams::get_required_bits(maxNodeIndex);
+        int edgeIndexBits = bitstreams::get_required_bits(maxEdgeIndex);
+
+        bitstreams::output_bitstream bs;
+        for (int bits : { edgeCountBits, blockDeltaBits, nodeIndexBits, edgeIndexBits }) {
+            bs.write_bits(static_cast<unsigned int>(bits), 6);
+        }
+        bs.write_bits(lastRank - firstRank, 32);
+        std::size_t index = 0;
+        for (std::uint32_t rank = firstRank; rank < lastRank; rank++) {
+            bs.write_bits(incomingEdgeOffsets[rank + 1] - incomingEdgeOffsets[rank], edgeCountBits);
+            for (std::uint32_t i = incomingEdgeOffsets[rank]; i < incomingEdgeOffsets[rank + 1]; i++, index++) {
+                bs.write_bits(blockIncomingEdges[index].blockDelta, blockDeltaBits);
+                bs.write_bits(blockIncomingEdges[index].nodeIndex, nodeIndexBits);
+                bs.write_bits(blockIncomingEdges[index].edgeIndex, edgeIndexBits);
+            }
+        }
+        return bs.data();
+    }
+
+    std::shared_ptr<eiff::data_chunk> PackageBuilder::createBlockChunk(const eiff::chunk::tag_type& tag, const std::vector<std::vector<unsigned char>>& blocks) {
+        // Block count, followed by offset table with an extra entry for the end of the last block
+        std::vector<unsigned char> data(sizeof(std::uint32_t) + (blocks.size() + 1) * sizeof(std::uint64_t));
+        std::uint32_t blockCount = static_cast<std::uint32_t>(blocks.size());
+        std::memcpy(data.data(), &blockCount, sizeof(blockCount));
+        std::uint64_t offset = data.size();
+        for (std::size_t i = 0; i <= blocks.size(); i++) {
+            std::memcpy(data.data() + sizeof(std::uint32_t) + i * sizeof(std::uint64_t), &offset, sizeof(offset));
+            if (i < blocks.size()) {
+                offset += blocks[i].size();
+            }
+        }
+        data.reserve(static_cast<std::size_t>(offset));
+        for (const std::vector<unsigned char>& block : blocks) {
+            data.insert(data.end(), block.begin(), block.end());
+        }
+        return std::make_shared<eiff::memory_data_chunk>(tag, std::move(data));
+    }
+
+    double PackageBuilder::getLength(const std::vector<Point>& geometry) {
+        double length = 0;
+        for (std::size_t i = 1; i < geometry.size(); i++) {
+            WGSPos pos0(geometry[i - 1].lat * 1.0e-6, geometry[i - 1].lon * 1.0e-6);
+            WGSPos pos1(geometry[i].lat * 1.0e-6, geometry[i].lon * 1.0e-6);
+            length += RoutingGraph::getGreatCircleDistance(pos0, pos1);
+        }
+        return length;
+    }
+
+    PackageBuilder::Bounds PackageBuilder::getBounds(const std::vector<Point>& geometry) {
+        Bounds bounds(geometry.front(), geometry.front());
+        for (const Point& point : geometry) {
+            bounds = mergeBounds(bounds, Bounds(point, point));
+        }
+        return bounds;
+    }
+
+    PackageBuilder::Bounds PackageBuilder::mergeBounds(const Bounds& bounds1, const Bounds& bounds2) {
+        return Bounds(Point(std::min(bounds1.min.lat, bounds2.min.lat), std::min(bounds1.min.lon, bounds2.min.lon)), Point(std::max(bounds1.max.lat, bounds2.max.lat), std::max(bounds1.max.lon, bounds2.max.lon)));
+    }
+
+    std::pair<int, int> PackageBuilder::selectWeightBits(const std::vector<unsigned int>& weights) {
+        // Weights are stored either with small or large width, pick the small width that minimizes the total size
+        std::array<std::size_t, 33> counts {};
+        int largeBits = 0;
+        for (unsigned int weight : weights) {
+            int bits = bitstreams::get_required_bits(weight);
+            counts[bits]++;
+            largeBits = std::max(largeBits, bits);
+        }
+        int smallBits = largeBits;
+        std::size_t bestSize = std::numeric_limits<std::size_t>::max();
+        for (int bits = 0; bits <= largeBits; bits++) {
+            std::size_t size = 0;
+            for (int i = 0; i <= largeBits; i++) {
+                size += counts[i] * (i <= bits ? bits : largeBits);
+            }
+            if (size < bestSize) {
+                bestSize = size;
+                smallBits = bits;
+            }
+        }
+        return std::make_pair(smallBits, largeBits);
+    }
+
+    unsigned int PackageBuilder::zigzag(int value) {
+        return (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+    }
+
+    int PackageBuilder::floorDiv(int value, int divisor) {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+
+    std::uint64_t PackageBuilder::getHilbertIndex(std::uint32_t x, std::uint32_t y) {
+        const std::uint32_t n = 1 << 16;
+        std::uint64_t index = 0;
+        for (std::uint32_t s = n / 2; s > 0; s /= 2) {
+            std::uint32_t rx = (x & s) != 0 ? 1 : 0;
+            std::uint32_t ry = (y & s) != 0 ? 1 : 0;
+            index += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return index;
+    }
+} }
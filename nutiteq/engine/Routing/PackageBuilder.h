@@ -0,0 +1,186 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_PACKAGEBUILDER_H_
+#define _NUTI_ROUTING_PACKAGEBUILDER_H_
+
+#include "RoutingGraph.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <ostream>
+
+#include <stdext/eiff_file.h>
+
+namespace Nuti { namespace Routing {
+    // Writes .nutigraph packages in the layout read by RoutingGraph: HEAD, NODE, GEOM, NAME, LINK and RTRE chunks,
+    // optionally NBOX, NLEN and RADJ. Nodes are the CH graph nodes (road segments), edges are stored at their source node with
+    // forward/backward flags, like in the CH search graph. Identical geometries and names are stored once.
+    class PackageBuilder {
+    public:
+        using Point = RoutingGraph::Point;
+
+        enum class NodeOrder {
+            INPUT, // keep the order nodes were added in
+            HILBERT // sort nodes along Hilbert curve, so that nearby nodes share blocks
+        };
+
+        struct Settings {
+            unsigned int nodeBlockSize = 256; // nodes per node block
+            unsigned int geometryBlockSize = 256; // geometries per geometry block
+            unsigned int nameBlockSize = 256; // names per name block
+            unsigned int rtreeNodeBlockSize = 64; // r-tree nodes per r-tree block
+            unsigned int rtreeFanout = 16; // children per r-tree node
+            NodeOrder nodeOrder = NodeOrder::HILBERT;
+            bool nodeBounds = true; // write NBOX chunk with node geometry bounds
+            bool nodeLengths = true; // write NLEN chunk with node geometry lengths
+            bool incomingEdges = true; // write RADJ chunk with the edges leading to each node
+            int nodeBoundsQuantizationBits = 4;
+
+            Settings() = default;
+        };
+
+        struct Node {
+            std::vector<Point> geometry; // at least one point
+            std::string name;
+            unsigned int weight = 0; // weight of traversing the whole node, in 1/10 seconds
+            unsigned char travelMode = 0;
+
+            Node() = default;
+        };
+
+        struct Edge {
+            std::uint32_t sourceNode = 0; // index returned by addNode
+            std::uint32_t targetNode = 0;
+            unsigned int weight = 0;
+            bool forward = false;
+            bool backward = false;
+            bool contracted = false;
+            std::uint32_t contractedNode = 0; // middle node of a shortcut edge
+            unsigned char turnInstruction = 0; // only stored for edges that are not contracted
+
+            Edge() = default;
+        };
+
+        // Copy of a border node in another package, given by its location there (see getNodeLocations)
+        struct NodeLink {
+            std::string packageName;
+            std::uint32_t blockIndex = 0;
+            std::uint32_t nodeIndex = 0;
+
+            NodeLink() = default;
+            explicit NodeLink(std::string packageName, std::uint32_t blockIndex, std::uint32_t nodeIndex) : packageName(std::move(packageName)), blockIndex(blockIndex), nodeIndex(nodeIndex) { }
+        };
+
+        struct Stats {
+            std::size_t nodeCount = 0;
+            std::size_t edgeCount = 0;
+            std::size_t externalEdgeCount = 0; // edges with target outside of the source node block
+            std::size_t globalNodeCount = 0; // nodes with copies in other packages
+            std::size_t geometryCount = 0; // after deduplication
+            std::size_t nameCount = 0;
+            std::size_t nodeBlockCount = 0;
+            std::size_t nodeChunkSize = 0;
+            std::size_t geometryChunkSize = 0;
+            std::size_t nameChunkSize = 0;
+            std::size_t globalNodeChunkSize = 0;
+            std::size_t rtreeChunkSize = 0;
+            std::size_t nodeBoundsChunkSize = 0;
+            std::size_t nodeLengthsChunkSize = 0;
+            std::size_t incomingEdgesChunkSize = 0;
+
+            Stats() = default;
+        };
+
+        explicit PackageBuilder(std::string packageName, const Settings& settings) : _packageName(std::move(packageName)), _settings(settings), _nodes(), _edges(), _nodeLinks(), _stats() { }
+
+        std::uint32_t addNode(Node node);
+        void addEdge(const Edge& edge);
+
+        // Edges and shortcuts leading to a linked node are written as global references. These resolve to the copy
+        // in the last linked package that is loaded, or to the node itself if none is.
+        void addNodeLink(std::uint32_t node, const NodeLink& link);
+
+        // Node block index and node index of each node in the written package, available once all nodes are added
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> getNodeLocations() const;
+
+        std::shared_ptr<eiff::form_chunk> build();
+        void write(std::ostream& os);
+
+        const Stats& getStats() const { return _stats; }
+
+    private:
+        struct Bounds {
+            Point min;
+            Point max;
+
+            Bounds() = default;
+            explicit Bounds(const Point& min, const Point& max) : min(min), max(max) { }
+        };
+
+        struct Layout {
+            std::vector<std::uint32_t> order; // node rank -> input node index
+            std::vector<std::uint32_t> ranks; // input node index -> node rank
+            std::vector<std::uint32_t> edgeOrder; // input edge indices, sorted by source node rank
+            std::vector<std::uint32_t> edgeOffsets; // first edge of each node rank in edgeOrder
+            std::vector<std::uint32_t> geometryIds; // by node rank
+            std::vector<bool> geometryReversed; // by node rank
+            std::vector<std::uint32_t> nameIds; // by node rank
+            std::unordered_map<std::uint32_t, std::uint32_t> globalNodeIndices; // input node index -> global node index, for linked nodes
+
+            Layout() = default;
+        };
+
+        struct RTreeNode {
+            bool leaf = false;
+            std::vector<std::pair<Bounds, std::uint32_t>> children; // node block index for leaves, r-tree node index otherwise
+
+            RTreeNode() = default;
+        };
+
+        std::vector<std::uint32_t> orderNodes() const;
+
+        std::vector<unsigned char> buildHeader(const Bounds& bbox) const;
+        std::vector<unsigned char> buildNodeBlock(const Layout& layout, std::uint32_t blockIndex);
+        std::vector<unsigned char> buildGeometryBlock(const std::vector<const std::vector<Point>*>& geometries) const;
+        std::vector<unsigned char> buildNameBlock(const std::vector<const std::string*>& names) const;
+        std::vector<unsigned char> buildGlobalNodeBlock(const std::vector<std::vector<NodeLink>>& globalNodeLinks) const;
+        std::vector<unsigned char> buildRTreeBlock(const std::vector<RTreeNode>& rtreeNodes, std::size_t first, std::size_t last) const;
+        std::vector<unsigned char> buildNodeBoundsBlock(const std::vector<Bounds>& nodeBounds) const;
+        std::vector<unsigned char> buildNodeLengthsBlock(const std::vector<double>& nodeLengths) const;
+        std::vector<unsigned char> buildIncomingEdgesBlock(const Layout& layout, const std::vector<std::uint32_t>& incomingEdgeOffsets, const std::vector<std::uint32_t>& incomingEdges, std::uint32_t blockIndex) const;
+
+        static std::shared_ptr<eiff::data_chunk> createBlockChunk(const eiff::chunk::tag_type& tag, const std::vector<std::vector<unsigned char>>& blocks);
+
+        static double getLength(const std::vector<Point>& geometry);
+
+        static Bounds getBounds(const std::vector<Point>& geometry);
+        static Bounds mergeBounds(const Bounds& bounds1, const Bounds& bounds2);
+
+        static std::pair<int, int> selectWeightBits(const std::vector<unsigned int>& weights);
+
+        static unsigned int zigzag(int value);
+
+        static int floorDiv(int value, int divisor);
+
+        static std::uint64_t getHilbertIndex(std::uint32_t x, std::uint32_t y);
+
+        const std::string _packageName;
+        const Settings _settings;
+        std::vector<Node> _nodes;
+        std::vector<Edge> _edges;
+        std::map<std::uint32_t, std::vector<NodeLink>> _nodeLinks;
+        Stats _stats;
+    };
+} }
+
+#endif
@@ -0,0 +1,396 @@
+#include "ReachabilityFinder.h"
+#include "SearchWorkspace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace Nuti { namespace Routing {
+    namespace {
+        // Adds the points of the geometry up to the given fraction of its length, the last point interpolated
+        void addGeometryPoints(const RoutingGraph::GeometryView& geometry, double fraction, std::vector<WGSPos>& points) {
+            if (geometry.empty()) {
+                return;
+            }
+            if (fraction >= 1) {
+                points.insert(points.end(), geometry.begin(), geometry.end());
+                return;
+            }
+
+            double totalLen = 0;
+            for (std::size_t i = 1; i < geometry.size(); i++) {
+                totalLen += RoutingGraph::getGreatCircleDistance(geometry[i - 1], geometry[i]);
+            }
+            double len = std::max(0.0, fraction) * totalLen;
+            points.push_back(geometry.front());
+            for (std::size_t i = 1; i < geometry.size(); i++) {
+                double segmentLen = RoutingGraph::getGreatCircleDistance(geometry[i - 1], geometry[i]);
+                if (segmentLen >= len) {
+                    if (segmentLen > 0) {
+                        points.push_back(geometry[i - 1] + (geometry[i] - geometry[i - 1]) * (len / segmentLen));
+                    }
+                    break;
+                }
+                points.push_back(geometry[i]);
+                len -= segmentLen;
+            }
+        }
+    }
+
+    void ReachabilityFinder::prepare() const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        getSweepIndices(_graph->getPackageInfos());
+    }
+
+    std::vector<ReachabilityFinder::ReachedNode> ReachabilityFinder::find(const std::vector<RoutingGraph::NearestNode>& sourceNodes, double maxTime) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        // Weights are in 1/10 s, as in RouteFinder
+        const float maxWeight = static_cast<float>(maxTime * 10.0);
+        std::vector<ReachedNode> reachedNodes;
+        if (sourceNodes.empty() || !(maxWeight >= 0)) {
+            return reachedNodes;
+        }
+
+        std::vector<RoutingGraph::PackageInfo> packageInfos = _graph->getPackageInfos();
+        std::vector<std::shared_ptr<const SweepIndex>> sweepIndices = getSweepIndices(packageInfos);
+        std::unordered_map<int, std::size_t> packageIndices;
+        for (std::size_t i = 0; i < packageInfos.size(); i++) {
+            packageIndices[packageInfos[i].packageId] = i;
+        }
+
+        // Upward search, the end point weights are calculated the same way as in RouteFinder. Nodes above maxWeight
+        // are not needed, as the downward edges only add weight.
+        static thread_local SearchSpace searchSpace;
+        searchSpace.clear();
+        for (const RoutingGraph::NearestNode& nearestNode : sourceNodes) {
+            RoutingGraph::NodePtr node = _graph->getNode(nearestNode.nodeId);
+            searchSpace.push(nearestNode.nodeId, RoutingGraph::NodeId(), -nearestNode.geometryRelPos * node->nodeData.weight);
+        }
+        std::unordered_map<RoutingGraph::NodeId, float, RoutingGraph::NodeId::Hash> upwardWeights;
+        while (!searchSpace.empty() && searchSpace.top().weight <= maxWeight) {
+            const SearchSpace::Entry& searchNode = searchSpace.pop();
+            RoutingGraph::NodeId nodeId = searchNode.nodeId;
+            float nodeWeight = searchNode.weight;
+
+            // Stall-on-demand, same as in RouteFinder. Stalled nodes get their weights from the sweep
+            RoutingGraph::NodePtr node = _graph->getNode(nodeId);
+            const RoutingGraph::NodeBlock& nodeBlock = node.block();
+            bool stall = false;
+            for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+                if (nodeBlock.edgeFlags[edgeIndex] & RoutingGraph::NodeBlock::BACKWARD_FLAG) {
+                    const SearchSpace::Entry* entry = searchSpace.find(nodeBlock.getEdgeTargetNodeId(edgeIndex));
+                    if (entry && entry->weight + nodeBlock.edgeWeights[edgeIndex] < nodeWeight) {
+                        stall = true;
+                        break;
+                    }
+                }
+            }
+            if (stall) {
+                continue;
+            }
+
+            upwardWeights.emplace(nodeId, nodeWeight);
+
+            for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+                if (nodeBlock.edgeFlags[edgeIndex] & RoutingGraph::NodeBlock::FORWARD_FLAG) {
+                    RoutingGraph::NodeId targetNodeId = nodeBlock.getEdgeTargetNodeId(edgeIndex);
+                    if (targetNodeId.valid()) {
+                        searchSpace.push(targetNodeId, nodeId, nodeWeight + nodeBlock.edgeWeights[edgeIndex]);
+                    }
+                }
+            }
+        }
+
+        // Seed the sweeps with the upward search weights. Weights of all packages are kept in a single buffer, reused between queries.
+        static thread_local std::vector<float> weights;
+        std::vector<std::size_t> weightOffsets(sweepIndices.size() + 1, 0);
+        for (std::size_t i = 0; i < sweepIndices.size(); i++) {
+            weightOffsets[i + 1] = weightOffsets[i] + sweepIndices[i]->nodeIds.size();
+        }
+        weights.assign(weightOffsets.back(), std::numeric_limits<float>::infinity());
+        std::vector<bool> seeded(sweepIndices.size(), false);
+        for (const std::pair<const RoutingGraph::NodeId, float>& upwardWeight : upwardWeights) {
+            auto it = packageIndices.find(upwardWeight.first.packageId());
+            if (it != packageIndices.end() && sweepIndices[it->second]->contracted) {
+                weights[weightOffsets[it->second] + sweepIndices[it->second]->getSweepPosition(upwardWeight.first)] = upwardWeight.second;
+                seeded[it->second] = true;
+            }
+            else if (upwardWeight.second <= maxWeight) {
+                // No hierarchy in the package, the upward search was a plain Dijkstra search there
+                reachedNodes.emplace_back(upwardWeight.first, std::max(0.0f, upwardWeight.second) / 10.0f);
+            }
+        }
+
+        // Downward sweeps, one package at a time. Edges from other packages use the weights of the packages swept before and
+        // the upward search weights, so paths that leave a package and enter it again are found only in package order.
+        std::vector<float> externalWeights;
+        for (std::size_t i = 0; i < sweepIndices.size(); i++) {
+            const SweepIndex& index = *sweepIndices[i];
+            if (!index.contracted) {
+                continue;
+            }
+
+            externalWeights.clear();
+            bool reachable = seeded[i];
+            for (RoutingGraph::NodeId externalNodeId : index.externalNodeIds) {
+                float externalWeight = std::numeric_limits<float>::infinity();
+                auto it = packageIndices.find(externalNodeId.packageId());
+                if (it != packageIndices.end() && it->second < i && sweepIndices[it->second]->contracted) {
+                    externalWeight = weights[weightOffsets[it->second] + sweepIndices[it->second]->getSweepPosition(externalNodeId)];
+                }
+                else {
+                    auto it2 = upwardWeights.find(externalNodeId);
+                    if (it2 != upwardWeights.end()) {
+                        externalWeight = it2->second;
+                    }
+                }
+                externalWeights.push_back(externalWeight);
+                reachable = reachable || externalWeight <= maxWeight;
+            }
+            if (!reachable) {
+                continue;
+            }
+
+            float* packageWeights = weights.data() + weightOffsets[i];
+            for (std::uint32_t pos = 0; pos < index.nodeIds.size(); pos++) {
+                float weight = packageWeights[pos];
+                for (std::uint32_t edgeIndex = index.edgeOffsets[pos]; edgeIndex != index.edgeOffsets[pos + 1]; edgeIndex++) {
+                    std::uint32_t source = index.edgeSources[edgeIndex];
+                    float sourceWeight = (source & SweepIndex::EXTERNAL_SOURCE_FLAG ? externalWeights[source & ~SweepIndex::EXTERNAL_SOURCE_FLAG] : packageWeights[source]);
+                    weight = std::min(weight, sourceWeight + index.edgeWeights[edgeIndex]);
+                }
+                packageWeights[pos] = weight;
+                if (weight <= maxWeight) {
+                    reachedNodes.emplace_back(index.nodeIds[pos], std::max(0.0f, weight) / 10.0f);
+                }
+            }
+        }
+
+        std::sort(reachedNodes.begin(), reachedNodes.end(), [](const ReachedNode& reachedNode1, const ReachedNode& reachedNode2) {
+            return reachedNode1.time < reachedNode2.time;
+        });
+        return reachedNodes;
+    }
+
+    std::vector<ReachabilityFinder::Isochrone> ReachabilityFinder::findIsochrones(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<double>& times) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        std::vector<Isochrone> isochrones;
+        if (times.empty()) {
+            return isochrones;
+        }
+        std::vector<ReachedNode> reachedNodes = find(sourceNodes, *std::max_element(times.begin(), times.end()));
+
+        // Nodes are ordered by time, so each isochrone covers a prefix of the reached nodes. The last node of the prefix is
+        // included only up to the point reached within the time.
+        for (double time : times) {
+            std::vector<WGSPos> points;
+            for (const ReachedNode& reachedNode : reachedNodes) {
+                if (reachedNode.time > time) {
+                    break;
+                }
+                RoutingGraph::NodePtr node = _graph->getNode(reachedNode.nodeId);
+                double nodeTime = node->nodeData.weight / 10.0;
+                addGeometryPoints(_graph->getNodeGeometryView(*node), nodeTime > 0 ? (time - reachedNode.time) / nodeTime : 1.0, points);
+            }
+
+            Isochrone isochrone;
+            isochrone.time = time;
+            isochrone.polygon = getConvexHull(std::move(points));
+            isochrones.push_back(std::move(isochrone));
+        }
+        return isochrones;
+    }
+
+    std::vector<std::shared_ptr<const ReachabilityFinder::SweepIndex>> ReachabilityFinder::getSweepIndices(const std::vector<RoutingGraph::PackageInfo>& packageInfos) const {
+        {
+            // Drop the indices of unloaded packages. Replaced packages are rebuilt below, as their generation differs.
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = _sweepIndices.begin(); it != _sweepIndices.end(); ) {
+                bool loaded = std::any_of(packageInfos.begin(), packageInfos.end(), [&it](const RoutingGraph::PackageInfo& packageInfo) {
+                    return packageInfo.packageId == it->first;
+                });
+                it = (loaded ? std::next(it) : _sweepIndices.erase(it));
+            }
+        }
+
+        std::vector<std::shared_ptr<const SweepIndex>> sweepIndices;
+        for (const RoutingGraph::PackageInfo& packageInfo : packageInfos) {
+            std::shared_ptr<const SweepIndex> sweepIndex;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _sweepIndices.find(packageInfo.packageId);
+                if (it != _sweepIndices.end() && it->second->generation == packageInfo.generation) {
+                    sweepIndex = it->second;
+                }
+            }
+
+            // Build without holding the lock, concurrent builds of the same package produce equal indices
+            if (!sweepIndex) {
+                sweepIndex = buildSweepIndex(packageInfo);
+                std::lock_guard<std::mutex> lock(_mutex);
+                _sweepIndices[packageInfo.packageId] = sweepIndex;
+            }
+            sweepIndices.push_back(std::move(sweepIndex));
+        }
+        return sweepIndices;
+    }
+
+    std::shared_ptr<const ReachabilityFinder::SweepIndex> ReachabilityFinder::buildSweepIndex(const RoutingGraph::PackageInfo& packageInfo) const {
+        auto sweepIndex = std::make_shared<SweepIndex>();
+        sweepIndex->generation = packageInfo.generation;
+
+        // Read the downward edges of all nodes in block order. Downward edges are stored at their lower end point, as edges
+        // usable by the backward search.
+        std::vector<RoutingGraph::NodeId> nodeIds;
+        std::vector<std::uint32_t> edgeOffsets(1, 0);
+        std::vector<RoutingGraph::NodeId> edgeSourceIds;
+        std::vector<std::uint32_t> edgeWeights;
+        std::vector<std::uint32_t>& blockOffsets = sweepIndex->blockOffsets;
+        for (int blockIndex = 0; blockIndex < packageInfo.nodeBlockCount; blockIndex++) {
+            RoutingGraph::NodePtr firstNode = _graph->getNode(RoutingGraph::NodeId(RoutingGraph::BlockId(packageInfo.packageId, blockIndex), 0));
+            const RoutingGraph::NodeBlock& nodeBlock = firstNode.block();
+            blockOffsets.push_back(static_cast<std::uint32_t>(nodeIds.size()));
+            for (std::size_t nodeIndex = 0; nodeIndex < nodeBlock.nodes.size(); nodeIndex++) {
+                const RoutingGraph::Node& node = nodeBlock.nodes[nodeIndex];
+                nodeIds.emplace_back(nodeBlock.blockId, static_cast<int>(nodeIndex));
+                for (std::uint32_t edgeIndex = node.firstEdge; edgeIndex != node.lastEdge; edgeIndex++) {
+                    if (nodeBlock.edgeFlags[edgeIndex] & RoutingGraph::NodeBlock::BACKWARD_FLAG) {
+                        RoutingGraph::NodeId sourceNodeId = nodeBlock.getEdgeTargetNodeId(edgeIndex);
+                        if (sourceNodeId.valid()) {
+                            edgeSourceIds.push_back(sourceNodeId);
+                            edgeWeights.push_back(nodeBlock.edgeWeights[edgeIndex]);
+                        }
+                    }
+                }
+                edgeOffsets.push_back(static_cast<std::uint32_t>(edgeSourceIds.size()));
+            }
+        }
+        blockOffsets.push_back(static_cast<std::uint32_t>(nodeIds.size()));
+
+        auto getOrdinal = [&blockOffsets, &packageInfo](RoutingGraph::NodeId nodeId) -> std::uint32_t {
+            if (nodeId.packageId() != packageInfo.packageId) {
+                return SweepIndex::EXTERNAL_SOURCE_FLAG;
+            }
+            return blockOffsets[nodeId.blockIndex()] + nodeId.elementIndex();
+        };
+
+        // Level order: a node comes after all higher end points of its downward edges. Nodes of the same level are kept in
+        // block order. Nodes left over belong to cycles, the package has no hierarchy then.
+        const std::uint32_t nodeCount = static_cast<std::uint32_t>(nodeIds.size());
+        std::vector<std::uint32_t> dependencyCounts(nodeCount, 0);
+        std::vector<std::uint32_t> dependentOffsets(nodeCount + 1, 0);
+        for (std::uint32_t ordinal = 0; ordinal < nodeCount; ordinal++) {
+            for (std::uint32_t edgeIndex = edgeOffsets[ordinal]; edgeIndex != edgeOffsets[ordinal + 1]; edgeIndex++) {
+                std::uint32_t sourceOrdinal = getOrdinal(edgeSourceIds[edgeIndex]);
+                if (sourceOrdinal != SweepIndex::EXTERNAL_SOURCE_FLAG) {
+                    dependencyCounts[ordinal]++;
+                    dependentOffsets[sourceOrdinal + 1]++;
+                }
+            }
+        }
+        for (std::uint32_t ordinal = 0; ordinal < nodeCount; ordinal++) {
+            dependentOffsets[ordinal + 1] += dependentOffsets[ordinal];
+        }
+        std::vector<std::uint32_t> dependents(dependentOffsets.back());
+        std::vector<std::uint32_t> dependentCounts(nodeCount, 0);
+        for (std::uint32_t ordinal = 0; ordinal < nodeCount; ordinal++) {
+            for (std::uint32_t edgeIndex = edgeOffsets[ordinal]; edgeIndex != edgeOffsets[ordinal + 1]; edgeIndex++) {
+                std::uint32_t sourceOrdinal = getOrdinal(edgeSourceIds[edgeIndex]);
+                if (sourceOrdinal != SweepIndex::EXTERNAL_SOURCE_FLAG) {
+                    dependents[dependentOffsets[sourceOrdinal] + dependentCounts[sourceOrdinal]++] = ordinal;
+                }
+            }
+        }
+
+        std::vector<std::uint32_t> sweepOrder;
+        sweepOrder.reserve(nodeCount);
+        for (std::uint32_t ordinal = 0; ordinal < nodeCount; ordinal++) {
+            if (dependencyCounts[ordinal] == 0) {
+                sweepOrder.push_back(ordinal);
+            }
+        }
+        for (std::size_t levelBegin = 0; levelBegin < sweepOrder.size(); ) {
+            std::size_t levelEnd = sweepOrder.size();
+            for (std::size_t i = levelBegin; i < levelEnd; i++) {
+                std::uint32_t ordinal = sweepOrder[i];
+                for (std::uint32_t j = dependentOffsets[ordinal]; j != dependentOffsets[ordinal + 1]; j++) {
+                    if (--dependencyCounts[dependents[j]] == 0) {
+                        sweepOrder.push_back(dependents[j]);
+                    }
+                }
+            }
+            std::sort(sweepOrder.begin() + levelEnd, sweepOrder.end());
+            levelBegin = levelEnd;
+        }
+        if (sweepOrder.size() != nodeCount) {
+            sweepIndex->contracted = false;
+            sweepIndex->blockOffsets.clear();
+            return sweepIndex;
+        }
+
+        // Store the edges in sweep order, with sources as sweep positions
+        sweepIndex->sweepPositions.resize(nodeCount);
+        for (std::uint32_t pos = 0; pos < nodeCount; pos++) {
+            sweepIndex->sweepPositions[sweepOrder[pos]] = pos;
+        }
+        std::unordered_map<RoutingGraph::NodeId, std::uint32_t, RoutingGraph::NodeId::Hash> externalIndices;
+        sweepIndex->nodeIds.reserve(nodeCount);
+        sweepIndex->edgeOffsets.reserve(nodeCount + 1);
+        sweepIndex->edgeOffsets.push_back(0);
+        for (std::uint32_t ordinal : sweepOrder) {
+            sweepIndex->nodeIds.push_back(nodeIds[ordinal]);
+            for (std::uint32_t edgeIndex = edgeOffsets[ordinal]; edgeIndex != edgeOffsets[ordinal + 1]; edgeIndex++) {
+                std::uint32_t sourceOrdinal = getOrdinal(edgeSourceIds[edgeIndex]);
+                if (sourceOrdinal != SweepIndex::EXTERNAL_SOURCE_FLAG) {
+                    sweepIndex->edgeSources.push_back(sweepIndex->sweepPositions[sourceOrdinal]);
+                }
+                else {
+                    auto it = externalIndices.emplace(edgeSourceIds[edgeIndex], static_cast<std::uint32_t>(sweepIndex->externalNodeIds.size())).first;
+                    if (it->second == sweepIndex->externalNodeIds.size()) {
+                        sweepIndex->externalNodeIds.push_back(edgeSourceIds[edgeIndex]);
+                    }
+                    sweepIndex->edgeSources.push_back(it->second | SweepIndex::EXTERNAL_SOURCE_FLAG);
+                }
+                sweepIndex->edgeWeights.push_back(edgeWeights[edgeIndex]);
+            }
+            sweepIndex->edgeOffsets.push_back(static_cast<std::uint32_t>(sweepIndex->edgeSources.size()));
+        }
+        return sweepIndex;
+    }
+
+    std::vector<WGSPos> ReachabilityFinder::getConvexHull(std::vector<WGSPos> points) {
+        // Andrew's monotone chain, with longitude as x and latitude as y
+        auto cross = [](const WGSPos& o, const WGSPos& a, const WGSPos& b) {
+            return (a(1) - o(1)) * (b(0) - o(0)) - (a(0) - o(0)) * (b(1) - o(1));
+        };
+        std::sort(points.begin(), points.end(), [](const WGSPos& pos1, const WGSPos& pos2) {
+            return pos1(1) < pos2(1) || (pos1(1) == pos2(1) && pos1(0) < pos2(0));
+        });
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+        if (points.size() < 3) {
+            return points;
+        }
+
+        std::vector<WGSPos> hull(2 * points.size());
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < points.size(); i++) {
+            while (size >= 2 && cross(hull[size - 2], hull[size - 1], points[i]) <= 0) {
+                size--;
+            }
+            hull[size++] = points[i];
+        }
+        for (std::size_t i = points.size() - 1, lowerSize = size + 1; i-- > 0; ) {
+            while (size >= lowerSize && cross(hull[size - 2], hull[size - 1], points[i]) <= 0) {
+                size--;
+            }
+            hull[size++] = points[i];
+        }
+        hull.resize(size - 1);
+        return hull;
+    }
+} }
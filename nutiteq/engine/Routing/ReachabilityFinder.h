@@ -0,0 +1,84 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_REACHABILITYFINDER_H_
+#define _NUTI_ROUTING_REACHABILITYFINDER_H_
+
+#include "RoutingObjects.h"
+#include "RoutingGraph.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Nuti { namespace Routing {
+    // One-to-all travel times using PHAST: an upward CH search from the source, followed by a single downward sweep
+    // over all nodes in level order. The sweep runs over a per-package index of the downward edges, built once from
+    // the node blocks, so it is a linear pass over flat arrays instead of block accesses in search order.
+    class ReachabilityFinder {
+    public:
+        struct ReachedNode {
+            RoutingGraph::NodeId nodeId;
+            float time = 0.0f; // seconds until the start of the node is reached
+
+            ReachedNode() = default;
+            explicit ReachedNode(RoutingGraph::NodeId nodeId, float time) : nodeId(nodeId), time(time) { }
+        };
+
+        struct Isochrone {
+            double time = 0; // threshold in seconds
+            std::vector<WGSPos> polygon; // convex hull of the road geometry reachable within the time, counterclockwise, empty if nothing is reachable
+
+            Isochrone() = default;
+        };
+
+        explicit ReachabilityFinder(std::shared_ptr<RoutingGraph> graph) : _graph(std::move(graph)) { }
+
+        // Build the sweep indices of all loaded packages. Optional, a missing index is built by the first query needing it
+        void prepare() const;
+
+        // Nodes reachable from the snapped source within maxTime seconds, ordered by time
+        std::vector<ReachedNode> find(const std::vector<RoutingGraph::NearestNode>& sourceNodes, double maxTime) const;
+
+        // Reachable areas for the given time thresholds (in seconds), in the order of the thresholds. All areas come from a single sweep.
+        std::vector<Isochrone> findIsochrones(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<double>& times) const;
+
+    private:
+        // Downward edges of a package in sweep order. Nodes are sorted so that the higher end point of each downward edge
+        // comes first, and each node lists the edges from higher nodes into it.
+        struct SweepIndex {
+            enum : std::uint32_t { EXTERNAL_SOURCE_FLAG = 0x80000000U };
+
+            std::uint64_t generation = 0; // of the package
+            bool contracted = true; // false if the edges do not form a hierarchy, the upward search then covers the package alone
+            std::vector<RoutingGraph::NodeId> nodeIds; // in sweep order
+            std::vector<std::uint32_t> edgeOffsets; // first edge of each node in sweep order, followed by the edge count
+            std::vector<std::uint32_t> edgeSources; // sweep positions of the higher nodes, or indices into externalNodeIds if EXTERNAL_SOURCE_FLAG is set
+            std::vector<std::uint32_t> edgeWeights;
+            std::vector<RoutingGraph::NodeId> externalNodeIds; // higher nodes in other packages
+            std::vector<std::uint32_t> blockOffsets; // ordinal of the first node of each node block, followed by the node count
+            std::vector<std::uint32_t> sweepPositions; // by node ordinal
+
+            SweepIndex() = default;
+
+            std::uint32_t getSweepPosition(RoutingGraph::NodeId nodeId) const { return sweepPositions[blockOffsets[nodeId.blockIndex()] + nodeId.elementIndex()]; }
+        };
+
+        std::vector<std::shared_ptr<const SweepIndex>> getSweepIndices(const std::vector<RoutingGraph::PackageInfo>& packageInfos) const;
+
+        std::shared_ptr<const SweepIndex> buildSweepIndex(const RoutingGraph::PackageInfo& packageInfo) const;
+
+        static std::vector<WGSPos> getConvexHull(std::vector<WGSPos> points);
+
+        const std::shared_ptr<RoutingGraph> _graph;
+        mutable std::mutex _mutex;
+        mutable std::unordered_map<int, std::shared_ptr<const SweepIndex>> _sweepIndices; // by package id, indices of unloaded packages are dropped on the next query
+    };
+} }
+
+#endif
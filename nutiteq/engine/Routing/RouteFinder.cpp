@@ -1,18 +1,264 @@
 #include "RouteFinder.h"
+#include "SearchWorkspace.h"
+#include "RoutingStats.h"
+
+#include <algorithm>
+#include <unordered_set>
 
 namespace Nuti { namespace Routing {
+    namespace {
+        SearchWorkspace& getThreadWorkspace() {
+            // Search state is reused between queries of the same thread, to avoid allocations while searching
+            static thread_local SearchWorkspace workspace;
+            return workspace;
+        }
+    }
+
+    RouteFinder::RouteFinder(std::shared_ptr<RoutingGraph> graph, const Settings& settings) :
+        _graph(std::move(graph)),
+        _settings(settings),
+        _unpackCache(settings.unpackCacheSize, settings.unpackCacheMemoryBudget > 0 ? std::make_shared<cache::memory_budget>(settings.unpackCacheMemoryBudget) : std::shared_ptr<cache::memory_budget>(), [](const std::shared_ptr<const UnpackedShortcut>& shortcut) { return sizeof(UnpackedShortcut) + shortcut->path.capacity() * sizeof(PathNode); })
+    {
+    }
+
     RoutingResult RouteFinder::find(const RoutingQuery& query) const {
-        std::array<std::vector<RoutingGraph::NearestNode>, 2> nearestNodes;
-        std::array<std::priority_queue<SearchNode>, 2> heaps;
-        std::unordered_map<RoutingGraph::NodeId, PathNode, RoutingGraph::NodeId::Hash> pathSuffixMap;
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        // Let the prefetcher load the neighbourhood of the target while the source is being snapped
+        _graph->prefetchNearbyNodeBlocks(query.getPos(1));
+        _graph->prefetchNearbyNodeBlocks(query.getPos(0));
+
+        std::vector<RoutingGraph::NearestNode> sourceNodes = _graph->findNearestNode(query.getPos(0));
+        if (sourceNodes.empty()) {
+            return RoutingResult();
+        }
+        std::vector<RoutingGraph::NearestNode> targetNodes = _graph->findNearestNode(query.getPos(1));
+        return find(sourceNodes, targetNodes);
+    }
+
+    RoutingResult RouteFinder::find(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        std::vector<PathNode> path;
+        if (!findPath(sourceNodes, targetNodes, path)) {
+            return RoutingResult();
+        }
+
+        return buildResult(path, sourceNodes, targetNodes);
+    }
+
+    RoutingSummary RouteFinder::findSummary(const RoutingQuery& query) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        _graph->prefetchNearbyNodeBlocks(query.getPos(1));
+        _graph->prefetchNearbyNodeBlocks(query.getPos(0));
+
+        std::vector<RoutingGraph::NearestNode> sourceNodes = _graph->findNearestNode(query.getPos(0));
+        if (sourceNodes.empty()) {
+            return RoutingSummary();
+        }
+        std::vector<RoutingGraph::NearestNode> targetNodes = _graph->findNearestNode(query.getPos(1));
+        return findSummary(sourceNodes, targetNodes);
+    }
+
+    RoutingSummary RouteFinder::findSummary(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        std::vector<PathNode> path;
+        if (!findPath(sourceNodes, targetNodes, path)) {
+            return RoutingSummary();
+        }
+
+        // Same totals as the instructions of find, but names are not needed and only the end point geometries are decoded, for partial lengths
+        double weight = 0;
+        double distance = 0;
+        for (std::size_t j = 0; j < path.size(); j++) {
+            RoutingGraph::NodeId nodeId = path[j].nextNodeId;
+            const RoutingGraph::NearestNode* firstNearestNode = (j == 0 ? getNearestNode(sourceNodes, nodeId) : nullptr);
+            const RoutingGraph::NearestNode* lastNearestNode = (j == path.size() - 1 ? getNearestNode(targetNodes, nodeId) : nullptr);
+            std::pair<float, float> geometryRelPos(firstNearestNode ? firstNearestNode->geometryRelPos : 0.0f, lastNearestNode ? lastNearestNode->geometryRelPos : 1.0f);
+
+            if (firstNearestNode || lastNearestNode) {
+                RoutingGraph::NodePtr node = _graph->getNode(nodeId);
+                distance += calculateGeometryLength(_graph->getNodeGeometryView(*node), geometryRelPos.first, geometryRelPos.second);
+            }
+            else {
+                distance += _graph->getNodeLength(nodeId);
+            }
+            unsigned int nodeWeight = (j > 0 ? path[j].edge.edgeData.weight : _graph->getNode(nodeId)->nodeData.weight);
+            weight += nodeWeight * (geometryRelPos.second - geometryRelPos.first);
+        }
+
+        return RoutingSummary(weight, distance, weight / 10.0);
+    }
+
+    std::vector<RoutingResult> RouteFinder::findAlternatives(const RoutingQuery& query, unsigned int maxAlternatives) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        _graph->prefetchNearbyNodeBlocks(query.getPos(1));
+        _graph->prefetchNearbyNodeBlocks(query.getPos(0));
+
+        std::vector<RoutingGraph::NearestNode> sourceNodes = _graph->findNearestNode(query.getPos(0));
+        if (sourceNodes.empty()) {
+            return std::vector<RoutingResult> { RoutingResult() };
+        }
+        std::vector<RoutingGraph::NearestNode> targetNodes = _graph->findNearestNode(query.getPos(1));
+        return findAlternatives(sourceNodes, targetNodes, maxAlternatives);
+    }
+
+    std::vector<RoutingResult> RouteFinder::findAlternatives(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, unsigned int maxAlternatives) const {
+        RoutingGraph::Snapshot snapshot(*_graph);
+
+        // The alternatives come from the same search as the shortest route, the search only continues further
+        SearchWorkspace& workspace = getThreadWorkspace();
+        std::vector<PathNode> pathSuffixes;
+        float bestWeight = 0;
+        RoutingGraph::NodeId bestNodeId = search(sourceNodes, targetNodes, static_cast<float>(_settings.alternativeMaxStretch), workspace, pathSuffixes, bestWeight);
+        std::vector<PathNode> path;
+        if (!bestNodeId.valid() || !unpackPath(workspace, bestNodeId, pathSuffixes, path)) {
+            return std::vector<RoutingResult> { RoutingResult() };
+        }
+
+        std::vector<RoutingResult> results;
+        results.push_back(buildResult(path, sourceNodes, targetNodes));
+        if (maxAlternatives == 0) {
+            return results;
+        }
+
+        // Check the sharing of the unpacked routes, as the estimates from packed paths may be too low
+        std::unordered_set<RoutingGraph::NodeId, RoutingGraph::NodeId::Hash> routeNodeIds;
+        for (const PathNode& pathNode : path) {
+            routeNodeIds.insert(pathNode.nextNodeId);
+        }
+        for (RoutingGraph::NodeId viaNodeId : selectViaNodes(workspace, bestNodeId, bestWeight, maxAlternatives)) {
+            if (!unpackPath(workspace, viaNodeId, pathSuffixes, path)) {
+                continue;
+            }
+            float weight = 0;
+            float sharedWeight = 0;
+            for (std::size_t j = 1; j < path.size(); j++) {
+                weight += path[j].edge.edgeData.weight;
+                sharedWeight += (routeNodeIds.count(path[j].nextNodeId) > 0 ? path[j].edge.edgeData.weight : 0);
+            }
+            if (sharedWeight > weight * _settings.alternativeMaxSharing) {
+                continue;
+            }
+            for (const PathNode& pathNode : path) {
+                routeNodeIds.insert(pathNode.nextNodeId);
+            }
+            results.push_back(buildResult(path, sourceNodes, targetNodes));
+        }
+        return results;
+    }
+
+    RoutingResult RouteFinder::buildResult(const std::vector<PathNode>& path, const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const {
+        const std::array<const std::vector<RoutingGraph::NearestNode>*, 2> nearestNodes {{ &sourceNodes, &targetNodes }};
+
+        // Construct query result
+        std::vector<RoutingInstruction> instructions;
+        std::vector<WGSPos> routeVertices;
+        for (std::size_t j = 0; j < path.size(); j++) {
+            RoutingGraph::NodeId nodeId = path[j].nextNodeId;
+            RoutingGraph::NodePtr node = _graph->getNode(nodeId);
+            
+            RoutingGraph::GeometryView geometry = _graph->getNodeGeometryView(*node);
+            std::pair<std::size_t, std::size_t> geometryIndex(0, geometry.size());
+            std::pair<float, float> geometryRelPos(0.0f, 1.0f);
+            // Segment indices are the indices of the segment end vertices, valid values are 1..size-1
+            auto clampSegmentIndex = [&geometry](unsigned int segmentIndex) {
+                if (geometry.size() < 2) {
+                    return static_cast<std::size_t>(0);
+                }
+                return std::max(static_cast<std::size_t>(1), std::min(static_cast<std::size_t>(segmentIndex), geometry.size() - 1));
+            };
+
+            std::size_t firstNNIndex = std::numeric_limits<std::size_t>::max();
+            if (j == 0) {
+                for (std::size_t k = 0; k < nearestNodes[0]->size(); k++) {
+                    if ((*nearestNodes[0])[k].nodeId == nodeId) {
+                        geometryIndex.first = clampSegmentIndex((*nearestNodes[0])[k].geometrySegmentIndex);
+                        geometryRelPos.first = (*nearestNodes[0])[k].geometryRelPos;
+                        firstNNIndex = k;
+                        break;
+                    }
+                }
+            }
+
+            std::size_t lastNNIndex = std::numeric_limits<std::size_t>::max();
+            if (j == path.size() - 1) {
+                for (std::size_t k = 0; k < nearestNodes[1]->size(); k++) {
+                    if ((*nearestNodes[1])[k].nodeId == nodeId) {
+                        geometryIndex.second = clampSegmentIndex((*nearestNodes[1])[k].geometrySegmentIndex);
+                        geometryRelPos.second = (*nearestNodes[1])[k].geometryRelPos;
+                        lastNNIndex = k;
+                        break;
+                    }
+                }
+            }
+
+            double dist = calculateGeometryLength(geometry, geometryRelPos.first, geometryRelPos.second);
+            double time = (j > 0 ? path[j].edge.edgeData.weight : node->nodeData.weight) * (geometryRelPos.second - geometryRelPos.first) / 10.0;
+            std::string streetName = _graph->getNodeNameView(*node).str();
+
+            // Initial route instruction/vertex
+            if (firstNNIndex != std::numeric_limits<std::size_t>::max()) {
+                instructions.emplace_back(RoutingInstruction::Type::HEAD_ON, RoutingInstruction::TravelMode::DEFAULT, streetName, dist, time, routeVertices.size());
+                routeVertices.push_back((*nearestNodes[0])[firstNNIndex].nodePos);
+            }
+            
+            // Middle instructions/vertices
+            if (!routeVertices.empty() && geometryIndex.first < geometryIndex.second) {
+                if (routeVertices.back() == geometry[geometryIndex.first]) {
+                    routeVertices.pop_back();
+                }
+            }
+            std::size_t vertexIndex = routeVertices.size();
+            for (std::size_t k = geometryIndex.first; k < geometryIndex.second; k++) {
+                routeVertices.push_back(geometry[k]);
+            }
+            if (j > 0) {
+                RoutingInstruction::Type type = static_cast<RoutingInstruction::Type>(path[j].edge.edgeData.turnInstruction);
+                RoutingInstruction::TravelMode travelMode = static_cast<RoutingInstruction::TravelMode>(node->nodeData.travelMode);
+                instructions.emplace_back(type, travelMode, streetName, dist, time, vertexIndex);
+            }
+
+            // Final instruction/vertex
+            if (lastNNIndex != std::numeric_limits<std::size_t>::max()) {
+                instructions.emplace_back(RoutingInstruction::Type::REACHED_YOUR_DESTINATION, RoutingInstruction::TravelMode::DEFAULT, "", 0, 0, routeVertices.size());
+                routeVertices.push_back((*nearestNodes[1])[lastNNIndex].nodePos);
+            }
+        }
+
+        return RoutingResult(std::move(instructions), std::move(routeVertices));
+    }
+
+    bool RouteFinder::findPath(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, std::vector<PathNode>& path) const {
+        SearchWorkspace& workspace = getThreadWorkspace();
+        std::vector<PathNode> pathSuffixes;
+        float bestWeight = 0;
+        RoutingGraph::NodeId bestNodeId = search(sourceNodes, targetNodes, 0.0f, workspace, pathSuffixes, bestWeight);
+        if (!bestNodeId.valid()) {
+            return false;
+        }
+        return unpackPath(workspace, bestNodeId, pathSuffixes, path);
+    }
+
+    RoutingGraph::NodeId RouteFinder::search(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, float maxStretch, SearchWorkspace& workspace, std::vector<PathNode>& pathSuffixes, float& bestWeight) const {
+        workspace.clear();
+        RoutingStats* stats = RoutingStatsCollector::current();
+        if (stats) {
+            stats->routes++;
+        }
+        std::array<SearchSpace, 2>& searchSpaces = workspace.searchSpaces;
+
+        const std::array<const std::vector<RoutingGraph::NearestNode>*, 2> nearestNodes {{ &sourceNodes, &targetNodes }};
         float minWeight = 0.0f;
         for (int i = 0; i < 2; i++) {
-            nearestNodes[i] = _graph->findNearestNode(query.getPos(i));
-            if (nearestNodes[i].empty()) {
-                return RoutingResult();
+            if (nearestNodes[i]->empty()) {
+                return RoutingGraph::NodeId();
             }
 
-            for (const RoutingGraph::NearestNode& nearestNode : nearestNodes[i]) {
+            for (const RoutingGraph::NearestNode& nearestNode : *nearestNodes[i]) {
                 RoutingGraph::NodePtr node = _graph->getNode(nearestNode.nodeId);
 
                 // Calculate end-point weights
@@ -20,283 +266,401 @@ namespace Nuti { namespace Routing {
                 minWeight = std::min(minWeight, weight);
 
                 // Special case: we have already added same node but the node is inaccessible along the current direction
-                if (i == 1 && nearestNodes[0].size() == 1 && nearestNodes[1].size() == 1) {
-                    const RoutingGraph::NearestNode& otherNearestNode = nearestNodes[1 - i][0];
+                if (i == 1 && nearestNodes[0]->size() == 1 && nearestNodes[1]->size() == 1) {
+                    const RoutingGraph::NearestNode& otherNearestNode = (*nearestNodes[1 - i])[0];
                     if (nearestNode.nodeId == otherNearestNode.nodeId && nearestNode.geometryRelPos < otherNearestNode.geometryRelPos) {
                         // Add all backward edges "leading" to current node
-                        for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
-                            if (edge->backward) {
-                                heaps[i].emplace(edge->targetNodeId, RoutingGraph::NodeId(), weight + edge->edgeData.weight);
-                                pathSuffixMap[edge->targetNodeId] = PathNode(edge->targetNodeId, *edge, nearestNode.nodeId);
+                        const RoutingGraph::NodeBlock& nodeBlock = node.block();
+                        for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+                            if (nodeBlock.edgeFlags[edgeIndex] & RoutingGraph::NodeBlock::BACKWARD_FLAG) {
+                                RoutingGraph::Edge edge = nodeBlock.getEdge(edgeIndex);
+                                if (edge.targetNodeId.valid() && searchSpaces[i].push(edge.targetNodeId, RoutingGraph::NodeId(), weight + edge.edgeData.weight)) {
+                                    if (stats) {
+                                        stats->heapPushes++;
+                                    }
+                                    addPathSuffix(pathSuffixes, PathNode(edge.targetNodeId, edge, nearestNode.nodeId));
+                                }
                             }
                         }
 
-                        // Here comes the tricky part: we must perform another spatial query to find INCOMING edges pointing to current edge
-                        std::vector<WGSPos> geometry = _graph->getNodeGeometry(*node);
-                        std::vector<RoutingGraph::NearestNode> nearestNodes2 = _graph->findNearestNode(geometry.front());
-                        for (const RoutingGraph::NearestNode& nearestNode2 : nearestNodes2) {
-                            RoutingGraph::NodePtr node2 = _graph->getNode(nearestNode2.nodeId);
-                            for (auto edge2 = node2->firstEdge; edge2 != node2->lastEdge; edge2++) {
-                                if (edge2->forward && edge2->targetNodeId == nearestNode.nodeId) {
-                                    heaps[i].emplace(nearestNode2.nodeId, RoutingGraph::NodeId(), weight + edge2->edgeData.weight);
-                                    pathSuffixMap[nearestNode2.nodeId] = PathNode(nearestNode2.nodeId, *edge2, nearestNode.nodeId);
+                        // Here comes the tricky part: INCOMING edges pointing to current edge are stored at their source nodes.
+                        // These are listed by the RADJ chunk of the package, otherwise we must perform another spatial query to find them
+                        std::vector<std::pair<RoutingGraph::NodeId, RoutingGraph::Edge>> incomingEdges;
+                        if (!_graph->getIncomingEdges(nearestNode.nodeId, incomingEdges)) {
+                            std::vector<RoutingGraph::NearestNode> nearestNodes2 = _graph->findNearestNode(_graph->getNodeGeometryView(*node).front());
+                            for (const RoutingGraph::NearestNode& nearestNode2 : nearestNodes2) {
+                                RoutingGraph::NodePtr node2 = _graph->getNode(nearestNode2.nodeId);
+                                const RoutingGraph::NodeBlock& nodeBlock2 = node2.block();
+                                for (std::uint32_t edgeIndex2 = node2->firstEdge; edgeIndex2 != node2->lastEdge; edgeIndex2++) {
+                                    if (nodeBlock2.getEdgeTargetNodeId(edgeIndex2) == nearestNode.nodeId) {
+                                        incomingEdges.emplace_back(nearestNode2.nodeId, nodeBlock2.getEdge(edgeIndex2));
+                                    }
                                 }
                             }
                         }
+                        for (const std::pair<RoutingGraph::NodeId, RoutingGraph::Edge>& incomingEdge : incomingEdges) {
+                            if (incomingEdge.second.forward && searchSpaces[i].push(incomingEdge.first, RoutingGraph::NodeId(), weight + incomingEdge.second.edgeData.weight)) {
+                                if (stats) {
+                                    stats->heapPushes++;
+                                }
+                                addPathSuffix(pathSuffixes, PathNode(incomingEdge.first, incomingEdge.second, nearestNode.nodeId));
+                            }
+                        }
 
                         continue;
                     }
                 }
 
                 // Add the node to heap, if other nodes were not already added
-                heaps[i].emplace(nearestNode.nodeId, RoutingGraph::NodeId(), weight);
+                if (searchSpaces[i].push(nearestNode.nodeId, RoutingGraph::NodeId(), weight) && stats) {
+                    stats->heapPushes++;
+                }
             }
         }
 
         // Apply bidirectional Dijkstra
         RoutingGraph::NodeId bestNodeId;
-        float bestWeight = std::numeric_limits<float>::infinity();
-        std::array<std::unordered_map<RoutingGraph::NodeId, SearchNode, RoutingGraph::NodeId::Hash>, 2> settledNodes;
-        for (int i = 0; !(heaps[0].empty() && heaps[1].empty()); i = 1 - i) {
-            if (heaps[i].empty()) {
-                continue;
-            }
-            SearchNode searchNode = heaps[i].top();
-            heaps[i].pop();
-            
-            // Skip all invalid nodes
-            if (searchNode.nodeId.blockId.packageId == -1) {
+        bestWeight = std::numeric_limits<float>::infinity();
+        for (int i = 0; !(searchSpaces[0].empty() && searchSpaces[1].empty()); i = 1 - i) {
+            if (searchSpaces[i].empty()) {
                 continue;
             }
 
             // Already shorter path found? In that case we can stop searching in the given direction
-            if (searchNode.weight + minWeight > bestWeight) {
-                while (!heaps[i].empty()) {
-                    heaps[i].pop();
-                }
+            if (searchSpaces[i].top().weight + minWeight > bestWeight * (1 + maxStretch)) {
+                searchSpaces[i].clearHeap();
                 continue;
             }
-            
-            // Best path to give node?
-            auto it0 = settledNodes[i].find(searchNode.nodeId);
-            if (it0 != settledNodes[i].end()) {
-                if (searchNode.weight >= it0->second.weight) { // not sure if the check is required
-                    continue;
+
+            RoutingGraph::NodeId nodeId = settleNode(searchSpaces, i, bestNodeId, bestWeight, stats);
+
+            // Nodes settled from both directions are the middle nodes of alternative paths
+            if (maxStretch > 0 && nodeId.valid()) {
+                const SearchSpace::Entry* otherEntry = searchSpaces[1 - i].find(nodeId);
+                if (otherEntry && otherEntry->settled) {
+                    workspace.viaNodeIds.push_back(nodeId);
                 }
             }
+        }
+        return bestNodeId;
+    }
 
-            // Settle the node
-            settledNodes[i][searchNode.nodeId] = searchNode;
-            
-            // Stalling optimization. This implementation is not optimal, we should also look at non-settled heap nodes
-            RoutingGraph::NodePtr node = _graph->getNode(searchNode.nodeId);
-            bool stall = false;
-            for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
-                if ((i == 0 && edge->backward) || (i != 0 && edge->forward)) {
-                    auto it = settledNodes[i].find(edge->targetNodeId);
-                    if (it != settledNodes[i].end()) {
-                        if (it->second.weight + edge->edgeData.weight < searchNode.weight) {
-                            stall = true;
-                            break;
-                        }
-                    }
+    RoutingGraph::NodeId RouteFinder::settleNode(std::array<SearchSpace, 2>& searchSpaces, int direction, RoutingGraph::NodeId& bestNodeId, float& bestWeight, RoutingStats* stats) const {
+        const SearchSpace::Entry& searchNode = searchSpaces[direction].pop();
+        if (stats) {
+            stats->heapPops++;
+        }
+        RoutingGraph::NodeId nodeId = searchNode.nodeId;
+        float nodeWeight = searchNode.weight;
+        
+        // Stalling optimization. Tentative weights of unsettled nodes are upper bounds, so these can be used for stalling, too
+        RoutingGraph::NodePtr node = _graph->getNode(nodeId);
+        const RoutingGraph::NodeBlock& nodeBlock = node.block();
+        const std::uint8_t forwardFlag = (direction == 0 ? RoutingGraph::NodeBlock::FORWARD_FLAG : RoutingGraph::NodeBlock::BACKWARD_FLAG);
+        const std::uint8_t backwardFlag = (direction == 0 ? RoutingGraph::NodeBlock::BACKWARD_FLAG : RoutingGraph::NodeBlock::FORWARD_FLAG);
+        bool stall = false;
+        for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+            if (nodeBlock.edgeFlags[edgeIndex] & backwardFlag) {
+                const SearchSpace::Entry* entry = searchSpaces[direction].find(nodeBlock.getEdgeTargetNodeId(edgeIndex));
+                if (entry && entry->weight + nodeBlock.edgeWeights[edgeIndex] < nodeWeight) {
+                    stall = true;
+                    break;
                 }
             }
-            if (stall) {
-                continue;
+        }
+        if (stall) {
+            if (stats) {
+                stats->nodesStalled++;
             }
+            return RoutingGraph::NodeId();
+        }
+        if (stats) {
+            stats->nodesSettled++;
+        }
 
-            // Recalculate shortest path and middle node
-            auto it1 = settledNodes[1 - i].find(searchNode.nodeId);
-            if (it1 != settledNodes[1 - i].end()) {
-                float totalWeight = searchNode.weight + it1->second.weight;
-                if (totalWeight >= 0 && totalWeight < bestWeight) {
-                    bestWeight = totalWeight;
-                    bestNodeId = searchNode.nodeId;
-                }
+        // Recalculate shortest path and middle node
+        const SearchSpace::Entry* otherEntry = searchSpaces[1 - direction].find(nodeId);
+        if (otherEntry && otherEntry->settled) {
+            float totalWeight = nodeWeight + otherEntry->weight;
+            if (totalWeight >= 0 && totalWeight < bestWeight) {
+                bestWeight = totalWeight;
+                bestNodeId = nodeId;
             }
+        }
 
-            // Add target nodes to heap
-            for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
-                if ((i == 0 && edge->forward) || (i != 0 && edge->backward)) {
-                    heaps[i].emplace(edge->targetNodeId, searchNode.nodeId, searchNode.weight + edge->edgeData.weight);
+        // Add target nodes to heap
+        for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++) {
+            if (nodeBlock.edgeFlags[edgeIndex] & forwardFlag) {
+                RoutingGraph::NodeId targetNodeId = nodeBlock.getEdgeTargetNodeId(edgeIndex);
+                if (targetNodeId.valid() && searchSpaces[direction].push(targetNodeId, nodeId, nodeWeight + nodeBlock.edgeWeights[edgeIndex])) {
+                    if (stats) {
+                        stats->heapPushes++;
+                    }
+                    // Targets in other blocks are likely to be settled soon, start loading their blocks
+                    if (nodeBlock.edgeTargets[edgeIndex] & RoutingGraph::NodeBlock::EXTERNAL_NODE_FLAG) {
+                        _graph->prefetchNodeBlock(targetNodeId.blockId());
+                    }
                 }
             }
         }
+        return nodeId;
+    }
 
-        // Check that path was found
-        if (bestNodeId.blockId.packageId == -1) {
-            return RoutingResult();
-        }
+    bool RouteFinder::unpackPath(SearchWorkspace& workspace, RoutingGraph::NodeId middleNodeId, const std::vector<PathNode>& pathSuffixes, std::vector<PathNode>& path) const {
+        RoutingStats* stats = RoutingStatsCollector::current();
+        const std::array<SearchSpace, 2>& searchSpaces = workspace.searchSpaces;
 
-        // Unpack path
+        // Unpack path. Shortcuts are unpacked recursively, fully unpacked shortcuts are cached with the package set generation
+        std::uint64_t generation = _graph->getGeneration();
+        std::vector<UnpackTask>& stack = workspace.unpackStack;
         std::array<std::vector<PathNode>, 2> paths;
         for (int i = 0; i < 2; i++) {
-            std::stack<std::pair<RoutingGraph::NodeId, RoutingGraph::NodeId>> stack;
-            RoutingGraph::NodeId nodeId = bestNodeId;
+            stack.clear();
+            RoutingGraph::NodeId nodeId = middleNodeId;
             while (true) {
-                auto it = settledNodes[i].find(nodeId);
-                assert(it != settledNodes[i].end());
-                RoutingGraph::NodeId prevNodeId = it->second.prevNodeId;
-                if (prevNodeId.blockId.packageId == -1) {
+                const SearchSpace::Entry* entry = searchSpaces[i].find(nodeId);
+                assert(entry && entry->settled);
+                RoutingGraph::NodeId prevNodeId = entry->prevNodeId;
+                if (!prevNodeId.valid()) {
                     break;
                 }
-                stack.emplace(prevNodeId, nodeId);
+                stack.emplace_back(prevNodeId, nodeId);
                 nodeId = prevNodeId;
             }
 
             while (!stack.empty()) {
-                std::pair<RoutingGraph::NodeId, RoutingGraph::NodeId> nodeIds = stack.top();
-                stack.pop();
-
-                RoutingGraph::NodePtr matchedNode;
-                const RoutingGraph::Edge* matchedEdge = nullptr;
-
-                // Find the edge between prevNodeId and nodeId. Do matching based on node ids.
-                RoutingGraph::NodeId prevNodeId = nodeIds.first;
-                RoutingGraph::NodeId nodeId = nodeIds.second;
-                for (int j = 0; j < 2 && !matchedEdge; j++) {
-                    RoutingGraph::NodePtr prevNode = _graph->getNode(prevNodeId);
-                    for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
-                        if (edge->targetNodeId == nodeId && ((j == i && edge->forward) || (j != i && edge->backward))) {
-                            matchedNode = prevNode;
-                            matchedEdge = edge;
-                            break;
-                        }
-                    }
-                    std::swap(nodeId, prevNodeId);
+                UnpackTask task = stack.back();
+                stack.pop_back();
+
+                // All original edges of a shortcut are on the path now, cache them
+                if (task.pathOffset != UnpackTask::NO_PATH_OFFSET) {
+                    auto shortcut = std::make_shared<UnpackedShortcut>();
+                    shortcut->generation = generation;
+                    shortcut->path.assign(paths[i].begin() + task.pathOffset, paths[i].end());
+                    _unpackCache.put(UnpackKey(task.prevNodeId, task.nodeId, i), shortcut);
+                    continue;
                 }
-                
-                // If the edge was not found, then we have a link between packages with different node encodings. Do slow matching, based on geometry, not node ids
-                for (int j = 0; j < 2 && !matchedEdge; j++) {
-                    RoutingGraph::NodePtr prevNode = _graph->getNode(prevNodeId);
-                    RoutingGraph::NodePtr node = _graph->getNode(nodeId);
-                    std::vector<WGSPos> nodeGeometry = _graph->getNodeGeometry(*node);
-                    for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
-                        if (edge->targetNodeId.blockId.packageId == -1) {
-                            continue;
-                        }
-                        RoutingGraph::NodePtr targetNode = _graph->getNode(edge->targetNodeId);
-                        std::vector<WGSPos> targetNodeGeometry = _graph->getNodeGeometry(*targetNode);
-                        if (nodeGeometry == targetNodeGeometry && ((j == i && edge->forward) || (j != i && edge->backward))) {
-                            matchedNode = prevNode;
-                            matchedEdge = edge;
-                            break;
-                        }
-                    }
-                    std::swap(nodeId, prevNodeId);
+
+                RoutingGraph::Edge matchedEdge;
+                if (!findEdge(i, task.prevNodeId, task.nodeId, matchedEdge)) {
+                    return false; // NOTE: this should not happen, unless the graph is broken
                 }
-                
-                // Unpack the matched edge
-                if (matchedEdge) {
-                    if (matchedEdge->contracted) {
-                        if (matchedEdge->contractedNodeId.blockId.packageId == -1) {
-                            return RoutingResult(); // Contracted node is not available, packing failed
-                        }
-                        stack.emplace(matchedEdge->contractedNodeId, nodeIds.second);
-                        stack.emplace(nodeIds.first, matchedEdge->contractedNodeId);
-                    }
-                    else {
-                        paths[i].emplace_back(nodeIds.first, *matchedEdge, nodeIds.second);
+                if (!matchedEdge.contracted) {
+                    paths[i].emplace_back(task.prevNodeId, matchedEdge, task.nodeId);
+                    continue;
+                }
+                if (!matchedEdge.contractedNodeId.valid()) {
+                    return false; // Contracted node is not available, packing failed
+                }
+
+                if (_settings.unpackCacheSize > 0) {
+                    std::shared_ptr<const UnpackedShortcut> shortcut;
+                    if (_unpackCache.read(UnpackKey(task.prevNodeId, task.nodeId, i), shortcut) && shortcut->generation == generation) {
+                        paths[i].insert(paths[i].end(), shortcut->path.begin(), shortcut->path.end());
+                        continue;
                     }
-                } else {
-                    return RoutingResult(); // NOTE: this should not happen, unless the graph is broken
+                    stack.emplace_back(task.prevNodeId, task.nodeId, paths[i].size());
+                }
+                if (stats) {
+                    stats->shortcutsUnpacked++;
                 }
+                stack.emplace_back(matchedEdge.contractedNodeId, task.nodeId);
+                stack.emplace_back(task.prevNodeId, matchedEdge.contractedNodeId);
             }
         }
 
         // Build joined path. Add pseudo-node at the beginning to simplify processing and add final node, if rerouting in case of one-way street
-        std::vector<PathNode> path;
         path = paths[0];
         for (auto it = paths[1].rbegin(); it != paths[1].rend(); it++) {
             path.emplace_back(it->nextNodeId, it->edge, it->prevNodeId);
         }
         if (path.empty()) {
-            path.emplace(path.begin(), bestNodeId, RoutingGraph::Edge(), bestNodeId);
+            path.emplace(path.begin(), middleNodeId, RoutingGraph::Edge(), middleNodeId);
         }
         else {
             RoutingGraph::NodeId firstNodeId = path.front().prevNodeId;
             path.emplace(path.begin(), firstNodeId, RoutingGraph::Edge(), firstNodeId);
         }
 
-        auto finalNodeIt = pathSuffixMap.find(path.back().nextNodeId);
-        if (finalNodeIt != pathSuffixMap.end()) {
-            path.push_back(finalNodeIt->second);
+        for (const PathNode& pathSuffix : pathSuffixes) {
+            if (pathSuffix.prevNodeId == path.back().nextNodeId) {
+                path.push_back(pathSuffix);
+                break;
+            }
         }
 
-        // Construct query result
-        std::vector<RoutingInstruction> instructions;
-        std::vector<WGSPos> routeVertices;
-        for (std::size_t j = 0; j < path.size(); j++) {
-            RoutingGraph::NodeId nodeId = path[j].nextNodeId;
-            RoutingGraph::NodePtr node = _graph->getNode(nodeId);
-            
-            std::vector<WGSPos> geometry = _graph->getNodeGeometry(*node);
-            std::pair<std::size_t, std::size_t> geometryIndex(0, geometry.size());
-            std::pair<float, float> geometryRelPos(0.0f, 1.0f);
+        return true;
+    }
 
-            std::size_t firstNNIndex = std::numeric_limits<std::size_t>::max();
-            if (j == 0) {
-                for (std::size_t k = 0; k < nearestNodes[0].size(); k++) {
-                    if (nearestNodes[0][k].nodeId == nodeId) {
-                        geometryIndex.first = nearestNodes[0][k].geometrySegmentIndex;
-                        geometryRelPos.first = nearestNodes[0][k].geometryRelPos;
-                        firstNNIndex = k;
+
+    std::vector<RoutingGraph::NodeId> RouteFinder::selectViaNodes(SearchWorkspace& workspace, RoutingGraph::NodeId bestNodeId, float bestWeight, unsigned int maxAlternatives) const {
+        const std::array<SearchSpace, 2>& searchSpaces = workspace.searchSpaces;
+        const float maxStretch = static_cast<float>(_settings.alternativeMaxStretch);
+        const float maxSharing = static_cast<float>(_settings.alternativeMaxSharing);
+        const float localOptimality = static_cast<float>(_settings.alternativeLocalOptimality);
+
+        // Packed path trees of the selected routes. Sharing is estimated from the packed paths: a via path shares
+        // the prefix of the search tree up to the first node that is already on a selected route.
+        std::array<std::unordered_set<RoutingGraph::NodeId, RoutingGraph::NodeId::Hash>, 2> routeNodeIds;
+        auto addRoute = [&](RoutingGraph::NodeId viaNodeId) {
+            for (int i = 0; i < 2; i++) {
+                for (RoutingGraph::NodeId nodeId = viaNodeId; nodeId.valid() && routeNodeIds[i].insert(nodeId).second; nodeId = searchSpaces[i].find(nodeId)->prevNodeId) {
+                }
+            }
+        };
+        auto getSharedWeight = [&](RoutingGraph::NodeId viaNodeId) {
+            float sharedWeight = 0;
+            for (int i = 0; i < 2; i++) {
+                for (RoutingGraph::NodeId nodeId = viaNodeId; nodeId.valid(); nodeId = searchSpaces[i].find(nodeId)->prevNodeId) {
+                    if (routeNodeIds[i].count(nodeId) > 0) {
+                        sharedWeight += std::max(0.0f, searchSpaces[i].find(nodeId)->weight);
                         break;
                     }
                 }
             }
+            return sharedWeight;
+        };
+        addRoute(bestNodeId);
+
+        // Candidates within the stretch limit, ranked by weight and sharing
+        std::vector<RoutingGraph::NodeId>& viaNodeIds = workspace.viaNodeIds;
+        std::sort(viaNodeIds.begin(), viaNodeIds.end(), [](RoutingGraph::NodeId nodeId1, RoutingGraph::NodeId nodeId2) { return nodeId1.packedId() < nodeId2.packedId(); });
+        viaNodeIds.erase(std::unique(viaNodeIds.begin(), viaNodeIds.end()), viaNodeIds.end());
+        std::vector<std::pair<float, RoutingGraph::NodeId>> candidates;
+        for (RoutingGraph::NodeId viaNodeId : viaNodeIds) {
+            float weight = searchSpaces[0].find(viaNodeId)->weight + searchSpaces[1].find(viaNodeId)->weight;
+            if (viaNodeId == bestNodeId || !(weight < bestWeight * (1 + maxStretch))) {
+                continue;
+            }
+            float sharedWeight = getSharedWeight(viaNodeId);
+            if (sharedWeight > maxSharing * bestWeight) {
+                continue;
+            }
+            candidates.emplace_back(2 * weight + sharedWeight, viaNodeId);
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, RoutingGraph::NodeId>& candidate1, const std::pair<float, RoutingGraph::NodeId>& candidate2) { return candidate1.first < candidate2.first; });
 
-            std::size_t lastNNIndex = std::numeric_limits<std::size_t>::max();
-            if (j == path.size() - 1) {
-                for (std::size_t k = 0; k < nearestNodes[1].size(); k++) {
-                    if (nearestNodes[1][k].nodeId == nodeId) {
-                        geometryIndex.second = nearestNodes[1][k].geometrySegmentIndex;
-                        geometryRelPos.second = nearestNodes[1][k].geometryRelPos;
-                        lastNNIndex = k;
-                        break;
-                    }
+        std::vector<RoutingGraph::NodeId> selectedNodeIds;
+        for (const std::pair<float, RoutingGraph::NodeId>& candidate : candidates) {
+            if (selectedNodeIds.size() >= maxAlternatives) {
+                break;
+            }
+            RoutingGraph::NodeId viaNodeId = candidate.second;
+
+            // Sharing with the routes selected so far, the detour must be locally close to the shortest path
+            float weight = searchSpaces[0].find(viaNodeId)->weight + searchSpaces[1].find(viaNodeId)->weight;
+            float sharedWeight = getSharedWeight(viaNodeId);
+            if (sharedWeight > maxSharing * bestWeight || !(weight - sharedWeight < (1 + localOptimality) * (bestWeight - sharedWeight))) {
+                continue;
+            }
+
+            // T-test: the subpath around the via node of about localOptimality times the shortest weight must be a shortest path
+            std::array<RoutingGraph::NodeId, 2> endNodeIds;
+            float subWeight = 0;
+            for (int i = 0; i < 2; i++) {
+                const SearchSpace::Entry* viaEntry = searchSpaces[i].find(viaNodeId);
+                const SearchSpace::Entry* entry = viaEntry;
+                while (entry->prevNodeId.valid() && viaEntry->weight - entry->weight < localOptimality * bestWeight) {
+                    entry = searchSpaces[i].find(entry->prevNodeId);
                 }
+                endNodeIds[i] = entry->nodeId;
+                subWeight += viaEntry->weight - entry->weight;
+            }
+            if (!(endNodeIds[0] == endNodeIds[1]) && findLocalWeight(workspace, endNodeIds[0], endNodeIds[1], subWeight) < subWeight * 0.999f) {
+                continue;
             }
 
-            double dist = calculateGeometryLength(geometry, geometryRelPos.first, geometryRelPos.second);
-            double time = (j > 0 ? path[j].edge.edgeData.weight : node->nodeData.weight) * (geometryRelPos.second - geometryRelPos.first) / 10.0;
-            std::string streetName = _graph->getNodeName(*node);
+            selectedNodeIds.push_back(viaNodeId);
+            addRoute(viaNodeId);
+        }
+        return selectedNodeIds;
+    }
 
-            // Initial route instruction/vertex
-            if (firstNNIndex != std::numeric_limits<std::size_t>::max()) {
-                instructions.emplace_back(RoutingInstruction::Type::HEAD_ON, RoutingInstruction::TravelMode::DEFAULT, streetName, dist, time, routeVertices.size());
-                routeVertices.push_back(nearestNodes[0][firstNNIndex].nodePos);
+    float RouteFinder::findLocalWeight(SearchWorkspace& workspace, RoutingGraph::NodeId sourceNodeId, RoutingGraph::NodeId targetNodeId, float maxWeight) const {
+        std::array<SearchSpace, 2>& searchSpaces = workspace.localSearchSpaces;
+        for (int i = 0; i < 2; i++) {
+            searchSpaces[i].clear();
+        }
+        RoutingStats* stats = RoutingStatsCollector::current();
+        searchSpaces[0].push(sourceNodeId, RoutingGraph::NodeId(), 0.0f);
+        searchSpaces[1].push(targetNodeId, RoutingGraph::NodeId(), 0.0f);
+
+        RoutingGraph::NodeId bestNodeId;
+        float bestWeight = std::numeric_limits<float>::infinity();
+        for (int i = 0; !(searchSpaces[0].empty() && searchSpaces[1].empty()); i = 1 - i) {
+            if (searchSpaces[i].empty()) {
+                continue;
             }
-            
-            // Middle instructions/vertices
-            if (!routeVertices.empty() && geometryIndex.first < geometryIndex.second) {
-                if (routeVertices.back() == geometry[geometryIndex.first]) {
-                    routeVertices.pop_back();
+            if (searchSpaces[i].top().weight > std::min(bestWeight, maxWeight)) {
+                searchSpaces[i].clearHeap();
+                continue;
+            }
+            settleNode(searchSpaces, i, bestNodeId, bestWeight, stats);
+        }
+        return bestWeight;
+    }
+
+    cache::cache_stats RouteFinder::getUnpackCacheStats() const {
+        return _unpackCache.stats();
+    }
+
+    bool RouteFinder::findEdge(int direction, RoutingGraph::NodeId prevNodeId, RoutingGraph::NodeId nodeId, RoutingGraph::Edge& edge) const {
+        // Find the edge between prevNodeId and nodeId. The edge can be stored at either node, do matching based on node ids.
+        for (int j = 0; j < 2; j++) {
+            RoutingGraph::NodePtr prevNode = _graph->getNode(prevNodeId);
+            const RoutingGraph::NodeBlock& prevNodeBlock = prevNode.block();
+            const std::uint8_t flag = (j == direction ? RoutingGraph::NodeBlock::FORWARD_FLAG : RoutingGraph::NodeBlock::BACKWARD_FLAG);
+            for (std::uint32_t edgeIndex = prevNode->firstEdge; edgeIndex != prevNode->lastEdge; edgeIndex++) {
+                if ((prevNodeBlock.edgeFlags[edgeIndex] & flag) && prevNodeBlock.getEdgeTargetNodeId(edgeIndex) == nodeId) {
+                    edge = prevNodeBlock.getEdge(edgeIndex);
+                    return true;
                 }
             }
-            std::size_t vertexIndex = routeVertices.size();
-            routeVertices.insert(routeVertices.end(), geometry.begin() + geometryIndex.first, geometry.begin() + geometryIndex.second);
-            if (j > 0) {
-                RoutingInstruction::Type type = static_cast<RoutingInstruction::Type>(path[j].edge.edgeData.turnInstruction);
-                RoutingInstruction::TravelMode travelMode = static_cast<RoutingInstruction::TravelMode>(node->nodeData.travelMode);
-                instructions.emplace_back(type, travelMode, streetName, dist, time, vertexIndex);
+            std::swap(nodeId, prevNodeId);
+        }
+
+        // If the edge was not found, then we have a link between packages with different node encodings. Match the copies of the node in other packages.
+        for (int j = 0; j < 2; j++) {
+            std::vector<RoutingGraph::NodeId> equivalentNodeIds = _graph->getEquivalentNodeIds(nodeId);
+            if (!equivalentNodeIds.empty()) {
+                RoutingGraph::NodePtr prevNode = _graph->getNode(prevNodeId);
+                const RoutingGraph::NodeBlock& prevNodeBlock = prevNode.block();
+                const std::uint8_t flag = (j == direction ? RoutingGraph::NodeBlock::FORWARD_FLAG : RoutingGraph::NodeBlock::BACKWARD_FLAG);
+                for (std::uint32_t edgeIndex = prevNode->firstEdge; edgeIndex != prevNode->lastEdge; edgeIndex++) {
+                    if ((prevNodeBlock.edgeFlags[edgeIndex] & flag) && std::find(equivalentNodeIds.begin(), equivalentNodeIds.end(), prevNodeBlock.getEdgeTargetNodeId(edgeIndex)) != equivalentNodeIds.end()) {
+                        edge = prevNodeBlock.getEdge(edgeIndex);
+                        return true;
+                    }
+                }
             }
+            std::swap(nodeId, prevNodeId);
+        }
+        return false;
+    }
 
-            // Final instruction/vertex
-            if (lastNNIndex != std::numeric_limits<std::size_t>::max()) {
-                instructions.emplace_back(RoutingInstruction::Type::REACHED_YOUR_DESTINATION, RoutingInstruction::TravelMode::DEFAULT, "", 0, 0, routeVertices.size());
-                routeVertices.push_back(nearestNodes[1][lastNNIndex].nodePos);
+    void RouteFinder::addPathSuffix(std::vector<PathNode>& pathSuffixes, const PathNode& pathSuffix) {
+        for (PathNode& existingPathSuffix : pathSuffixes) {
+            if (existingPathSuffix.prevNodeId == pathSuffix.prevNodeId) {
+                existingPathSuffix = pathSuffix;
+                return;
             }
         }
+        pathSuffixes.push_back(pathSuffix);
+    }
 
-        return RoutingResult(std::move(instructions), std::move(routeVertices));
+    const RoutingGraph::NearestNode* RouteFinder::getNearestNode(const std::vector<RoutingGraph::NearestNode>& nearestNodes, RoutingGraph::NodeId nodeId) {
+        for (const RoutingGraph::NearestNode& nearestNode : nearestNodes) {
+            if (nearestNode.nodeId == nodeId) {
+                return &nearestNode;
+            }
+        }
+        return nullptr;
     }
 
-    double RouteFinder::calculateGeometryLength(const std::vector<WGSPos>& geometry, double t0, double t1) {
+    double RouteFinder::calculateGeometryLength(const RoutingGraph::GeometryView& geometry, double t0, double t1) {
         double totalLen = 0;
         for (unsigned int j = 1; j < geometry.size(); j++) {
-            totalLen += calculateGreatCircleDistance(geometry[j - 1], geometry[j]);
+            totalLen += RoutingGraph::getGreatCircleDistance(geometry[j - 1], geometry[j]);
         }
         if (t0 == 0 && t1 == 1) {
             return totalLen;
@@ -305,7 +669,7 @@ namespace Nuti { namespace Routing {
         double pos = 0;
         double len = 0;
         for (unsigned int j = 1; j < geometry.size(); j++) {
-            double segmentLen = calculateGreatCircleDistance(geometry[j - 1], geometry[j]);
+            double segmentLen = RoutingGraph::getGreatCircleDistance(geometry[j - 1], geometry[j]);
             double segmentPos0 = std::max(pos, t0 * totalLen);
             double segmentPos1 = std::min(pos + segmentLen, t1 * totalLen);
             len += std::max(0.0, segmentPos1 - segmentPos0);
@@ -313,21 +677,4 @@ namespace Nuti { namespace Routing {
         }
         return len;
     }
-
-    double RouteFinder::calculateGreatCircleDistance(const WGSPos& p0, const WGSPos& p1) {
-        static const double DEG_TO_RAD = 0.017453292519943295769236907684886;
-        static const double EARTH_RADIUS = 6372797.560856;
-
-        double lat1 = p0(0) * DEG_TO_RAD;
-        double lng1 = p0(1) * DEG_TO_RAD;
-        double lat2 = p1(0) * DEG_TO_RAD;
-        double lng2 = p1(1) * DEG_TO_RAD;
-
-        double dLng = lng1 - lng2;
-        double dLat = lat1 - lat2;
-
-        double aHarv = std::pow(std::sin(dLat / 2.0), 2) + std::cos(lat1) * std::cos(lat2) * std::pow(std::sin(dLng / 2.0), 2);
-        double cHarv = 2.0 * std::atan2(std::sqrt(aHarv), std::sqrt(1.0 - aHarv));
-        return EARTH_RADIUS * cHarv;
-    }
 } }
@@ -10,32 +10,52 @@
 #include "RoutingObjects.h"
 #include "RoutingGraph.h"
 
-#include <queue>
+#include <cstdint>
+#include <cstddef>
+#include <array>
 #include <map>
+#include <memory>
 #include <vector>
-#include <stack>
+
+#include <stdext/concurrent_cache.h>
 
 namespace Nuti { namespace Routing {
+    struct RoutingStats;
+    class SearchSpace;
+    struct SearchWorkspace;
+
     class RouteFinder {
     public:
-        explicit RouteFinder(std::shared_ptr<RoutingGraph> graph) : _graph(std::move(graph)) { }
+        struct Settings {
+            std::size_t unpackCacheSize = 4096; // shortcuts with cached unpacked edge sequences, 0 disables the cache
+            std::size_t unpackCacheMemoryBudget = 16 * 1024 * 1024; // byte limit for the cached sequences, 0 means only the entry count is limited
+            double alternativeMaxStretch = 0.15; // alternatives are at most 15% longer than the shortest route
+            double alternativeMaxSharing = 0.75; // and share at most 75% of the shortest route
+            double alternativeLocalOptimality = 0.10; // detours and the sections around via nodes of this fraction of the shortest route are near optimal
+
+            Settings() = default;
+        };
+
+        explicit RouteFinder(std::shared_ptr<RoutingGraph> graph) : RouteFinder(std::move(graph), Settings()) { }
+        explicit RouteFinder(std::shared_ptr<RoutingGraph> graph, const Settings& settings);
 
         RoutingResult find(const RoutingQuery& query) const;
 
-    private:
-        struct SearchNode {
-            RoutingGraph::NodeId nodeId;
-            RoutingGraph::NodeId prevNodeId;
-            float weight = 0.0f;
+        // Find route between already snapped end points, as returned by RoutingGraph::findNearestNode
+        RoutingResult find(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const;
 
-            SearchNode() = default;
-            SearchNode(RoutingGraph::NodeId nodeId, RoutingGraph::NodeId prevNodeId, float weight) : nodeId(nodeId), prevNodeId(prevNodeId), weight(weight) { }
+        // Route totals only. Names are not loaded and geometries are decoded only for the end points, the node lengths come from NLEN chunks
+        RoutingSummary findSummary(const RoutingQuery& query) const;
+        RoutingSummary findSummary(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const;
 
-            bool operator < (const SearchNode& searchNode) const {
-                return weight > searchNode.weight;
-            }
-        };
+        // Shortest route followed by up to maxAlternatives alternative routes through other via nodes, best first. The first
+        // result is failed if no route is found. Only the selected routes are unpacked.
+        std::vector<RoutingResult> findAlternatives(const RoutingQuery& query, unsigned int maxAlternatives) const;
+        std::vector<RoutingResult> findAlternatives(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, unsigned int maxAlternatives) const;
+
+        cache::cache_stats getUnpackCacheStats() const;
 
+    private:
         struct PathNode {
             RoutingGraph::NodeId prevNodeId;
             RoutingGraph::Edge edge;
@@ -45,11 +65,58 @@ namespace Nuti { namespace Routing {
             PathNode(RoutingGraph::NodeId prevNodeId, const RoutingGraph::Edge& edge, RoutingGraph::NodeId nextNodeId) : prevNodeId(prevNodeId), edge(edge), nextNodeId(nextNodeId) { }
         };
 
-        static double calculateGeometryLength(const std::vector<WGSPos>& geometry, double t0, double t1);
+        struct UnpackKey {
+            RoutingGraph::NodeId prevNodeId;
+            RoutingGraph::NodeId nodeId;
+            int direction = 0;
+
+            UnpackKey() = default;
+            explicit UnpackKey(RoutingGraph::NodeId prevNodeId, RoutingGraph::NodeId nodeId, int direction) : prevNodeId(prevNodeId), nodeId(nodeId), direction(direction) { }
+
+            bool operator == (const UnpackKey& key) const { return prevNodeId == key.prevNodeId && nodeId == key.nodeId && direction == key.direction; }
+
+            struct Hash {
+                std::size_t operator() (const UnpackKey& key) const { return RoutingGraph::NodeId::Hash()(key.prevNodeId) * 31 ^ RoutingGraph::NodeId::Hash()(key.nodeId) ^ key.direction; }
+            };
+        };
+
+        // Original edges of a shortcut, valid only for the package set generation they were unpacked from
+        struct UnpackedShortcut {
+            std::uint64_t generation = 0;
+            std::vector<PathNode> path;
+
+            UnpackedShortcut() = default;
+        };
+
+        bool findPath(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, std::vector<PathNode>& path) const;
+
+        RoutingResult buildResult(const std::vector<PathNode>& path, const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes) const;
+
+        // Bidirectional search, returns the middle node of the shortest path. With positive maxStretch, the search continues
+        // until all paths up to (1 + maxStretch) times the shortest weight are met, collecting the via node candidates.
+        RoutingGraph::NodeId search(const std::vector<RoutingGraph::NearestNode>& sourceNodes, const std::vector<RoutingGraph::NearestNode>& targetNodes, float maxStretch, SearchWorkspace& workspace, std::vector<PathNode>& pathSuffixes, float& bestWeight) const;
+
+        // Pops the top node of the direction. Unless the node is stalled, updates the best middle node and relaxes the edges of the node.
+        // Returns the settled node, invalid id if stalled.
+        RoutingGraph::NodeId settleNode(std::array<SearchSpace, 2>& searchSpaces, int direction, RoutingGraph::NodeId& bestNodeId, float& bestWeight, RoutingStats* stats) const;
+
+        bool unpackPath(SearchWorkspace& workspace, RoutingGraph::NodeId middleNodeId, const std::vector<PathNode>& pathSuffixes, std::vector<PathNode>& path) const;
+
+        std::vector<RoutingGraph::NodeId> selectViaNodes(SearchWorkspace& workspace, RoutingGraph::NodeId bestNodeId, float bestWeight, unsigned int maxAlternatives) const;
+
+        float findLocalWeight(SearchWorkspace& workspace, RoutingGraph::NodeId sourceNodeId, RoutingGraph::NodeId targetNodeId, float maxWeight) const;
+
+        bool findEdge(int direction, RoutingGraph::NodeId prevNodeId, RoutingGraph::NodeId nodeId, RoutingGraph::Edge& edge) const;
+
+        static void addPathSuffix(std::vector<PathNode>& pathSuffixes, const PathNode& pathSuffix);
+
+        static const RoutingGraph::NearestNode* getNearestNode(const std::vector<RoutingGraph::NearestNode>& nearestNodes, RoutingGraph::NodeId nodeId);
 
-        static double calculateGreatCircleDistance(const WGSPos& p0, const WGSPos& p1);
+        static double calculateGeometryLength(const RoutingGraph::GeometryView& geometry, double t0, double t1);
 
         const std::shared_ptr<RoutingGraph> _graph;
+        const Settings _settings;
+        mutable cache::concurrent_cache<UnpackKey, std::shared_ptr<const UnpackedShortcut>, UnpackKey::Hash> _unpackCache;
     };
 } }
 
@@ -1,37 +1,228 @@
 #include "RoutingGraph.h"
+#include "RoutingStats.h"
+#include "SegmentProjector.h"
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <limits>
 #include <list>
+#include <iterator>
 #include <queue>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace Nuti { namespace Routing {
+    static_assert(sizeof(RoutingGraph::Point) == 2 * sizeof(std::int32_t), "Geometry points must be contiguous (lat, lon) pairs for SegmentProjector");
+
+    namespace {
+        // Package set pinned by RoutingGraph::Snapshot for the current thread
+        thread_local const RoutingGraph* pinnedGraph = nullptr;
+        thread_local std::shared_ptr<const void> pinnedPackages;
+
+        // Counts a block load and its decoding time in the stats of the current thread, if collected
+        class BlockLoadStats {
+        public:
+            explicit BlockLoadStats(std::uint64_t RoutingStats::* blocksLoaded) : _stats(RoutingStatsCollector::current()) {
+                if (_stats) {
+                    (_stats->*blocksLoaded)++;
+                    _startTime = std::chrono::steady_clock::now();
+                }
+            }
+
+            ~BlockLoadStats() {
+                if (_stats) {
+                    _stats->decodeMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _startTime).count();
+                }
+            }
+
+        private:
+            RoutingStats* _stats;
+            std::chrono::steady_clock::time_point _startTime;
+        };
+
+        // Morton order key of a position, so that sorting by the key keeps nearby positions together
+        std::uint64_t getSpatialKey(const Nuti::Routing::WGSPos& pos) {
+            auto spreadBits = [](std::uint64_t x) {
+                x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+                x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+                x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+                x = (x | (x << 2)) & 0x3333333333333333ULL;
+                x = (x | (x << 1)) & 0x5555555555555555ULL;
+                return x;
+            };
+            std::uint64_t lat = static_cast<std::uint64_t>(std::max(0.0, std::min(1.0, (pos(0) + 90.0) / 180.0)) * 0xFFFFF);
+            std::uint64_t lon = static_cast<std::uint64_t>(std::max(0.0, std::min(1.0, (pos(1) + 180.0) / 360.0)) * 0xFFFFF);
+            return spreadBits(lat) | (spreadBits(lon) << 1);
+        }
+    }
+
+    RoutingGraph::Snapshot::Snapshot(const RoutingGraph& graph) {
+        pin(graph, pinnedGraph == &graph ? pinnedPackages : std::atomic_load(&graph._packages));
+    }
+
+    RoutingGraph::Snapshot::Snapshot(const Snapshot& outer, const RoutingGraph& graph) {
+        pin(graph, outer._packages);
+    }
+
+    void RoutingGraph::Snapshot::pin(const RoutingGraph& graph, std::shared_ptr<const void> packages) {
+        _packages = std::move(packages);
+        if (pinnedGraph != &graph || pinnedPackages != _packages) {
+            _pinned = true;
+            _prevGraph = pinnedGraph;
+            _prevPackages = std::move(pinnedPackages);
+            pinnedGraph = &graph;
+            pinnedPackages = _packages;
+        }
+    }
+
+    RoutingGraph::Snapshot::~Snapshot() {
+        if (_pinned) {
+            pinnedGraph = _prevGraph;
+            pinnedPackages = std::move(_prevPackages);
+        }
+    }
+
     RoutingGraph::RoutingGraph(const Settings& settings) :
-        _packages(),
-        _nodeBlockCache(settings.nodeBlockCacheSize),
-        _geometryBlockCache(settings.geometryBlockCacheSize),
-        _nameBlockCache(settings.nameBlockCacheSize),
-        _globalNodeBlockCache(settings.globalNodeBlockCacheSize),
-        _rtreeNodeBlockCache(settings.rtreeNodeBlockCacheSize),
-        _mutex()
+        _settings(settings),
+        _packages(std::make_shared<PackageSet>()),
+        _blockCacheMemoryBudget(settings.blockCacheMemoryBudget > 0 ? std::make_shared<cache::memory_budget>(settings.blockCacheMemoryBudget) : std::shared_ptr<cache::memory_budget>()),
+        _nodeBlockCache(settings.nodeBlockCacheSize, _blockCacheMemoryBudget, [](const std::shared_ptr<NodeBlock>& block) { return getBlockSize(block); }),
+        _geometryBlockCache(settings.geometryBlockCacheSize, _blockCacheMemoryBudget, [](const std::shared_ptr<GeometryBlock>& block) { return getBlockSize(block); }),
+        _nameBlockCache(settings.nameBlockCacheSize, _blockCacheMemoryBudget, [](const std::shared_ptr<NameBlock>& block) { return getBlockSize(block); }),
+        _rtreeNodeBlockCache(settings.rtreeNodeBlockCacheSize, _blockCacheMemoryBudget, [](const std::shared_ptr<RTreeNodeBlock>& block) { return getBlockSize(block); }),
+        _mutex(),
+        _blocksRead(0),
+        _bytesRead(0),
+        _prefetchRequests(0),
+        _prefetchLoads(0),
+        _prefetchHits(0),
+        _prefetchDropped(0)
     {
+        for (unsigned int i = 0; i < settings.prefetchThreadCount; i++) {
+            _prefetchThreads.emplace_back(&RoutingGraph::runPrefetcher, this);
+        }
+    }
+
+    RoutingGraph::~RoutingGraph() {
+        {
+            std::lock_guard<std::mutex> lock(_prefetchMutex);
+            _prefetchStop = true;
+        }
+        _prefetchCondition.notify_all();
+        for (std::thread& thread : _prefetchThreads) {
+            thread.join();
+        }
     }
     
     bool RoutingGraph::import(const std::string& fileName) {
+        if (_settings.useMemoryMapping) {
+            auto file = std::make_shared<const eiff::mapped_file>(fileName, _settings.memoryMappingAdvice);
+            eiff::mapped_file::size_type offset = 0;
+            return importPackage(eiff::read_chunk(file, offset), fileName);
+        }
+
         auto file = std::make_shared<std::ifstream>();
         file->exceptions(std::ifstream::failbit | std::ifstream::badbit);
         file->open(fileName, std::ios::binary);
-        return import(file);
+        return importPackage(eiff::read_chunk(file, true), fileName);
     }
 
     bool RoutingGraph::import(const std::shared_ptr<std::ifstream>& file) {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return importPackage(eiff::read_chunk(file, true), std::string());
+    }
+
+    bool RoutingGraph::unload(const std::string& packageName) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto packages = std::make_shared<PackageSet>(*std::atomic_load(&_packages));
+        for (Package& package : packages->packages) {
+            if (package.active && package.packageName == packageName) {
+                int packageId = package.packageId;
+                Package retiredPackage;
+                retiredPackage.packageId = packageId;
+                retiredPackage.retiredLifetime = package.lifetime;
+                package = std::move(retiredPackage);
+                publishPackages(std::move(packages), std::vector<int> { packageId });
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<RoutingGraph::PackageInfo> RoutingGraph::getPackageInfos() const {
+        auto packages = getPackages();
+        std::vector<PackageInfo> packageInfos;
+        for (const Package& package : packages->packages) {
+            if (package.active) {
+                PackageInfo packageInfo;
+                packageInfo.packageId = package.packageId;
+                packageInfo.packageName = package.packageName;
+                packageInfo.fileName = package.fileName;
+                packageInfo.generation = package.generation;
+                packageInfo.bbox = package.bbox;
+                packageInfo.nodeBlockCount = getBlockCount(package, *package.nodeChunk);
+                packageInfos.push_back(std::move(packageInfo));
+            }
+        }
+        return packageInfos;
+    }
+
+    std::uint64_t RoutingGraph::getGeneration() const {
+        return getPackages()->generation;
+    }
+
+    std::uint64_t RoutingGraph::getNodeGeneration(NodeId nodeId) const {
+        auto packages = getPackages();
+        int packageId = nodeId.packageId();
+        if (packageId < 0 || packageId >= static_cast<int>(packages->packages.size())) {
+            return 0;
+        }
+        const Package& package = packages->packages[packageId];
+        if (!package.active || nodeId.blockIndex() >= getBlockCount(package, *package.nodeChunk)) {
+            return 0;
+        }
+        return package.generation;
+    }
+
+    std::vector<RoutingGraph::NodeId> RoutingGraph::getEquivalentNodeIds(NodeId nodeId) const {
+        auto packages = getPackages();
+        auto it = packages->nodeEquivalents.find(nodeId);
+        if (it == packages->nodeEquivalents.end()) {
+            return std::vector<NodeId>();
+        }
+        return it->second;
+    }
+
+    bool RoutingGraph::importPackage(const std::shared_ptr<eiff::chunk>& chunk, const std::string& fileName) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto packages = std::make_shared<PackageSet>(*std::atomic_load(&_packages));
 
+        // Reuse a slot of an unloaded package once no pinned package set can refer to it, otherwise allocate a new id.
+        // Package ids are never reused while old ids may still be in use, as cached blocks are keyed by package id.
         Package package;
-        package.packageId = static_cast<int>(_packages.size());
+        package.packageId = static_cast<int>(packages->packages.size());
+        for (const Package& oldPackage : packages->packages) {
+            if (!oldPackage.active && oldPackage.retiredLifetime.expired()) {
+                package.packageId = oldPackage.packageId;
+                break;
+            }
+        }
+        if (package.packageId > NodeId::MAX_PACKAGE_ID) {
+            throw std::runtime_error("Too many packages");
+        }
+        package.active = true;
+        package.generation = packages->generation + 1;
+        package.fileName = fileName;
+        package.fileMutex = std::make_shared<std::mutex>();
+        package.lifetime = std::make_shared<int>(0);
         
-        auto graphChunk = std::dynamic_pointer_cast<eiff::form_chunk>(eiff::read_chunk(file, true));
+        auto graphChunk = std::dynamic_pointer_cast<eiff::form_chunk>(chunk);
         if (!graphChunk) {
             throw std::runtime_error("Illegal graph file");
         }
@@ -45,18 +236,16 @@ namespace Nuti { namespace Routing {
         headerChunk->read(headerData);
 
         bitstreams::input_bitstream bs(std::move(headerData));
-        auto version = bs.read_bits<int>(32);
+        auto version = bs.read_bits<int, 32>();
         if (version != VERSION) {
             throw std::runtime_error("Unsupported graph version");
         }
-        auto packageNameLength = bs.read_bits<int>(16);
-        while (packageNameLength-- > 0) {
-            package.packageName.append(1, bs.read_bits<char>(8));
-        }
-        auto lat0 = bs.read_bits<int>(32);
-        auto lon0 = bs.read_bits<int>(32);
-        auto lat1 = bs.read_bits<int>(32);
-        auto lon1 = bs.read_bits<int>(32);
+        auto packageNameLength = bs.read_bits<int, 16>();
+        bs.read_bytes(std::back_inserter(package.packageName), packageNameLength);
+        auto lat0 = bs.read_bits<int, 32>();
+        auto lon0 = bs.read_bits<int, 32>();
+        auto lat1 = bs.read_bits<int, 32>();
+        auto lon1 = bs.read_bits<int, 32>();
         package.bbox.min = fromPoint(Point(lat0, lon0));
         package.bbox.max = fromPoint(Point(lat1, lon1));
         
@@ -65,117 +254,364 @@ namespace Nuti { namespace Routing {
         package.nameChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'N', 'A', 'M', 'E' }});
         package.globalNodeChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'L', 'I', 'N', 'K' }});
         package.rtreeNodeChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'R', 'T', 'R', 'E' }});
+        package.nodeBoundsChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'N', 'B', 'O', 'X' }});
+        package.nodeLengthsChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'N', 'L', 'E', 'N' }});
+        package.incomingEdgesChunk = graphChunk->get<eiff::data_chunk>(eiff::chunk::tag_type {{ 'R', 'A', 'D', 'J' }});
         if (!package.nodeChunk || !package.geometryChunk || !package.nameChunk || !package.globalNodeChunk || !package.rtreeNodeChunk) {
             throw std::runtime_error("Graph sections missing");
         }
-        _packages.push_back(std::move(package));
 
-        // Invalidate caches whose contents may depend on other packages
-        _nodeBlockCache.clear();
-        _globalNodeBlockCache.clear();
+        // Keep the nodes shared with other packages in memory, global node references are resolved through these
+        package.linkTable = loadLinkTable(package);
+
+        // Retire the package being replaced, its id stays valid for queries already running on it
+        std::vector<int> changedPackageIds { package.packageId };
+        for (Package& oldPackage : packages->packages) {
+            if (oldPackage.active && oldPackage.packageName == package.packageName) {
+                Package retiredPackage;
+                retiredPackage.packageId = oldPackage.packageId;
+                retiredPackage.retiredLifetime = oldPackage.lifetime;
+                oldPackage = std::move(retiredPackage);
+                changedPackageIds.push_back(oldPackage.packageId);
+            }
+        }
+        if (package.packageId == static_cast<int>(packages->packages.size())) {
+            packages->packages.push_back(std::move(package));
+        }
+        else {
+            packages->packages.at(package.packageId) = std::move(package);
+        }
+        publishPackages(std::move(packages), changedPackageIds);
         return true;
     }
 
-    RoutingGraph::NodePtr RoutingGraph::getNode(NodeId nodeId) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+    void RoutingGraph::publishPackages(std::shared_ptr<PackageSet> packages, const std::vector<int>& changedPackageIds) {
+        packages->generation++;
 
-        std::shared_ptr<NodeBlock> nodeBlock;
-        if (!_nodeBlockCache.read(nodeId.blockId, nodeBlock)) {
-            nodeBlock = loadNodeBlock(nodeId.blockId);
-            _nodeBlockCache.put(nodeId.blockId, nodeBlock);
+        auto changed = [&changedPackageIds](int packageId) {
+            return std::find(changedPackageIds.begin(), changedPackageIds.end(), packageId) != changedPackageIds.end();
+        };
+
+        // Resolve the global nodes and rebuild the node equivalence table, both depend on the set of loaded packages.
+        // Global node tables of unchanged packages are reused if the packages they refer to keep their ids.
+        std::unordered_map<std::string, int> packageIds;
+        for (const Package& package : packages->packages) {
+            if (package.active) {
+                packageIds[package.packageName] = package.packageId;
+            }
+        }
+        packages->globalNodeTables.resize(packages->packages.size());
+        packages->nodeEquivalents.clear();
+        for (const Package& package : packages->packages) {
+            std::shared_ptr<const GlobalNodeTable>& globalNodeTable = packages->globalNodeTables[package.packageId];
+            if (!package.active) {
+                globalNodeTable.reset();
+                continue;
+            }
+
+            const LinkTable& linkTable = *package.linkTable;
+            std::vector<int> linkedPackageIds;
+            linkedPackageIds.reserve(linkTable.packageNames.size());
+            for (const std::string& packageName : linkTable.packageNames) {
+                auto it = packageIds.find(packageName);
+                linkedPackageIds.push_back(it != packageIds.end() ? it->second : -1);
+            }
+
+            if (!globalNodeTable || changed(package.packageId) || globalNodeTable->packageIds != linkedPackageIds) {
+                auto newGlobalNodeTable = std::make_shared<GlobalNodeTable>();
+                newGlobalNodeTable->nodeIds.reserve(linkTable.linkOffsets.size() - 1);
+                for (std::size_t i = 0; i + 1 < linkTable.linkOffsets.size(); i++) {
+                    NodeId globalNodeId;
+                    for (std::uint32_t j = linkTable.linkOffsets[i]; j < linkTable.linkOffsets[i + 1]; j++) {
+                        const NodeLink& link = linkTable.links[j];
+                        if (linkedPackageIds[link.packageIndex] != -1) {
+                            globalNodeId = NodeId(BlockId(linkedPackageIds[link.packageIndex], link.blockIndex), link.nodeIndex);
+                        }
+                    }
+                    newGlobalNodeTable->nodeIds.push_back(globalNodeId);
+                }
+                newGlobalNodeTable->packageIds = linkedPackageIds;
+                globalNodeTable = std::move(newGlobalNodeTable);
+            }
+
+            for (std::size_t i = 0; i + 1 < linkTable.linkOffsets.size(); i++) {
+                if (linkTable.linkOffsets[i + 1] - linkTable.linkOffsets[i] < 2) {
+                    continue;
+                }
+                std::vector<NodeId> nodeIds;
+                for (std::uint32_t j = linkTable.linkOffsets[i]; j < linkTable.linkOffsets[i + 1]; j++) {
+                    const NodeLink& link = linkTable.links[j];
+                    if (linkedPackageIds[link.packageIndex] != -1) {
+                        nodeIds.emplace_back(BlockId(linkedPackageIds[link.packageIndex], link.blockIndex), link.nodeIndex);
+                    }
+                }
+                for (NodeId nodeId : nodeIds) {
+                    for (NodeId otherNodeId : nodeIds) {
+                        std::vector<NodeId>& equivalentNodeIds = packages->nodeEquivalents[nodeId];
+                        if (otherNodeId != nodeId && std::find(equivalentNodeIds.begin(), equivalentNodeIds.end(), otherNodeId) == equivalentNodeIds.end()) {
+                            equivalentNodeIds.push_back(otherNodeId);
+                        }
+                    }
+                }
+            }
         }
-        return NodePtr(nodeBlock, nodeId.elementIndex);
+
+        std::atomic_store(&_packages, std::shared_ptr<const PackageSet>(std::move(packages)));
+
+        // Invalidate only the blocks of changed packages, and the node blocks with resolved global references,
+        // as their contents depend on the package set
+        _nodeBlockCache.erase_if([&changed](BlockId blockId, const std::shared_ptr<NodeBlock>& nodeBlock) { return nodeBlock->globalNodeRefs || changed(blockId.packageId); });
+        _geometryBlockCache.erase_if([&changed](BlockId blockId, const std::shared_ptr<GeometryBlock>&) { return changed(blockId.packageId); });
+        _nameBlockCache.erase_if([&changed](BlockId blockId, const std::shared_ptr<NameBlock>&) { return changed(blockId.packageId); });
+        _rtreeNodeBlockCache.erase_if([&changed](BlockId blockId, const std::shared_ptr<RTreeNodeBlock>&) { return changed(blockId.packageId); });
+    }
+
+    RoutingGraph::NodePtr RoutingGraph::getNode(NodeId nodeId) const {
+        return NodePtr(getNodeBlock(nodeId.blockId()), nodeId.elementIndex());
     }
 
     std::string RoutingGraph::getNodeName(const Node& node) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return getNodeNameView(node).str();
+    }
 
+    std::vector<WGSPos> RoutingGraph::getNodeGeometry(const Node& node) const {
+        return getNodeGeometryView(node).toVector();
+    }
+
+    RoutingGraph::NameView RoutingGraph::getNodeNameView(const Node& node) const {
         NameId nameId = node.nodeData.nameId;
         std::shared_ptr<NameBlock> nameBlock;
-        if (!_nameBlockCache.read(nameId.blockId, nameBlock)) {
-            nameBlock = loadNameBlock(nameId.blockId);
-            _nameBlockCache.put(nameId.blockId, nameBlock);
+        if (!_nameBlockCache.read(nameId.blockId(), nameBlock)) {
+            nameBlock = loadNameBlock(nameId.blockId());
+            _nameBlockCache.put(nameId.blockId(), nameBlock);
         }
-        return nameBlock->names.at(nameId.elementIndex);
+        return NameView(std::move(nameBlock), nameId.elementIndex());
     }
 
-    std::vector<WGSPos> RoutingGraph::getNodeGeometry(const Node& node) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
-
+    RoutingGraph::GeometryView RoutingGraph::getNodeGeometryView(const Node& node) const {
         GeometryId geometryId = node.nodeData.geometryId;
-        std::shared_ptr<GeometryBlock> geometryBlock;
-        if (!_geometryBlockCache.read(geometryId.blockId, geometryBlock)) {
-            geometryBlock = loadGeometryBlock(geometryId.blockId);
-            _geometryBlockCache.put(geometryId.blockId, geometryBlock);
-        }
+        return GeometryView(getGeometryBlock(geometryId.blockId()), geometryId.elementIndex(), node.nodeData.geometryReversed);
+    }
+
+    double RoutingGraph::getNodeLength(NodeId nodeId) const {
+        std::shared_ptr<NodeBlock> nodeBlock = getNodeBlock(nodeId.blockId());
+
+        // Load lengths for the node block, if not yet loaded. The block may be shared by concurrent queries.
+        std::call_once(nodeBlock->nodeLengthsFlag, [this, &nodeBlock]() {
+            loadNodeLengths(*nodeBlock);
+        });
+        return nodeBlock->nodeLengths.at(nodeId.elementIndex());
+    }
 
-        std::vector<WGSPos> geometry;
-        geometry.reserve(geometryBlock->geometries.at(geometryId.elementIndex).size());
-        for (const Point& point : geometryBlock->geometries.at(geometryId.elementIndex)) {
-            geometry.emplace_back(fromPoint(point));
+    bool RoutingGraph::getIncomingEdges(NodeId nodeId, std::vector<std::pair<NodeId, Edge>>& edges) const {
+        std::shared_ptr<NodeBlock> nodeBlock = getNodeBlock(nodeId.blockId());
+
+        // Load incoming edges for the node block, if not yet loaded. The block may be shared by concurrent queries.
+        std::call_once(nodeBlock->incomingEdgesFlag, [this, &nodeBlock]() {
+            loadIncomingEdges(*nodeBlock);
+        });
+        if (nodeBlock->incomingEdgeOffsets.empty() || !getEquivalentNodeIds(nodeId).empty()) {
+            return false;
         }
-        if (node.nodeData.geometryReversed) {
-            std::reverse(geometry.begin(), geometry.end());
+
+        edges.clear();
+        std::size_t elementIndex = static_cast<std::size_t>(nodeId.elementIndex());
+        for (std::uint32_t i = nodeBlock->incomingEdgeOffsets.at(elementIndex); i < nodeBlock->incomingEdgeOffsets.at(elementIndex + 1); i++) {
+            NodeId sourceNodeId = nodeBlock->incomingEdgeSources[i];
+            NodePtr sourceNode = getNode(sourceNodeId);
+            std::uint32_t edgeIndex = nodeBlock->incomingEdgeIndices[i];
+            if (edgeIndex < sourceNode->firstEdge || edgeIndex >= sourceNode->lastEdge || sourceNode.block().getEdgeTargetNodeId(edgeIndex) != nodeId) {
+                throw std::runtime_error("Incoming edge table does not match node blocks");
+            }
+            edges.emplace_back(sourceNodeId, sourceNode.block().getEdge(edgeIndex));
         }
-        return geometry;
+        return true;
     }
 
+    // Blocks used by a group of nearby snap queries. These are kept for the group, skipping the shared cache lookups and r-tree node copies.
+    struct RoutingGraph::SnapCache {
+        explicit SnapCache(const RoutingGraph& graph) : _graph(graph) { }
+
+        const RTreeNode& getRTreeNode(RTreeNodeId rtreeNodeId) {
+            std::shared_ptr<RTreeNodeBlock>& rtreeNodeBlock = _rtreeNodeBlocks[rtreeNodeId.blockId()];
+            if (!rtreeNodeBlock) {
+                rtreeNodeBlock = _graph.getRTreeNodeBlock(rtreeNodeId.blockId());
+            }
+            return rtreeNodeBlock->rtreeNodes.at(rtreeNodeId.elementIndex());
+        }
+
+        const NodeBlock& getNodeBlock(BlockId blockId) {
+            std::shared_ptr<NodeBlock>& nodeBlock = _nodeBlocks[blockId];
+            if (!nodeBlock) {
+                nodeBlock = _graph.getNodeBlock(blockId);
+
+                // Load geometry bounds for the node block, if not yet loaded. The block may be shared by concurrent queries.
+                std::call_once(nodeBlock->nodeGeometryBoundsFlag, [this, &nodeBlock]() {
+                    _graph.loadNodeGeometryBounds(*nodeBlock);
+                });
+            }
+            return *nodeBlock;
+        }
+
+        GeometryView getNodeGeometryView(const Node& node) {
+            GeometryId geometryId = node.nodeData.geometryId;
+            std::shared_ptr<GeometryBlock>& geometryBlock = _geometryBlocks[geometryId.blockId()];
+            if (!geometryBlock) {
+                geometryBlock = _graph.getGeometryBlock(geometryId.blockId());
+            }
+            return GeometryView(geometryBlock, geometryId.elementIndex(), node.nodeData.geometryReversed);
+        }
+
+    private:
+        const RoutingGraph& _graph;
+        std::unordered_map<BlockId, std::shared_ptr<RTreeNodeBlock>, BlockId::Hash> _rtreeNodeBlocks;
+        std::unordered_map<BlockId, std::shared_ptr<NodeBlock>, BlockId::Hash> _nodeBlocks;
+        std::unordered_map<BlockId, std::shared_ptr<GeometryBlock>, BlockId::Hash> _geometryBlocks;
+    };
+
     std::vector<RoutingGraph::NearestNode> RoutingGraph::findNearestNode(const WGSPos& pos) const {
+        auto packages = getPackages();
+        SnapCache cache(*this);
+        return findNearestNodes(*packages, SnapQuery(pos), SnapOptions(), cache);
+    }
+
+    std::vector<std::vector<RoutingGraph::NearestNode>> RoutingGraph::findNearestNodes(const std::vector<SnapQuery>& queries, const SnapOptions& options) const {
+        static const std::size_t GROUP_SIZE = 64;
+
+        // Sort the queries spatially, consecutive queries form the groups
+        std::vector<std::pair<std::uint64_t, std::size_t>> order;
+        order.reserve(queries.size());
+        for (std::size_t i = 0; i < queries.size(); i++) {
+            order.emplace_back(getSpatialKey(queries[i].pos), i);
+        }
+        std::sort(order.begin(), order.end());
+        std::size_t groupCount = (order.size() + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        // Worker threads use the package set and the stats collector of the calling thread
+        const Snapshot snapshot(*this);
+        auto packages = getPackages();
+        const RoutingStatsCollector* statsCollector = RoutingStatsCollector::currentCollector();
+
+        std::vector<std::vector<NearestNode>> results(queries.size());
+        std::atomic<std::size_t> nextGroup(0);
+        std::mutex exceptionMutex;
+        std::exception_ptr exception;
+        auto processGroup = [&](std::size_t group) {
+            try {
+                SnapCache cache(*this);
+                for (std::size_t i = group * GROUP_SIZE; i < std::min(order.size(), (group + 1) * GROUP_SIZE); i++) {
+                    results[order[i].second] = findNearestNodes(*packages, queries[order[i].second], options, cache);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+                nextGroup = groupCount;
+            }
+        };
+
+        if (options.executor) {
+            // Caller provided thread pool, tasks may also run on the calling thread
+            options.executor(groupCount, [&](std::size_t group) {
+                const Snapshot workerSnapshot(snapshot, *this);
+                const RoutingStatsCollector workerStatsCollector(statsCollector);
+                if (nextGroup < groupCount) { // remaining groups are skipped after a failure
+                    processGroup(group);
+                }
+            });
+        }
+        else {
+            auto processGroups = [&]() {
+                for (std::size_t group = nextGroup++; group < groupCount; group = nextGroup++) {
+                    processGroup(group);
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (std::size_t i = 1; i < std::min(static_cast<std::size_t>(options.threadCount), groupCount); i++) {
+                threads.emplace_back([&]() {
+                    const Snapshot workerSnapshot(snapshot, *this);
+                    const RoutingStatsCollector workerStatsCollector(statsCollector);
+                    processGroups();
+                });
+            }
+            processGroups();
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return results;
+    }
+
+    std::vector<RoutingGraph::NearestNode> RoutingGraph::findNearestNodes(const PackageSet& packages, const SnapQuery& query, const SnapOptions& options, SnapCache& cache) const {
         static const double DIST_THRESHOLD = 1.01;
-        
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+
+        const WGSPos& pos = query.pos;
+        const double metersPerDegree = EARTH_RADIUS * DEG_TO_RAD;
+        const double maxDist = options.maxDistance / metersPerDegree;
+        const std::size_t maxResults = std::max(1u, options.maxResults);
+        RoutingStats* stats = RoutingStatsCollector::current();
+
+        // The longitude factor is taken at the query latitude for all segments
+        double lonFactor = std::cos(pos(0) * DEG_TO_RAD);
+        Point posPoint = toPoint(pos);
+        SegmentProjector projector(posPoint.lat, posPoint.lon, static_cast<float>(lonFactor));
+        std::vector<float> segmentDist2s;
+        std::vector<float> segmentRelPoses;
+
+        // Found nodes ordered by distance. Nodes farther than the last requested one are dropped, unless within the threshold
+        std::vector<std::pair<double, NearestNode>> bestNodes;
+        auto getSearchDist = [&bestNodes, maxDist, maxResults]() {
+            if (bestNodes.size() < maxResults) {
+                return maxDist;
+            }
+            return std::min(maxDist, bestNodes[maxResults - 1].first * DIST_THRESHOLD);
+        };
 
         // First build a priority queue of the packages, based on distance from package bounding box
         std::priority_queue<SearchRTreeNode> searchRTreeNodeQueue;
-        for (const Package& package : _packages) {
+        for (const Package& package : packages.packages) {
+            if (!package.active) {
+                continue;
+            }
             double dist = getBBoxDistance(pos, package.bbox);
             searchRTreeNodeQueue.emplace(RTreeNodeId(BlockId(package.packageId, 0), 0), dist);
         }
 
         // Process the queue in order, with early out
-        double bestDist = std::numeric_limits<double>::infinity();
-        std::vector<NearestNode> bestNodes;
         while (!searchRTreeNodeQueue.empty()) {
             SearchRTreeNode searchRTreeNode = searchRTreeNodeQueue.top();
-            if (searchRTreeNode.distance > bestDist * DIST_THRESHOLD) {
+            if (searchRTreeNode.distance > getSearchDist()) {
                 break;
             }
             searchRTreeNodeQueue.pop();
 
             // Add all children of the node to the queue
-            RTreeNode rtreeNode = loadRTreeNode(searchRTreeNode.rtreeNodeId);
+            const RTreeNode& rtreeNode = cache.getRTreeNode(searchRTreeNode.rtreeNodeId);
             for (const std::pair<WGSBounds, RTreeNodeId>& child : rtreeNode.children) {
                 double dist = getBBoxDistance(pos, child.first);
                 searchRTreeNodeQueue.emplace(child.second, dist);
             }
             for (const std::pair<WGSBounds, BlockId>& nodeBlockId : rtreeNode.nodeBlockIds) {
                 double dist = getBBoxDistance(pos, nodeBlockId.first);
-                if (dist > bestDist * DIST_THRESHOLD) {
+                if (dist > getSearchDist()) {
                     continue;
                 }
 
                 BlockId blockId = nodeBlockId.second;
-                std::shared_ptr<NodeBlock> nodeBlock;
-                if (!_nodeBlockCache.read(blockId, nodeBlock)) {
-                    nodeBlock = loadNodeBlock(blockId);
-                    _nodeBlockCache.put(blockId, nodeBlock);
-                }
-
-                // Fill bounds cache for the node block, if not yet created
-                if (nodeBlock->nodeGeometryBoundsCache.empty()) {
-                    nodeBlock->nodeGeometryBoundsCache.reserve(nodeBlock->nodes.size());
-                    for (unsigned int i = 0; i < nodeBlock->nodes.size(); i++) {
-                        const Node& node = nodeBlock->nodes[i];
-                        std::vector<WGSPos> geometry = getNodeGeometry(node);
-                        nodeBlock->nodeGeometryBoundsCache.push_back(WGSBounds::make_union(geometry.begin(), geometry.end()));
-                    }
-                }
+                const NodeBlock& nodeBlock = cache.getNodeBlock(blockId);
 
                 // Build priority queue of the nodes within the block, using distance to geometry bounding box
                 std::priority_queue<SearchGeometry> searchGeometryQueue;
-                for (unsigned int i = 0; i < nodeBlock->nodeGeometryBoundsCache.size(); i++) {
-                    double dist = getBBoxDistance(pos, nodeBlock->nodeGeometryBoundsCache[i]);
-                    if (dist <= bestDist * DIST_THRESHOLD) {
+                const std::vector<float>& bounds = nodeBlock.nodeGeometryBounds;
+                for (unsigned int i = 0; i * 4 < bounds.size(); i++) {
+                    double dist = getBBoxDistance(pos, WGSBounds(WGSPos(bounds[i * 4 + 0], bounds[i * 4 + 1]), WGSPos(bounds[i * 4 + 2], bounds[i * 4 + 3])));
+                    if (dist <= getSearchDist()) {
                         searchGeometryQueue.emplace(NodeId(blockId, i), dist);
                     }
                 }
@@ -183,98 +619,408 @@ namespace Nuti { namespace Routing {
                 // Process the node priority queue, with early out
                 while (!searchGeometryQueue.empty()) {
                     SearchGeometry searchGeometry = searchGeometryQueue.top();
-                    if (searchGeometry.distance > bestDist * DIST_THRESHOLD) {
+                    if (searchGeometry.distance > getSearchDist()) {
                         break;
                     }
                     searchGeometryQueue.pop();
+                    if (stats) {
+                        stats->snapCandidates++;
+                    }
 
-                    std::vector<WGSPos> geometry = getNodeGeometry(nodeBlock->nodes[searchGeometry.nodeId.elementIndex]);
-                    double t = 0;
-                    for (unsigned int j = 1; j < geometry.size(); j++) {
-                        WGSPos posProj = getClosestSegmentPoint(pos, geometry[j - 1], geometry[j]);
-                        double dist = getPointDistance(pos, posProj);
-                        if (dist <= bestDist * DIST_THRESHOLD) {
-                            if (dist * DIST_THRESHOLD < bestDist) {
-                                bestNodes.clear();
+                    GeometryView geometry = cache.getNodeGeometryView(nodeBlock.nodes[searchGeometry.nodeId.elementIndex()]);
+                    if (geometry.size() < 2) {
+                        continue;
+                    }
+
+                    // Project to all segments at once, the segments are in stored order
+                    std::size_t segments = geometry.size() - 1;
+                    segmentDist2s.resize(segments);
+                    segmentRelPoses.resize(segments);
+                    std::size_t bestSegment = projector.project(reinterpret_cast<const std::int32_t*>(geometry.data()), geometry.size(), segmentDist2s.data(), segmentRelPoses.data());
+                    if (std::sqrt(segmentDist2s[bestSegment]) * COORDINATE_SCALE > getSearchDist()) {
+                        continue;
+                    }
+
+                    // With bearing filter, use the closest segment in the direction of travel
+                    if (query.bearing >= 0) {
+                        bestSegment = segments;
+                        for (std::size_t segment = 0; segment < segments; segment++) {
+                            if (bestSegment < segments && segmentDist2s[segment] >= segmentDist2s[bestSegment]) {
+                                continue;
                             }
-                            bestDist = std::min(dist, bestDist);
-                            
-                            double len = 0;
-                            for (unsigned int j = 1; j < geometry.size(); j++) {
-                                len += cglib::length(geometry[j] - geometry[j - 1]);
+                            std::size_t j = geometry.reversed() ? segments - segment : segment + 1;
+                            WGSPos pos0 = geometry[j - 1];
+                            WGSPos pos1 = geometry[j];
+                            if (pos0(0) == pos1(0) && pos0(1) == pos1(1)) {
+                                continue;
                             }
-                            
-                            NearestNode newBestNode;
-                            newBestNode.nodePos = posProj;
-                            newBestNode.nodeId = searchGeometry.nodeId;
-                            newBestNode.geometrySegmentIndex = j;
-                            newBestNode.geometryRelPos = static_cast<float>((t + cglib::length(posProj - geometry[j - 1])) / len);
-                            bestNodes.push_back(newBestNode);
+                            double bearing = std::atan2((pos1(1) - pos0(1)) * lonFactor, pos1(0) - pos0(0)) / DEG_TO_RAD;
+                            if (std::abs(std::fmod(bearing - query.bearing + 540.0, 360.0) - 180.0) <= query.bearingRange) {
+                                bestSegment = segment;
+                            }
+                        }
+                        if (bestSegment == segments) {
+                            continue;
                         }
-                        t += cglib::length(geometry[j] - geometry[j - 1]);
+                    }
+
+                    double dist = std::sqrt(segmentDist2s[bestSegment]) * COORDINATE_SCALE;
+                    if (dist > getSearchDist()) {
+                        continue;
+                    }
+
+                    // Segment index and relative position in the node direction
+                    std::size_t j = geometry.reversed() ? segments - bestSegment : bestSegment + 1;
+                    double relPos = geometry.reversed() ? 1.0 - segmentRelPoses[bestSegment] : segmentRelPoses[bestSegment];
+                    WGSPos pos0 = geometry[j - 1];
+                    WGSPos pos1 = geometry[j];
+                    double t = 0;
+                    double len = 0;
+                    for (std::size_t k = 1; k < geometry.size(); k++) {
+                        double segmentLen = cglib::length(geometry[k] - geometry[k - 1]);
+                        t += (k < j ? segmentLen : 0);
+                        len += segmentLen;
+                    }
+
+                    NearestNode nearestNode;
+                    nearestNode.nodePos = pos0 + (pos1 - pos0) * relPos;
+                    nearestNode.nodeId = searchGeometry.nodeId;
+                    nearestNode.geometrySegmentIndex = static_cast<unsigned int>(j);
+                    nearestNode.geometryRelPos = len > 0 ? static_cast<float>((t + cglib::length(pos1 - pos0) * relPos) / len) : 0.0f;
+                    nearestNode.distance = static_cast<float>(dist * metersPerDegree);
+
+                    auto it = std::upper_bound(bestNodes.begin(), bestNodes.end(), dist, [](double value, const std::pair<double, NearestNode>& bestNode) {
+                        return value < bestNode.first;
+                    });
+                    bestNodes.insert(it, std::make_pair(dist, nearestNode));
+                    while (bestNodes.size() > maxResults && bestNodes.back().first > bestNodes[maxResults - 1].first * DIST_THRESHOLD) {
+                        bestNodes.pop_back();
                     }
                 }
             }
         }
-        return bestNodes;
+
+        std::vector<NearestNode> nearestNodes;
+        nearestNodes.reserve(bestNodes.size());
+        for (const std::pair<double, NearestNode>& bestNode : bestNodes) {
+            nearestNodes.push_back(bestNode.second);
+        }
+        return nearestNodes;
     }
     
-    std::shared_ptr<RoutingGraph::NodeBlock> RoutingGraph::loadNodeBlock(BlockId blockId) const {
-        if (blockId.packageId == -1) {
-            throw std::runtime_error("Bad package id");
+    void RoutingGraph::prefetchNodeBlock(BlockId blockId) const {
+        if (_prefetchThreads.empty() || blockId.packageId == -1 || _nodeBlockCache.exists(blockId)) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_prefetchMutex);
+        if (!_prefetchPendingBlockIds.insert(blockId).second) {
+            return;
+        }
+        if (_prefetchQueue.size() >= _settings.prefetchQueueSize) {
+            _prefetchPendingBlockIds.erase(blockId);
+            _prefetchDropped++;
+            return;
+        }
+        _prefetchRequests++;
+        _prefetchQueue.emplace_back([this, blockId]() {
+            try {
+                if (!_nodeBlockCache.exists(blockId)) {
+                    auto packages = getPackages();
+                    std::shared_ptr<NodeBlock> nodeBlock = loadNodeBlock(blockId);
+                    nodeBlock->prefetched = true;
+                    _nodeBlockCache.put(blockId, nodeBlock);
+                    if (!isCurrentPackageSet(packages)) {
+                        _nodeBlockCache.erase(blockId);
+                    }
+                    _prefetchLoads++;
+                }
+            }
+            catch (const std::exception&) {
+                // Ignore, the same error is reported when a query loads the block
+            }
+            std::lock_guard<std::mutex> lock(_prefetchMutex);
+            _prefetchPendingBlockIds.erase(blockId);
+        });
+        lock.unlock();
+        _prefetchCondition.notify_one();
+    }
+
+    void RoutingGraph::prefetchNearbyNodeBlocks(const WGSPos& pos) const {
+        if (_prefetchThreads.empty()) {
+            return;
+        }
+
+        // Traverse package R-trees in the background, queueing all node blocks within the prefetch radius
+        schedulePrefetch([this, pos]() {
+            auto packages = getPackages();
+            std::vector<RTreeNodeId> rtreeNodeIds;
+            for (const Package& package : packages->packages) {
+                if (package.active && getBBoxDistance(pos, package.bbox) <= _settings.prefetchRadius) {
+                    rtreeNodeIds.emplace_back(BlockId(package.packageId, 0), 0);
+                }
+            }
+            while (!rtreeNodeIds.empty()) {
+                RTreeNode rtreeNode = loadRTreeNode(rtreeNodeIds.back());
+                rtreeNodeIds.pop_back();
+                for (const std::pair<WGSBounds, RTreeNodeId>& child : rtreeNode.children) {
+                    if (getBBoxDistance(pos, child.first) <= _settings.prefetchRadius) {
+                        rtreeNodeIds.push_back(child.second);
+                    }
+                }
+                for (const std::pair<WGSBounds, BlockId>& nodeBlockId : rtreeNode.nodeBlockIds) {
+                    if (getBBoxDistance(pos, nodeBlockId.first) <= _settings.prefetchRadius) {
+                        prefetchNodeBlock(nodeBlockId.second);
+                    }
+                }
+            }
+        });
+    }
+
+    RoutingGraph::PrefetchStats RoutingGraph::getPrefetchStats() const {
+        PrefetchStats stats;
+        stats.requests = _prefetchRequests.load();
+        stats.loads = _prefetchLoads.load();
+        stats.hits = _prefetchHits.load();
+        stats.dropped = _prefetchDropped.load();
+        return stats;
+    }
+
+    RoutingGraph::CacheStats RoutingGraph::getCacheStats() const {
+        CacheStats stats;
+        stats.nodeBlocks = _nodeBlockCache.stats();
+        stats.geometryBlocks = _geometryBlockCache.stats();
+        stats.nameBlocks = _nameBlockCache.stats();
+        stats.rtreeNodeBlocks = _rtreeNodeBlockCache.stats();
+        if (_blockCacheMemoryBudget) {
+            stats.memoryBudget = _blockCacheMemoryBudget->max_bytes();
+            stats.memoryUsed = _blockCacheMemoryBudget->used_bytes();
+        }
+        stats.blocksRead = _blocksRead.load();
+        stats.bytesRead = _bytesRead.load();
+        return stats;
+    }
+
+    std::shared_ptr<RoutingGraph::NodeBlock> RoutingGraph::getNodeBlock(BlockId blockId) const {
+        std::shared_ptr<NodeBlock> nodeBlock;
+        if (!_nodeBlockCache.read(blockId, nodeBlock)) {
+            auto packages = getPackages();
+            nodeBlock = loadNodeBlock(blockId);
+            _nodeBlockCache.put(blockId, nodeBlock);
+            if (!isCurrentPackageSet(packages)) {
+                // Loaded from a pinned or outdated package set, do not leave it for queries on the current set
+                _nodeBlockCache.erase(blockId);
+            }
+        }
+        else if (nodeBlock->prefetched.load(std::memory_order_relaxed) && nodeBlock->prefetched.exchange(false)) {
+            _prefetchHits++;
+        }
+        return nodeBlock;
+    }
+
+    std::shared_ptr<RoutingGraph::GeometryBlock> RoutingGraph::getGeometryBlock(BlockId blockId) const {
+        std::shared_ptr<GeometryBlock> geometryBlock;
+        if (!_geometryBlockCache.read(blockId, geometryBlock)) {
+            geometryBlock = loadGeometryBlock(blockId);
+            _geometryBlockCache.put(blockId, geometryBlock);
+        }
+        return geometryBlock;
+    }
+
+    std::shared_ptr<RoutingGraph::RTreeNodeBlock> RoutingGraph::getRTreeNodeBlock(BlockId blockId) const {
+        std::shared_ptr<RTreeNodeBlock> rtreeNodeBlock;
+        if (!_rtreeNodeBlockCache.read(blockId, rtreeNodeBlock)) {
+            rtreeNodeBlock = loadRTreeNodeBlock(blockId);
+            _rtreeNodeBlockCache.put(blockId, rtreeNodeBlock);
+        }
+        return rtreeNodeBlock;
+    }
+
+    void RoutingGraph::schedulePrefetch(std::function<void()> task) const {
+        std::unique_lock<std::mutex> lock(_prefetchMutex);
+        if (_prefetchQueue.size() >= _settings.prefetchQueueSize) {
+            _prefetchDropped++;
+            return;
+        }
+        _prefetchQueue.push_back(std::move(task));
+        lock.unlock();
+        _prefetchCondition.notify_one();
+    }
+
+    void RoutingGraph::runPrefetcher() const {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_prefetchMutex);
+                _prefetchCondition.wait(lock, [this]() { return _prefetchStop || !_prefetchQueue.empty(); });
+                if (_prefetchStop) {
+                    return;
+                }
+                task = std::move(_prefetchQueue.front());
+                _prefetchQueue.pop_front();
+            }
+            try {
+                task();
+            }
+            catch (const std::exception&) {
+                // Prefetching is best effort, errors are reported when queries load the same blocks
+            }
+        }
+    }
+
+    std::shared_ptr<const RoutingGraph::PackageSet> RoutingGraph::getPackages() const {
+        if (pinnedGraph == this) {
+            return std::static_pointer_cast<const PackageSet>(pinnedPackages);
+        }
+        return std::atomic_load(&_packages);
+    }
+
+    bool RoutingGraph::isCurrentPackageSet(const std::shared_ptr<const PackageSet>& packages) const {
+        return std::atomic_load(&_packages) == packages;
+    }
+
+    const RoutingGraph::Package& RoutingGraph::getPackage(const PackageSet& packages, int packageId) {
+        const Package& package = packages.packages.at(packageId);
+        if (!package.active) {
+            throw std::runtime_error("Package not loaded");
+        }
+        return package;
+    }
+
+    int RoutingGraph::getBlockCount(const Package& package, const eiff::data_chunk& chunk) const {
+        std::uint32_t blockCount = 0;
+        if (const unsigned char* blockCountData = chunk.view(0, sizeof(blockCount))) {
+            std::memcpy(&blockCount, blockCountData, sizeof(blockCount));
+        }
+        else {
+            std::lock_guard<std::mutex> lock(*package.fileMutex);
+            std::vector<unsigned char> blockCountBytes(sizeof(blockCount));
+            chunk.read(blockCountBytes, 0, blockCountBytes.size());
+            std::memcpy(&blockCount, blockCountBytes.data(), sizeof(blockCount));
         }
+        return static_cast<int>(blockCount);
+    }
 
-        const Package& package = _packages.at(blockId.packageId);
+    bitstreams::input_bitstream RoutingGraph::readBlock(const Package& package, const eiff::data_chunk& chunk, int blockIndex) const {
+        eiff::data_chunk::size_type blockOffsetsOffset = sizeof(std::uint32_t) + static_cast<eiff::data_chunk::size_type>(blockIndex) * sizeof(std::uint64_t);
+
+        // Fast path for memory-addressable chunks: no copying, no seeking and no locking
+        if (const unsigned char* blockOffsetData = chunk.view(blockOffsetsOffset, 2 * sizeof(std::uint64_t))) {
+            std::uint64_t blockOffsets[2];
+            std::memcpy(blockOffsets, blockOffsetData, sizeof(blockOffsets));
+            if (blockOffsets[1] < blockOffsets[0]) {
+                throw std::runtime_error("Block offset table is corrupted");
+            }
+            std::size_t blockSize = static_cast<std::size_t>(blockOffsets[1] - blockOffsets[0]);
+            const unsigned char* blockData = chunk.view(blockOffsets[0], blockSize);
+            if (!blockData) {
+                throw std::runtime_error("Block offset table is corrupted");
+            }
+            _blocksRead++;
+            _bytesRead += blockSize;
+            if (RoutingStats* stats = RoutingStatsCollector::current()) {
+                stats->bytesRead += blockSize;
+            }
+            return bitstreams::input_bitstream(blockData, blockSize);
+        }
+
+        std::lock_guard<std::mutex> lock(*package.fileMutex);
 
         std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.nodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
+        chunk.read(blockOffsetData, blockOffsetsOffset, blockOffsetData.size());
         const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
 
         std::vector<unsigned char> block;
-        package.nodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        chunk.read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        _blocksRead++;
+        _bytesRead += block.size();
+        if (RoutingStats* stats = RoutingStatsCollector::current()) {
+            stats->bytesRead += block.size();
+        }
+        return bitstreams::input_bitstream(std::move(block));
+    }
 
-        bitstreams::input_bitstream bs(std::move(block));
+    std::shared_ptr<RoutingGraph::NodeBlock> RoutingGraph::loadNodeBlock(BlockId blockId) const {
+        if (blockId.packageId == -1) {
+            throw std::runtime_error("Bad package id");
+        }
+
+        BlockLoadStats loadStats(&RoutingStats::nodeBlocksLoaded);
+
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, blockId.packageId);
+
+        bitstreams::input_bitstream bs = readBlock(package, *package.nodeChunk, blockId.blockIndex);
 
         auto nodeBlock = std::make_shared<NodeBlock>();
+        nodeBlock->blockId = blockId;
 
         // Read block header
-        auto maxInternalNodeIndexBits = bs.read_bits<int>(6);
-        auto maxExternalNodeBlockBits = bs.read_bits<int>(6);
-        auto maxExternalNodeIndexBits = bs.read_bits<int>(6);
-        auto maxGlobalNodeBlockBits = bs.read_bits<int>(6);
-        auto maxGlobalNodeIndexBits = bs.read_bits<int>(6);
-        auto maxContractedNodeBlockBits = bs.read_bits<int>(6);
-        auto maxContractedNodeIndexBits = bs.read_bits<int>(6);
-        auto maxGeometryBlockBits = bs.read_bits<int>(6);
-        auto maxGeometryBlockDiffBits = bs.read_bits<int>(6);
-        auto maxGeometryIndexBits = bs.read_bits<int>(6);
-        auto maxNameBlockBits = bs.read_bits<int>(6);
-        auto maxNameBlockDiffBits = bs.read_bits<int>(6);
-        auto maxNameIndexBits = bs.read_bits<int>(6);
-        auto maxNodeOutDegreeBits = bs.read_bits<int>(6);
-        auto maxTravelModeBits = bs.read_bits<int>(6);
-        auto maxInstructionBits = bs.read_bits<int>(6);
-        auto smallWeightBits = bs.read_bits<int>(6);
-        auto largeWeightBits = bs.read_bits<int>(6);
+        auto maxInternalNodeIndexBits = bs.read_bits<int, 6>();
+        auto maxExternalNodeBlockBits = bs.read_bits<int, 6>();
+        auto maxExternalNodeIndexBits = bs.read_bits<int, 6>();
+        auto maxGlobalNodeBlockBits = bs.read_bits<int, 6>();
+        auto maxGlobalNodeIndexBits = bs.read_bits<int, 6>();
+        auto maxContractedNodeBlockBits = bs.read_bits<int, 6>();
+        auto maxContractedNodeIndexBits = bs.read_bits<int, 6>();
+        auto maxGeometryBlockBits = bs.read_bits<int, 6>();
+        auto maxGeometryBlockDiffBits = bs.read_bits<int, 6>();
+        auto maxGeometryIndexBits = bs.read_bits<int, 6>();
+        auto maxNameBlockBits = bs.read_bits<int, 6>();
+        auto maxNameBlockDiffBits = bs.read_bits<int, 6>();
+        auto maxNameIndexBits = bs.read_bits<int, 6>();
+        auto maxNodeOutDegreeBits = bs.read_bits<int, 6>();
+        auto maxTravelModeBits = bs.read_bits<int, 6>();
+        auto maxInstructionBits = bs.read_bits<int, 6>();
+        auto smallWeightBits = bs.read_bits<int, 6>();
+        auto largeWeightBits = bs.read_bits<int, 6>();
         auto minGeometryBlockId = bs.read_bits<unsigned int>(maxGeometryBlockBits);
         auto minNameBlockId = bs.read_bits<unsigned int>(maxNameBlockBits);
 
+        // Decoded ids must address existing blocks and fit the element index field, ElementId would silently wrap them
+        int nodeBlockCount = getBlockCount(package, *package.nodeChunk);
+        int geometryBlockCount = getBlockCount(package, *package.geometryChunk);
+        int nameBlockCount = getBlockCount(package, *package.nameChunk);
+        auto makeElementId = [&package](std::int64_t blockIndex, std::int64_t elementIndex, std::int64_t blockCount, const char* error) {
+            if (blockIndex < 0 || blockIndex >= blockCount || elementIndex < 0 || elementIndex > ElementId::MAX_ELEMENT_INDEX) {
+                throw std::runtime_error(error);
+            }
+            return ElementId(BlockId(package.packageId, static_cast<int>(blockIndex)), static_cast<int>(elementIndex));
+        };
+
+        // References to nodes in other blocks are stored once per block, local nodes by their index
+        std::unordered_map<NodeId, std::uint32_t, NodeId::Hash> externalNodeRefs;
+        auto getNodeRef = [&](NodeId nodeId) -> std::uint32_t {
+            if (nodeId.valid() && nodeId.blockId() == blockId) {
+                return static_cast<std::uint32_t>(nodeId.elementIndex());
+            }
+            auto it = externalNodeRefs.find(nodeId);
+            if (it != externalNodeRefs.end()) {
+                return it->second;
+            }
+            std::uint32_t nodeRef = static_cast<std::uint32_t>(nodeBlock->externalNodeIds.size()) | NodeBlock::EXTERNAL_NODE_FLAG;
+            nodeBlock->externalNodeIds.push_back(nodeId);
+            externalNodeRefs.emplace(nodeId, nodeRef);
+            return nodeRef;
+        };
+
         // Store nodes and outgoing edges
-        auto nodeCount = bs.read_bits<int>(32);
+        auto nodeCount = bs.read_bits<int, 32>();
+        if (nodeCount < 0 || nodeCount > NodeId::MAX_ELEMENT_INDEX) {
+            throw std::runtime_error("Block node table is corrupted");
+        }
         nodeBlock->nodes.reserve(nodeCount);
-        std::vector<unsigned> nodeEdgeCount;
-        nodeEdgeCount.reserve(nodeCount);
         for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++) {
             nodeBlock->nodes.emplace_back();
             Node& node = nodeBlock->nodes.back();
             auto edgeCount = bs.read_bits<int>(maxNodeOutDegreeBits);
-            auto geometryBlockId = minGeometryBlockId + bs.read_bits<unsigned int>(maxGeometryBlockDiffBits);
+            auto geometryBlockId = static_cast<std::int64_t>(minGeometryBlockId) + bs.read_bits<unsigned int>(maxGeometryBlockDiffBits);
             auto geometryIndexId = bs.read_bits<unsigned int>(maxGeometryIndexBits);
-            node.nodeData.geometryId = GeometryId(BlockId(package.packageId, geometryBlockId), geometryIndexId);
+            node.nodeData.geometryId = makeElementId(geometryBlockId, geometryIndexId, geometryBlockCount, "Block node geometry id is corrupted");
             node.nodeData.geometryReversed = bs.read_bit();
-            auto nameBlockId = minNameBlockId + bs.read_bits<unsigned int>(maxNameBlockDiffBits);
+            auto nameBlockId = static_cast<std::int64_t>(minNameBlockId) + bs.read_bits<unsigned int>(maxNameBlockDiffBits);
             auto nameIndexId = bs.read_bits<unsigned int>(maxNameIndexBits);
-            node.nodeData.nameId = NameId(BlockId(package.packageId, nameBlockId), nameIndexId);
+            node.nodeData.nameId = makeElementId(nameBlockId, nameIndexId, nameBlockCount, "Block node name id is corrupted");
             node.nodeData.travelMode = bs.read_bits<unsigned char>(maxTravelModeBits);
             if (bs.read_bit()) {
                 node.nodeData.weight = bs.read_bits<unsigned int>(largeWeightBits);
@@ -283,75 +1029,89 @@ namespace Nuti { namespace Routing {
                 node.nodeData.weight = bs.read_bits<unsigned int>(smallWeightBits);
             }
 
-            nodeEdgeCount.push_back(edgeCount);
+            node.firstEdge = static_cast<std::uint32_t>(nodeBlock->edgeTargets.size());
             while (edgeCount-- > 0) {
-                nodeBlock->edges.emplace_back();
-                Edge& edge = nodeBlock->edges.back();
+                std::uint32_t targetNodeRef = 0;
                 if (bs.read_bit()) {
                     auto delta = bs.read_bits<unsigned int>(maxExternalNodeBlockBits);
-                    auto targetBlockIndex = blockId.blockIndex - delta;
+                    auto targetBlockIndex = static_cast<std::int32_t>(static_cast<std::uint32_t>(blockId.blockIndex) - delta); // deltas to later blocks wrap around
                     auto targetNodeIndex = bs.read_bits<unsigned int>(maxExternalNodeIndexBits);
-                    edge.targetNodeId = NodeId(BlockId(package.packageId, targetBlockIndex), targetNodeIndex);
+                    targetNodeRef = getNodeRef(makeElementId(targetBlockIndex, targetNodeIndex, nodeBlockCount, "Block edge target is corrupted"));
                 }
                 else {
                     auto delta = bs.read_bits<unsigned int>(maxInternalNodeIndexBits);
                     if (delta == 0) {
                         auto globalTargetBlockIndex = bs.read_bits<unsigned int>(maxGlobalNodeBlockBits);
                         auto globalTargetNodeIndex = bs.read_bits<unsigned int>(maxGlobalNodeIndexBits);
-                        edge.targetNodeId = resolveGlobalNodeId(NodeId(BlockId(package.packageId, globalTargetBlockIndex), globalTargetNodeIndex));
+                        targetNodeRef = getNodeRef(resolveGlobalNodeId(*packages, makeElementId(globalTargetBlockIndex, globalTargetNodeIndex, NodeId::MAX_BLOCK_INDEX + 1, "Block edge target is corrupted")));
+                        nodeBlock->globalNodeRefs = true;
                     }
                     else {
-                        auto targetNodeIndex = nodeIndex - delta;
-                        edge.targetNodeId = NodeId(blockId, targetNodeIndex);
+                        targetNodeRef = static_cast<std::uint32_t>(nodeIndex - delta);
                     }
                 }
-                edge.forward = bs.read_bit();
-                edge.backward = bs.read_bit();
+                std::uint8_t flags = 0;
+                flags |= bs.read_bit() ? NodeBlock::FORWARD_FLAG : 0;
+                flags |= bs.read_bit() ? NodeBlock::BACKWARD_FLAG : 0;
+                std::uint32_t weight = 0;
                 if (bs.read_bit()) {
-                    edge.edgeData.weight = bs.read_bits<unsigned int>(largeWeightBits);
+                    weight = bs.read_bits<unsigned int>(largeWeightBits);
                 }
                 else {
-                    edge.edgeData.weight = bs.read_bits<unsigned int>(smallWeightBits);
+                    weight = bs.read_bits<unsigned int>(smallWeightBits);
                 }
+                std::uint32_t contractedNodeRef = 0;
+                std::uint8_t turnInstruction = 0;
                 if (bs.read_bit()) {
-                    edge.contracted = true;
+                    flags |= NodeBlock::CONTRACTED_FLAG;
                     if (bs.read_bit()) {
-                        auto delta = decodeZigZagValue(bs.read_bits<unsigned int>(maxContractedNodeBlockBits));
-                        auto contractedBlockIndex = blockId.blockIndex + delta;
+                        auto delta = bs.read_zigzag(maxContractedNodeBlockBits);
+                        auto contractedBlockIndex = static_cast<std::int64_t>(blockId.blockIndex) + delta;
                         auto contractedNodeIndex = bs.read_bits<unsigned int>(maxContractedNodeIndexBits);
-                        edge.contractedNodeId = NodeId(BlockId(package.packageId, contractedBlockIndex), contractedNodeIndex);
+                        contractedNodeRef = getNodeRef(makeElementId(contractedBlockIndex, contractedNodeIndex, nodeBlockCount, "Block contracted node is corrupted"));
                     }
                     else {
                         auto delta = bs.read_bits<unsigned int>(maxInternalNodeIndexBits);
                         if (delta == 0) {
                             auto globalContractedBlockIndex = bs.read_bits<unsigned int>(maxGlobalNodeBlockBits);
                             auto globalContractedNodeIndex = bs.read_bits<unsigned int>(maxGlobalNodeIndexBits);
-                            edge.contractedNodeId = resolveGlobalNodeId(NodeId(BlockId(package.packageId, globalContractedBlockIndex), globalContractedNodeIndex));
+                            contractedNodeRef = getNodeRef(resolveGlobalNodeId(*packages, makeElementId(globalContractedBlockIndex, globalContractedNodeIndex, NodeId::MAX_BLOCK_INDEX + 1, "Block contracted node is corrupted")));
+                            nodeBlock->globalNodeRefs = true;
                         }
                         else {
-                            auto contractedNodeIndex = nodeIndex - delta;
-                            edge.contractedNodeId = NodeId(blockId, contractedNodeIndex);
+                            contractedNodeRef = static_cast<std::uint32_t>(nodeIndex - delta);
                         }
                     }
                 }
                 else {
-                    edge.contracted = false;
-                    edge.edgeData.turnInstruction = bs.read_bits<unsigned char>(maxInstructionBits);
+                    turnInstruction = bs.read_bits<unsigned char>(maxInstructionBits);
                 }
+                nodeBlock->edgeTargets.push_back(targetNodeRef);
+                nodeBlock->edgeWeights.push_back(weight);
+                nodeBlock->edgeFlags.push_back(flags);
+                nodeBlock->edgeTurnInstructions.push_back(turnInstruction);
+                nodeBlock->edgeContractedNodes.push_back(contractedNodeRef);
             }
+            node.lastEdge = static_cast<std::uint32_t>(nodeBlock->edgeTargets.size());
         }
-        
-        // Link node edge iterators to edge table
-        unsigned edgeIndex = 0;
-        for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++) {
-            Node& node = nodeBlock->nodes[nodeIndex];
-            node.firstEdge = nodeBlock->edges.data() + edgeIndex;
-            edgeIndex += nodeEdgeCount[nodeIndex];
-            node.lastEdge = nodeBlock->edges.data() + edgeIndex;
-        }
-        if (edgeIndex != nodeBlock->edges.size()) {
-            throw std::runtime_error("Block node/edge table is corrupted");
+
+        // Local references must point inside the block
+        for (std::uint32_t edgeIndex = 0; edgeIndex < nodeBlock->edgeTargets.size(); edgeIndex++) {
+            for (std::uint32_t nodeRef : { nodeBlock->edgeTargets[edgeIndex], nodeBlock->edgeContractedNodes[edgeIndex] }) {
+                bool external = (nodeRef & NodeBlock::EXTERNAL_NODE_FLAG) != 0;
+                if ((nodeRef & ~static_cast<std::uint32_t>(NodeBlock::EXTERNAL_NODE_FLAG)) >= (external ? nodeBlock->externalNodeIds.size() : nodeBlock->nodes.size())) {
+                    throw std::runtime_error("Block node/edge table is corrupted");
+                }
+            }
         }
+
+        // The per-edge arrays are final, release reserve capacity as the block may stay cached for a long time
+        nodeBlock->edgeTargets.shrink_to_fit();
+        nodeBlock->edgeWeights.shrink_to_fit();
+        nodeBlock->edgeFlags.shrink_to_fit();
+        nodeBlock->edgeTurnInstructions.shrink_to_fit();
+        nodeBlock->edgeContractedNodes.shrink_to_fit();
+        nodeBlock->externalNodeIds.shrink_to_fit();
         
         return nodeBlock;
     }
@@ -361,32 +1121,28 @@ namespace Nuti { namespace Routing {
             throw std::runtime_error("Bad package id");
         }
 
-        const Package& package = _packages.at(blockId.packageId);
+        BlockLoadStats loadStats(&RoutingStats::geometryBlocksLoaded);
 
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.geometryChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, blockId.packageId);
 
-        std::vector<unsigned char> block;
-        package.geometryChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
-
-        bitstreams::input_bitstream bs(std::move(block));
+        bitstreams::input_bitstream bs = readBlock(package, *package.geometryChunk, blockId.blockIndex);
 
         auto geometryBlock = std::make_shared<GeometryBlock>();
 
         // Read block header
-        auto maxLatDiffBits = bs.read_bits<int>(6);
-        auto maxLonDiffBits = bs.read_bits<int>(6);
-        auto maxGeometrySizeBits = bs.read_bits<int>(6);
-        auto minLat = bs.read_bits<int>(32);
-        auto minLon = bs.read_bits<int>(32);
+        auto maxLatDiffBits = bs.read_bits<int, 6>();
+        auto maxLonDiffBits = bs.read_bits<int, 6>();
+        auto maxGeometrySizeBits = bs.read_bits<int, 6>();
+        auto minLat = bs.read_bits<int, 32>();
+        auto minLon = bs.read_bits<int, 32>();
         
         // Read geometry list
-        auto geometryCount = bs.read_bits<int>(32);
+        auto geometryCount = bs.read_bits<int, 32>();
         geometryBlock->geometries.reserve(geometryCount);
         while (geometryCount-- > 0) {
-            auto maxLatZigZagBits = bs.read_bits<int>(6);
-            auto maxLonZigZagBits = bs.read_bits<int>(6);
+            auto maxLatZigZagBits = bs.read_bits<int, 6>();
+            auto maxLonZigZagBits = bs.read_bits<int, 6>();
             auto lat = minLat + bs.read_bits<int>(maxLatDiffBits);
             auto lon = minLon + bs.read_bits<int>(maxLonDiffBits);
 
@@ -396,8 +1152,8 @@ namespace Nuti { namespace Routing {
             geometry.reserve(geometrySize + 1);
             geometry.emplace_back(lat, lon);
             while (geometrySize-- > 0) {
-                lat += decodeZigZagValue(bs.read_bits<int>(maxLatZigZagBits));
-                lon += decodeZigZagValue(bs.read_bits<int>(maxLonZigZagBits));
+                lat += bs.read_zigzag(maxLatZigZagBits);
+                lon += bs.read_zigzag(maxLonZigZagBits);
                 geometry.emplace_back(lat, lon);
             }
             geometryBlock->geometries.push_back(std::move(geometry));
@@ -411,98 +1167,81 @@ namespace Nuti { namespace Routing {
             throw std::runtime_error("Bad package id");
         }
 
-        const Package& package = _packages.at(blockId.packageId);
-
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.nameChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
+        BlockLoadStats loadStats(&RoutingStats::nameBlocksLoaded);
 
-        std::vector<unsigned char> block;
-        package.nameChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, blockId.packageId);
 
-        bitstreams::input_bitstream bs(std::move(block));
+        bitstreams::input_bitstream bs = readBlock(package, *package.nameChunk, blockId.blockIndex);
 
         auto nameBlock = std::make_shared<NameBlock>();
 
         // Read block header
-        auto maxLengthBits = bs.read_bits<int>(6);
+        auto maxLengthBits = bs.read_bits<int, 6>();
 
         // Read name list
-        auto nameCount = bs.read_bits<int>(32);
+        auto nameCount = bs.read_bits<int, 32>();
         nameBlock->names.reserve(nameCount);
         while (nameCount-- > 0) {
             auto length = bs.read_bits<int>(maxLengthBits);
             std::string name;
             name.reserve(length);
-            while (length-- > 0) {
-                name.append(1, bs.read_bits<unsigned char>(8));
-            }
+            bs.read_bytes(std::back_inserter(name), length);
             nameBlock->names.push_back(std::move(name));
         }
 
         return nameBlock;
     }
     
-    std::shared_ptr<RoutingGraph::GlobalNodeBlock> RoutingGraph::loadGlobalNodeBlock(BlockId blockId) const {
-        if (blockId.packageId == -1) {
-            throw std::runtime_error("Bad package id");
-        }
-        
-        const Package& package = _packages.at(blockId.packageId);
+    std::shared_ptr<const RoutingGraph::LinkTable> RoutingGraph::loadLinkTable(const Package& package) const {
+        auto linkTable = std::make_shared<LinkTable>();
+        std::unordered_map<std::string, int> packageIndices;
         
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.globalNodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
-        
-        std::vector<unsigned char> block;
-        package.globalNodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
-        
-        bitstreams::input_bitstream bs(std::move(block));
-        
-        auto globalNodeBlock = std::make_shared<GlobalNodeBlock>();
-        
-        auto maxPackageNameBits = bs.read_bits<int>(6);
-        auto maxPackagesPerNodeBits = bs.read_bits<int>(6);
-        auto maxGlobalNodeBlockBits = bs.read_bits<int>(6);
-        auto maxGlobalNodeIndexBits = bs.read_bits<int>(6);
-        
-        std::vector<int> packageIds;
-        auto packagesCount = bs.read_bits<int>(32);
-        packageIds.reserve(packagesCount);
-        while (packagesCount-- > 0) {
-            std::string packageName;
-            auto packageLength = bs.read_bits<int>(maxPackageNameBits);
-            packageName.reserve(packageLength);
-            while (packageLength-- > 0) {
-                packageName.append(1, bs.read_bits<char>(8));
-            }
-            int packageId = -1;
-            for (const Package& package : _packages) {
-                if (package.packageName == packageName) {
-                    packageId = package.packageId;
-                    break;
+        int blockCount = getBlockCount(package, *package.globalNodeChunk);
+        for (int blockIndex = 0; blockIndex < blockCount; blockIndex++) {
+            bitstreams::input_bitstream bs = readBlock(package, *package.globalNodeChunk, blockIndex);
+            
+            auto maxPackageNameBits = bs.read_bits<int, 6>();
+            auto maxPackagesPerNodeBits = bs.read_bits<int, 6>();
+            auto maxGlobalNodeBlockBits = bs.read_bits<int, 6>();
+            auto maxGlobalNodeIndexBits = bs.read_bits<int, 6>();
+            
+            // Package names are listed in each block, map them to the names shared by all blocks
+            std::vector<int> blockPackageIndices;
+            auto packagesCount = bs.read_bits<int, 32>();
+            blockPackageIndices.reserve(packagesCount);
+            while (packagesCount-- > 0) {
+                std::string packageName;
+                auto packageLength = bs.read_bits<int>(maxPackageNameBits);
+                packageName.reserve(packageLength);
+                bs.read_bytes(std::back_inserter(packageName), packageLength);
+                auto it = packageIndices.emplace(packageName, static_cast<int>(linkTable->packageNames.size())).first;
+                if (it->second == static_cast<int>(linkTable->packageNames.size())) {
+                    linkTable->packageNames.push_back(std::move(packageName));
                 }
+                blockPackageIndices.push_back(it->second);
             }
-            packageIds.push_back(packageId);
-        }
-        
-        auto globalNodeCount = bs.read_bits<int>(32);
-        globalNodeBlock->globalNodeIds.reserve(globalNodeCount);
-        while (globalNodeCount-- > 0) {
-            NodeId globalNodeId;
-            auto nodePackagesCount = bs.read_bits<int>(maxPackagesPerNodeBits);
-            while (nodePackagesCount-- > 0) {
-                auto packageIndex = bs.read_bits<int>(maxPackagesPerNodeBits);
-                auto blockIndex = bs.read_bits<int>(maxGlobalNodeBlockBits);
-                auto nodeIndex = bs.read_bits<int>(maxGlobalNodeIndexBits);
-                if (packageIds.at(packageIndex) != -1) {
-                    globalNodeId = NodeId(BlockId(packageIds.at(packageIndex), blockIndex), nodeIndex);
+            
+            linkTable->blockOffsets.push_back(static_cast<std::uint32_t>(linkTable->linkOffsets.size()));
+            auto globalNodeCount = bs.read_bits<int, 32>();
+            while (globalNodeCount-- > 0) {
+                linkTable->linkOffsets.push_back(static_cast<std::uint32_t>(linkTable->links.size()));
+                auto nodePackagesCount = bs.read_bits<int>(maxPackagesPerNodeBits);
+                while (nodePackagesCount-- > 0) {
+                    auto packageIndex = bs.read_bits<int>(maxPackagesPerNodeBits);
+                    auto blockIndex = bs.read_bits<int>(maxGlobalNodeBlockBits);
+                    auto nodeIndex = bs.read_bits<int>(maxGlobalNodeIndexBits);
+                    linkTable->links.emplace_back(blockPackageIndices.at(packageIndex), blockIndex, nodeIndex);
                 }
             }
-            globalNodeBlock->globalNodeIds.push_back(globalNodeId);
         }
-
-        return globalNodeBlock;
+        linkTable->blockOffsets.push_back(static_cast<std::uint32_t>(linkTable->linkOffsets.size()));
+        linkTable->linkOffsets.push_back(static_cast<std::uint32_t>(linkTable->links.size()));
+        
+        linkTable->blockOffsets.shrink_to_fit();
+        linkTable->linkOffsets.shrink_to_fit();
+        linkTable->links.shrink_to_fit();
+        return linkTable;
     }
     
     std::shared_ptr<RoutingGraph::RTreeNodeBlock> RoutingGraph::loadRTreeNodeBlock(BlockId blockId) const {
@@ -510,32 +1249,28 @@ namespace Nuti { namespace Routing {
             throw std::runtime_error("Bad package id");
         }
         
-        const Package& package = _packages.at(blockId.packageId);
+        BlockLoadStats loadStats(&RoutingStats::rtreeNodeBlocksLoaded);
 
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.rtreeNodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
-        
-        std::vector<unsigned char> block;
-        package.rtreeNodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
-        
-        bitstreams::input_bitstream bs(std::move(block));
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, blockId.packageId);
+
+        bitstreams::input_bitstream bs = readBlock(package, *package.rtreeNodeChunk, blockId.blockIndex);
         
         auto rtreeNodeBlock = std::make_shared<RTreeNodeBlock>();
 
-        auto maxRTreeBlockBits = bs.read_bits<int>(6);
-        auto maxRTreeIndexBits = bs.read_bits<int>(6);
-        auto maxNodeBlockBits = bs.read_bits<int>(6);
-        auto maxSizeBits = bs.read_bits<int>(6);
-        auto maxLatDiffBits = bs.read_bits<int>(6);
-        auto maxLonDiffBits = bs.read_bits<int>(6);
-        auto maxLatDiffBits2 = bs.read_bits<int>(6);
-        auto maxLonDiffBits2 = bs.read_bits<int>(6);
+        auto maxRTreeBlockBits = bs.read_bits<int, 6>();
+        auto maxRTreeIndexBits = bs.read_bits<int, 6>();
+        auto maxNodeBlockBits = bs.read_bits<int, 6>();
+        auto maxSizeBits = bs.read_bits<int, 6>();
+        auto maxLatDiffBits = bs.read_bits<int, 6>();
+        auto maxLonDiffBits = bs.read_bits<int, 6>();
+        auto maxLatDiffBits2 = bs.read_bits<int, 6>();
+        auto maxLonDiffBits2 = bs.read_bits<int, 6>();
         
-        auto minLat = bs.read_bits<int>(32);
-        auto minLon = bs.read_bits<int>(32);
+        auto minLat = bs.read_bits<int, 32>();
+        auto minLon = bs.read_bits<int, 32>();
         
-        auto nodeCount = bs.read_bits<int>(32);
+        auto nodeCount = bs.read_bits<int, 32>();
         rtreeNodeBlock->rtreeNodes.reserve(nodeCount);
         while (nodeCount-- > 0) {
             RTreeNode rtreeNode;
@@ -569,38 +1304,152 @@ namespace Nuti { namespace Routing {
         return rtreeNodeBlock;
     }
     
-    RoutingGraph::NodeId RoutingGraph::resolveGlobalNodeId(GlobalNodeId globalNodeId) const {
-        std::shared_ptr<GlobalNodeBlock> globalNodeBlock;
-        if (!_globalNodeBlockCache.read(globalNodeId.blockId, globalNodeBlock)) {
-            globalNodeBlock = loadGlobalNodeBlock(globalNodeId.blockId);
-            _globalNodeBlockCache.put(globalNodeId.blockId, globalNodeBlock);
+    void RoutingGraph::loadNodeGeometryBounds(NodeBlock& nodeBlock) const {
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, nodeBlock.blockId.packageId);
+
+        std::vector<float> bounds;
+        bounds.reserve(nodeBlock.nodes.size() * 4);
+        if (package.nodeBoundsChunk) {
+            // Bounds are stored per node block, using the same block index. Coordinates are quantized (floored)
+            // to (1 << quantizationBits) units and delta coded relative to the block minimum, the stored size excludes the last unit.
+            bitstreams::input_bitstream bs = readBlock(package, *package.nodeBoundsChunk, nodeBlock.blockId.blockIndex);
+
+            auto quantizationBits = bs.read_bits<int, 6>();
+            auto maxLatDiffBits = bs.read_bits<int, 6>();
+            auto maxLonDiffBits = bs.read_bits<int, 6>();
+            auto maxLatSizeBits = bs.read_bits<int, 6>();
+            auto maxLonSizeBits = bs.read_bits<int, 6>();
+            auto minLat = bs.read_bits<int, 32>();
+            auto minLon = bs.read_bits<int, 32>();
+
+            auto nodeCount = bs.read_bits<int, 32>();
+            if (nodeCount != static_cast<int>(nodeBlock.nodes.size())) {
+                throw std::runtime_error("Node bounds block does not match node block");
+            }
+            while (nodeCount-- > 0) {
+                auto lat0 = minLat + bs.read_bits<int>(maxLatDiffBits);
+                auto lon0 = minLon + bs.read_bits<int>(maxLonDiffBits);
+                auto lat1 = lat0 + bs.read_bits<int>(maxLatSizeBits) + 1;
+                auto lon1 = lon0 + bs.read_bits<int>(maxLonSizeBits) + 1;
+                addBounds(bounds, Point(lat0 * (1 << quantizationBits), lon0 * (1 << quantizationBits)), Point(lat1 * (1 << quantizationBits), lon1 * (1 << quantizationBits)));
+            }
         }
-        return globalNodeBlock->globalNodeIds.at(globalNodeId.elementIndex);
+        else {
+            // No persisted bounds, calculate these from geometry blocks without building per node WGSPos vectors
+            for (const Node& node : nodeBlock.nodes) {
+                GeometryId geometryId = node.nodeData.geometryId;
+                std::shared_ptr<GeometryBlock> geometryBlock = getGeometryBlock(geometryId.blockId());
+
+                const std::vector<Point>& geometry = geometryBlock->geometries.at(geometryId.elementIndex());
+                Point min(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+                Point max(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+                for (const Point& point : geometry) {
+                    min = Point(std::min(min.lat, point.lat), std::min(min.lon, point.lon));
+                    max = Point(std::max(max.lat, point.lat), std::max(max.lon, point.lon));
+                }
+                addBounds(bounds, min, max);
+            }
+        }
+        nodeBlock.nodeGeometryBounds = std::move(bounds);
     }
 
-    RoutingGraph::RTreeNode RoutingGraph::loadRTreeNode(RTreeNodeId rtreeNodeId) const {
-        std::shared_ptr<RTreeNodeBlock> rtreeNodeBlock;
-        if (!_rtreeNodeBlockCache.read(rtreeNodeId.blockId, rtreeNodeBlock)) {
-            rtreeNodeBlock = loadRTreeNodeBlock(rtreeNodeId.blockId);
-            _rtreeNodeBlockCache.put(rtreeNodeId.blockId, rtreeNodeBlock);
+    void RoutingGraph::loadNodeLengths(NodeBlock& nodeBlock) const {
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, nodeBlock.blockId.packageId);
+
+        std::vector<float> lengths;
+        lengths.reserve(nodeBlock.nodes.size());
+        if (package.nodeLengthsChunk) {
+            // Lengths are stored per node block, using the same block index, in decimeters
+            bitstreams::input_bitstream bs = readBlock(package, *package.nodeLengthsChunk, nodeBlock.blockId.blockIndex);
+
+            auto lengthBits = bs.read_bits<int, 6>();
+            auto nodeCount = bs.read_bits<int, 32>();
+            if (nodeCount != static_cast<int>(nodeBlock.nodes.size())) {
+                throw std::runtime_error("Node lengths block does not match node block");
+            }
+            while (nodeCount-- > 0) {
+                lengths.push_back(bs.read_bits<unsigned int>(lengthBits) * 0.1f);
+            }
         }
-        return rtreeNodeBlock->rtreeNodes.at(rtreeNodeId.elementIndex);
+        else {
+            // No persisted lengths, calculate these from geometry blocks
+            for (const Node& node : nodeBlock.nodes) {
+                GeometryId geometryId = node.nodeData.geometryId;
+                std::shared_ptr<GeometryBlock> geometryBlock = getGeometryBlock(geometryId.blockId());
+
+                const std::vector<Point>& geometry = geometryBlock->geometries.at(geometryId.elementIndex());
+                double length = 0;
+                for (std::size_t i = 1; i < geometry.size(); i++) {
+                    length += getGreatCircleDistance(fromPoint(geometry[i - 1]), fromPoint(geometry[i]));
+                }
+                lengths.push_back(static_cast<float>(length));
+            }
+        }
+        nodeBlock.nodeLengths = std::move(lengths);
     }
-    
-    WGSPos RoutingGraph::getClosestSegmentPoint(const WGSPos& pos, const WGSPos& p0, const WGSPos& p1) {
-        // TODO: questionable approximation, we should project all positions to EPSG3857 and the result back
-        double lonFactor = std::cos((p0(0) + p1(0)) * 0.5 * DEG_TO_RAD);
-        cglib::vec2<double> dp = p1 - p0;
-        dp(1) *= lonFactor;
-        double len2 = cglib::dot_product(dp, dp);
-        if (len2 == 0) {
-            return p0;
-        }
-        cglib::vec2<double> dpos = pos - p0;
-        dpos(1) *= lonFactor;
-        double t = cglib::dot_product(dp, dpos);
-        WGSPos posProj = p0 + cglib::vec2<double>(dp(0), dp(1) / lonFactor) * std::max(0.0, std::min(1.0, t / len2));
-        return posProj;
+
+    void RoutingGraph::loadIncomingEdges(NodeBlock& nodeBlock) const {
+        auto packages = getPackages();
+        const Package& package = getPackage(*packages, nodeBlock.blockId.packageId);
+        if (!package.incomingEdgesChunk) {
+            return; // incoming edges can only be found by scanning the whole package, callers must use other means
+        }
+
+        // Incoming edges are stored per node block, using the same block index. Source nodes are given by signed block delta
+        // and node index, followed by the edge index within the source node block.
+        bitstreams::input_bitstream bs = readBlock(package, *package.incomingEdgesChunk, nodeBlock.blockId.blockIndex);
+
+        auto edgeCountBits = bs.read_bits<int, 6>();
+        auto blockDeltaBits = bs.read_bits<int, 6>();
+        auto nodeIndexBits = bs.read_bits<int, 6>();
+        auto edgeIndexBits = bs.read_bits<int, 6>();
+        auto nodeCount = bs.read_bits<int, 32>();
+        if (nodeCount != static_cast<int>(nodeBlock.nodes.size())) {
+            throw std::runtime_error("Incoming edges block does not match node block");
+        }
+
+        int nodeBlockCount = getBlockCount(package, *package.nodeChunk);
+        std::vector<std::uint32_t> offsets;
+        std::vector<NodeId> sources;
+        std::vector<std::uint32_t> indices;
+        offsets.reserve(nodeCount + 1);
+        offsets.push_back(0);
+        while (nodeCount-- > 0) {
+            auto edgeCount = bs.read_bits<unsigned int>(edgeCountBits);
+            while (edgeCount-- > 0) {
+                auto sourceBlockIndex = static_cast<std::int64_t>(nodeBlock.blockId.blockIndex) + bs.read_zigzag(blockDeltaBits);
+                auto sourceNodeIndex = bs.read_bits<unsigned int>(nodeIndexBits);
+                if (sourceBlockIndex < 0 || sourceBlockIndex >= nodeBlockCount || sourceNodeIndex > NodeId::MAX_ELEMENT_INDEX) {
+                    throw std::runtime_error("Incoming edges block is corrupted");
+                }
+                sources.emplace_back(BlockId(package.packageId, static_cast<int>(sourceBlockIndex)), static_cast<int>(sourceNodeIndex));
+                indices.push_back(bs.read_bits<std::uint32_t>(edgeIndexBits));
+            }
+            offsets.push_back(static_cast<std::uint32_t>(sources.size()));
+        }
+        nodeBlock.incomingEdgeSources = std::move(sources);
+        nodeBlock.incomingEdgeIndices = std::move(indices);
+        nodeBlock.incomingEdgeOffsets = std::move(offsets);
+    }
+
+    RoutingGraph::NodeId RoutingGraph::resolveGlobalNodeId(const PackageSet& packages, GlobalNodeId globalNodeId) {
+        const Package& package = getPackage(packages, globalNodeId.blockId().packageId);
+        const LinkTable& linkTable = *package.linkTable;
+        std::size_t blockIndex = static_cast<std::size_t>(globalNodeId.blockId().blockIndex);
+        if (blockIndex + 1 >= linkTable.blockOffsets.size()) {
+            throw std::runtime_error("Bad global node block");
+        }
+        std::uint32_t globalNodeIndex = linkTable.blockOffsets[blockIndex] + static_cast<std::uint32_t>(globalNodeId.elementIndex());
+        if (globalNodeIndex >= linkTable.blockOffsets[blockIndex + 1]) {
+            throw std::runtime_error("Bad global node index");
+        }
+        return packages.globalNodeTables[package.packageId]->nodeIds[globalNodeIndex];
+    }
+
+    RoutingGraph::RTreeNode RoutingGraph::loadRTreeNode(RTreeNodeId rtreeNodeId) const {
+        return getRTreeNodeBlock(rtreeNodeId.blockId())->rtreeNodes.at(rtreeNodeId.elementIndex());
     }
     
     double RoutingGraph::getBBoxDistance(const WGSPos& pos, const WGSBounds& bbox) {
@@ -611,16 +1460,67 @@ namespace Nuti { namespace Routing {
         return dist;
     }
 
-    double RoutingGraph::getPointDistance(const WGSPos& pos0, const WGSPos& pos1) {
-        // TODO: we do not handle -180/180 wrapping properly
-        double lonFactor = std::cos((pos0(0) + pos1(0)) * 0.5 * DEG_TO_RAD);
-        cglib::vec2<double> dp = pos1 - pos0;
-        dp(1) *= lonFactor;
-        return cglib::length(dp);
+    double RoutingGraph::getGreatCircleDistance(const WGSPos& pos0, const WGSPos& pos1) {
+        double lat1 = pos0(0) * DEG_TO_RAD;
+        double lng1 = pos0(1) * DEG_TO_RAD;
+        double lat2 = pos1(0) * DEG_TO_RAD;
+        double lng2 = pos1(1) * DEG_TO_RAD;
+
+        double dLng = lng1 - lng2;
+        double dLat = lat1 - lat2;
+
+        double aHarv = std::pow(std::sin(dLat / 2.0), 2) + std::cos(lat1) * std::cos(lat2) * std::pow(std::sin(dLng / 2.0), 2);
+        double cHarv = 2.0 * std::atan2(std::sqrt(aHarv), std::sqrt(1.0 - aHarv));
+        return EARTH_RADIUS * cHarv;
     }
 
-    int RoutingGraph::decodeZigZagValue(unsigned int val) {
-        return ((val & 1) != 0 ? -static_cast<int>((val + 1) >> 1) : static_cast<int>(val >> 1));
+    std::size_t RoutingGraph::getBlockSize(const std::shared_ptr<NodeBlock>& nodeBlock) {
+        // Node geometry bounds, lengths and incoming edges are loaded lazily, so they are always included in the estimate.
+        // Each edge is an incoming edge of exactly one node, so the block edge count approximates the incoming edge count.
+        std::size_t size = sizeof(NodeBlock);
+        size += nodeBlock->nodes.size() * (sizeof(Node) + 5 * sizeof(float) + sizeof(std::uint32_t));
+        size += nodeBlock->edgeTargets.size() * (sizeof(std::uint32_t) * 3 + sizeof(std::uint8_t) * 2 + sizeof(NodeId) + sizeof(std::uint32_t));
+        size += nodeBlock->externalNodeIds.size() * sizeof(NodeId);
+        return size;
+    }
+
+    std::size_t RoutingGraph::getBlockSize(const std::shared_ptr<GeometryBlock>& geometryBlock) {
+        std::size_t size = sizeof(GeometryBlock);
+        for (const std::vector<Point>& geometry : geometryBlock->geometries) {
+            size += sizeof(std::vector<Point>) + geometry.capacity() * sizeof(Point);
+        }
+        return size;
+    }
+
+    std::size_t RoutingGraph::getBlockSize(const std::shared_ptr<NameBlock>& nameBlock) {
+        std::size_t size = sizeof(NameBlock);
+        for (const std::string& name : nameBlock->names) {
+            size += sizeof(std::string) + name.capacity();
+        }
+        return size;
+    }
+
+    std::size_t RoutingGraph::getBlockSize(const std::shared_ptr<RTreeNodeBlock>& rtreeNodeBlock) {
+        std::size_t size = sizeof(RTreeNodeBlock);
+        for (const RTreeNode& rtreeNode : rtreeNodeBlock->rtreeNodes) {
+            size += sizeof(RTreeNode);
+            size += rtreeNode.children.capacity() * sizeof(std::pair<WGSBounds, RTreeNodeId>);
+            size += rtreeNode.nodeBlockIds.capacity() * sizeof(std::pair<WGSBounds, BlockId>);
+        }
+        return size;
+    }
+
+    void RoutingGraph::addBounds(std::vector<float>& bounds, const Point& min, const Point& max) {
+        // Round outwards, so that the float bounds always contain the exact bounds
+        WGSPos pos0 = fromPoint(min), pos1 = fromPoint(max);
+        for (double value : { pos0(0), pos0(1) }) {
+            float rounded = static_cast<float>(value);
+            bounds.push_back(rounded > value ? std::nextafter(rounded, -std::numeric_limits<float>::infinity()) : rounded);
+        }
+        for (double value : { pos1(0), pos1(1) }) {
+            float rounded = static_cast<float>(value);
+            bounds.push_back(rounded < value ? std::nextafter(rounded, std::numeric_limits<float>::infinity()) : rounded);
+        }
     }
 
     WGSPos RoutingGraph::fromPoint(const Point& point) {
@@ -636,4 +1536,6 @@ namespace Nuti { namespace Routing {
     const double RoutingGraph::COORDINATE_SCALE = 1.0e-6;
 
     const double RoutingGraph::DEG_TO_RAD = 0.017453292519943295769236907684886;
+
+    const double RoutingGraph::EARTH_RADIUS = 6372797.560856;
 } }
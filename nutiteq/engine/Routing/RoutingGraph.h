@@ -9,16 +9,27 @@
 
 #include "RoutingObjects.h"
 
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <array>
 #include <vector>
 #include <fstream>
 #include <utility>
 #include <functional>
+#include <iterator>
+#include <string>
 
-#include <stdext/lru_cache.h>
+#include <stdext/concurrent_cache.h>
 #include <stdext/eiff_file.h>
+#include <stdext/eiff_mapped_file.h>
 #include <stdext/bitstream.h>
 
 namespace Nuti { namespace Routing {
@@ -38,18 +49,34 @@ namespace Nuti { namespace Routing {
             };
         };
         
+        // Element id packed into 64 bits: 16 bits for package id, 28 bits for block index and 20 bits for element index
         struct ElementId {
-            BlockId blockId;
-            int elementIndex = -1;
-            
+            enum { PACKAGE_BITS = 16, BLOCK_BITS = 28, INDEX_BITS = 20 };
+            enum { MAX_PACKAGE_ID = (1 << PACKAGE_BITS) - 2, MAX_BLOCK_INDEX = (1 << BLOCK_BITS) - 1, MAX_ELEMENT_INDEX = (1 << INDEX_BITS) - 1 }; // package id with all bits set is reserved for invalid ids
+
             ElementId() = default;
-            ElementId(BlockId blockId, int elementIndex) : blockId(blockId), elementIndex(elementIndex) { }
+            ElementId(BlockId blockId, int elementIndex) : _id(blockId.packageId < 0 ? INVALID_ID : (static_cast<std::uint64_t>(blockId.packageId) << (BLOCK_BITS + INDEX_BITS)) | (static_cast<std::uint64_t>(blockId.blockIndex & MAX_BLOCK_INDEX) << INDEX_BITS) | static_cast<std::uint64_t>(elementIndex & MAX_ELEMENT_INDEX)) { }
+
+            bool valid() const { return _id != INVALID_ID; }
+            int packageId() const { return valid() ? static_cast<int>(_id >> (BLOCK_BITS + INDEX_BITS)) : -1; }
+            int blockIndex() const { return valid() ? static_cast<int>((_id >> INDEX_BITS) & MAX_BLOCK_INDEX) : -1; }
+            int elementIndex() const { return valid() ? static_cast<int>(_id & MAX_ELEMENT_INDEX) : -1; }
+            BlockId blockId() const { return BlockId(packageId(), blockIndex()); }
+            std::uint64_t packedId() const { return _id; }
 
-            bool operator == (const ElementId& elementId) const { return blockId == elementId.blockId && elementIndex == elementId.elementIndex; }
+            static ElementId fromPackedId(std::uint64_t packedId) { ElementId elementId; elementId._id = packedId; return elementId; }
+
+            bool operator == (const ElementId& elementId) const { return _id == elementId._id; }
+            bool operator != (const ElementId& elementId) const { return _id != elementId._id; }
 
             struct Hash {
-                std::size_t operator() (const Nuti::Routing::RoutingGraph::ElementId& elementId) const { return BlockId::Hash()(elementId.blockId) * 769 ^ elementId.elementIndex; }
+                std::size_t operator() (const Nuti::Routing::RoutingGraph::ElementId& elementId) const { return static_cast<std::size_t>(elementId._id ^ (elementId._id >> 32)); }
             };
+
+        private:
+            enum : std::uint64_t { INVALID_ID = ~static_cast<std::uint64_t>(0) };
+
+            std::uint64_t _id = INVALID_ID;
         };
         
         using GeometryId = ElementId;
@@ -86,18 +113,18 @@ namespace Nuti { namespace Routing {
 
         struct NodeData {
             GeometryId geometryId;
-            bool geometryReversed = false;
             NameId nameId;
             unsigned int weight = 0;
             unsigned char travelMode = 0;
+            bool geometryReversed = false;
 
             NodeData() = default;
         };
 
         struct Node {
-            const Edge* firstEdge = nullptr;
-            const Edge* lastEdge = nullptr;
             NodeData nodeData;
+            std::uint32_t firstEdge = 0; // index of the first outgoing edge in the node block edge arrays
+            std::uint32_t lastEdge = 0;
 
             Node() = default;
         };
@@ -121,18 +148,59 @@ namespace Nuti { namespace Routing {
             NameBlock() = default;
         };
 
+        // Decoded node block. Edges are stored as a structure of arrays, indexed by Node::firstEdge..Node::lastEdge.
+        // Edge target and contracted node references are local node indices within the block, or indices
+        // into externalNodeIds if EXTERNAL_NODE_FLAG is set.
         struct NodeBlock {
+            enum { FORWARD_FLAG = 1, BACKWARD_FLAG = 2, CONTRACTED_FLAG = 4 };
+
+            enum : std::uint32_t { EXTERNAL_NODE_FLAG = 0x80000000U };
+
+            BlockId blockId;
             std::vector<Node> nodes;
-            std::vector<Edge> edges;
-            std::vector<WGSBounds> nodeGeometryBoundsCache;
+            std::vector<std::uint32_t> edgeTargets;
+            std::vector<std::uint32_t> edgeWeights;
+            std::vector<std::uint8_t> edgeFlags;
+            std::vector<std::uint8_t> edgeTurnInstructions;
+            std::vector<std::uint32_t> edgeContractedNodes; // only meaningful for edges with CONTRACTED_FLAG
+            std::vector<NodeId> externalNodeIds;
+            std::vector<float> nodeGeometryBounds; // min lat, min lon, max lat, max lon of each node geometry, rounded outwards
+            std::once_flag nodeGeometryBoundsFlag; // bounds are loaded lazily, by the first nearest node query touching the block
+            std::vector<float> nodeLengths; // geometry length of each node, in meters
+            std::once_flag nodeLengthsFlag; // lengths are loaded lazily, by the first query asking for these
+            std::vector<std::uint32_t> incomingEdgeOffsets; // first incoming edge of each node, followed by the edge count. Empty if the package has no RADJ chunk
+            std::vector<NodeId> incomingEdgeSources; // nodes storing the incoming edges
+            std::vector<std::uint32_t> incomingEdgeIndices; // edge indices within the node blocks of the source nodes
+            std::once_flag incomingEdgesFlag; // incoming edges are loaded lazily, by the first query asking for these
+            std::atomic<bool> prefetched { false }; // loaded by the prefetcher and not yet used by a query
+            bool globalNodeRefs = false; // some references were resolved through global node blocks, so the block depends on other packages
 
             NodeBlock() = default;
-        };
-        
-        struct GlobalNodeBlock {
-            std::vector<NodeId> globalNodeIds;
-            
-            GlobalNodeBlock() = default;
+
+            NodeId resolveNodeId(std::uint32_t nodeRef) const {
+                if (nodeRef & EXTERNAL_NODE_FLAG) {
+                    return externalNodeIds[nodeRef & ~EXTERNAL_NODE_FLAG];
+                }
+                return NodeId(blockId, static_cast<int>(nodeRef));
+            }
+
+            NodeId getEdgeTargetNodeId(std::uint32_t edgeIndex) const {
+                return resolveNodeId(edgeTargets[edgeIndex]);
+            }
+
+            Edge getEdge(std::uint32_t edgeIndex) const {
+                Edge edge;
+                edge.targetNodeId = resolveNodeId(edgeTargets[edgeIndex]);
+                edge.contracted = (edgeFlags[edgeIndex] & CONTRACTED_FLAG) != 0;
+                edge.forward = (edgeFlags[edgeIndex] & FORWARD_FLAG) != 0;
+                edge.backward = (edgeFlags[edgeIndex] & BACKWARD_FLAG) != 0;
+                if (edge.contracted) {
+                    edge.contractedNodeId = resolveNodeId(edgeContractedNodes[edgeIndex]);
+                }
+                edge.edgeData.weight = edgeWeights[edgeIndex];
+                edge.edgeData.turnInstruction = edgeTurnInstructions[edgeIndex];
+                return edge;
+            }
         };
         
         struct RTreeNodeBlock {
@@ -141,6 +209,77 @@ namespace Nuti { namespace Routing {
             RTreeNodeBlock() = default;
         };
         
+        // Node geometry without copying. Keeps the geometry block alive and yields the points in node direction,
+        // either as fixed point coordinates or as WGS84 positions.
+        class GeometryView {
+        public:
+            class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = WGSPos;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const WGSPos*;
+                using reference = WGSPos;
+
+                const_iterator() = default;
+                explicit const_iterator(const GeometryView* view, std::size_t index) : _view(view), _index(index) { }
+
+                WGSPos operator * () const { return (*_view)[_index]; }
+                const_iterator& operator ++ () { _index++; return *this; }
+                const_iterator operator ++ (int) { const_iterator it(*this); _index++; return it; }
+
+                bool operator == (const const_iterator& it) const { return _index == it._index; }
+                bool operator != (const const_iterator& it) const { return _index != it._index; }
+
+            private:
+                const GeometryView* _view = nullptr;
+                std::size_t _index = 0;
+            };
+
+            GeometryView() = default;
+            explicit GeometryView(std::shared_ptr<const GeometryBlock> geometryBlock, int elementIndex, bool reversed) : _points(&geometryBlock->geometries.at(elementIndex)), _reversed(reversed), _geometryBlock(std::move(geometryBlock)) { }
+
+            std::size_t size() const { return _points ? _points->size() : 0; }
+            bool empty() const { return size() == 0; }
+
+            const Point& point(std::size_t index) const { return (*_points)[_reversed ? _points->size() - 1 - index : index]; }
+            const Point* data() const { return _points ? _points->data() : nullptr; } // in stored order, see reversed()
+            bool reversed() const { return _reversed; }
+            WGSPos operator [] (std::size_t index) const { return fromPoint(point(index)); }
+            WGSPos front() const { return (*this)[0]; }
+            WGSPos back() const { return (*this)[size() - 1]; }
+
+            const_iterator begin() const { return const_iterator(this, 0); }
+            const_iterator end() const { return const_iterator(this, size()); }
+
+            std::vector<WGSPos> toVector() const { return std::vector<WGSPos>(begin(), end()); }
+
+        private:
+            const std::vector<Point>* _points = nullptr;
+            bool _reversed = false;
+            std::shared_ptr<const GeometryBlock> _geometryBlock;
+        };
+
+        // Node name without copying, keeps the name block alive
+        class NameView {
+        public:
+            NameView() = default;
+            explicit NameView(std::shared_ptr<const NameBlock> nameBlock, int elementIndex) : _name(&nameBlock->names.at(elementIndex)), _nameBlock(std::move(nameBlock)) { }
+
+            const char* data() const { return _name ? _name->data() : ""; }
+            std::size_t size() const { return _name ? _name->size() : 0; }
+            bool empty() const { return size() == 0; }
+
+            std::string str() const { return std::string(data(), size()); }
+
+            bool operator == (const std::string& name) const { return size() == name.size() && name.compare(0, name.size(), data(), size()) == 0; }
+            bool operator != (const std::string& name) const { return !(*this == name); }
+
+        private:
+            const std::string* _name = nullptr;
+            std::shared_ptr<const NameBlock> _nameBlock;
+        };
+
         struct NodePtr {
             NodePtr() = default;
             explicit NodePtr(const std::shared_ptr<NodeBlock>& nodeBlock, int elementIndex) : _node(&nodeBlock->nodes.at(elementIndex)), _nodeBlock(nodeBlock) { }
@@ -148,6 +287,8 @@ namespace Nuti { namespace Routing {
             const Node* operator -> () const { return _node; }
             const Node& operator * () const { return *_node; }
 
+            const NodeBlock& block() const { return *_nodeBlock; }
+
         private:
             const Node* _node = nullptr;
             std::shared_ptr<NodeBlock> _nodeBlock; // keep the node pointer valid by holding reference to the node block
@@ -158,44 +299,208 @@ namespace Nuti { namespace Routing {
             NodeId nodeId;
             unsigned int geometrySegmentIndex = 0;
             float geometryRelPos = 0.0f;
+            float distance = 0.0f; // from the query position, in meters
 
             NearestNode() = default;
         };
 
+        struct SnapQuery {
+            WGSPos pos;
+            double bearing = -1; // direction of travel in degrees clockwise from north, negative disables the filter
+            double bearingRange = 45; // allowed deviation from the bearing, in degrees
+
+            SnapQuery() = default;
+            explicit SnapQuery(const WGSPos& pos) : pos(pos) { }
+            explicit SnapQuery(const WGSPos& pos, double bearing, double bearingRange) : pos(pos), bearing(bearing), bearingRange(bearingRange) { }
+        };
+
+        struct SnapOptions {
+            unsigned int maxResults = 1; // nearest nodes per position, nodes within 1% of the distance of the last one are included as well
+            double maxDistance = std::numeric_limits<double>::infinity(); // in meters
+            unsigned int threadCount = 1; // threads used for a batch, including the calling thread. Ignored if executor is set
+            std::function<void(std::size_t, const std::function<void(std::size_t)>&)> executor; // optional, runs tasks 0..n-1 of a batch on the caller's thread pool and returns when all are done
+
+            SnapOptions() = default;
+        };
+
+        struct PrefetchStats {
+            std::uint64_t requests = 0; // hinted blocks that were not cached and were queued for loading
+            std::uint64_t loads = 0; // blocks loaded by the prefetcher
+            std::uint64_t hits = 0; // prefetched blocks that were later used by a query
+            std::uint64_t dropped = 0; // hints dropped as the queue was full
+
+            PrefetchStats() = default;
+
+            double hitRate() const { return loads > 0 ? static_cast<double>(hits) / loads : 0.0; }
+        };
+
+        struct CacheStats {
+            cache::cache_stats nodeBlocks;
+            cache::cache_stats geometryBlocks;
+            cache::cache_stats nameBlocks;
+            cache::cache_stats rtreeNodeBlocks;
+            std::size_t memoryBudget = 0; // 0 if the caches are limited by entry counts only
+            std::size_t memoryUsed = 0; // estimated size of all cached blocks, in bytes
+            std::uint64_t blocksRead = 0; // blocks read from package files, of all types
+            std::uint64_t bytesRead = 0; // encoded size of the read blocks
+
+            CacheStats() = default;
+        };
+
         struct Settings {
             std::size_t nodeBlockCacheSize = 512;
             std::size_t geometryBlockCacheSize = 512;
             std::size_t nameBlockCacheSize = 64;
-            std::size_t globalNodeBlockCacheSize = 64;
             std::size_t rtreeNodeBlockCacheSize = 16;
+            std::size_t blockCacheMemoryBudget = 0; // shared byte limit for all block caches, 0 means only the entry counts above are used
+            bool useMemoryMapping = false; // map package files into memory instead of reading blocks from stream
+            eiff::mapped_file::advice memoryMappingAdvice = eiff::mapped_file::advice::random;
+            unsigned int prefetchThreadCount = 0; // background threads loading hinted node blocks, 0 disables prefetching
+            std::size_t prefetchQueueSize = 4096;
+            double prefetchRadius = 0.01; // radius (in degrees) of the neighbourhood prefetched around route end points
 
             Settings() = default;
         };
 
+        struct PackageInfo {
+            int packageId = -1;
+            std::string packageName;
+            std::string fileName; // empty if imported from a stream
+            std::uint64_t generation = 0; // package set generation that introduced the package
+            WGSBounds bbox = WGSBounds::smallest();
+            int nodeBlockCount = 0; // node ids of the package are NodeId(BlockId(packageId, 0..nodeBlockCount-1), nodeIndex)
+
+            PackageInfo() = default;
+        };
+
+        // Pins the current package set for the calling thread, so that a query started before a package update
+        // finishes on the packages it started with. Nested snapshots of the same graph reuse the outermost one.
+        // Worker threads of the same query can join the snapshot of the calling thread.
+        class Snapshot {
+        public:
+            explicit Snapshot(const RoutingGraph& graph);
+            explicit Snapshot(const Snapshot& outer, const RoutingGraph& graph);
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator = (const Snapshot&) = delete;
+            ~Snapshot();
+
+        private:
+            void pin(const RoutingGraph& graph, std::shared_ptr<const void> packages);
+
+            bool _pinned = false;
+            std::shared_ptr<const void> _packages;
+            const RoutingGraph* _prevGraph = nullptr;
+            std::shared_ptr<const void> _prevPackages;
+        };
+
+        static const int VERSION; // supported package format version
+
         RoutingGraph() = delete;
         explicit RoutingGraph(const Settings& settings);
+        RoutingGraph(const RoutingGraph&) = delete;
+        RoutingGraph& operator = (const RoutingGraph&) = delete;
+        ~RoutingGraph();
         
+        // Import a package. An already loaded package with the same name is replaced.
         bool import(const std::string& fileName);
         bool import(const std::shared_ptr<std::ifstream>& file);
+        bool unload(const std::string& packageName);
+
+        std::vector<PackageInfo> getPackageInfos() const; // active packages of the package set used by the calling thread
+        std::uint64_t getGeneration() const; // generation of the package set used by the calling thread
+        std::uint64_t getNodeGeneration(NodeId nodeId) const; // generation of the package containing the node, 0 if the package is not loaded or the node block does not exist
+
+        // Copies of the node in other packages, for nodes shared by several loaded packages (border nodes listed in LINK chunks)
+        std::vector<NodeId> getEquivalentNodeIds(NodeId nodeId) const;
 
         NodePtr getNode(NodeId nodeId) const;
         std::string getNodeName(const Node& node) const;
         std::vector<WGSPos> getNodeGeometry(const Node& node) const;
-        std::vector<NearestNode> findNearestNode(const WGSPos& pos) const;
+        NameView getNodeNameView(const Node& node) const;
+        GeometryView getNodeGeometryView(const Node& node) const;
+        double getNodeLength(NodeId nodeId) const; // in meters. Geometry is not decoded if the package has NLEN chunk
+
+        // Edges stored at other nodes with the given node as target, with their source nodes, from the RADJ chunk of the package.
+        // Returns false if these can not be listed completely: the package has no RADJ chunk or the node is shared with other packages.
+        bool getIncomingEdges(NodeId nodeId, std::vector<std::pair<NodeId, Edge>>& edges) const;
+
+        std::vector<NearestNode> findNearestNode(const WGSPos& pos) const; // nearest node and the nodes within 1% of its distance
+
+        // Snaps a batch of positions, returning the nearest nodes of each position in input order, closest first. Each
+        // node is returned once, with its closest segment matching the bearing filter. Nearby positions are processed
+        // together, sharing the loaded r-tree nodes and blocks.
+        std::vector<std::vector<NearestNode>> findNearestNodes(const std::vector<SnapQuery>& queries, const SnapOptions& options) const;
+
+        // Hints for the background prefetcher. These never block and are ignored if prefetching is disabled
+        void prefetchNodeBlock(BlockId blockId) const;
+        void prefetchNearbyNodeBlocks(const WGSPos& pos) const;
+        PrefetchStats getPrefetchStats() const;
+
+        CacheStats getCacheStats() const;
+
+        static double getGreatCircleDistance(const WGSPos& pos0, const WGSPos& pos1); // in meters
 
     private:
+        // Copy of a border node in one package
+        struct NodeLink {
+            int packageIndex = -1; // index in LinkTable::packageNames
+            int blockIndex = -1;
+            int nodeIndex = -1;
+
+            NodeLink() = default;
+            explicit NodeLink(int packageIndex, int blockIndex, int nodeIndex) : packageIndex(packageIndex), blockIndex(blockIndex), nodeIndex(nodeIndex) { }
+        };
+
+        // LINK chunk of a package, decoded once at import into flat arrays
+        struct LinkTable {
+            std::vector<std::string> packageNames; // distinct packages referenced by the links
+            std::vector<std::uint32_t> blockOffsets; // index of the first global node of each LINK block, followed by the global node count
+            std::vector<std::uint32_t> linkOffsets; // index of the first link of each global node, followed by the link count
+            std::vector<NodeLink> links;
+
+            LinkTable() = default;
+        };
+
+        // Global nodes of a package resolved against the loaded packages
+        struct GlobalNodeTable {
+            std::vector<int> packageIds; // ids of LinkTable::packageNames, -1 if not loaded
+            std::vector<NodeId> nodeIds; // copy in the last listed loaded package, by global node index
+
+            GlobalNodeTable() = default;
+        };
+
         struct Package {
             int packageId = -1;
+            bool active = false; // false for unloaded packages, their slots are reused once retiredLifetime expires
+            std::uint64_t generation = 0;
             std::string packageName;
+            std::string fileName;
             WGSBounds bbox = WGSBounds::smallest();
             std::shared_ptr<eiff::data_chunk> nodeChunk;
             std::shared_ptr<eiff::data_chunk> geometryChunk;
             std::shared_ptr<eiff::data_chunk> nameChunk;
             std::shared_ptr<eiff::data_chunk> globalNodeChunk;
             std::shared_ptr<eiff::data_chunk> rtreeNodeChunk;
+            std::shared_ptr<eiff::data_chunk> nodeBoundsChunk; // optional, per node block geometry bounds
+            std::shared_ptr<eiff::data_chunk> nodeLengthsChunk; // optional, per node block geometry lengths
+            std::shared_ptr<eiff::data_chunk> incomingEdgesChunk; // optional, per node block incoming edges
+            std::shared_ptr<std::mutex> fileMutex; // serializes reads from the shared file stream, not needed for mapped files
+            std::shared_ptr<const void> lifetime; // shared by all package set generations containing the package
+            std::weak_ptr<const void> retiredLifetime; // lifetime of the unloaded package that used this slot
+            
+            std::shared_ptr<const LinkTable> linkTable; // nodes shared with other packages
             
             Package() = default;
         };
+
+        struct PackageSet {
+            std::uint64_t generation = 0;
+            std::vector<Package> packages; // indexed by package id
+            std::vector<std::shared_ptr<const GlobalNodeTable>> globalNodeTables; // indexed by package id, null for unloaded packages
+            std::unordered_map<NodeId, std::vector<NodeId>, NodeId::Hash> nodeEquivalents; // built from link tables of the active packages
+
+            PackageSet() = default;
+        };
         
         struct SearchRTreeNode {
             RTreeNodeId rtreeNodeId;
@@ -221,45 +526,95 @@ namespace Nuti { namespace Routing {
             }
         };
         
+        std::shared_ptr<const PackageSet> getPackages() const;
+
+        bool importPackage(const std::shared_ptr<eiff::chunk>& chunk, const std::string& fileName);
+
+        void publishPackages(std::shared_ptr<PackageSet> packages, const std::vector<int>& changedPackageIds);
+
+        bool isCurrentPackageSet(const std::shared_ptr<const PackageSet>& packages) const;
+
+        static const Package& getPackage(const PackageSet& packages, int packageId);
+
+        std::shared_ptr<NodeBlock> getNodeBlock(BlockId blockId) const;
+
+        std::shared_ptr<GeometryBlock> getGeometryBlock(BlockId blockId) const;
+
+        std::shared_ptr<RTreeNodeBlock> getRTreeNodeBlock(BlockId blockId) const;
+
+        void schedulePrefetch(std::function<void()> task) const;
+
+        void runPrefetcher() const;
+
+        int getBlockCount(const Package& package, const eiff::data_chunk& chunk) const;
+
+        bitstreams::input_bitstream readBlock(const Package& package, const eiff::data_chunk& chunk, int blockIndex) const;
+
         std::shared_ptr<NodeBlock> loadNodeBlock(BlockId blockId) const;
 
         std::shared_ptr<GeometryBlock> loadGeometryBlock(BlockId blockId) const;
 
         std::shared_ptr<NameBlock> loadNameBlock(BlockId blockId) const;
         
-        std::shared_ptr<GlobalNodeBlock> loadGlobalNodeBlock(BlockId blockId) const;
+        std::shared_ptr<const LinkTable> loadLinkTable(const Package& package) const;
         
         std::shared_ptr<RTreeNodeBlock> loadRTreeNodeBlock(BlockId blockId) const;
+
+        void loadNodeGeometryBounds(NodeBlock& nodeBlock) const;
+
+        void loadNodeLengths(NodeBlock& nodeBlock) const;
+
+        void loadIncomingEdges(NodeBlock& nodeBlock) const;
         
-        NodeId resolveGlobalNodeId(GlobalNodeId globalNodeId) const;
+        static NodeId resolveGlobalNodeId(const PackageSet& packages, GlobalNodeId globalNodeId);
         
         RTreeNode loadRTreeNode(RTreeNodeId rtreeNodeId) const;
 
-        static WGSPos getClosestSegmentPoint(const WGSPos& pos, const WGSPos& p0, const WGSPos& p1);
-        
-        static double getPointDistance(const WGSPos& pos0, const WGSPos& pos1);
+        struct SnapCache;
+
+        std::vector<NearestNode> findNearestNodes(const PackageSet& packages, const SnapQuery& query, const SnapOptions& options, SnapCache& cache) const;
 
         static double getBBoxDistance(const WGSPos& pos, const WGSBounds& bbox);
         
-        static int decodeZigZagValue(unsigned int val);
+        static std::size_t getBlockSize(const std::shared_ptr<NodeBlock>& nodeBlock);
+        static std::size_t getBlockSize(const std::shared_ptr<GeometryBlock>& geometryBlock);
+        static std::size_t getBlockSize(const std::shared_ptr<NameBlock>& nameBlock);
+        static std::size_t getBlockSize(const std::shared_ptr<RTreeNodeBlock>& rtreeNodeBlock);
+
+        static void addBounds(std::vector<float>& bounds, const Point& min, const Point& max);
 
         static WGSPos fromPoint(const Point& point);
         static Point toPoint(const WGSPos& pos);
 
-        std::vector<Package> _packages;
-
-        mutable cache::lru_cache<BlockId, std::shared_ptr<NodeBlock>, BlockId::Hash> _nodeBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<GeometryBlock>, BlockId::Hash> _geometryBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<NameBlock>, BlockId::Hash> _nameBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<GlobalNodeBlock>, BlockId::Hash> _globalNodeBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<RTreeNodeBlock>, BlockId::Hash> _rtreeNodeBlockCache;
-        mutable std::recursive_mutex _mutex;
+        const Settings _settings;
+        std::shared_ptr<const PackageSet> _packages; // immutable snapshot, replaced atomically on import and unload
+
+        std::shared_ptr<cache::memory_budget> _blockCacheMemoryBudget; // null if not limited
+
+        mutable cache::concurrent_cache<BlockId, std::shared_ptr<NodeBlock>, BlockId::Hash> _nodeBlockCache;
+        mutable cache::concurrent_cache<BlockId, std::shared_ptr<GeometryBlock>, BlockId::Hash> _geometryBlockCache;
+        mutable cache::concurrent_cache<BlockId, std::shared_ptr<NameBlock>, BlockId::Hash> _nameBlockCache;
+        mutable cache::concurrent_cache<BlockId, std::shared_ptr<RTreeNodeBlock>, BlockId::Hash> _rtreeNodeBlockCache;
+        mutable std::mutex _mutex; // serializes package updates
+        mutable std::atomic<std::uint64_t> _blocksRead;
+        mutable std::atomic<std::uint64_t> _bytesRead;
+
+        mutable std::mutex _prefetchMutex;
+        mutable std::condition_variable _prefetchCondition;
+        mutable std::deque<std::function<void()>> _prefetchQueue;
+        mutable std::unordered_set<BlockId, BlockId::Hash> _prefetchPendingBlockIds;
+        mutable std::atomic<std::uint64_t> _prefetchRequests;
+        mutable std::atomic<std::uint64_t> _prefetchLoads;
+        mutable std::atomic<std::uint64_t> _prefetchHits;
+        mutable std::atomic<std::uint64_t> _prefetchDropped;
+        bool _prefetchStop = false;
+        std::vector<std::thread> _prefetchThreads;
         
-        static const int VERSION;
-
         static const double COORDINATE_SCALE;
         
         static const double DEG_TO_RAD;
+
+        static const double EARTH_RADIUS;
     };
 } }
 
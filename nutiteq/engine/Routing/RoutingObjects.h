@@ -145,6 +145,37 @@ namespace Nuti { namespace Routing {
         std::vector<RoutingInstruction> _instructions;
         std::vector<WGSPos> _geometry;
     };
+
+    // Route totals only, without instructions and geometry
+    class RoutingSummary {
+    public:
+        using Status = RoutingResult::Status;
+
+        RoutingSummary() = default;
+        explicit RoutingSummary(double weight, double distance, double time) : _status(Status::SUCCESS), _weight(weight), _distance(distance), _time(time) { }
+
+        Status getStatus() const {
+            return _status;
+        }
+
+        double getTotalWeight() const {
+            return _weight;
+        }
+
+        double getTotalDistance() const {
+            return _distance;
+        }
+
+        double getTotalTime() const {
+            return _time;
+        }
+
+    private:
+        Status _status = Status::FAILED;
+        double _weight = 0.0;
+        double _distance = 0.0;
+        double _time = 0.0;
+    };
 } }
 
 #endif
@@ -0,0 +1,90 @@
+#include "RoutingStats.h"
+
+#include <atomic>
+
+namespace Nuti { namespace Routing {
+    namespace {
+        // Stats of the innermost collector of the current thread
+        thread_local RoutingStats* currentStats = nullptr;
+        thread_local const RoutingStatsCollector* currentStatsCollector = nullptr;
+
+        std::atomic<bool> totalsEnabled(false);
+        std::mutex totalsMutex;
+        RoutingStats totals;
+    }
+
+    RoutingStats& RoutingStats::operator += (const RoutingStats& stats) {
+        routes += stats.routes;
+        nodeBlocksLoaded += stats.nodeBlocksLoaded;
+        geometryBlocksLoaded += stats.geometryBlocksLoaded;
+        nameBlocksLoaded += stats.nameBlocksLoaded;
+        rtreeNodeBlocksLoaded += stats.rtreeNodeBlocksLoaded;
+        bytesRead += stats.bytesRead;
+        decodeMicroseconds += stats.decodeMicroseconds;
+        heapPushes += stats.heapPushes;
+        heapPops += stats.heapPops;
+        nodesSettled += stats.nodesSettled;
+        nodesStalled += stats.nodesStalled;
+        shortcutsUnpacked += stats.shortcutsUnpacked;
+        snapCandidates += stats.snapCandidates;
+        return *this;
+    }
+
+    void RoutingStats::setTotalsEnabled(bool enabled) {
+        totalsEnabled = enabled;
+    }
+
+    bool RoutingStats::isTotalsEnabled() {
+        return totalsEnabled;
+    }
+
+    RoutingStats RoutingStats::getTotals() {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        return totals;
+    }
+
+    RoutingStatsCollector::RoutingStatsCollector(RoutingStats& stats) : _stats(&stats), _prevStats(currentStats), _prevCollector(currentStatsCollector) {
+        currentStats = _stats;
+        currentStatsCollector = this;
+    }
+
+    RoutingStatsCollector::RoutingStatsCollector(const RoutingStatsCollector* outer) : _stats(outer ? &_workerStats : nullptr), _outer(outer), _prevStats(currentStats), _prevCollector(currentStatsCollector) {
+        if (_stats) {
+            currentStats = _stats;
+            currentStatsCollector = this;
+        }
+    }
+
+    RoutingStatsCollector::~RoutingStatsCollector() {
+        if (!_stats) {
+            return;
+        }
+        currentStats = _prevStats;
+        currentStatsCollector = _prevCollector;
+
+        {
+            std::lock_guard<std::mutex> lock(_joinedMutex);
+            *_stats += _joinedStats;
+        }
+        if (_outer) {
+            std::lock_guard<std::mutex> lock(_outer->_joinedMutex);
+            _outer->_joinedStats += _workerStats;
+            return;
+        }
+        if (_prevStats) {
+            *_prevStats += *_stats;
+        }
+        else if (totalsEnabled) {
+            std::lock_guard<std::mutex> lock(totalsMutex);
+            totals += *_stats;
+        }
+    }
+
+    RoutingStats* RoutingStatsCollector::current() {
+        return currentStats;
+    }
+
+    const RoutingStatsCollector* RoutingStatsCollector::currentCollector() {
+        return currentStatsCollector;
+    }
+} }
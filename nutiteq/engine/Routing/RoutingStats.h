@@ -0,0 +1,67 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_ROUTINGSTATS_H_
+#define _NUTI_ROUTING_ROUTINGSTATS_H_
+
+#include <cstdint>
+#include <mutex>
+
+namespace Nuti { namespace Routing {
+    // Work done by routing queries. The engine adds to the stats of the collector of the calling thread, nothing is
+    // counted if the thread has no collector.
+    struct RoutingStats {
+        std::uint64_t routes = 0; // RouteFinder queries
+        std::uint64_t nodeBlocksLoaded = 0;
+        std::uint64_t geometryBlocksLoaded = 0;
+        std::uint64_t nameBlocksLoaded = 0;
+        std::uint64_t rtreeNodeBlocksLoaded = 0;
+        std::uint64_t bytesRead = 0; // encoded size of the loaded blocks
+        std::uint64_t decodeMicroseconds = 0; // time spent reading and decoding blocks
+        std::uint64_t heapPushes = 0; // inserts and decreases
+        std::uint64_t heapPops = 0;
+        std::uint64_t nodesSettled = 0;
+        std::uint64_t nodesStalled = 0;
+        std::uint64_t shortcutsUnpacked = 0; // not counting the shortcuts found in the unpack cache
+        std::uint64_t snapCandidates = 0; // node geometries examined when finding nearest nodes
+
+        RoutingStats() = default;
+
+        RoutingStats& operator += (const RoutingStats& stats);
+
+        // Process-wide totals of all top-level collectors, accumulated only when enabled
+        static void setTotalsEnabled(bool enabled);
+        static bool isTotalsEnabled();
+        static RoutingStats getTotals();
+    };
+
+    // Installs stats for the calling thread for the lifetime of the collector. A nested collector passes its counts
+    // to the enclosing collector of the same thread. Worker threads of the same query join the collector of the
+    // calling thread, their counts are merged when the worker collectors are destroyed. Joining a null collector
+    // does nothing, so that workers need not check whether the query collects stats.
+    class RoutingStatsCollector {
+    public:
+        explicit RoutingStatsCollector(RoutingStats& stats);
+        explicit RoutingStatsCollector(const RoutingStatsCollector* outer);
+        RoutingStatsCollector(const RoutingStatsCollector&) = delete;
+        RoutingStatsCollector& operator = (const RoutingStatsCollector&) = delete;
+        ~RoutingStatsCollector();
+
+        static RoutingStats* current();
+        static const RoutingStatsCollector* currentCollector(); // for joining worker threads started by the engine
+
+    private:
+        RoutingStats _workerStats;
+        RoutingStats* _stats = nullptr; // null if joined to a null collector
+        const RoutingStatsCollector* _outer = nullptr;
+        RoutingStats* _prevStats = nullptr;
+        const RoutingStatsCollector* _prevCollector = nullptr;
+        mutable std::mutex _joinedMutex;
+        mutable RoutingStats _joinedStats; // counts of the joined worker collectors
+    };
+} }
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_SEARCHWORKSPACE_H_
+#define _NUTI_ROUTING_SEARCHWORKSPACE_H_
+
+#include "RoutingGraph.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <utility>
+
+namespace Nuti { namespace Routing {
+    // Search state of a single Dijkstra direction: node table with open addressing, keyed by packed node id,
+    // and an addressable binary heap over the table entries. The memory is reused between queries and
+    // clear() only touches the entries used by the previous query.
+    class SearchSpace {
+    public:
+        struct Entry {
+            RoutingGraph::NodeId nodeId;
+            RoutingGraph::NodeId prevNodeId;
+            float weight = 0.0f;
+            std::uint32_t heapIndex = NOT_IN_HEAP;
+            std::uint32_t slot = 0;
+            bool settled = false;
+
+            Entry() = default;
+        };
+
+        SearchSpace() : _table(INITIAL_CAPACITY, EMPTY_SLOT), _mask(INITIAL_CAPACITY - 1) { }
+
+        void clear() {
+            for (const Entry& entry : _entries) {
+                _table[entry.slot] = EMPTY_SLOT;
+            }
+            _entries.clear();
+            _heap.clear();
+        }
+
+        std::size_t size() const { return _entries.size(); }
+
+        const Entry* find(RoutingGraph::NodeId nodeId) const {
+            std::uint32_t entryIndex = _table[findSlot(nodeId)];
+            return entryIndex != EMPTY_SLOT ? &_entries[entryIndex] : nullptr;
+        }
+
+        // Add the node to the heap or decrease its weight. Returns false if the node already has the same or smaller weight.
+        bool push(RoutingGraph::NodeId nodeId, RoutingGraph::NodeId prevNodeId, float weight) {
+            std::size_t slot = findSlot(nodeId);
+            std::uint32_t entryIndex = _table[slot];
+            if (entryIndex == EMPTY_SLOT) {
+                if ((_entries.size() + 1) * 2 > _table.size()) {
+                    grow();
+                    slot = findSlot(nodeId);
+                }
+                entryIndex = static_cast<std::uint32_t>(_entries.size());
+                _table[slot] = entryIndex;
+                _entries.emplace_back();
+                Entry& entry = _entries.back();
+                entry.nodeId = nodeId;
+                entry.slot = static_cast<std::uint32_t>(slot);
+            }
+            else if (_entries[entryIndex].weight <= weight) {
+                return false;
+            }
+
+            Entry& entry = _entries[entryIndex];
+            entry.prevNodeId = prevNodeId;
+            entry.weight = weight;
+            entry.settled = false;
+            if (entry.heapIndex == NOT_IN_HEAP) {
+                entry.heapIndex = static_cast<std::uint32_t>(_heap.size());
+                _heap.push_back(entryIndex);
+            }
+            siftUp(entry.heapIndex);
+            return true;
+        }
+
+        bool empty() const { return _heap.empty(); }
+
+        const Entry& top() const { return _entries[_heap.front()]; }
+
+        // Remove the minimum weight node from the heap and mark it as settled
+        const Entry& pop() {
+            std::uint32_t entryIndex = _heap.front();
+            _heap.front() = _heap.back();
+            _entries[_heap.front()].heapIndex = 0;
+            _heap.pop_back();
+            if (!_heap.empty()) {
+                siftDown(0);
+            }
+            Entry& entry = _entries[entryIndex];
+            entry.heapIndex = NOT_IN_HEAP;
+            entry.settled = true;
+            return entry;
+        }
+
+        // Drop all unsettled nodes, settled nodes are kept for path reconstruction
+        void clearHeap() {
+            for (std::uint32_t entryIndex : _heap) {
+                _entries[entryIndex].heapIndex = NOT_IN_HEAP;
+            }
+            _heap.clear();
+        }
+
+    private:
+        enum : std::uint32_t { EMPTY_SLOT = 0xFFFFFFFFU, NOT_IN_HEAP = 0xFFFFFFFFU };
+        enum { INITIAL_CAPACITY = 1024 };
+
+        std::size_t findSlot(RoutingGraph::NodeId nodeId) const {
+            // Fibonacci hashing, followed by linear probing
+            std::size_t slot = static_cast<std::size_t>((nodeId.packedId() * 0x9E3779B97F4A7C15ULL) >> 32) & _mask;
+            while (_table[slot] != EMPTY_SLOT && !(_entries[_table[slot]].nodeId == nodeId)) {
+                slot = (slot + 1) & _mask;
+            }
+            return slot;
+        }
+
+        void grow() {
+            _table.assign(_table.size() * 2, EMPTY_SLOT);
+            _mask = _table.size() - 1;
+            for (std::uint32_t entryIndex = 0; entryIndex < _entries.size(); entryIndex++) {
+                std::size_t slot = findSlot(_entries[entryIndex].nodeId);
+                _table[slot] = entryIndex;
+                _entries[entryIndex].slot = static_cast<std::uint32_t>(slot);
+            }
+        }
+
+        void siftUp(std::uint32_t heapIndex) {
+            std::uint32_t entryIndex = _heap[heapIndex];
+            float weight = _entries[entryIndex].weight;
+            while (heapIndex > 0) {
+                std::uint32_t parentIndex = (heapIndex - 1) / 2;
+                if (!(weight < _entries[_heap[parentIndex]].weight)) {
+                    break;
+                }
+                _heap[heapIndex] = _heap[parentIndex];
+                _entries[_heap[heapIndex]].heapIndex = heapIndex;
+                heapIndex = parentIndex;
+            }
+            _heap[heapIndex] = entryIndex;
+            _entries[entryIndex].heapIndex = heapIndex;
+        }
+
+        void siftDown(std::uint32_t heapIndex) {
+            std::uint32_t entryIndex = _heap[heapIndex];
+            float weight = _entries[entryIndex].weight;
+            std::uint32_t size = static_cast<std::uint32_t>(_heap.size());
+            while (true) {
+                std::uint32_t childIndex = heapIndex * 2 + 1;
+                if (childIndex >= size) {
+                    break;
+                }
+                if (childIndex + 1 < size && _entries[_heap[childIndex + 1]].weight < _entries[_heap[childIndex]].weight) {
+                    childIndex++;
+                }
+                if (!(_entries[_heap[childIndex]].weight < weight)) {
+                    break;
+                }
+                _heap[heapIndex] = _heap[childIndex];
+                _entries[_heap[heapIndex]].heapIndex = heapIndex;
+                heapIndex = childIndex;
+            }
+            _heap[heapIndex] = entryIndex;
+            _entries[entryIndex].heapIndex = heapIndex;
+        }
+
+        std::vector<Entry> _entries;
+        std::vector<std::uint32_t> _table;
+        std::vector<std::uint32_t> _heap;
+        std::size_t _mask;
+    };
+
+    // Pending step of RouteFinder path unpacking: an edge to unpack, or, if pathOffset is set, the end of the
+    // unpacked edge sequence of a shortcut that started at pathOffset of the output path
+    struct UnpackTask {
+        enum : std::size_t { NO_PATH_OFFSET = ~static_cast<std::size_t>(0) };
+
+        RoutingGraph::NodeId prevNodeId;
+        RoutingGraph::NodeId nodeId;
+        std::size_t pathOffset = NO_PATH_OFFSET;
+
+        UnpackTask() = default;
+        explicit UnpackTask(RoutingGraph::NodeId prevNodeId, RoutingGraph::NodeId nodeId, std::size_t pathOffset = NO_PATH_OFFSET) : prevNodeId(prevNodeId), nodeId(nodeId), pathOffset(pathOffset) { }
+    };
+
+    // Reusable per-thread state for RouteFinder queries
+    struct SearchWorkspace {
+        std::array<SearchSpace, 2> searchSpaces;
+        std::array<SearchSpace, 2> localSearchSpaces; // local optimality tests of alternatives, the main search spaces are kept for unpacking
+        std::vector<UnpackTask> unpackStack;
+        std::vector<RoutingGraph::NodeId> viaNodeIds; // alternative via node candidates, settled from both directions
+
+        SearchWorkspace() = default;
+
+        void clear() {
+            searchSpaces[0].clear();
+            searchSpaces[1].clear();
+            localSearchSpaces[0].clear();
+            localSearchSpaces[1].clear();
+            unpackStack.clear();
+            viaNodeIds.clear();
+        }
+    };
+} }
+
+#endif
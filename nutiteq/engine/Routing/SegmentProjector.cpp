@@ -0,0 +1,108 @@
+#include "SegmentProjector.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NUTI_SEGMENTPROJECTOR_SSE2
+#endif
+
+namespace Nuti { namespace Routing {
+    std::size_t SegmentProjector::project(const std::int32_t* coords, std::size_t count, float* dist2s, float* relPoses) const {
+        std::size_t segments = count - 1;
+        std::size_t i = 0;
+
+#if defined(__AVX2__)
+        // 8 segments per iteration, points i..i+8 are read
+        const __m256i latLon = _mm256_setr_epi32(_lat, _lon, _lat, _lon, _lat, _lon, _lat, _lon);
+        const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        const __m256 lonFactor = _mm256_set1_ps(_lonFactor);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        auto load = [&](std::size_t index, __m256& lat, __m256& lon) {
+            __m256i v0 = _mm256_permutevar8x32_epi32(_mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(coords + index * 2)), latLon), deinterleave);
+            __m256i v1 = _mm256_permutevar8x32_epi32(_mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(coords + index * 2 + 8)), latLon), deinterleave);
+            lat = _mm256_cvtepi32_ps(_mm256_permute2x128_si256(v0, v1, 0x20));
+            lon = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_permute2x128_si256(v0, v1, 0x31)), lonFactor);
+        };
+        for (; i + 8 < count; i += 8) {
+            __m256 ax, ay, bx, by;
+            load(i, ax, ay);
+            load(i + 1, bx, by);
+            __m256 dx = _mm256_sub_ps(bx, ax);
+            __m256 dy = _mm256_sub_ps(by, ay);
+            __m256 len2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+            __m256 dot = _mm256_add_ps(_mm256_mul_ps(ax, dx), _mm256_mul_ps(ay, dy));
+            __m256 t = _mm256_div_ps(_mm256_sub_ps(zero, dot), len2);
+            t = _mm256_and_ps(_mm256_min_ps(_mm256_max_ps(t, zero), one), _mm256_cmp_ps(len2, zero, _CMP_GT_OQ));
+            __m256 px = _mm256_add_ps(ax, _mm256_mul_ps(dx, t));
+            __m256 py = _mm256_add_ps(ay, _mm256_mul_ps(dy, t));
+            _mm256_storeu_ps(dist2s + i, _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)));
+            _mm256_storeu_ps(relPoses + i, t);
+        }
+#elif defined(NUTI_SEGMENTPROJECTOR_SSE2)
+        // 4 segments per iteration, points i..i+4 are read
+        const __m128i latLon = _mm_setr_epi32(_lat, _lon, _lat, _lon);
+        const __m128 lonFactor = _mm_set1_ps(_lonFactor);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        auto load = [&](std::size_t index, __m128& lat, __m128& lon) {
+            __m128 v0 = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(coords + index * 2)), latLon));
+            __m128 v1 = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(coords + index * 2 + 4)), latLon));
+            lat = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+            lon = _mm_mul_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)), lonFactor);
+        };
+        for (; i + 4 < count; i += 4) {
+            __m128 ax, ay, bx, by;
+            load(i, ax, ay);
+            load(i + 1, bx, by);
+            __m128 dx = _mm_sub_ps(bx, ax);
+            __m128 dy = _mm_sub_ps(by, ay);
+            __m128 len2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 dot = _mm_add_ps(_mm_mul_ps(ax, dx), _mm_mul_ps(ay, dy));
+            __m128 t = _mm_div_ps(_mm_sub_ps(zero, dot), len2);
+            t = _mm_and_ps(_mm_min_ps(_mm_max_ps(t, zero), one), _mm_cmpgt_ps(len2, zero));
+            __m128 px = _mm_add_ps(ax, _mm_mul_ps(dx, t));
+            __m128 py = _mm_add_ps(ay, _mm_mul_ps(dy, t));
+            _mm_storeu_ps(dist2s + i, _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)));
+            _mm_storeu_ps(relPoses + i, t);
+        }
+#endif
+
+        projectScalar(coords, i, segments, dist2s, relPoses);
+        return std::min_element(dist2s, dist2s + segments) - dist2s;
+    }
+
+    const char* SegmentProjector::getImplementationName() {
+#if defined(__AVX2__)
+        return "avx2";
+#elif defined(NUTI_SEGMENTPROJECTOR_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void SegmentProjector::projectScalar(const std::int32_t* coords, std::size_t first, std::size_t last, float* dist2s, float* relPoses) const {
+        // Same operations as the vectorized loops, so that the results do not depend on the code path
+        for (std::size_t i = first; i < last; i++) {
+            float ax = static_cast<float>(coords[i * 2 + 0] - _lat);
+            float ay = static_cast<float>(coords[i * 2 + 1] - _lon) * _lonFactor;
+            float bx = static_cast<float>(coords[i * 2 + 2] - _lat);
+            float by = static_cast<float>(coords[i * 2 + 3] - _lon) * _lonFactor;
+            float dx = bx - ax;
+            float dy = by - ay;
+            float len2 = dx * dx + dy * dy;
+            float t = 0;
+            if (len2 > 0) {
+                t = std::min(std::max((0.0f - (ax * dx + ay * dy)) / len2, 0.0f), 1.0f);
+            }
+            float px = ax + dx * t;
+            float py = ay + dy * t;
+            dist2s[i] = px * px + py * py;
+            relPoses[i] = t;
+        }
+    }
+} }
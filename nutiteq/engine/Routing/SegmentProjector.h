@@ -0,0 +1,40 @@
+/*
+ * Copyright 2014 Nutiteq Llc. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://www.nutiteq.com/license/
+ */
+
+#ifndef _NUTI_ROUTING_SEGMENTPROJECTOR_H_
+#define _NUTI_ROUTING_SEGMENTPROJECTOR_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Nuti { namespace Routing {
+    // Projects a query point to all segments of a polyline in one pass. The polyline is given as contiguous
+    // fixed-point (lat, lon) pairs. Coordinates are taken relative to the query point and longitudes are scaled by
+    // a single latitude factor, so that the trigonometry is done once per query instead of once per segment.
+    // Uses AVX2 or SSE2 when the compiler targets them, with a scalar loop for the remaining segments.
+    class SegmentProjector {
+    public:
+        SegmentProjector() = default;
+        explicit SegmentProjector(std::int32_t lat, std::int32_t lon, float lonFactor) : _lat(lat), _lon(lon), _lonFactor(lonFactor) { }
+
+        // Writes the squared distance to the closest point of each segment and the relative position of that point
+        // within the segment (0..1) to dist2s and relPoses, both of size count - 1. Returns the index of the closest
+        // segment, the first one in case of ties. Count must be at least 2.
+        std::size_t project(const std::int32_t* coords, std::size_t count, float* dist2s, float* relPoses) const;
+
+        // Name of the code path selected at compile time
+        static const char* getImplementationName();
+
+    private:
+        void projectScalar(const std::int32_t* coords, std::size_t first, std::size_t last, float* dist2s, float* relPoses) const;
+
+        std::int32_t _lat = 0;
+        std::int32_t _lon = 0;
+        float _lonFactor = 1.0f;
+    };
+} }
+
+#endif
@@ -2,7 +2,11 @@
 #define _BITSTREAM_H_INCLUDED_
 
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <cassert>
 
 namespace bitstreams {
@@ -55,6 +59,11 @@ namespace bitstreams {
             assert(!(initial > 0 && val > 0));
         }
 
+        // Write signed value using zig-zag encoding (0, -1, 1, -2, 2, ...)
+        void write_zigzag(int val, int bits) {
+            write_bits((static_cast<unsigned int>(val) << 1) ^ static_cast<unsigned int>(val >> 31), bits);
+        }
+
         template <typename T>
         void rewrite_bits(T val, int bits, std::uint64_t offset) {
             T initial = val;
@@ -85,43 +94,115 @@ namespace bitstreams {
         std::vector<unsigned char> _data;
     };
 
-    // Input bitstream
+    // Input bitstream. Either owns its data or reads from external buffer that must outlive the stream.
+    // Bits are consumed from a 64-bit buffer that is refilled a whole word at a time.
     class input_bitstream {
     public:
-        explicit input_bitstream(const std::vector<unsigned char>& data) : _bits(0), _offset(0), _data(data) { }
-        explicit input_bitstream(std::vector<unsigned char>&& data) : _bits(0), _offset(0), _data(std::move(data)) { }
+        explicit input_bitstream(const std::vector<unsigned char>& data) : _data(data), _ptr(_data.data()), _size(_data.size()) { }
+        explicit input_bitstream(std::vector<unsigned char>&& data) : _data(std::move(data)), _ptr(_data.data()), _size(_data.size()) { }
+        explicit input_bitstream(const unsigned char* data, std::size_t size) : _data(), _ptr(data), _size(size) { }
+
+        input_bitstream(const input_bitstream&) = delete;
+        input_bitstream(input_bitstream&&) = default;
+        input_bitstream& operator = (const input_bitstream&) = delete;
+        input_bitstream& operator = (input_bitstream&&) = default;
 
         bool read_bit() {
-            bool bit = ((_data.at(_offset) >> _bits) & 1) != 0;
-            
-            _bits += 1;
-            _offset += _bits >> 3;
-            _bits = _bits & 7;
-            return bit;
+            return read_raw(1) != 0;
         }
 
         template <typename T>
         T read_bits(int bits) {
-            T val = 0;
-            int shift = 0;
-            while (bits > 0) {
-                int block = std::min(8 - _bits, bits);
-                unsigned int mask = (1 << block) - 1;
-                val |= static_cast<T>((_data.at(_offset) >> _bits) & mask) << shift;
-                
-                _bits += block;
-                _offset += _bits >> 3;
-                _bits = _bits & 7;
-                shift += block;
-                bits -= block;
+            if (bits > MAX_RAW_BITS) {
+                std::uint64_t lo = read_raw(32);
+                std::uint64_t hi = read_raw(bits - 32);
+                return static_cast<T>(lo | (hi << 32));
+            }
+            return static_cast<T>(read_raw(bits));
+        }
+
+        // Fixed width read, the mask is known at compile time
+        template <typename T, int Bits>
+        T read_bits() {
+            static_assert(Bits > 0 && Bits <= 32, "Unsupported fixed bit width");
+            if (_avail < Bits) {
+                refill(Bits);
+            }
+            std::uint64_t val = _buffer & ((std::uint64_t(1) << Bits) - 1);
+            _buffer >>= Bits;
+            _avail -= Bits;
+            return static_cast<T>(val);
+        }
+
+        // Read zig-zag encoded signed value (0, -1, 1, -2, 2, ...)
+        int read_zigzag(int bits) {
+            unsigned int val = static_cast<unsigned int>(read_raw(bits));
+            return static_cast<int>(val >> 1) ^ -static_cast<int>(val & 1);
+        }
+
+        // Read 8-bit values. Byte-aligned tail is copied directly from the underlying data
+        template <typename OutputIt>
+        void read_bytes(OutputIt out, std::size_t count) {
+            while (count > 0 && (_avail & 7) == 0 && _avail > 0) {
+                *out++ = static_cast<unsigned char>(read_raw(8));
+                count--;
             }
+            if (_avail == 0) {
+                _buffer = 0;
+                if (count > _size - _pos) {
+                    throw std::out_of_range("Read past end of bitstream");
+                }
+                out = std::copy(_ptr + _pos, _ptr + _pos + count, out);
+                _pos += count;
+                return;
+            }
+            while (count-- > 0) {
+                *out++ = static_cast<unsigned char>(read_raw(8));
+            }
+        }
+
+    private:
+        enum { MAX_RAW_BITS = 56 };
+
+        std::uint64_t read_raw(int bits) {
+            assert(bits >= 0 && bits <= MAX_RAW_BITS);
+            if (_avail < bits) {
+                refill(bits);
+            }
+            std::uint64_t val = _buffer & ((std::uint64_t(1) << bits) - 1);
+            _buffer >>= bits;
+            _avail -= bits;
             return val;
         }
 
-    public:
-        int _bits;
-        std::size_t _offset;
+        void refill(int bits) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            if (_size - _pos >= sizeof(std::uint64_t)) {
+                // Load a whole little-endian word. Bits above the accepted bytes are valid stream bits as well,
+                // so OR-ing them again on the next refill is harmless.
+                std::uint64_t word;
+                std::memcpy(&word, _ptr + _pos, sizeof(word));
+                _buffer |= word << _avail;
+                _pos += (63 - _avail) >> 3;
+                _avail |= 56;
+                return;
+            }
+#endif
+            while (_avail <= 56 && _pos < _size) {
+                _buffer |= static_cast<std::uint64_t>(_ptr[_pos++]) << _avail;
+                _avail += 8;
+            }
+            if (_avail < bits) {
+                throw std::out_of_range("Read past end of bitstream");
+            }
+        }
+
         std::vector<unsigned char> _data;
+        const unsigned char* _ptr = nullptr;
+        std::size_t _size = 0;
+        std::size_t _pos = 0;
+        std::uint64_t _buffer = 0;
+        int _avail = 0;
     };
 
 } // namespace bitstreams
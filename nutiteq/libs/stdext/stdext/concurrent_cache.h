@@ -0,0 +1,338 @@
+#ifndef _CONCURRENT_CACHE_H_INCLUDED_
+#define _CONCURRENT_CACHE_H_INCLUDED_
+
+#include "memory_budget.h"
+
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+
+namespace cache {
+
+    // Cache counters, for monitoring and tuning
+    struct cache_stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t insertions = 0;
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    // Thread-safe cache, split into independently locked shards. Each shard uses segmented CLOCK (2Q-like) eviction:
+    // new entries go to a probationary segment and are promoted to the protected segment only when they are referenced
+    // again before the clock reaches them. One-off scans are therefore evicted before the frequently used entries.
+    // A cache hit only updates a reference bit under the shard lock - no list reordering.
+    // Optionally the entries are also accounted in bytes against a memory budget, that may be shared by several caches.
+    template <
+        typename key_t,
+        typename value_t,
+        typename hash_t = std::hash<key_t>,
+        typename key_equal_t = std::equal_to<key_t>>
+    class concurrent_cache {
+    public:
+        using size_func_t = std::function<std::size_t(const value_t&)>;
+
+        explicit concurrent_cache(std::size_t max_size, std::size_t shard_count = 16) :
+            concurrent_cache(max_size, std::shared_ptr<memory_budget>(), size_func_t(), shard_count)
+        {
+        }
+
+        concurrent_cache(std::size_t max_size, std::shared_ptr<memory_budget> budget, size_func_t size_func, std::size_t shard_count = 16) :
+            _shards(std::max(static_cast<std::size_t>(1), std::min(shard_count, max_size / MIN_SHARD_SIZE))),
+            _hash(),
+            _budget(std::move(budget)),
+            _size_func(std::move(size_func)),
+            _evict_cursor(0)
+        {
+            for (std::unique_ptr<shard>& s : _shards) {
+                s.reset(new shard());
+            }
+            resize(max_size);
+            if (_budget) {
+                _evictor_id = _budget->register_evictor([this](bool force) { return evict_one(force); });
+            }
+        }
+
+        concurrent_cache(const concurrent_cache&) = delete;
+        concurrent_cache& operator = (const concurrent_cache&) = delete;
+
+        ~concurrent_cache() {
+            if (_budget) {
+                _budget->unregister_evictor(_evictor_id);
+            }
+            clear();
+        }
+
+        void put(const key_t& key, const value_t& value) {
+            std::size_t bytes = _size_func ? _size_func(value) : 0;
+            if (_budget) {
+                // Make room before inserting, so that the new entry is not evicted immediately
+                _budget->enforce(bytes);
+            }
+            {
+                shard& s = get_shard(key);
+                std::lock_guard<std::mutex> lock(s.mutex);
+
+                auto it = s.index.find(key);
+                if (it != s.index.end()) {
+                    entry& e = *it->second;
+                    account(s, e, -static_cast<std::ptrdiff_t>(e.bytes));
+                    e.value = value;
+                    e.bytes = bytes;
+                    e.referenced = true;
+                    account(s, e, static_cast<std::ptrdiff_t>(bytes));
+                }
+                else {
+                    if (s.max_size == 0) {
+                        return;
+                    }
+                    while (s.index.size() >= s.max_size && evict(s, true) > 0) {
+                    }
+                    s.probation.push_back(entry { key, value, bytes, false, false });
+                    s.index[key] = std::prev(s.probation.end());
+                    account(s, s.probation.back(), static_cast<std::ptrdiff_t>(bytes));
+                    s.insertions++;
+                }
+            }
+        }
+
+        bool read(const key_t& key, value_t& value) const {
+            shard& s = get_shard(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            auto it = s.index.find(key);
+            if (it == s.index.end()) {
+                s.misses++;
+                return false;
+            }
+            entry& e = *it->second;
+            e.referenced = true;
+            value = e.value;
+            s.hits++;
+            return true;
+        }
+
+        bool exists(const key_t& key) const {
+            shard& s = get_shard(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.index.find(key) != s.index.end();
+        }
+
+        bool erase(const key_t& key) {
+            shard& s = get_shard(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.index.find(key);
+            if (it == s.index.end()) {
+                return false;
+            }
+            remove(s, it->second);
+            return true;
+        }
+
+        // Erase all entries for which pred(key, value) returns true. Returns the number of erased entries.
+        template <typename pred_t>
+        std::size_t erase_if(pred_t pred) {
+            std::size_t count = 0;
+            for (const std::unique_ptr<shard>& s : _shards) {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                for (entry_list* list : { &s->probation, &s->protected_ }) {
+                    for (auto it = list->begin(); it != list->end(); ) {
+                        auto next = std::next(it);
+                        if (pred(it->key, it->value)) {
+                            remove(*s, it);
+                            count++;
+                        }
+                        it = next;
+                    }
+                }
+            }
+            return count;
+        }
+
+        void clear() {
+            for (const std::unique_ptr<shard>& s : _shards) {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                if (_budget) {
+                    _budget->remove(s->bytes);
+                }
+                s->probation.clear();
+                s->protected_.clear();
+                s->index.clear();
+                s->bytes = 0;
+                s->protected_bytes = 0;
+            }
+        }
+
+        void resize(std::size_t size) {
+            std::size_t shard_size = (size + _shards.size() - 1) / _shards.size();
+            for (const std::unique_ptr<shard>& s : _shards) {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                s->max_size = shard_size;
+                while (s->index.size() > shard_size && evict(*s, true) > 0) {
+                }
+            }
+        }
+
+        std::size_t size() const {
+            std::size_t total = 0;
+            for (const std::unique_ptr<shard>& s : _shards) {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                total += s->index.size();
+            }
+            return total;
+        }
+
+        cache_stats stats() const {
+            cache_stats result;
+            for (const std::unique_ptr<shard>& s : _shards) {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                result.hits += s->hits;
+                result.misses += s->misses;
+                result.insertions += s->insertions;
+                result.evictions += s->evictions;
+                result.entries += s->index.size();
+                result.bytes += s->bytes;
+            }
+            return result;
+        }
+
+    private:
+        enum { MIN_SHARD_SIZE = 8, MAX_COLD_SCAN = 8 };
+
+        struct entry {
+            key_t key;
+            value_t value;
+            std::size_t bytes;
+            bool referenced;
+            bool is_protected;
+        };
+
+        using entry_list = std::list<entry>;
+
+        struct shard {
+            std::mutex mutex;
+            entry_list probation;
+            entry_list protected_;
+            std::unordered_map<key_t, typename entry_list::iterator, hash_t, key_equal_t> index;
+            std::size_t bytes = 0;
+            std::size_t protected_bytes = 0;
+            std::size_t max_size = 0;
+            // Counters are kept per shard and updated under the shard lock, so reads do not contend on shared atomics
+            std::uint64_t hits = 0;
+            std::uint64_t misses = 0;
+            std::uint64_t insertions = 0;
+            std::uint64_t evictions = 0;
+        };
+
+        shard& get_shard(const key_t& key) const {
+            // Mix the hash, as block hashes tend to differ only in the low bits
+            std::uint64_t h = static_cast<std::uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ULL;
+            return *_shards[static_cast<std::size_t>(h >> 32) % _shards.size()];
+        }
+
+        void account(shard& s, const entry& e, std::ptrdiff_t bytes) {
+            s.bytes += bytes;
+            if (e.is_protected) {
+                s.protected_bytes += bytes;
+            }
+            if (_budget) {
+                if (bytes >= 0) {
+                    _budget->add(static_cast<std::size_t>(bytes));
+                } else {
+                    _budget->remove(static_cast<std::size_t>(-bytes));
+                }
+            }
+        }
+
+        std::size_t remove(shard& s, typename entry_list::iterator it) {
+            std::size_t bytes = it->bytes;
+            account(s, *it, -static_cast<std::ptrdiff_t>(bytes));
+            s.index.erase(it->key);
+            (it->is_protected ? s.protected_ : s.probation).erase(it);
+            return std::max(bytes, static_cast<std::size_t>(1));
+        }
+
+        // Advance the clock over the probationary segment. Referenced entries are promoted, the first unreferenced entry
+        // is evicted. Without force only a few entries are examined. Returns the number of bytes released (at least 1).
+        std::size_t evict(shard& s, bool force) {
+            for (std::size_t scanned = 0; force || scanned < MAX_COLD_SCAN; scanned++) {
+                if (s.probation.empty()) {
+                    if (s.protected_.empty() || !force) {
+                        return 0;
+                    }
+                    demote(s, true);
+                    continue;
+                }
+                auto it = s.probation.begin();
+                if (!it->referenced) {
+                    s.evictions++;
+                    return remove(s, it);
+                }
+                it->referenced = false;
+                it->is_protected = true;
+                s.protected_bytes += it->bytes;
+                s.protected_.splice(s.protected_.end(), s.probation, it);
+                while (protected_full(s)) {
+                    demote(s, false);
+                }
+            }
+            return 0;
+        }
+
+        // The protected segment may hold up to 3/4 of the shard, measured in bytes if the entry sizes are known
+        bool protected_full(const shard& s) const {
+            if (_size_func) {
+                return s.protected_bytes * 4 > s.bytes * 3;
+            }
+            return s.protected_.size() * 4 > s.index.size() * 3;
+        }
+
+        // Advance the clock over the protected segment: referenced entries get a second chance, the first unreferenced
+        // entry is moved back to the probationary segment
+        void demote(shard& s, bool force) {
+            while (!s.protected_.empty()) {
+                auto it = s.protected_.begin();
+                if (it->referenced && !force) {
+                    it->referenced = false;
+                    s.protected_.splice(s.protected_.end(), s.protected_, it);
+                    continue;
+                }
+                it->referenced = false;
+                it->is_protected = false;
+                s.protected_bytes -= it->bytes;
+                s.probation.splice(s.probation.end(), s.protected_, it);
+                return;
+            }
+        }
+
+        std::size_t evict_one(bool force) {
+            for (std::size_t i = 0; i < _shards.size(); i++) {
+                shard& s = *_shards[_evict_cursor++ % _shards.size()];
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (std::size_t bytes = evict(s, force)) {
+                    return bytes;
+                }
+            }
+            return 0;
+        }
+
+        std::vector<std::unique_ptr<shard>> _shards;
+        hash_t _hash;
+        std::shared_ptr<memory_budget> _budget;
+        size_func_t _size_func;
+        std::size_t _evictor_id = 0;
+        std::atomic<std::size_t> _evict_cursor;
+    };
+
+} // namespace cache
+
+#endif // _CONCURRENT_CACHE_H_INCLUDED_
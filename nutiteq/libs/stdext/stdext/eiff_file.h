@@ -57,6 +57,9 @@ namespace eiff {
         virtual size_type size() const = 0;
         virtual void read(std::vector<unsigned char>& data) const = 0;
         virtual void read(std::vector<unsigned char>& data, size_type offset, std::size_t size) const = 0;
+
+        // Direct read-only access to chunk data, without copying. Returns null if the chunk is not memory-addressable
+        virtual const unsigned char* view(size_type /* offset */, std::size_t /* size */) const { return nullptr; }
         
     protected:
         explicit data_chunk(const tag_type& tag) : chunk(tag) { }
@@ -71,6 +74,7 @@ namespace eiff {
         virtual size_type size() const override { return _data.size(); }
         virtual void read(std::vector<unsigned char>& data) const override { data = _data; }
         virtual void read(std::vector<unsigned char>& data, size_type offset, std::size_t size) const override { data.assign(_data.begin() + offset, _data.begin() + offset + size); }
+        virtual const unsigned char* view(size_type offset, std::size_t size) const override { return offset + size <= _data.size() ? _data.data() + offset : nullptr; }
         
     private:
         std::vector<unsigned char> _data;
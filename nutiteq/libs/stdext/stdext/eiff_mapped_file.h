@@ -0,0 +1,202 @@
+#ifndef _EIFF_MAPPED_FILE_H_INCLUDED_
+#define _EIFF_MAPPED_FILE_H_INCLUDED_
+
+#include "eiff_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace eiff {
+
+    // Read-only memory mapping of a whole file
+    class mapped_file {
+    public:
+        using size_type = std::uint64_t;
+
+        // Access pattern hint given to the OS for the mapped pages
+        enum class advice {
+            normal,
+            random,
+            sequential,
+            willneed
+        };
+
+        explicit mapped_file(const std::string& file_name, advice hint = advice::normal) {
+#ifdef _WIN32
+            _file = ::CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, hint == advice::sequential ? FILE_FLAG_SEQUENTIAL_SCAN : (hint == advice::random ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL), nullptr);
+            if (_file == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Failed to open file " + file_name);
+            }
+            LARGE_INTEGER size;
+            if (!::GetFileSizeEx(_file, &size)) {
+                ::CloseHandle(_file);
+                throw std::runtime_error("Failed to read size of file " + file_name);
+            }
+            _size = static_cast<size_type>(size.QuadPart);
+            if (_size > 0) {
+                _mapping = ::CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                _data = _mapping ? static_cast<const unsigned char*>(::MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+                if (!_data) {
+                    if (_mapping) {
+                        ::CloseHandle(_mapping);
+                    }
+                    ::CloseHandle(_file);
+                    throw std::runtime_error("Failed to map file " + file_name);
+                }
+            }
+#else
+            int fd = ::open(file_name.c_str(), O_RDONLY);
+            if (fd == -1) {
+                throw std::runtime_error("Failed to open file " + file_name);
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Failed to read size of file " + file_name);
+            }
+            _size = static_cast<size_type>(st.st_size);
+            if (_size > 0) {
+                void* data = ::mmap(nullptr, static_cast<std::size_t>(_size), PROT_READ, MAP_SHARED, fd, 0);
+                if (data == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Failed to map file " + file_name);
+                }
+                _data = static_cast<const unsigned char*>(data);
+            }
+            ::close(fd); // the mapping keeps its own reference to the file
+            advise(0, _size, hint);
+#endif
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator = (const mapped_file&) = delete;
+
+        ~mapped_file() {
+#ifdef _WIN32
+            if (_data) {
+                ::UnmapViewOfFile(_data);
+            }
+            if (_mapping) {
+                ::CloseHandle(_mapping);
+            }
+            ::CloseHandle(_file);
+#else
+            if (_data) {
+                ::munmap(const_cast<unsigned char*>(_data), static_cast<std::size_t>(_size));
+            }
+#endif
+        }
+
+        const unsigned char* data() const { return _data; }
+        size_type size() const { return _size; }
+
+        // Give access pattern hint for the specified byte range. This is only a hint and failures are ignored
+        void advise(size_type offset, size_type size, advice hint) const {
+#ifndef _WIN32
+            if (!_data || offset >= _size) {
+                return;
+            }
+            int flag = MADV_NORMAL;
+            switch (hint) {
+            case advice::random:
+                flag = MADV_RANDOM;
+                break;
+            case advice::sequential:
+                flag = MADV_SEQUENTIAL;
+                break;
+            case advice::willneed:
+                flag = MADV_WILLNEED;
+                break;
+            default:
+                break;
+            }
+            size_type page_size = static_cast<size_type>(::sysconf(_SC_PAGESIZE));
+            size_type begin = offset - offset % page_size;
+            size_type end = std::min(offset + size, _size);
+            ::madvise(const_cast<unsigned char*>(_data) + begin, static_cast<std::size_t>(end - begin), flag);
+#else
+            (void) offset;
+            (void) size;
+            (void) hint;
+#endif
+        }
+
+    private:
+        const unsigned char* _data = nullptr;
+        size_type _size = 0;
+#ifdef _WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+#endif
+    };
+
+    // Data chunk backed by memory mapped file. Reads never seek, views point directly into the mapping
+    class mapped_data_chunk : public data_chunk {
+    public:
+        mapped_data_chunk(const tag_type& tag, const std::shared_ptr<const mapped_file>& file, size_type offset, size_type size) : data_chunk(tag), _file(file), _offset(offset), _size(size) { }
+
+        virtual size_type size() const override { return _size; }
+        virtual void read(std::vector<unsigned char>& data) const override { data.assign(_file->data() + _offset, _file->data() + _offset + _size); }
+        virtual void read(std::vector<unsigned char>& data, size_type offset, std::size_t size) const override { const unsigned char* ptr = view(offset, size); if (!ptr) { throw std::out_of_range("Read outside of chunk"); } data.assign(ptr, ptr + size); }
+        virtual const unsigned char* view(size_type offset, std::size_t size) const override { return offset + size <= _size ? _file->data() + _offset + offset : nullptr; }
+
+    private:
+        std::shared_ptr<const mapped_file> _file;
+        size_type _offset = 0;
+        size_type _size = 0;
+    };
+
+    // Read chunk from memory mapped file, starting at given offset. The offset is advanced past the chunk
+    inline std::shared_ptr<chunk> read_chunk(const std::shared_ptr<const mapped_file>& file, mapped_file::size_type& offset) {
+        auto read_value = [&file, &offset](void* value, std::size_t size) {
+            if (offset + size > file->size()) {
+                throw std::runtime_error("Truncated EIFF file");
+            }
+            std::memcpy(value, file->data() + offset, size);
+            offset += size;
+        };
+
+        chunk::tag_type tag { };
+        read_value(tag.data(), sizeof(tag));
+        std::uint64_t size = 0;
+        read_value(&size, sizeof(size));
+        mapped_file::size_type start_offset = offset;
+        if (start_offset + size > file->size()) {
+            throw std::runtime_error("Truncated EIFF file");
+        }
+        std::shared_ptr<chunk> result;
+        if (tag == form_chunk().tag()) {
+            std::uint64_t count = 0;
+            read_value(&count, sizeof(count));
+            std::vector<std::shared_ptr<chunk>> chunks;
+            chunks.reserve(static_cast<std::size_t>(count));
+            while (count-- > 0) {
+                chunks.push_back(read_chunk(file, offset));
+            }
+            result = std::make_shared<form_chunk>(std::move(chunks));
+        } else {
+            result = std::make_shared<mapped_data_chunk>(tag, file, start_offset, size);
+        }
+        offset = start_offset + size;
+        return result;
+    }
+
+} // namespace eiff
+
+#endif
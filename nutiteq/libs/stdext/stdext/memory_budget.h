@@ -0,0 +1,86 @@
+#ifndef _MEMORY_BUDGET_H_INCLUDED_
+#define _MEMORY_BUDGET_H_INCLUDED_
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+namespace cache {
+
+    // Byte budget shared by several caches. Caches account their entries against the budget and register an evictor,
+    // the budget then evicts entries from all registered caches when the total size exceeds the limit.
+    class memory_budget {
+    public:
+        // Evictor callback: evict a single entry and return the number of bytes released, 0 if nothing was evicted.
+        // With force == false only cold entries should be evicted.
+        using evictor_t = std::function<std::size_t(bool force)>;
+
+        explicit memory_budget(std::size_t max_bytes) : _max_bytes(max_bytes), _used_bytes(0) { }
+
+        memory_budget(const memory_budget&) = delete;
+        memory_budget& operator = (const memory_budget&) = delete;
+
+        std::size_t max_bytes() const { return _max_bytes.load(); }
+        std::size_t used_bytes() const { return _used_bytes.load(); }
+
+        void resize(std::size_t max_bytes) {
+            _max_bytes = max_bytes;
+            enforce();
+        }
+
+        void add(std::size_t bytes) { _used_bytes += bytes; }
+        void remove(std::size_t bytes) { _used_bytes -= bytes; }
+
+        std::size_t register_evictor(evictor_t evictor) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::size_t id = _next_id++;
+            _evictors.emplace_back(id, std::move(evictor));
+            return id;
+        }
+
+        void unregister_evictor(std::size_t id) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = _evictors.begin(); it != _evictors.end(); it++) {
+                if (it->first == id) {
+                    _evictors.erase(it);
+                    break;
+                }
+            }
+        }
+
+        // Evict entries until the budget has room for extra_bytes. Caches are visited round-robin, cold entries are evicted first.
+        void enforce(std::size_t extra_bytes = 0) {
+            if (_used_bytes.load() + extra_bytes <= _max_bytes.load()) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (_used_bytes.load() + extra_bytes > _max_bytes.load() && !_evictors.empty()) {
+                bool evicted = false;
+                for (int pass = 0; pass < 2 && !evicted; pass++) {
+                    for (std::size_t i = 0; i < _evictors.size() && !evicted; i++) {
+                        _cursor = (_cursor + 1) % _evictors.size();
+                        evicted = _evictors[_cursor].second(pass > 0) > 0;
+                    }
+                }
+                if (!evicted) {
+                    break;
+                }
+            }
+        }
+
+    private:
+        std::atomic<std::size_t> _max_bytes;
+        std::atomic<std::size_t> _used_bytes;
+        std::vector<std::pair<std::size_t, evictor_t>> _evictors;
+        std::size_t _next_id = 0;
+        std::size_t _cursor = 0;
+        std::mutex _mutex;
+    };
+
+} // namespace cache
+
+#endif // _MEMORY_BUDGET_H_INCLUDED_
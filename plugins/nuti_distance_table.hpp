@@ -0,0 +1,196 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_DISTANCE_TABLE_HPP
+#define NUTI_DISTANCE_TABLE_HPP
+
+#include "plugin_base.hpp"
+
+#include "../util/integer_range.hpp"
+#include "../util/json_renderer.hpp"
+#include "../util/make_unique.hpp"
+
+#include "../nutiteq/engine/Routing/RoutingObjects.h"
+#include "../nutiteq/engine/Routing/RoutingGraph.h"
+#include "../nutiteq/engine/Routing/DistanceTableFinder.h"
+#include "../nutiteq/engine/Routing/RoutingStats.h"
+
+#include "nuti_routing_graph.hpp"
+#include "nuti_stats.hpp"
+
+#include <osrm/json_container.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Distance table service on top of .nutigraph packages, replaces DistanceTablePlugin in NUTISERVER builds
+class NutiDistanceTablePlugin final : public BasePlugin
+{
+  private:
+    std::string descriptor_string;
+    std::shared_ptr<Nuti::Routing::RoutingGraph> routing_graph;
+    std::unique_ptr<Nuti::Routing::DistanceTableFinder> table_finder;
+    int max_locations_distance_table;
+
+  public:
+    explicit NutiDistanceTablePlugin(std::shared_ptr<Nuti::Routing::RoutingGraph> graph, int max_locations_distance_table)
+        : descriptor_string("table"),
+          routing_graph(std::move(graph)),
+          max_locations_distance_table(max_locations_distance_table)
+    {
+        table_finder = osrm::make_unique<Nuti::Routing::DistanceTableFinder>(routing_graph);
+    }
+
+    virtual ~NutiDistanceTablePlugin() {}
+
+    const std::string GetDescriptor() const override final { return descriptor_string; }
+
+    Status HandleRequest(const RouteParameters &route_parameters,
+                      osrm::json::Object &json_result) override final
+    {
+        if (!check_all_coordinates(route_parameters.coordinates))
+        {
+            json_result.values["status_message"] = "Coordinates are invalid";
+            return Status::Error;
+        }
+
+        const auto number_of_sources =
+            std::count(route_parameters.is_source.begin(), route_parameters.is_source.end(), true);
+        const auto number_of_destination =
+            std::count(route_parameters.is_destination.begin(), route_parameters.is_destination.end(), true);
+
+        if (max_locations_distance_table > 0 &&
+            (number_of_sources * number_of_destination >
+             max_locations_distance_table * max_locations_distance_table))
+        {
+            json_result.values["status_message"] =
+                "Number of entries " + std::to_string(number_of_sources * number_of_destination) +
+                " is higher than current maximum (" +
+                std::to_string(max_locations_distance_table * max_locations_distance_table) + ")";
+            return Status::Error;
+        }
+
+        // All locations are snapped and routed on the same package set, even if packages are updated meanwhile
+        const Nuti::Routing::RoutingGraph::Snapshot snapshot(*routing_graph);
+
+        // Engine work counters, reported with debug=true and added to the totals of the stats service
+        Nuti::Routing::RoutingStats query_stats;
+        std::unique_ptr<Nuti::Routing::RoutingStatsCollector> stats_collector;
+        if (route_parameters.debug || Nuti::Routing::RoutingStats::isTotalsEnabled())
+        {
+            stats_collector = osrm::make_unique<Nuti::Routing::RoutingStatsCollector>(query_stats);
+        }
+
+        // Snap all locations in one batch, nearby locations share the traversal and are distributed between threads
+        const std::size_t location_count = route_parameters.coordinates.size();
+        std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> nearest_nodes;
+        try
+        {
+            const Nuti::Routing::RoutingGraph::SnapOptions snap_options = NutiSnapOptions();
+            nearest_nodes = routing_graph->findNearestNodes(NutiSnapQueries(route_parameters), snap_options);
+        }
+        catch (const std::exception& ex)
+        {
+            json_result.values["status_message"] = std::string("Distance table failed, exception: ") + ex.what();
+            return Status::Error;
+        }
+
+        std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> source_nodes;
+        std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> target_nodes;
+        for (const auto i : osrm::irange<std::size_t>(0u, location_count))
+        {
+            if (nearest_nodes[i].empty())
+            {
+                json_result.values["status_message"] =
+                    std::string("Could not find a matching segment for coordinate ") + std::to_string(i);
+                return Status::NoSegment;
+            }
+            if (route_parameters.is_source[i])
+            {
+                source_nodes.push_back(nearest_nodes[i]);
+            }
+            if (route_parameters.is_destination[i])
+            {
+                target_nodes.push_back(nearest_nodes[i]);
+            }
+        }
+
+        std::vector<float> weights;
+        try
+        {
+            weights = table_finder->find(source_nodes, target_nodes);
+        }
+        catch (const std::exception& ex)
+        {
+            json_result.values["status_message"] = std::string("Distance table failed, exception: ") + ex.what();
+            return Status::Error;
+        }
+
+        stats_collector.reset();
+        if (route_parameters.debug)
+        {
+            json_result.values["debug"] = NutiRoutingStatsToJSON(query_stats);
+        }
+
+        // Weights are in the same units as OSRM edge weights (1/10 s), unreachable pairs are reported as INT_MAX
+        osrm::json::Array matrix_json_array;
+        for (const auto row : osrm::irange<std::size_t>(0, source_nodes.size()))
+        {
+            osrm::json::Array json_row;
+            for (const auto column : osrm::irange<std::size_t>(0, target_nodes.size()))
+            {
+                const float weight = weights[row * target_nodes.size() + column];
+                json_row.values.push_back(std::isinf(weight) ? std::numeric_limits<int>::max() : static_cast<int>(std::round(weight)));
+            }
+            matrix_json_array.values.push_back(json_row);
+        }
+        json_result.values["distance_table"] = matrix_json_array;
+        json_result.values["destination_coordinates"] = MakeCoordinateArray(target_nodes);
+        json_result.values["source_coordinates"] = MakeCoordinateArray(source_nodes);
+        return Status::Ok;
+    }
+
+  private:
+    static osrm::json::Array MakeCoordinateArray(const std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> &nodes)
+    {
+        osrm::json::Array coord_json_array;
+        for (const auto &nearest_nodes : nodes)
+        {
+            osrm::json::Array json_coord;
+            json_coord.values.push_back(nearest_nodes.front().nodePos(0));
+            json_coord.values.push_back(nearest_nodes.front().nodePos(1));
+            coord_json_array.values.push_back(json_coord);
+        }
+        return coord_json_array;
+    }
+};
+
+#endif // NUTI_DISTANCE_TABLE_HPP
@@ -0,0 +1,222 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_ISOCHRONE_HPP
+#define NUTI_ISOCHRONE_HPP
+
+#include "plugin_base.hpp"
+
+#include "../util/integer_range.hpp"
+#include "../util/json_renderer.hpp"
+#include "../util/make_unique.hpp"
+
+#include "../nutiteq/engine/Routing/RoutingObjects.h"
+#include "../nutiteq/engine/Routing/RoutingGraph.h"
+#include "../nutiteq/engine/Routing/ReachabilityFinder.h"
+#include "../nutiteq/engine/Routing/RoutingStats.h"
+
+#include "nuti_routing_graph.hpp"
+#include "nuti_stats.hpp"
+
+#include <osrm/json_container.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+// Reachable areas around each location for the requested travel times (time=<seconds>, repeated), on top of .nutigraph packages
+class NutiIsochronePlugin final : public BasePlugin
+{
+  private:
+    std::string descriptor_string;
+    std::shared_ptr<Nuti::Routing::RoutingGraph> routing_graph;
+    std::unique_ptr<Nuti::Routing::ReachabilityFinder> reachability_finder;
+    int max_locations_isochrone;
+    int max_isochrone_times;
+    int max_isochrone_time; // in seconds
+
+  public:
+    explicit NutiIsochronePlugin(std::shared_ptr<Nuti::Routing::RoutingGraph> graph,
+                                 int max_locations_isochrone,
+                                 int max_isochrone_times,
+                                 int max_isochrone_time)
+        : descriptor_string("isochrone"),
+          routing_graph(std::move(graph)),
+          max_locations_isochrone(max_locations_isochrone),
+          max_isochrone_times(max_isochrone_times),
+          max_isochrone_time(max_isochrone_time)
+    {
+        reachability_finder = osrm::make_unique<Nuti::Routing::ReachabilityFinder>(routing_graph);
+    }
+
+    virtual ~NutiIsochronePlugin() {}
+
+    const std::string GetDescriptor() const override final { return descriptor_string; }
+
+    Status HandleRequest(const RouteParameters &route_parameters,
+                      osrm::json::Object &json_result) override final
+    {
+        if (route_parameters.coordinates.empty() || !check_all_coordinates(route_parameters.coordinates))
+        {
+            json_result.values["status_message"] = "Invalid coordinates";
+            return Status::Error;
+        }
+
+        if (max_locations_isochrone > 0 &&
+            (static_cast<int>(route_parameters.coordinates.size()) > max_locations_isochrone))
+        {
+            json_result.values["status_message"] =
+                "Number of entries " + std::to_string(route_parameters.coordinates.size()) +
+                " is higher than current maximum (" + std::to_string(max_locations_isochrone) + ")";
+            return Status::Error;
+        }
+
+        if (route_parameters.isochrone_times.empty())
+        {
+            json_result.values["status_message"] = "No isochrone times given";
+            return Status::Error;
+        }
+
+        // Each time is a separate threshold of the sweep, and longer times widen the sweep, so both are capped
+        if (max_isochrone_times > 0 &&
+            (static_cast<int>(route_parameters.isochrone_times.size()) > max_isochrone_times))
+        {
+            json_result.values["status_message"] =
+                "Number of isochrone times " + std::to_string(route_parameters.isochrone_times.size()) +
+                " is higher than current maximum (" + std::to_string(max_isochrone_times) + ")";
+            return Status::Error;
+        }
+        if (max_isochrone_time > 0 &&
+            *std::max_element(route_parameters.isochrone_times.begin(), route_parameters.isochrone_times.end()) > max_isochrone_time)
+        {
+            json_result.values["status_message"] =
+                "Isochrone time is higher than current maximum (" + std::to_string(max_isochrone_time) + " seconds)";
+            return Status::Error;
+        }
+
+        // All locations are snapped and swept on the same package set, even if packages are updated meanwhile
+        const Nuti::Routing::RoutingGraph::Snapshot snapshot(*routing_graph);
+
+        // Engine work counters, reported with debug=true and added to the totals of the stats service
+        Nuti::Routing::RoutingStats query_stats;
+        std::unique_ptr<Nuti::Routing::RoutingStatsCollector> stats_collector;
+        if (route_parameters.debug || Nuti::Routing::RoutingStats::isTotalsEnabled())
+        {
+            stats_collector = osrm::make_unique<Nuti::Routing::RoutingStatsCollector>(query_stats);
+        }
+
+        const std::size_t location_count = route_parameters.coordinates.size();
+        std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> nearest_nodes;
+        try
+        {
+            const Nuti::Routing::RoutingGraph::SnapOptions snap_options = NutiSnapOptions();
+            nearest_nodes = routing_graph->findNearestNodes(NutiSnapQueries(route_parameters), snap_options);
+        }
+        catch (const std::exception& ex)
+        {
+            json_result.values["status_message"] = std::string("Isochrone failed, exception: ") + ex.what();
+            return Status::Error;
+        }
+        for (const auto i : osrm::irange<std::size_t>(0u, location_count))
+        {
+            if (nearest_nodes[i].empty())
+            {
+                json_result.values["status_message"] =
+                    std::string("Could not find a matching segment for coordinate ") + std::to_string(i);
+                return Status::NoSegment;
+            }
+        }
+
+        // One sweep per location, locations are distributed over the TBB worker pool
+        std::vector<std::vector<Nuti::Routing::ReachabilityFinder::Isochrone>> isochrones(location_count);
+        std::vector<std::string> errors(location_count);
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, location_count, 1),
+                          [&](const tbb::blocked_range<std::size_t> &range)
+                          {
+                              const Nuti::Routing::RoutingGraph::Snapshot worker_snapshot(snapshot, *routing_graph);
+                              const Nuti::Routing::RoutingStatsCollector worker_stats_collector(stats_collector.get());
+                              for (std::size_t i = range.begin(); i != range.end(); ++i)
+                              {
+                                  try
+                                  {
+                                      isochrones[i] = reachability_finder->findIsochrones(nearest_nodes[i], route_parameters.isochrone_times);
+                                  }
+                                  catch (const std::exception& ex)
+                                  {
+                                      errors[i] = std::string("Isochrone failed, exception: ") + ex.what();
+                                  }
+                              }
+                          });
+
+        stats_collector.reset();
+        if (route_parameters.debug)
+        {
+            json_result.values["debug"] = NutiRoutingStatsToJSON(query_stats);
+        }
+
+        for (const std::string& error : errors)
+        {
+            if (!error.empty())
+            {
+                json_result.values["status_message"] = error;
+                return Status::Error;
+            }
+        }
+
+        // Polygons as [lat, lon] rings, one array of isochrones per location in the order of the requested times
+        osrm::json::Array json_locations;
+        for (const auto &location_isochrones : isochrones)
+        {
+            osrm::json::Array json_isochrones;
+            for (const Nuti::Routing::ReachabilityFinder::Isochrone& isochrone : location_isochrones)
+            {
+                osrm::json::Array json_polygon;
+                for (const Nuti::Routing::WGSPos& pos : isochrone.polygon)
+                {
+                    osrm::json::Array json_coord;
+                    json_coord.values.push_back(pos(0));
+                    json_coord.values.push_back(pos(1));
+                    json_polygon.values.push_back(json_coord);
+                }
+                osrm::json::Object json_isochrone;
+                json_isochrone.values["time"] = isochrone.time;
+                json_isochrone.values["polygon"] = json_polygon;
+                json_isochrones.values.push_back(json_isochrone);
+            }
+            json_locations.values.push_back(json_isochrones);
+        }
+        json_result.values["isochrones"] = json_locations;
+        json_result.values["status_message"] = "Found isochrones";
+        return Status::Ok;
+    }
+};
+
+#endif // NUTI_ISOCHRONE_HPP
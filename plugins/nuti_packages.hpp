@@ -0,0 +1,99 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_PACKAGES_HPP
+#define NUTI_PACKAGES_HPP
+
+#include "plugin_base.hpp"
+#include "nuti_routing_graph.hpp"
+
+#include "../util/json_renderer.hpp"
+
+#include <osrm/json_container.hpp>
+
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+// Admin service listing the loaded .nutigraph packages. The 'reloadpackages' variant first applies the changes
+// of the base directory, so that packages can be added, replaced and removed without restarting the server.
+// As any client could trigger the directory rescan, 'reloadpackages' is only registered with --package-reload-service.
+// Package files are listed by their base name only, so that the server layout is not exposed to clients.
+class NutiPackagesPlugin final : public BasePlugin
+{
+  private:
+    std::string descriptor_string;
+    std::shared_ptr<NutiPackageDirectory> package_directory;
+    bool reload;
+
+  public:
+    explicit NutiPackagesPlugin(std::shared_ptr<NutiPackageDirectory> directory, bool reload)
+        : descriptor_string(reload ? "reloadpackages" : "packages"),
+          package_directory(std::move(directory)),
+          reload(reload)
+    {
+    }
+
+    virtual ~NutiPackagesPlugin() {}
+
+    const std::string GetDescriptor() const override final { return descriptor_string; }
+
+    Status HandleRequest(const RouteParameters &route_parameters,
+                      osrm::json::Object &json_result) override final
+    {
+        (void)route_parameters; // unused
+
+        if (reload)
+        {
+            json_result.values["changes"] = static_cast<double>(package_directory->Sync());
+        }
+
+        const auto &routing_graph = package_directory->GetRoutingGraph();
+        osrm::json::Array json_packages;
+        for (const auto &package_info : routing_graph->getPackageInfos())
+        {
+            osrm::json::Object json_package;
+            json_package.values["name"] = package_info.packageName;
+            json_package.values["file"] = boost::filesystem::path(package_info.fileName).filename().string();
+            json_package.values["id"] = static_cast<double>(package_info.packageId);
+            json_package.values["generation"] = static_cast<double>(package_info.generation);
+            osrm::json::Array json_bbox;
+            json_bbox.values.push_back(package_info.bbox.min(0));
+            json_bbox.values.push_back(package_info.bbox.min(1));
+            json_bbox.values.push_back(package_info.bbox.max(0));
+            json_bbox.values.push_back(package_info.bbox.max(1));
+            json_package.values["bbox"] = json_bbox;
+            json_packages.values.push_back(json_package);
+        }
+        json_result.values["packages"] = json_packages;
+        json_result.values["generation"] = static_cast<double>(routing_graph->getGeneration());
+        return Status::Ok;
+    }
+};
+
+#endif // NUTI_PACKAGES_HPP
@@ -0,0 +1,204 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_ROUTE_CACHE_HPP
+#define NUTI_ROUTE_CACHE_HPP
+
+#include <osrm/json_container.hpp>
+#include <osrm/route_parameters.hpp>
+
+#include <stdext/concurrent_cache.h>
+#include <stdext/memory_budget.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Estimate of the heap memory held by a JSON value tree, used to account cached results without rendering them
+struct NutiJSONSizeEstimator : mapbox::util::static_visitor<std::size_t>
+{
+    std::size_t operator()(const osrm::json::String &string) const { return string.value.capacity(); }
+
+    std::size_t operator()(const osrm::json::Number &) const { return 0; }
+
+    std::size_t operator()(const osrm::json::Object &object) const
+    {
+        // Each map entry is a separately allocated node with a next pointer and cached hash, plus a bucket pointer
+        std::size_t size = sizeof(osrm::json::Object) + object.values.bucket_count() * sizeof(void *);
+        for (const auto &value : object.values)
+        {
+            size += sizeof(std::pair<const std::string, osrm::json::Value>) + 2 * sizeof(void *);
+            size += value.first.capacity();
+            size += mapbox::util::apply_visitor(NutiJSONSizeEstimator(), value.second);
+        }
+        return size;
+    }
+
+    std::size_t operator()(const osrm::json::Array &array) const
+    {
+        std::size_t size = sizeof(osrm::json::Array) + array.values.capacity() * sizeof(osrm::json::Value);
+        for (const osrm::json::Value &value : array.values)
+        {
+            size += mapbox::util::apply_visitor(NutiJSONSizeEstimator(), value);
+        }
+        return size;
+    }
+
+    std::size_t operator()(const osrm::json::True &) const { return 0; }
+
+    std::size_t operator()(const osrm::json::False &) const { return 0; }
+
+    std::size_t operator()(const osrm::json::Null &) const { return 0; }
+};
+
+// Results of recent viaroute requests, keyed on the request coordinates quantised to a grid of about one meter and on
+// the request options affecting the result. Entries are bound to the package set generation they were computed on:
+// the cache is cleared once a newer generation is seen, and entries of older generations are never returned.
+// Results are shared between the cache and readers, and accounted by an estimate of their in-memory size against a
+// memory cap.
+class NutiRouteCache
+{
+  public:
+    static const int COORDINATE_QUANTUM = 10; // in fixed point units, 1e-5 degrees
+
+    explicit NutiRouteCache(std::size_t max_bytes)
+        : budget(std::make_shared<cache::memory_budget>(max_bytes)),
+          results(std::max(static_cast<std::size_t>(1), max_bytes / MIN_ENTRY_BYTES), budget, [](const Entry &entry) { return entry.bytes; }),
+          generation(0)
+    {
+    }
+
+    NutiRouteCache(const NutiRouteCache &) = delete;
+    NutiRouteCache &operator=(const NutiRouteCache &) = delete;
+
+    // Cache key of the request, for the package set generation used by the request
+    static std::string MakeKey(std::uint64_t generation, const RouteParameters &route_parameters)
+    {
+        std::string key;
+        AppendKey(key, generation);
+        AppendKey(key, route_parameters.zoom_level);
+        AppendKey(key, static_cast<char>((route_parameters.alternate_route ? 1 : 0) | (route_parameters.geometry ? 2 : 0) | (route_parameters.print_instructions ? 4 : 0)));
+        AppendKey(key, route_parameters.coordinates.size());
+        for (const FixedPointCoordinate &coordinate : route_parameters.coordinates)
+        {
+            AppendKey(key, Quantise(coordinate.lat));
+            AppendKey(key, Quantise(coordinate.lon));
+        }
+        AppendKey(key, route_parameters.bearings.size());
+        for (const auto &bearing : route_parameters.bearings)
+        {
+            AppendKey(key, bearing.first);
+            AppendKey(key, bearing.second ? *bearing.second : -1);
+        }
+        AppendKey(key, route_parameters.hints.size());
+        for (const std::string &hint : route_parameters.hints)
+        {
+            AppendKey(key, hint.size());
+            key.append(hint);
+        }
+        return key;
+    }
+
+    bool Read(std::uint64_t request_generation, const std::string &key, osrm::json::Object &json_result)
+    {
+        SyncGeneration(request_generation);
+
+        Entry entry;
+        if (!results.read(key, entry))
+        {
+            return false;
+        }
+        // The caller owns json_result and amends it (status) before rendering, so the shared result is copied once here
+        json_result = *entry.result;
+        return true;
+    }
+
+    void Put(std::uint64_t request_generation, const std::string &key, const osrm::json::Object &json_result)
+    {
+        if (request_generation < generation.load())
+        {
+            return;
+        }
+
+        Entry entry;
+        entry.result = std::make_shared<const osrm::json::Object>(json_result);
+        entry.bytes = NutiJSONSizeEstimator()(*entry.result) + key.capacity() + sizeof(Entry);
+        if (entry.bytes > budget->max_bytes())
+        {
+            return;
+        }
+        results.put(key, entry);
+    }
+
+    cache::cache_stats GetStats() const { return results.stats(); }
+
+    std::size_t GetMaxBytes() const { return budget->max_bytes(); }
+
+  private:
+    enum { MIN_ENTRY_BYTES = 256 }; // bounds the entry count, the memory cap limits the cache in practice
+
+    struct Entry
+    {
+        std::shared_ptr<const osrm::json::Object> result;
+        std::size_t bytes = 0; // estimated in-memory size of the result, plus the key
+    };
+
+    static int Quantise(int value)
+    {
+        return (value >= 0 ? value + COORDINATE_QUANTUM / 2 : value - COORDINATE_QUANTUM / 2) / COORDINATE_QUANTUM;
+    }
+
+    template <typename T> static void AppendKey(std::string &key, const T &value)
+    {
+        key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // Drop the entries of older generations as soon as a request runs on a newer package set. Keys include the
+    // generation, so that entries inserted concurrently by requests on the old package set are never hit.
+    void SyncGeneration(std::uint64_t request_generation)
+    {
+        std::uint64_t cached_generation = generation.load();
+        while (request_generation > cached_generation)
+        {
+            if (generation.compare_exchange_weak(cached_generation, request_generation))
+            {
+                results.clear();
+                break;
+            }
+        }
+    }
+
+    std::shared_ptr<cache::memory_budget> budget;
+    cache::concurrent_cache<std::string, Entry> results;
+    std::atomic<std::uint64_t> generation;
+};
+
+#endif // NUTI_ROUTE_CACHE_HPP
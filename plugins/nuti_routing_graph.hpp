@@ -0,0 +1,284 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_ROUTING_GRAPH_HPP
+#define NUTI_ROUTING_GRAPH_HPP
+
+#include "../util/simple_logger.hpp"
+
+#include "../nutiteq/engine/Routing/RoutingGraph.h"
+
+#include <osrm/coordinate.hpp>
+#include <osrm/route_parameters.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <tbb/parallel_for.h>
+
+// Create routing graph shared by the .nutigraph plugins
+inline std::shared_ptr<Nuti::Routing::RoutingGraph> CreateNutiRoutingGraph()
+{
+    Nuti::Routing::RoutingGraph::Settings graph_settings;
+    graph_settings.nodeBlockCacheSize = 512 * 16;
+    graph_settings.geometryBlockCacheSize = 512 * 16;
+    graph_settings.nameBlockCacheSize = 64 * 64;
+    graph_settings.rtreeNodeBlockCacheSize = 64 * 64;
+    graph_settings.blockCacheMemoryBudget = std::size_t(1024) * 1024 * 1024;
+    graph_settings.useMemoryMapping = true;
+    graph_settings.memoryMappingAdvice = eiff::mapped_file::advice::random;
+    graph_settings.prefetchThreadCount = 2;
+    return std::make_shared<Nuti::Routing::RoutingGraph>(graph_settings);
+}
+
+// Snap queries for the request locations, with the bearing filters given by the request
+inline std::vector<Nuti::Routing::RoutingGraph::SnapQuery> NutiSnapQueries(const RouteParameters &route_parameters)
+{
+    std::vector<Nuti::Routing::RoutingGraph::SnapQuery> queries;
+    for (std::size_t i = 0; i < route_parameters.coordinates.size(); i++)
+    {
+        Nuti::Routing::WGSPos pos(route_parameters.coordinates[i].lat / COORDINATE_PRECISION, route_parameters.coordinates[i].lon / COORDINATE_PRECISION);
+        if (i < route_parameters.bearings.size())
+        {
+            const auto &bearing = route_parameters.bearings[i];
+            queries.emplace_back(pos, bearing.first, bearing.second ? *bearing.second : 10);
+        }
+        else
+        {
+            queries.emplace_back(pos);
+        }
+    }
+    return queries;
+}
+
+// Snap options running the batch on the TBB worker pool shared by the requests, instead of starting threads per request
+inline Nuti::Routing::RoutingGraph::SnapOptions NutiSnapOptions()
+{
+    Nuti::Routing::RoutingGraph::SnapOptions snap_options;
+    snap_options.executor = [](std::size_t task_count, const std::function<void(std::size_t)> &task)
+    {
+        tbb::parallel_for(static_cast<std::size_t>(0), task_count, [&task](std::size_t i) { task(i); });
+    };
+    return snap_options;
+}
+
+// Keeps the routing graph in sync with the .nutigraph files of the base directory: packages are imported, replaced
+// and unloaded as the files are added, modified and removed. Packages named 'parent-xxx' are skipped if the
+// 'parent' package is present. Running queries finish on the packages they started with.
+// Files should be replaced by renaming, as mapped files must not change while in use.
+class NutiPackageDirectory
+{
+  public:
+    explicit NutiPackageDirectory(std::shared_ptr<Nuti::Routing::RoutingGraph> graph,
+                                  boost::filesystem::path base_path,
+                                  int watch_interval)
+        : routing_graph(std::move(graph)), base_path(std::move(base_path))
+    {
+        Sync();
+        if (watch_interval > 0)
+        {
+            watch_thread = std::thread(&NutiPackageDirectory::Watch, this, std::chrono::seconds(watch_interval));
+        }
+    }
+
+    NutiPackageDirectory(const NutiPackageDirectory &) = delete;
+    NutiPackageDirectory &operator=(const NutiPackageDirectory &) = delete;
+
+    ~NutiPackageDirectory()
+    {
+        {
+            std::lock_guard<std::mutex> lock(watch_mutex);
+            watch_stop = true;
+        }
+        watch_condition.notify_all();
+        if (watch_thread.joinable())
+        {
+            watch_thread.join();
+        }
+    }
+
+    const std::shared_ptr<Nuti::Routing::RoutingGraph> &GetRoutingGraph() const { return routing_graph; }
+
+    // Rescan the base directory and apply the changes. Returns the number of imported and unloaded packages.
+    std::size_t Sync()
+    {
+        namespace fs = boost::filesystem;
+
+        std::lock_guard<std::mutex> lock(sync_mutex);
+
+        std::map<std::string, FileState> nutigraph_files;
+        try
+        {
+            fs::directory_iterator end_iter;
+            for (fs::directory_iterator dir_iter(base_path); dir_iter != end_iter; ++dir_iter)
+            {
+                std::string file_name = dir_iter->path().string();
+                if (fs::is_regular_file(dir_iter->status()) && file_name.size() > 10 && file_name.rfind(".nutigraph") == file_name.size() - 10)
+                {
+                    nutigraph_files[file_name.substr(0, file_name.size() - 10)] = FileState { fs::last_write_time(dir_iter->path()), fs::file_size(dir_iter->path()) };
+                }
+            }
+        }
+        catch (const std::exception &ex)
+        {
+            SimpleLogger().Write(logWARNING) << "Failed to scan " << base_path.string() << ": " << ex.what();
+            return 0;
+        }
+
+        std::map<std::string, FileState> wanted_files;
+        for (const auto &nutigraph_file : nutigraph_files)
+        {
+            std::string::size_type pos = nutigraph_file.first.find('-', nutigraph_file.first.find_last_of("/\\") + 1);
+            if (pos != std::string::npos)
+            {
+                std::string parent_nutigraph_file = nutigraph_file.first.substr(0, pos);
+                if (nutigraph_files.count(parent_nutigraph_file) > 0)
+                {
+                    if (skipped_files.insert(nutigraph_file.first).second)
+                    {
+                        SimpleLogger().Write(logINFO) << "Skipping " << (nutigraph_file.first + ".nutigraph") << " as " << (parent_nutigraph_file + ".nutigraph") << " exists";
+                    }
+                    continue;
+                }
+            }
+            skipped_files.erase(nutigraph_file.first);
+            wanted_files.insert(nutigraph_file);
+        }
+
+        std::size_t changes = 0;
+        for (auto it = loaded_files.begin(); it != loaded_files.end();)
+        {
+            if (wanted_files.count(it->first) == 0)
+            {
+                SimpleLogger().Write(logINFO) << "Unloading " << (it->first + ".nutigraph");
+                changes += UnloadFilePackages(it->first + ".nutigraph", 0);
+                it = loaded_files.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (const auto &wanted_file : wanted_files)
+        {
+            auto loaded_it = loaded_files.find(wanted_file.first);
+            if (loaded_it != loaded_files.end() && loaded_it->second == wanted_file.second)
+            {
+                continue;
+            }
+            auto failed_it = failed_files.find(wanted_file.first);
+            if (failed_it != failed_files.end() && failed_it->second == wanted_file.second)
+            {
+                continue;
+            }
+            const std::string file_name = wanted_file.first + ".nutigraph";
+            try
+            {
+                SimpleLogger().Write(logINFO) << (loaded_it != loaded_files.end() ? "Reloading " : "Loading ") << file_name;
+                routing_graph->import(file_name);
+                loaded_files[wanted_file.first] = wanted_file.second;
+                failed_files.erase(wanted_file.first);
+                changes++;
+
+                // A package with the same name was replaced by the import. If the package was renamed, unload the old one.
+                changes += UnloadFilePackages(file_name, routing_graph->getGeneration());
+            }
+            catch (const std::exception &ex)
+            {
+                SimpleLogger().Write(logWARNING) << "Failed to load " << file_name << ": " << ex.what();
+                failed_files[wanted_file.first] = wanted_file.second;
+            }
+        }
+        return changes;
+    }
+
+  private:
+    struct FileState
+    {
+        std::time_t modification_time;
+        std::uintmax_t size;
+
+        bool operator==(const FileState &other) const
+        {
+            return modification_time == other.modification_time && size == other.size;
+        }
+    };
+
+    // Unload the packages imported from the file, except the ones from the given generation
+    std::size_t UnloadFilePackages(const std::string &file_name, std::uint64_t keep_generation)
+    {
+        std::size_t count = 0;
+        for (const auto &package_info : routing_graph->getPackageInfos())
+        {
+            if (package_info.fileName == file_name && package_info.generation != keep_generation)
+            {
+                count += routing_graph->unload(package_info.packageName) ? 1 : 0;
+            }
+        }
+        return count;
+    }
+
+    void Watch(std::chrono::seconds watch_interval)
+    {
+        std::unique_lock<std::mutex> lock(watch_mutex);
+        while (!watch_condition.wait_for(lock, watch_interval, [this] { return watch_stop; }))
+        {
+            lock.unlock();
+            if (std::size_t changes = Sync())
+            {
+                SimpleLogger().Write(logINFO) << "Applied " << changes << " package changes, generation " << routing_graph->getGeneration();
+            }
+            lock.lock();
+        }
+    }
+
+    const std::shared_ptr<Nuti::Routing::RoutingGraph> routing_graph;
+    const boost::filesystem::path base_path;
+    std::mutex sync_mutex;
+    std::map<std::string, FileState> loaded_files; // base names of imported files
+    std::map<std::string, FileState> failed_files; // not retried until modified
+    std::set<std::string> skipped_files;
+    std::mutex watch_mutex;
+    std::condition_variable watch_condition;
+    bool watch_stop = false;
+    std::thread watch_thread;
+};
+
+#endif // NUTI_ROUTING_GRAPH_HPP
@@ -0,0 +1,214 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_SNAP_HINT_HPP
+#define NUTI_SNAP_HINT_HPP
+
+#include "../algorithms/coordinate_calculation.hpp"
+#include "../algorithms/object_encoder.hpp"
+
+#include "../nutiteq/engine/Routing/RoutingGraph.h"
+
+#include <osrm/coordinate.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Opaque per-location tokens for snap results. A client passes the token of a location back with hint=<token>, the
+// location is then not snapped again as long as the request coordinate stays close to the coordinate the token was
+// created for and the packages of the snapped nodes have not been reloaded or unloaded meanwhile.
+// Tokens are url-safe base64 of a header followed by one record per nearest node.
+struct NutiSnapHintHeader
+{
+    std::int32_t lat; // fixed point coordinate the location was snapped for
+    std::int32_t lon;
+    std::uint32_t node_count;
+    std::uint32_t checksum; // of the token with this field set to zero, rejects truncated and mistyped tokens
+};
+
+struct NutiSnapHintNode
+{
+    std::uint64_t node_id; // packed
+    std::uint64_t generation; // of the package of the node
+    std::int32_t lat; // fixed point snapped position
+    std::int32_t lon;
+    std::uint32_t segment_index;
+    float rel_pos;
+    float distance;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(NutiSnapHintHeader) == 16 && sizeof(NutiSnapHintNode) == 40, "snap hint records must not contain padding");
+
+static const unsigned NUTI_SNAP_HINT_MAX_NODES = 8;
+static const double NUTI_SNAP_HINT_MAX_DISTANCE = 5.0; // in meters, between the request coordinate and the hinted coordinate
+
+inline std::uint32_t NutiSnapHintChecksum(const std::vector<unsigned char> &data)
+{
+    std::uint32_t hash = 2166136261U; // FNV-1a
+    for (unsigned char c : data)
+    {
+        hash = (hash ^ c) * 16777619U;
+    }
+    return hash;
+}
+
+// Token for the snap result of a location, empty if the result can not be hinted
+inline std::string EncodeNutiSnapHint(const Nuti::Routing::RoutingGraph &graph,
+                                      const FixedPointCoordinate &coordinate,
+                                      const std::vector<Nuti::Routing::RoutingGraph::NearestNode> &nearest_nodes)
+{
+    if (nearest_nodes.empty() || nearest_nodes.size() > NUTI_SNAP_HINT_MAX_NODES)
+    {
+        return std::string();
+    }
+
+    std::vector<unsigned char> data(sizeof(NutiSnapHintHeader) + nearest_nodes.size() * sizeof(NutiSnapHintNode));
+    NutiSnapHintHeader header;
+    header.lat = coordinate.lat;
+    header.lon = coordinate.lon;
+    header.node_count = static_cast<std::uint32_t>(nearest_nodes.size());
+    header.checksum = 0;
+    std::memcpy(&data[0], &header, sizeof(header));
+    for (std::size_t i = 0; i < nearest_nodes.size(); i++)
+    {
+        const Nuti::Routing::RoutingGraph::NearestNode &nearest_node = nearest_nodes[i];
+        NutiSnapHintNode node;
+        node.node_id = nearest_node.nodeId.packedId();
+        node.generation = graph.getNodeGeneration(nearest_node.nodeId);
+        if (node.generation == 0)
+        {
+            return std::string();
+        }
+        node.lat = static_cast<std::int32_t>(std::round(nearest_node.nodePos(0) * COORDINATE_PRECISION));
+        node.lon = static_cast<std::int32_t>(std::round(nearest_node.nodePos(1) * COORDINATE_PRECISION));
+        node.segment_index = nearest_node.geometrySegmentIndex;
+        node.rel_pos = nearest_node.geometryRelPos;
+        node.distance = nearest_node.distance;
+        node.reserved = 0;
+        std::memcpy(&data[sizeof(header) + i * sizeof(node)], &node, sizeof(node));
+    }
+    header.checksum = NutiSnapHintChecksum(data);
+    std::memcpy(&data[0], &header, sizeof(header));
+
+    // Same alphabet and padding as ObjectEncoder, so that the tokens pass the hint= grammar
+    const std::size_t padded_size = (data.size() + 2) / 3 * 3;
+    const std::size_t encoded_size = (data.size() * 8 + 5) / 6;
+    data.resize(padded_size, 0);
+    const char *chars = reinterpret_cast<const char *>(&data[0]);
+    std::string encoded(ObjectEncoder::base64_t(chars), ObjectEncoder::base64_t(chars + padded_size));
+    encoded.resize(encoded_size);
+    std::replace(encoded.begin(), encoded.end(), '+', '-');
+    std::replace(encoded.begin(), encoded.end(), '/', '_');
+    return encoded;
+}
+
+// Snap result stored in the token, if the token is still valid for the request coordinate
+inline bool DecodeNutiSnapHint(const Nuti::Routing::RoutingGraph &graph,
+                               const std::string &hint,
+                               const FixedPointCoordinate &coordinate,
+                               std::vector<Nuti::Routing::RoutingGraph::NearestNode> &nearest_nodes)
+{
+    std::vector<unsigned char> data;
+    try
+    {
+        std::string encoded(hint);
+        std::replace(encoded.begin(), encoded.end(), '-', '+');
+        std::replace(encoded.begin(), encoded.end(), '_', '/');
+        std::copy(ObjectEncoder::binary_t(encoded.cbegin()), ObjectEncoder::binary_t(encoded.cend()), std::back_inserter(data));
+    }
+    catch (...)
+    {
+        return false;
+    }
+    if (data.size() < sizeof(NutiSnapHintHeader))
+    {
+        return false;
+    }
+
+    NutiSnapHintHeader header;
+    std::memcpy(&header, &data[0], sizeof(header));
+    if (header.node_count == 0 || header.node_count > NUTI_SNAP_HINT_MAX_NODES ||
+        data.size() != sizeof(header) + header.node_count * sizeof(NutiSnapHintNode) ||
+        hint.size() != (data.size() * 8 + 5) / 6)
+    {
+        return false;
+    }
+    const std::uint32_t checksum = header.checksum;
+    std::memset(&data[offsetof(NutiSnapHintHeader, checksum)], 0, sizeof(header.checksum));
+    if (NutiSnapHintChecksum(data) != checksum)
+    {
+        return false;
+    }
+
+    if (coordinate_calculation::haversine_distance(header.lat, header.lon, coordinate.lat, coordinate.lon) > NUTI_SNAP_HINT_MAX_DISTANCE)
+    {
+        return false;
+    }
+
+    std::vector<Nuti::Routing::RoutingGraph::NearestNode> hinted_nodes(header.node_count);
+    for (std::size_t i = 0; i < hinted_nodes.size(); i++)
+    {
+        NutiSnapHintNode node;
+        std::memcpy(&node, &data[sizeof(header) + i * sizeof(node)], sizeof(node));
+        const auto node_id = Nuti::Routing::RoutingGraph::NodeId::fromPackedId(node.node_id);
+        if (!node_id.valid() || node.generation == 0 || graph.getNodeGeneration(node_id) != node.generation ||
+            !(node.rel_pos >= 0.0f && node.rel_pos <= 1.0f))
+        {
+            return false;
+        }
+        try
+        {
+            // segment_index comes from the client. It is the index of the segment end vertex, so it must be in 1..size-1
+            const auto graph_node = graph.getNode(node_id);
+            if (node.segment_index == 0 || node.segment_index >= graph.getNodeGeometryView(*graph_node).size())
+            {
+                return false;
+            }
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+        hinted_nodes[i].nodePos = Nuti::Routing::WGSPos(node.lat / COORDINATE_PRECISION, node.lon / COORDINATE_PRECISION);
+        hinted_nodes[i].nodeId = node_id;
+        hinted_nodes[i].geometrySegmentIndex = node.segment_index;
+        hinted_nodes[i].geometryRelPos = node.rel_pos;
+        hinted_nodes[i].distance = node.distance;
+    }
+    nearest_nodes = std::move(hinted_nodes);
+    return true;
+}
+
+#endif // NUTI_SNAP_HINT_HPP
@@ -0,0 +1,141 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NUTI_STATS_HPP
+#define NUTI_STATS_HPP
+
+#include "plugin_base.hpp"
+
+#include "../util/json_renderer.hpp"
+
+#include "../nutiteq/engine/Routing/RoutingGraph.h"
+#include "../nutiteq/engine/Routing/RoutingStats.h"
+
+#include "nuti_route_cache.hpp"
+
+#include <osrm/json_container.hpp>
+
+#include <memory>
+#include <string>
+
+// Engine work counters as JSON, used for the debug output of the .nutigraph services and by the stats service
+inline osrm::json::Object NutiRoutingStatsToJSON(const Nuti::Routing::RoutingStats &stats)
+{
+    osrm::json::Object json_stats;
+    json_stats.values["routes"] = static_cast<double>(stats.routes);
+    json_stats.values["node_blocks_loaded"] = static_cast<double>(stats.nodeBlocksLoaded);
+    json_stats.values["geometry_blocks_loaded"] = static_cast<double>(stats.geometryBlocksLoaded);
+    json_stats.values["name_blocks_loaded"] = static_cast<double>(stats.nameBlocksLoaded);
+    json_stats.values["rtree_node_blocks_loaded"] = static_cast<double>(stats.rtreeNodeBlocksLoaded);
+    json_stats.values["bytes_read"] = static_cast<double>(stats.bytesRead);
+    json_stats.values["decode_time"] = stats.decodeMicroseconds / 1000.0; // ms
+    json_stats.values["heap_pushes"] = static_cast<double>(stats.heapPushes);
+    json_stats.values["heap_pops"] = static_cast<double>(stats.heapPops);
+    json_stats.values["nodes_settled"] = static_cast<double>(stats.nodesSettled);
+    json_stats.values["nodes_stalled"] = static_cast<double>(stats.nodesStalled);
+    json_stats.values["shortcuts_unpacked"] = static_cast<double>(stats.shortcutsUnpacked);
+    json_stats.values["snap_candidates"] = static_cast<double>(stats.snapCandidates);
+    return json_stats;
+}
+
+inline osrm::json::Object NutiCacheStatsToJSON(const cache::cache_stats &stats)
+{
+    osrm::json::Object json_stats;
+    json_stats.values["hits"] = static_cast<double>(stats.hits);
+    json_stats.values["misses"] = static_cast<double>(stats.misses);
+    json_stats.values["insertions"] = static_cast<double>(stats.insertions);
+    json_stats.values["evictions"] = static_cast<double>(stats.evictions);
+    json_stats.values["entries"] = static_cast<double>(stats.entries);
+    json_stats.values["bytes"] = static_cast<double>(stats.bytes);
+    return json_stats;
+}
+
+// Admin service reporting the process-wide engine counters (when enabled with --stats), block cache and prefetcher
+// statistics of the routing graph, and the counters of the viaroute result cache. All counters are cumulative since
+// the server start.
+class NutiStatsPlugin final : public BasePlugin
+{
+  private:
+    std::string descriptor_string;
+    std::shared_ptr<Nuti::Routing::RoutingGraph> routing_graph;
+    std::shared_ptr<NutiRouteCache> route_cache;
+
+  public:
+    explicit NutiStatsPlugin(std::shared_ptr<Nuti::Routing::RoutingGraph> graph, std::shared_ptr<NutiRouteCache> cache)
+        : descriptor_string("stats"), routing_graph(std::move(graph)), route_cache(std::move(cache))
+    {
+    }
+
+    virtual ~NutiStatsPlugin() {}
+
+    const std::string GetDescriptor() const override final { return descriptor_string; }
+
+    Status HandleRequest(const RouteParameters &route_parameters,
+                      osrm::json::Object &json_result) override final
+    {
+        (void)route_parameters; // unused
+
+        if (Nuti::Routing::RoutingStats::isTotalsEnabled())
+        {
+            json_result.values["enabled"] = osrm::json::True();
+            json_result.values["totals"] = NutiRoutingStatsToJSON(Nuti::Routing::RoutingStats::getTotals());
+        }
+        else
+        {
+            json_result.values["enabled"] = osrm::json::False();
+        }
+
+        const Nuti::Routing::RoutingGraph::CacheStats cache_stats = routing_graph->getCacheStats();
+        osrm::json::Object json_caches;
+        json_caches.values["node_blocks"] = NutiCacheStatsToJSON(cache_stats.nodeBlocks);
+        json_caches.values["geometry_blocks"] = NutiCacheStatsToJSON(cache_stats.geometryBlocks);
+        json_caches.values["name_blocks"] = NutiCacheStatsToJSON(cache_stats.nameBlocks);
+        json_caches.values["rtree_node_blocks"] = NutiCacheStatsToJSON(cache_stats.rtreeNodeBlocks);
+        if (route_cache)
+        {
+            osrm::json::Object json_route_results = NutiCacheStatsToJSON(route_cache->GetStats());
+            json_route_results.values["max_bytes"] = static_cast<double>(route_cache->GetMaxBytes());
+            json_caches.values["route_results"] = json_route_results;
+        }
+        json_caches.values["memory_budget"] = static_cast<double>(cache_stats.memoryBudget);
+        json_caches.values["memory_used"] = static_cast<double>(cache_stats.memoryUsed);
+        json_caches.values["blocks_read"] = static_cast<double>(cache_stats.blocksRead);
+        json_caches.values["bytes_read"] = static_cast<double>(cache_stats.bytesRead);
+        json_result.values["caches"] = json_caches;
+
+        const Nuti::Routing::RoutingGraph::PrefetchStats prefetch_stats = routing_graph->getPrefetchStats();
+        osrm::json::Object json_prefetch;
+        json_prefetch.values["requests"] = static_cast<double>(prefetch_stats.requests);
+        json_prefetch.values["loads"] = static_cast<double>(prefetch_stats.loads);
+        json_prefetch.values["hits"] = static_cast<double>(prefetch_stats.hits);
+        json_prefetch.values["dropped"] = static_cast<double>(prefetch_stats.dropped);
+        json_result.values["prefetch"] = json_prefetch;
+        return Status::Ok;
+    }
+};
+
+#endif // NUTI_STATS_HPP
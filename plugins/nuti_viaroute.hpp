@@ -46,18 +46,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../nutiteq/engine/Routing/RoutingObjects.h"
 #include "../nutiteq/engine/Routing/RoutingGraph.h"
 #include "../nutiteq/engine/Routing/RouteFinder.h"
+#include "../nutiteq/engine/Routing/RoutingStats.h"
+
+#include "nuti_route_cache.hpp"
+#include "nuti_routing_graph.hpp"
+#include "nuti_snap_hint.hpp"
+#include "nuti_stats.hpp"
 
 #include <osrm/json_container.hpp>
 
+#include <cstdint>
 #include <cstdlib>
 
 #include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
-#include <set>
 
-#include <boost/filesystem.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 class NutiViaRoutePlugin final : public BasePlugin
 {
@@ -66,57 +73,23 @@ class NutiViaRoutePlugin final : public BasePlugin
     std::string descriptor_string;
     DouglasPeucker polyline_generalizer;
     std::shared_ptr<Nuti::Routing::RoutingGraph> routing_graph;
+    std::unique_ptr<Nuti::Routing::RouteFinder> route_finder;
+    std::shared_ptr<NutiRouteCache> route_cache;
     int max_locations_viaroute;
 
+    static constexpr unsigned int MAX_ALTERNATIVES = 1; // OSRM clients expect at most one alternative
+
   public:
-    explicit NutiViaRoutePlugin(const boost::filesystem::path& base_path, int max_locations_viaroute)
+    explicit NutiViaRoutePlugin(std::shared_ptr<Nuti::Routing::RoutingGraph> graph,
+                                std::shared_ptr<NutiRouteCache> cache,
+                                int max_locations_viaroute)
         : descriptor_string("viaroute"),
+          routing_graph(std::move(graph)),
+          route_cache(std::move(cache)),
           max_locations_viaroute(max_locations_viaroute)
     {
-        namespace fs = boost::filesystem;
-
-        Nuti::Routing::RoutingGraph::Settings graph_settings;
-        graph_settings.nodeBlockCacheSize = 512 * 16;
-        graph_settings.geometryBlockCacheSize = 512 * 16;
-        graph_settings.nameBlockCacheSize = 64 * 64;
-        graph_settings.globalNodeBlockCacheSize = 64 * 64;
-        graph_settings.rtreeNodeBlockCacheSize = 64 * 64;
-        routing_graph = std::make_shared<Nuti::Routing::RoutingGraph>(graph_settings);
-
-        fs::directory_iterator end_iter;
-        std::set<std::string> nutigraph_files;
-        for (fs::directory_iterator dir_iter(base_path); dir_iter != end_iter; ++dir_iter)
-        {
-            std::string file_name = dir_iter->path().string();
-            if (fs::is_regular_file(dir_iter->status()) && file_name.rfind(".nutigraph") == file_name.size() - 10)
-            {
-                nutigraph_files.insert(file_name.substr(0, file_name.size() - 10));
-            }
-        }
-        
-        for (const std::string& nutigraph_file : nutigraph_files)
-        {
-            std::string::size_type pos = nutigraph_file.find('-');
-            if (pos != std::string::npos)
-            {
-                std::string parent_nutigraph_file = nutigraph_file.substr(0, pos);
-                if (nutigraph_files.count(parent_nutigraph_file) > 0)
-                {
-                    SimpleLogger().Write(logINFO) << "Skipping " << (nutigraph_file + ".nutigraph") << " as " << (parent_nutigraph_file + ".nutigraph") << " exists";
-                    continue;
-                }
-            }
-            try
-            {
-                SimpleLogger().Write(logINFO) << "Loading " << (nutigraph_file + ".nutigraph");
-                routing_graph->import(nutigraph_file + ".nutigraph");
-            }
-            catch (const std::exception& ex)
-            {
-                SimpleLogger().Write(logWARNING) << "Failed to load " << (nutigraph_file + ".nutigraph") << ": " << ex.what();
-            }
-        }
-        
+        route_finder = osrm::make_unique<Nuti::Routing::RouteFinder>(routing_graph);
+
         descriptor_table.emplace("json", 0);
     }
 
@@ -126,6 +99,32 @@ class NutiViaRoutePlugin final : public BasePlugin
 
     Status HandleRequest(const RouteParameters &route_parameters,
                       osrm::json::Object &json_result) override final
+    {
+        // Debug output reports the work of the query itself, so it always bypasses the result cache
+        if (!route_cache || route_parameters.debug)
+        {
+            return HandleRouteRequest(route_parameters, json_result);
+        }
+
+        // The route is computed on the pinned package set, so the result is cached for the generation it was found on
+        const Nuti::Routing::RoutingGraph::Snapshot snapshot(*routing_graph);
+        const std::uint64_t generation = routing_graph->getGeneration();
+        const std::string cache_key = NutiRouteCache::MakeKey(generation, route_parameters);
+        if (route_cache->Read(generation, cache_key, json_result))
+        {
+            return Status::Ok;
+        }
+        const Status status = HandleRouteRequest(route_parameters, json_result);
+        if (status == Status::Ok)
+        {
+            route_cache->Put(generation, cache_key, json_result);
+        }
+        return status;
+    }
+
+  private:
+    Status HandleRouteRequest(const RouteParameters &route_parameters,
+                              osrm::json::Object &json_result)
     {
         if (max_locations_viaroute > 0 &&
             (static_cast<int>(route_parameters.coordinates.size()) > max_locations_viaroute))
@@ -142,108 +141,195 @@ class NutiViaRoutePlugin final : public BasePlugin
             return Status::Error;
         }
 
-        std::vector<Nuti::Routing::RoutingResult> results;
-        for (std::size_t i = 1; i < route_parameters.coordinates.size(); i++)
+        // All locations are snapped and routed on the same package set, even if packages are updated meanwhile
+        const Nuti::Routing::RoutingGraph::Snapshot snapshot(*routing_graph);
+
+        // Engine work counters, reported with debug=true and added to the totals of the stats service
+        Nuti::Routing::RoutingStats query_stats;
+        std::unique_ptr<Nuti::Routing::RoutingStatsCollector> stats_collector;
+        if (route_parameters.debug || Nuti::Routing::RoutingStats::isTotalsEnabled())
+        {
+            stats_collector = osrm::make_unique<Nuti::Routing::RoutingStatsCollector>(query_stats);
+        }
+
+        // Locations with a valid hint from an earlier response reuse its snap result. The other locations are snapped
+        // once, the result is shared by both legs touching the location. Nearby locations share the traversal and are
+        // distributed between threads
+        const std::size_t location_count = route_parameters.coordinates.size();
+        std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> nearest_nodes(location_count);
+        std::vector<bool> hinted(location_count, false);
+        try
         {
-            Nuti::Routing::WGSPos pos0(route_parameters.coordinates[0].lat / COORDINATE_PRECISION, route_parameters.coordinates[0].lon / COORDINATE_PRECISION);
-            Nuti::Routing::WGSPos pos1(route_parameters.coordinates[1].lat / COORDINATE_PRECISION, route_parameters.coordinates[1].lon / COORDINATE_PRECISION);
-            Nuti::Routing::RouteFinder finder(routing_graph);
-            Nuti::Routing::RoutingResult result;
-            try
+            std::vector<std::size_t> snap_indices;
+            for (const auto i : osrm::irange<std::size_t>(0u, location_count))
+            {
+                if (i < route_parameters.hints.size() && !route_parameters.hints[i].empty())
+                {
+                    hinted[i] = DecodeNutiSnapHint(*routing_graph, route_parameters.hints[i], route_parameters.coordinates[i], nearest_nodes[i]);
+                }
+                if (!hinted[i])
+                {
+                    snap_indices.push_back(i);
+                }
+            }
+
+            if (!snap_indices.empty())
             {
-                result = finder.find(Nuti::Routing::RoutingQuery(pos0, pos1));
+                const std::vector<Nuti::Routing::RoutingGraph::SnapQuery> location_queries = NutiSnapQueries(route_parameters);
+                std::vector<Nuti::Routing::RoutingGraph::SnapQuery> snap_queries;
+                for (const std::size_t i : snap_indices)
+                {
+                    snap_queries.push_back(location_queries[i]);
+                }
+                const Nuti::Routing::RoutingGraph::SnapOptions snap_options = NutiSnapOptions();
+                std::vector<std::vector<Nuti::Routing::RoutingGraph::NearestNode>> snapped_nodes = routing_graph->findNearestNodes(snap_queries, snap_options);
+                for (const auto j : osrm::irange<std::size_t>(0u, snap_indices.size()))
+                {
+                    nearest_nodes[snap_indices[j]] = std::move(snapped_nodes[j]);
+                }
             }
-            catch (const std::exception& ex)
+        }
+        catch (const std::exception& ex)
+        {
+            json_result.values["status_message"] = std::string("Routing failed, exception: ") + ex.what();
+            return Status::Error;
+        }
+        // Without geometry and instructions only the route totals are needed, these are calculated without decoding
+        // names and intermediate geometries
+        const bool summary_only = !route_parameters.geometry && !route_parameters.print_instructions;
+
+        // Alternatives are only searched for routes without via locations, as in OSRM
+        const bool alternatives = route_parameters.alternate_route && location_count == 2 && !summary_only;
+
+        // Route legs concurrently on the TBB worker pool. RouteFinder keeps its search workspace per thread
+        std::vector<Nuti::Routing::RoutingResult> results(summary_only ? 0 : location_count - 1);
+        std::vector<Nuti::Routing::RoutingSummary> summaries(summary_only ? location_count - 1 : 0);
+        std::vector<Nuti::Routing::RoutingResult> alternative_results;
+        // Each leg task writes only its own error slot, errors are read after the join
+        std::vector<std::string> errors(location_count - 1);
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(1, location_count, 1),
+                          [&](const tbb::blocked_range<std::size_t> &range)
+                          {
+                              const Nuti::Routing::RoutingGraph::Snapshot worker_snapshot(snapshot, *routing_graph);
+                              const Nuti::Routing::RoutingStatsCollector worker_stats_collector(stats_collector.get());
+                              for (std::size_t i = range.begin(); i != range.end(); ++i)
+                              {
+                                  try
+                                  {
+                                      if (summary_only)
+                                      {
+                                          summaries[i - 1] = route_finder->findSummary(nearest_nodes[i - 1], nearest_nodes[i]);
+                                      }
+                                      else if (alternatives)
+                                      {
+                                          alternative_results = route_finder->findAlternatives(nearest_nodes[i - 1], nearest_nodes[i], MAX_ALTERNATIVES);
+                                          results[i - 1] = alternative_results.front();
+                                          alternative_results.erase(alternative_results.begin());
+                                      }
+                                      else
+                                      {
+                                          results[i - 1] = route_finder->find(nearest_nodes[i - 1], nearest_nodes[i]);
+                                      }
+                                  }
+                                  catch (const std::exception& ex)
+                                  {
+                                      errors[i - 1] = std::string("Routing failed, exception: ") + ex.what();
+                                  }
+                              }
+                          });
+
+        stats_collector.reset();
+        if (route_parameters.debug)
+        {
+            json_result.values["debug"] = NutiRoutingStatsToJSON(query_stats);
+        }
+
+        for (const std::string& error : errors)
+        {
+            if (!error.empty())
             {
-                json_result.values["status_message"] = std::string("Routing failed, exception: ") + ex.what();
+                json_result.values["status_message"] = error;
                 return Status::Error;
             }
+        }
+        for (const Nuti::Routing::RoutingResult& result : results)
+        {
             if (result.getStatus() == Nuti::Routing::RoutingResult::Status::FAILED)
             {
                 json_result.values["status_message"] = "Routing failed";
                 return Status::Error;
             }
-            results.push_back(std::move(result));
         }
 
-        std::vector<SegmentInformation> path_description;
-        osrm::json::Array json_route_instructions;
+        // Hints are returned also for the hinted locations, unchanged, so that a slowly moving client keeps the first snap
+        // result only while it stays near the location it was snapped for
+        osrm::json::Array json_hint_locations;
+        for (const auto i : osrm::irange<std::size_t>(0u, location_count))
+        {
+            json_hint_locations.values.push_back(hinted[i] ? route_parameters.hints[i] : EncodeNutiSnapHint(*routing_graph, route_parameters.coordinates[i], nearest_nodes[i]));
+        }
+        osrm::json::Object json_hint_data;
+        json_hint_data.values["checksum"] = static_cast<double>(routing_graph->getGeneration() & 0xffffffffU); // informational, hints carry their own package generations
+        json_hint_data.values["locations"] = json_hint_locations;
+        json_result.values["hint_data"] = json_hint_data;
 
-        for (size_t i = 0; i < results.size(); i++)
+        if (summary_only)
         {
-            const Nuti::Routing::RoutingResult& result = results[i];
-            if (result.getInstructions().empty())
+            double total_distance = 0;
+            double total_time = 0;
+            for (const Nuti::Routing::RoutingSummary& summary : summaries)
             {
-                continue;
+                if (summary.getStatus() == Nuti::Routing::RoutingSummary::Status::FAILED)
+                {
+                    json_result.values["status_message"] = "Routing failed";
+                    return Status::Error;
+                }
+                total_distance += summary.getTotalDistance();
+                total_time += summary.getTotalTime();
             }
 
-            std::size_t path_index = path_description.size();
-            for (const Nuti::Routing::WGSPos& pos : result.getGeometry())
+            osrm::json::Object json_route_summary;
+            json_route_summary.values["total_distance"] = total_distance;
+            json_route_summary.values["total_time"] = total_time;
+            json_result.values["route_summary"] = json_route_summary;
+            json_result.values["status_message"] = "Found route between points";
+            return Status::Ok;
+        }
+
+        osrm::json::Array json_route_instructions;
+        json_result.values["route_geometry"] = DescribeRoute(results, route_parameters, json_route_instructions);
+        json_result.values["status_message"] = "Found route between points";
+        json_result.values["route_instructions"] = json_route_instructions;
+
+        if (alternatives)
+        {
+            osrm::json::Array json_alternative_geometries;
+            osrm::json::Array json_alternative_instructions;
+            osrm::json::Array json_alternative_summaries;
+            for (const Nuti::Routing::RoutingResult& alternative_result : alternative_results)
             {
-                FixedPointCoordinate segment_pos(static_cast<int>(pos(0) * COORDINATE_PRECISION), static_cast<int>(pos(1) * COORDINATE_PRECISION));
-                SegmentInformation segment(segment_pos, 0, 0, 0, TurnInstruction::NoTurn, true, true, TRAVEL_MODE_INACCESSIBLE);
-                path_description.push_back(segment);
+                osrm::json::Array json_instructions;
+                json_alternative_geometries.values.push_back(DescribeRoute({ alternative_result }, route_parameters, json_instructions));
+                json_alternative_instructions.values.push_back(json_instructions);
+
+                osrm::json::Object json_summary;
+                json_summary.values["total_distance"] = alternative_result.getTotalDistance();
+                json_summary.values["total_time"] = alternative_result.getTotalTime();
+                json_alternative_summaries.values.push_back(json_summary);
             }
-            
-            for (std::size_t i = std::max(static_cast<std::size_t>(1), path_index); i < path_description.size(); i++)
+            if (alternative_results.empty())
             {
-                SegmentInformation& first = path_description[i - 1];
-                SegmentInformation& second = path_description[i];
-                const double post_turn_bearing = coordinate_calculation::bearing(first.location, second.location);
-                const double pre_turn_bearing = coordinate_calculation::bearing(second.location, first.location);
-                second.post_turn_bearing = static_cast<short>(post_turn_bearing * 10);
-                second.pre_turn_bearing = static_cast<short>(pre_turn_bearing * 10);
+                json_result.values["found_alternative"] = osrm::json::False();
             }
-
-            double distance = 0;
-            double time = 0;
-            for (const Nuti::Routing::RoutingInstruction& instr : result.getInstructions())
+            else
             {
-                distance += instr.getDistance();
-                time += instr.getTime();
-
-                Nuti::Routing::RoutingInstruction::Type type = instr.getType();
-                if (type == Nuti::Routing::RoutingInstruction::Type::NO_TURN || type == Nuti::Routing::RoutingInstruction::Type::STAY_ON_ROUNDABOUT)
-                {
-                    continue;
-                }
-                if (type == Nuti::Routing::RoutingInstruction::Type::REACHED_YOUR_DESTINATION && i + 1 < results.size())
-                {
-                    type = Nuti::Routing::RoutingInstruction::Type::REACH_VIA_LOCATION;
-                }
-
-                std::size_t point_index = path_index + instr.getGeometryIndex();
-
-                osrm::json::Array json_instruction_row;
-                json_instruction_row.values.push_back(std::to_string(static_cast<int>(type)));
-                json_instruction_row.values.push_back(instr.getAddress());
-                json_instruction_row.values.push_back(distance);
-                json_instruction_row.values.push_back(point_index);
-                json_instruction_row.values.push_back(time);
-                json_instruction_row.values.push_back(std::to_string(static_cast<unsigned>(distance)) + "m");
-
-                const double post_turn_bearing_value = (path_description[point_index].post_turn_bearing / 10.0);
-                json_instruction_row.values.push_back(bearing::get(post_turn_bearing_value));
-                json_instruction_row.values.push_back(post_turn_bearing_value);
-
-                const double pre_turn_bearing_value = (path_description[point_index].pre_turn_bearing / 10.0);
-                json_instruction_row.values.push_back(bearing::get(pre_turn_bearing_value));
-                json_instruction_row.values.push_back(pre_turn_bearing_value);
-
-                json_route_instructions.values.push_back(json_instruction_row);
-
-                distance = 0;
-                time = 0;
+                json_result.values["found_alternative"] = osrm::json::True();
+                json_result.values["alternative_geometries"] = json_alternative_geometries;
+                json_result.values["alternative_instructions"] = json_alternative_instructions;
+                json_result.values["alternative_summaries"] = json_alternative_summaries;
             }
         }
 
-        // Generalize poly line
-        polyline_generalizer.Run(path_description.begin(), path_description.end(), route_parameters.zoom_level);
-
-        json_result.values["route_geometry"] = PolylineFormatter().printEncodedString(path_description);
-        json_result.values["status_message"] = "Found route between points";
-        json_result.values["route_instructions"] = json_route_instructions;
-
 #if 0
 
         if (!check_all_coordinates(route_parameters.coordinates))
@@ -371,6 +457,87 @@ class NutiViaRoutePlugin final : public BasePlugin
 
 
     }
+
+    // Encoded geometry and OSRM instruction rows of consecutive route legs
+    osrm::json::String DescribeRoute(const std::vector<Nuti::Routing::RoutingResult> &results,
+                                     const RouteParameters &route_parameters,
+                                     osrm::json::Array &json_route_instructions)
+    {
+        std::vector<SegmentInformation> path_description;
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Nuti::Routing::RoutingResult& result = results[i];
+            if (result.getInstructions().empty())
+            {
+                continue;
+            }
+
+            std::size_t path_index = path_description.size();
+            for (const Nuti::Routing::WGSPos& pos : result.getGeometry())
+            {
+                FixedPointCoordinate segment_pos(static_cast<int>(pos(0) * COORDINATE_PRECISION), static_cast<int>(pos(1) * COORDINATE_PRECISION));
+                SegmentInformation segment(segment_pos, 0, 0, 0, TurnInstruction::NoTurn, true, true, TRAVEL_MODE_INACCESSIBLE);
+                path_description.push_back(segment);
+            }
+            
+            for (std::size_t i = std::max(static_cast<std::size_t>(1), path_index); i < path_description.size(); i++)
+            {
+                SegmentInformation& first = path_description[i - 1];
+                SegmentInformation& second = path_description[i];
+                const double post_turn_bearing = coordinate_calculation::bearing(first.location, second.location);
+                const double pre_turn_bearing = coordinate_calculation::bearing(second.location, first.location);
+                second.post_turn_bearing = static_cast<short>(post_turn_bearing * 10);
+                second.pre_turn_bearing = static_cast<short>(pre_turn_bearing * 10);
+            }
+
+            double distance = 0;
+            double time = 0;
+            for (const Nuti::Routing::RoutingInstruction& instr : result.getInstructions())
+            {
+                distance += instr.getDistance();
+                time += instr.getTime();
+
+                Nuti::Routing::RoutingInstruction::Type type = instr.getType();
+                if (type == Nuti::Routing::RoutingInstruction::Type::NO_TURN || type == Nuti::Routing::RoutingInstruction::Type::STAY_ON_ROUNDABOUT)
+                {
+                    continue;
+                }
+                if (type == Nuti::Routing::RoutingInstruction::Type::REACHED_YOUR_DESTINATION && i + 1 < results.size())
+                {
+                    type = Nuti::Routing::RoutingInstruction::Type::REACH_VIA_LOCATION;
+                }
+
+                std::size_t point_index = path_index + instr.getGeometryIndex();
+
+                osrm::json::Array json_instruction_row;
+                json_instruction_row.values.push_back(std::to_string(static_cast<int>(type)));
+                json_instruction_row.values.push_back(instr.getAddress());
+                json_instruction_row.values.push_back(distance);
+                json_instruction_row.values.push_back(point_index);
+                json_instruction_row.values.push_back(time);
+                json_instruction_row.values.push_back(std::to_string(static_cast<unsigned>(distance)) + "m");
+
+                const double post_turn_bearing_value = (path_description[point_index].post_turn_bearing / 10.0);
+                json_instruction_row.values.push_back(bearing::get(post_turn_bearing_value));
+                json_instruction_row.values.push_back(post_turn_bearing_value);
+
+                const double pre_turn_bearing_value = (path_description[point_index].pre_turn_bearing / 10.0);
+                json_instruction_row.values.push_back(bearing::get(pre_turn_bearing_value));
+                json_instruction_row.values.push_back(pre_turn_bearing_value);
+
+                json_route_instructions.values.push_back(json_instruction_row);
+
+                distance = 0;
+                time = 0;
+            }
+        }
+
+        // Generalize poly line
+        polyline_generalizer.Run(path_description.begin(), path_description.end(), route_parameters.zoom_level);
+
+        return PolylineFormatter().printEncodedString(path_description);
+    }
 };
 
 #endif // VIA_ROUTE_HPP
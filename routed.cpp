@@ -79,7 +79,9 @@ int main(int argc, const char *argv[]) try
         argc, argv, lib_config.server_paths, ip_address, ip_port, requested_thread_num,
         lib_config.use_shared_memory, trial_run, lib_config.max_locations_trip, lib_config.max_locations_viaroute,
         lib_config.max_locations_distance_table,
-        lib_config.max_locations_map_matching);
+        lib_config.max_locations_map_matching, lib_config.package_watch_interval,
+        lib_config.package_reload_service, lib_config.collect_stats, lib_config.route_cache_size,
+        lib_config.max_isochrone_times, lib_config.max_isochrone_time);
     if (init_result == INIT_OK_DO_NOT_START_ENGINE)
     {
         return EXIT_SUCCESS;
@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdext/bitstream.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(bitstream)
+
+BOOST_AUTO_TEST_CASE(read_bits_roundtrip_test)
+{
+    std::mt19937 mt_rand(13);
+    std::vector<std::pair<unsigned, int>> values;
+    bitstreams::output_bitstream output;
+    for (int i = 0; i < 10000; i++)
+    {
+        int bits = std::uniform_int_distribution<int>(0, 32)(mt_rand);
+        unsigned value = static_cast<unsigned>(mt_rand()) & (bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1);
+        output.write_bits(value, bits);
+        values.emplace_back(value, bits);
+    }
+
+    bitstreams::input_bitstream input(output.data());
+    for (const auto &value : values)
+    {
+        BOOST_CHECK_EQUAL(input.read_bits<unsigned>(value.second), value.first);
+    }
+    BOOST_CHECK_THROW(input.read_bits<unsigned>(16), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(fixed_width_and_zigzag_test)
+{
+    bitstreams::output_bitstream output;
+    output.write_bit(true);
+    output.write_bits(45, 6);
+    output.write_bits(0xDEADBEEFu, 32);
+    for (int delta = -100; delta <= 100; delta++)
+    {
+        output.write_bits(static_cast<unsigned>(delta < 0 ? -delta * 2 - 1 : delta * 2), 9);
+    }
+
+    bitstreams::input_bitstream input(output.data().data(), output.data().size());
+    BOOST_CHECK(input.read_bit());
+    BOOST_CHECK_EQUAL((input.read_bits<int, 6>()), 45);
+    BOOST_CHECK_EQUAL((input.read_bits<unsigned, 32>()), 0xDEADBEEFu);
+    for (int delta = -100; delta <= 100; delta++)
+    {
+        BOOST_CHECK_EQUAL(input.read_zigzag(9), delta);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(write_zigzag_test)
+{
+    // Same bits as the reference encoding, including the extremes of the field width
+    for (int bits : { 2, 9, 32 })
+    {
+        const int max_value = static_cast<int>((bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1) >> 1);
+        std::vector<int> values { 0, 1, -1, max_value, -max_value - 1 };
+        bitstreams::output_bitstream output;
+        bitstreams::output_bitstream reference;
+        for (int value : values)
+        {
+            output.write_zigzag(value, bits);
+            reference.write_bits(static_cast<unsigned>(value < 0 ? -(value + 1) * 2u + 1 : value * 2u), bits);
+        }
+        BOOST_CHECK(output.data() == reference.data());
+
+        bitstreams::input_bitstream input(output.data().data(), output.data().size());
+        for (int value : values)
+        {
+            BOOST_CHECK_EQUAL(input.read_zigzag(bits), value);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(read_bytes_test)
+{
+    const std::string text = "Liivalaia 33, Tallinn";
+    for (int prefix_bits = 0; prefix_bits < 16; prefix_bits++)
+    {
+        bitstreams::output_bitstream output;
+        output.write_bits(0, prefix_bits);
+        for (char c : text)
+        {
+            output.write_bits(static_cast<unsigned char>(c), 8);
+        }
+        output.write_bits(5, 3);
+
+        bitstreams::input_bitstream input(output.data());
+        input.read_bits<int>(prefix_bits);
+        std::string result;
+        input.read_bytes(std::back_inserter(result), text.size());
+        BOOST_CHECK_EQUAL(result, text);
+        BOOST_CHECK_EQUAL(input.read_bits<int>(3), 5);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
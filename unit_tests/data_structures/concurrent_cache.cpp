@@ -0,0 +1,202 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdext/concurrent_cache.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(concurrent_cache)
+
+BOOST_AUTO_TEST_CASE(put_read_test)
+{
+    cache::concurrent_cache<int, int> test_cache(64);
+    for (int i = 0; i < 32; i++)
+    {
+        test_cache.put(i, i * 10);
+    }
+
+    int value = 0;
+    BOOST_CHECK(test_cache.read(7, value));
+    BOOST_CHECK_EQUAL(value, 70);
+    BOOST_CHECK(!test_cache.read(100, value));
+
+    test_cache.put(7, 77);
+    BOOST_CHECK(test_cache.read(7, value));
+    BOOST_CHECK_EQUAL(value, 77);
+
+    test_cache.clear();
+    BOOST_CHECK_EQUAL(test_cache.size(), 0);
+    BOOST_CHECK(!test_cache.exists(7));
+}
+
+BOOST_AUTO_TEST_CASE(eviction_test)
+{
+    cache::concurrent_cache<int, int> test_cache(64);
+    for (int i = 0; i < 1000; i++)
+    {
+        test_cache.put(i, i);
+        BOOST_CHECK_LE(test_cache.size(), 64);
+    }
+
+    test_cache.resize(16);
+    BOOST_CHECK_LE(test_cache.size(), 16);
+}
+
+BOOST_AUTO_TEST_CASE(second_chance_test)
+{
+    // Single shard, so that eviction order is deterministic
+    cache::concurrent_cache<int, int> test_cache(4, 1);
+    for (int i = 0; i < 4; i++)
+    {
+        test_cache.put(i, i);
+    }
+
+    int value = 0;
+    BOOST_CHECK(test_cache.read(0, value));
+    test_cache.put(4, 4);
+
+    BOOST_CHECK(test_cache.exists(0));
+    BOOST_CHECK(!test_cache.exists(1));
+    BOOST_CHECK(test_cache.exists(4));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_access_test)
+{
+    cache::concurrent_cache<int, int> test_cache(256);
+    std::atomic<int> mismatches(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&test_cache, &mismatches, t]()
+                             {
+                                 for (int i = 0; i < 10000; i++)
+                                 {
+                                     int key = (i * 7 + t) % 1024;
+                                     int value = 0;
+                                     if (test_cache.read(key, value))
+                                     {
+                                         if (value != key * 3)
+                                         {
+                                             mismatches++;
+                                         }
+                                     }
+                                     else
+                                     {
+                                         test_cache.put(key, key * 3);
+                                     }
+                                 }
+                             });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(mismatches.load(), 0);
+    BOOST_CHECK_LE(test_cache.size(), 256);
+}
+
+BOOST_AUTO_TEST_CASE(scan_resistance_test)
+{
+    cache::concurrent_cache<int, int> test_cache(8, 1);
+    int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        test_cache.put(i, i);
+        BOOST_CHECK(test_cache.read(i, value));
+    }
+
+    // A long one-off scan must not flush the frequently used entries
+    for (int i = 100; i < 1000; i++)
+    {
+        test_cache.put(i, i);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        BOOST_CHECK(test_cache.exists(i));
+    }
+    BOOST_CHECK_LE(test_cache.size(), 8);
+}
+
+BOOST_AUTO_TEST_CASE(stats_test)
+{
+    cache::concurrent_cache<int, int> test_cache(4, 1);
+    int value = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        test_cache.put(i, i);
+    }
+    test_cache.read(5, value);
+    test_cache.read(0, value);
+
+    cache::cache_stats stats = test_cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK_EQUAL(stats.misses, 1);
+    BOOST_CHECK_EQUAL(stats.insertions, 6);
+    BOOST_CHECK_EQUAL(stats.evictions, 2);
+    BOOST_CHECK_EQUAL(stats.entries, 4);
+}
+
+BOOST_AUTO_TEST_CASE(memory_budget_test)
+{
+    auto budget = std::make_shared<cache::memory_budget>(1000);
+    auto size_func = [](const int &value)
+    {
+        return static_cast<std::size_t>(value);
+    };
+    cache::concurrent_cache<int, int> cache1(1000, budget, size_func);
+    cache::concurrent_cache<int, int> cache2(1000, budget, size_func);
+
+    for (int i = 0; i < 10; i++)
+    {
+        cache1.put(i, 100);
+    }
+    BOOST_CHECK_EQUAL(budget->used_bytes(), 1000);
+    BOOST_CHECK_EQUAL(cache1.stats().bytes, 1000);
+
+    // Entries of the other cache are evicted to make room
+    cache2.put(0, 300);
+    BOOST_CHECK_LE(budget->used_bytes(), 1000);
+    BOOST_CHECK(cache2.exists(0));
+    BOOST_CHECK_LE(cache1.size(), 7);
+    BOOST_CHECK_EQUAL(cache1.stats().bytes + cache2.stats().bytes, budget->used_bytes());
+
+    budget->resize(300);
+    BOOST_CHECK_LE(budget->used_bytes(), 300);
+
+    cache2.clear();
+    cache1.clear();
+    BOOST_CHECK_EQUAL(budget->used_bytes(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
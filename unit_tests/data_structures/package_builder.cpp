@@ -0,0 +1,749 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+#include "Routing/PackageBuilder.h"
+#include "Routing/RoutingGraph.h"
+#include "Routing/RouteFinder.h"
+#include "Routing/RoutingStats.h"
+#include "Routing/DistanceTableFinder.h"
+#include "Routing/ReachabilityFinder.h"
+#include "../../plugins/nuti_snap_hint.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(package_builder)
+
+using Nuti::Routing::PackageBuilder;
+using Nuti::Routing::RoutingGraph;
+
+namespace
+{
+constexpr int SEGMENT_COUNT = 600;
+constexpr int SEGMENT_LENGTH = 1000; // in 1e-6 degrees
+constexpr unsigned int SEGMENT_WEIGHT = 10;
+
+// Writes the package to a new temporary file, returns the file name
+std::string writePackage(PackageBuilder& builder)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.nutigraph");
+    std::ofstream os(path.string(), std::ios::binary);
+    builder.write(os);
+    os.close();
+    return path.string();
+}
+
+PackageBuilder::Settings roadSettings(PackageBuilder::NodeOrder nodeOrder, bool incomingEdges = true)
+{
+    PackageBuilder::Settings settings;
+    settings.nodeBlockSize = 16;
+    settings.geometryBlockSize = 32;
+    settings.nameBlockSize = 8;
+    settings.rtreeNodeBlockSize = 4;
+    settings.rtreeFanout = 4;
+    settings.nodeOrder = nodeOrder;
+    settings.incomingEdges = incomingEdges;
+    return settings;
+}
+
+// Two-way road along a parallel, segments first..last-1 of equal length. Each edge is stored at both end points,
+// so the routing searches are plain bidirectional Dijkstra searches. Segment i is node i - first.
+void addRoadSegments(PackageBuilder& builder, int first, int last, unsigned int segmentWeight)
+{
+    for (int i = first; i < last; i++)
+    {
+        PackageBuilder::Node node;
+        node.geometry.emplace_back(45000000, 25000000 + i * SEGMENT_LENGTH);
+        node.geometry.emplace_back(45000000 + (i % 2) * 100, 25000000 + i * SEGMENT_LENGTH + SEGMENT_LENGTH / 2);
+        node.geometry.emplace_back(45000000, 25000000 + (i + 1) * SEGMENT_LENGTH);
+        node.name = "Street " + std::to_string(i / 10);
+        node.weight = segmentWeight;
+        node.travelMode = 0;
+        BOOST_CHECK_EQUAL(builder.addNode(std::move(node)), static_cast<std::uint32_t>(i - first));
+    }
+    for (int i = 0; i + 1 < last - first; i++)
+    {
+        PackageBuilder::Edge edge;
+        edge.weight = segmentWeight;
+        edge.forward = edge.backward = true;
+        edge.turnInstruction = 1;
+        edge.sourceNode = i;
+        edge.targetNode = i + 1;
+        builder.addEdge(edge);
+        edge.sourceNode = i + 1;
+        edge.targetNode = i;
+        builder.addEdge(edge);
+    }
+}
+
+std::string buildRoadPackage(PackageBuilder::NodeOrder nodeOrder, unsigned int segmentWeight = SEGMENT_WEIGHT, bool incomingEdges = true)
+{
+    PackageBuilder builder("road", roadSettings(nodeOrder, incomingEdges));
+    addRoadSegments(builder, 0, SEGMENT_COUNT, segmentWeight);
+    std::string fileName = writePackage(builder);
+
+    const PackageBuilder::Stats& stats = builder.getStats();
+    BOOST_CHECK_EQUAL(stats.nodeCount, static_cast<std::size_t>(SEGMENT_COUNT));
+    BOOST_CHECK_EQUAL(stats.edgeCount, static_cast<std::size_t>(2 * (SEGMENT_COUNT - 1)));
+    BOOST_CHECK_EQUAL(stats.geometryCount, static_cast<std::size_t>(SEGMENT_COUNT));
+    BOOST_CHECK_EQUAL(stats.nameCount, static_cast<std::size_t>(SEGMENT_COUNT / 10));
+    BOOST_CHECK_EQUAL(stats.nodeBlockCount, static_cast<std::size_t>((SEGMENT_COUNT + 15) / 16));
+    BOOST_CHECK(stats.externalEdgeCount > 0);
+    BOOST_CHECK_EQUAL(stats.globalNodeCount, 0u);
+    BOOST_CHECK(stats.nodeBoundsChunkSize > 0);
+    BOOST_CHECK_EQUAL(stats.incomingEdgesChunkSize > 0, incomingEdges);
+    return fileName;
+}
+
+// Contraction hierarchy of 5 road segments: segments 1 and 3 are contracted first, then 2, 0 and 4.
+// Edges are stored at the lower ranked end point.
+std::string buildShortcutPackage()
+{
+    PackageBuilder builder("shortcuts", PackageBuilder::Settings());
+    for (int i = 0; i < 5; i++)
+    {
+        PackageBuilder::Node node;
+        node.geometry.emplace_back(45000000, 25000000 + i * SEGMENT_LENGTH);
+        node.geometry.emplace_back(45000000, 25000000 + (i + 1) * SEGMENT_LENGTH);
+        node.name = "Street";
+        node.weight = SEGMENT_WEIGHT;
+        builder.addNode(std::move(node));
+    }
+    auto addEdge = [&builder](std::uint32_t sourceNode, std::uint32_t targetNode, int contractedNode)
+    {
+        PackageBuilder::Edge edge;
+        edge.sourceNode = sourceNode;
+        edge.targetNode = targetNode;
+        edge.weight = SEGMENT_WEIGHT * (contractedNode < 0 ? 1 : std::abs(static_cast<int>(targetNode) - static_cast<int>(sourceNode)));
+        edge.forward = edge.backward = true;
+        edge.contracted = contractedNode >= 0;
+        edge.contractedNode = contractedNode >= 0 ? contractedNode : 0;
+        builder.addEdge(edge);
+    };
+    addEdge(1, 0, -1);
+    addEdge(1, 2, -1);
+    addEdge(3, 2, -1);
+    addEdge(3, 4, -1);
+    addEdge(2, 0, 1);
+    addEdge(2, 4, 3);
+    addEdge(0, 4, 2);
+
+    return writePackage(builder);
+}
+
+// The road split in two packages, both containing the border segment and linking it to the copy in the other package.
+// Returns the file names of the west and east packages.
+std::pair<std::string, std::string> buildBorderPackages(int borderSegment, unsigned int eastSegmentWeight)
+{
+    PackageBuilder westBuilder("west", roadSettings(PackageBuilder::NodeOrder::HILBERT));
+    addRoadSegments(westBuilder, 0, borderSegment + 1, SEGMENT_WEIGHT);
+    PackageBuilder eastBuilder("east", roadSettings(PackageBuilder::NodeOrder::HILBERT));
+    addRoadSegments(eastBuilder, borderSegment, SEGMENT_COUNT, eastSegmentWeight);
+
+    std::pair<std::uint32_t, std::uint32_t> westLocation = westBuilder.getNodeLocations()[borderSegment];
+    std::pair<std::uint32_t, std::uint32_t> eastLocation = eastBuilder.getNodeLocations()[0];
+    westBuilder.addNodeLink(borderSegment, PackageBuilder::NodeLink("east", eastLocation.first, eastLocation.second));
+    eastBuilder.addNodeLink(0, PackageBuilder::NodeLink("west", westLocation.first, westLocation.second));
+
+    std::pair<std::string, std::string> fileNames(writePackage(westBuilder), writePackage(eastBuilder));
+    BOOST_CHECK_EQUAL(westBuilder.getStats().globalNodeCount, 1u);
+    BOOST_CHECK_EQUAL(eastBuilder.getStats().globalNodeCount, 1u);
+    return fileNames;
+}
+
+Nuti::Routing::WGSPos segmentCenter(int i)
+{
+    return Nuti::Routing::WGSPos(45.0 + (i % 2) * 0.0001, 25.0 + (i * SEGMENT_LENGTH + SEGMENT_LENGTH / 2) * 1.0e-6);
+}
+}
+
+BOOST_AUTO_TEST_CASE(round_trip_test)
+{
+    // Blocks are read from the stream or from the mapped file, with or without background prefetching,
+    // through caches that can hold only a few of them
+    for (bool useMemoryMapping : { false, true })
+    for (unsigned int prefetchThreadCount : { 0u, 2u })
+    for (PackageBuilder::NodeOrder nodeOrder : { PackageBuilder::NodeOrder::INPUT, PackageBuilder::NodeOrder::HILBERT })
+    {
+        BOOST_TEST_MESSAGE("useMemoryMapping " << useMemoryMapping << ", prefetchThreadCount " << prefetchThreadCount);
+        std::string fileName = buildRoadPackage(nodeOrder);
+        RoutingGraph::Settings settings;
+        settings.useMemoryMapping = useMemoryMapping;
+        settings.prefetchThreadCount = prefetchThreadCount;
+        settings.blockCacheMemoryBudget = 16 * 1024;
+        auto graph = std::make_shared<RoutingGraph>(settings);
+        BOOST_REQUIRE(graph->import(fileName));
+
+        for (int i : { 0, 17, 255, SEGMENT_COUNT - 1 })
+        {
+            std::vector<RoutingGraph::NearestNode> nearestNodes = graph->findNearestNode(segmentCenter(i));
+            BOOST_REQUIRE(!nearestNodes.empty());
+            RoutingGraph::NodePtr node = graph->getNode(nearestNodes.front().nodeId);
+            BOOST_CHECK_EQUAL(graph->getNodeName(*node), "Street " + std::to_string(i / 10));
+            BOOST_CHECK_EQUAL(node->nodeData.weight, SEGMENT_WEIGHT);
+
+            std::vector<Nuti::Routing::WGSPos> geometry = graph->getNodeGeometry(*node);
+            BOOST_REQUIRE_EQUAL(geometry.size(), 3u);
+            BOOST_CHECK_CLOSE(geometry.front()(1), 25.0 + i * SEGMENT_LENGTH * 1.0e-6, 1.0e-6);
+            BOOST_CHECK_CLOSE(geometry.back()(1), 25.0 + (i + 1) * SEGMENT_LENGTH * 1.0e-6, 1.0e-6);
+
+            RoutingGraph::GeometryView geometryView = graph->getNodeGeometryView(*node);
+            BOOST_REQUIRE_EQUAL(geometryView.size(), geometry.size());
+            BOOST_CHECK(std::equal(geometryView.begin(), geometryView.end(), geometry.begin()));
+            BOOST_CHECK(graph->getNodeNameView(*node) == "Street " + std::to_string(i / 10));
+        }
+
+        // The weight between segment centers is half of both end segments plus all segments in between
+        Nuti::Routing::RouteFinder routeFinder(graph);
+        Nuti::Routing::RoutingResult result = routeFinder.find(Nuti::Routing::RoutingQuery(segmentCenter(10), segmentCenter(500)));
+        BOOST_REQUIRE(result.getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+        BOOST_CHECK_CLOSE(result.getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+        // Summary uses node lengths from NLEN chunk instead of geometry
+        Nuti::Routing::RoutingSummary summary = routeFinder.findSummary(Nuti::Routing::RoutingQuery(segmentCenter(10), segmentCenter(500)));
+        BOOST_REQUIRE(summary.getStatus() == Nuti::Routing::RoutingSummary::Status::SUCCESS);
+        BOOST_CHECK_CLOSE(summary.getTotalTime(), result.getTotalTime(), 0.01);
+        BOOST_CHECK_CLOSE(summary.getTotalWeight(), 490.0 * SEGMENT_WEIGHT, 1.0);
+        BOOST_CHECK_CLOSE(summary.getTotalDistance(), result.getTotalDistance(), 0.1);
+
+        Nuti::Routing::DistanceTableFinder tableFinder(graph);
+        std::vector<std::vector<RoutingGraph::NearestNode>> sourceNodes { graph->findNearestNode(segmentCenter(3)) };
+        std::vector<std::vector<RoutingGraph::NearestNode>> targetNodes { graph->findNearestNode(segmentCenter(100)), graph->findNearestNode(segmentCenter(590)) };
+        std::vector<float> weights = tableFinder.find(sourceNodes, targetNodes);
+        BOOST_REQUIRE_EQUAL(weights.size(), 2u);
+        BOOST_CHECK_CLOSE(weights[0], 97.0f * SEGMENT_WEIGHT, 1.0);
+        BOOST_CHECK_CLOSE(weights[1], 587.0f * SEGMENT_WEIGHT, 1.0);
+
+        RoutingGraph::CacheStats cacheStats = graph->getCacheStats();
+        BOOST_CHECK_EQUAL(cacheStats.memoryBudget, settings.blockCacheMemoryBudget);
+        BOOST_CHECK(cacheStats.memoryUsed <= cacheStats.memoryBudget);
+        BOOST_CHECK(cacheStats.nodeBlocks.evictions > 0);
+        RoutingGraph::PrefetchStats prefetchStats = graph->getPrefetchStats();
+        BOOST_CHECK_EQUAL(prefetchStats.requests > 0, prefetchThreadCount > 0);
+        BOOST_CHECK(prefetchStats.loads <= prefetchStats.requests);
+
+        graph.reset();
+        boost::filesystem::remove(fileName);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(shortcut_unpack_test)
+{
+    std::string fileName = buildShortcutPackage();
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    BOOST_REQUIRE(graph->import(fileName));
+    Nuti::Routing::RouteFinder routeFinder(graph);
+    Nuti::Routing::RoutingQuery query(Nuti::Routing::WGSPos(45.0, 25.0005), Nuti::Routing::WGSPos(45.0, 25.0045));
+
+    // The second query uses the cached original edges of the shortcuts
+    for (int i = 0; i < 2; i++)
+    {
+        Nuti::Routing::RoutingStats stats;
+        Nuti::Routing::RoutingResult result;
+        {
+            Nuti::Routing::RoutingStatsCollector collector(stats);
+            result = routeFinder.find(query);
+        }
+        BOOST_REQUIRE(result.getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+        BOOST_CHECK_CLOSE(result.getTotalTime(), 4 * SEGMENT_WEIGHT / 10.0, 1.0);
+        BOOST_CHECK_EQUAL(result.getInstructions().size(), 6u);
+
+        BOOST_CHECK_EQUAL(stats.routes, 1u);
+        BOOST_CHECK_EQUAL(stats.nodeBlocksLoaded, i == 0 ? 1u : 0u);
+        BOOST_CHECK_EQUAL(stats.shortcutsUnpacked, i == 0 ? 3u : 0u);
+        BOOST_CHECK_EQUAL(stats.heapPops, stats.nodesSettled + stats.nodesStalled);
+        BOOST_CHECK(stats.heapPushes >= stats.heapPops);
+        BOOST_CHECK(stats.snapCandidates > 0);
+    }
+    BOOST_CHECK_EQUAL(routeFinder.getUnpackCacheStats().insertions, 3u);
+    BOOST_CHECK_EQUAL(routeFinder.getUnpackCacheStats().hits, 1u);
+
+    graph.reset();
+    boost::filesystem::remove(fileName);
+}
+
+BOOST_AUTO_TEST_CASE(incoming_edges_test)
+{
+    std::vector<double> times;
+    for (bool incomingEdges : { true, false })
+    {
+        std::string fileName = buildRoadPackage(PackageBuilder::NodeOrder::HILBERT, SEGMENT_WEIGHT, incomingEdges);
+        auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+        BOOST_REQUIRE(graph->import(fileName));
+        Nuti::Routing::RouteFinder routeFinder(graph);
+
+        // Both neighbours of a segment store an edge to it
+        std::vector<RoutingGraph::NearestNode> nearestNodes = graph->findNearestNode(segmentCenter(100));
+        BOOST_REQUIRE_EQUAL(nearestNodes.size(), 1u);
+        std::vector<std::pair<RoutingGraph::NodeId, RoutingGraph::Edge>> edges;
+        BOOST_REQUIRE_EQUAL(graph->getIncomingEdges(nearestNodes.front().nodeId, edges), incomingEdges);
+        if (incomingEdges)
+        {
+            BOOST_REQUIRE_EQUAL(edges.size(), 2u);
+            for (const std::pair<RoutingGraph::NodeId, RoutingGraph::Edge>& edge : edges)
+            {
+                BOOST_CHECK(edge.first != nearestNodes.front().nodeId);
+                BOOST_CHECK(edge.second.targetNodeId == nearestNodes.front().nodeId);
+                BOOST_CHECK(edge.second.forward);
+            }
+            RoutingGraph::NodeId previousNodeId = graph->findNearestNode(segmentCenter(99)).front().nodeId;
+            BOOST_CHECK(edges[0].first == previousNodeId || edges[1].first == previousNodeId);
+        }
+
+        // Start and end on the same one-way segment in the wrong order: the route leaves the segment and comes back.
+        // The incoming edges of the segment come from the RADJ chunk if present, otherwise from a second spatial query.
+        std::vector<RoutingGraph::NearestNode> sourceNodes = graph->findNearestNode(Nuti::Routing::WGSPos(45.0, 25.10075));
+        std::vector<RoutingGraph::NearestNode> targetNodes = graph->findNearestNode(Nuti::Routing::WGSPos(45.0, 25.10025));
+        BOOST_REQUIRE_EQUAL(sourceNodes.size(), 1u);
+        BOOST_REQUIRE_EQUAL(targetNodes.size(), 1u);
+        BOOST_REQUIRE(sourceNodes.front().nodeId == targetNodes.front().nodeId);
+        Nuti::Routing::RoutingStats stats;
+        Nuti::Routing::RoutingResult result;
+        {
+            Nuti::Routing::RoutingStatsCollector collector(stats);
+            result = routeFinder.find(sourceNodes, targetNodes);
+        }
+        BOOST_REQUIRE(result.getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+        BOOST_CHECK(result.getTotalTime() > 0.5 * SEGMENT_WEIGHT / 10.0);
+        BOOST_CHECK_EQUAL(stats.snapCandidates > 0, !incomingEdges);
+        times.push_back(result.getTotalTime());
+
+        graph.reset();
+        boost::filesystem::remove(fileName);
+    }
+    BOOST_CHECK_CLOSE(times[0], times[1], 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(reload_test)
+{
+    std::string fileName1 = buildRoadPackage(PackageBuilder::NodeOrder::HILBERT);
+    std::string fileName2 = buildRoadPackage(PackageBuilder::NodeOrder::INPUT, 2 * SEGMENT_WEIGHT);
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    Nuti::Routing::RouteFinder routeFinder(graph);
+    Nuti::Routing::RoutingQuery query(segmentCenter(10), segmentCenter(500));
+
+    BOOST_REQUIRE(graph->import(fileName1));
+    std::uint64_t generation = graph->getGeneration();
+    BOOST_REQUIRE_EQUAL(graph->getPackageInfos().size(), 1u);
+    BOOST_CHECK_EQUAL(graph->getPackageInfos().front().fileName, fileName1);
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    RoutingGraph::NodeId nodeId;
+    std::uint64_t nodeGeneration = 0;
+    {
+        // Searches in the snapshot keep using the package set that was current when the snapshot was taken
+        RoutingGraph::Snapshot snapshot(*graph);
+        std::vector<RoutingGraph::NearestNode> nearestNodes = graph->findNearestNode(segmentCenter(10));
+
+        BOOST_REQUIRE(graph->import(fileName2));
+        BOOST_REQUIRE(!nearestNodes.empty());
+        BOOST_CHECK_EQUAL(graph->getNode(nearestNodes.front().nodeId)->nodeData.weight, SEGMENT_WEIGHT);
+        BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+        nodeId = nearestNodes.front().nodeId;
+        nodeGeneration = graph->getNodeGeneration(nodeId);
+        BOOST_CHECK_EQUAL(nodeGeneration, graph->getPackageInfos().front().generation);
+        BOOST_CHECK(RoutingGraph::NodeId::fromPackedId(nodeId.packedId()) == nodeId);
+    }
+
+    // The package with the same name was replaced
+    BOOST_CHECK(graph->getGeneration() > generation);
+    BOOST_REQUIRE_EQUAL(graph->getPackageInfos().size(), 1u);
+    BOOST_CHECK_EQUAL(graph->getPackageInfos().front().fileName, fileName2);
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * 2 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK(graph->getNodeGeneration(nodeId) != nodeGeneration);
+    BOOST_CHECK_EQUAL(graph->getNodeGeneration(RoutingGraph::NodeId(RoutingGraph::BlockId(graph->getPackageInfos().front().packageId, graph->getPackageInfos().front().nodeBlockCount), 0)), 0u);
+
+    BOOST_CHECK(graph->unload("road"));
+    BOOST_CHECK(!graph->unload("road"));
+    BOOST_CHECK(graph->getPackageInfos().empty());
+    BOOST_CHECK(graph->findNearestNode(segmentCenter(10)).empty());
+    BOOST_CHECK_EQUAL(graph->getNodeGeneration(nodeId), 0u);
+
+    // Unloaded package slots are reused
+    BOOST_REQUIRE(graph->import(fileName1));
+    BOOST_REQUIRE_EQUAL(graph->getPackageInfos().size(), 1u);
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    graph.reset();
+    boost::filesystem::remove(fileName1);
+    boost::filesystem::remove(fileName2);
+}
+
+BOOST_AUTO_TEST_CASE(border_link_test)
+{
+    constexpr int BORDER_SEGMENT = 300;
+    std::pair<std::string, std::string> fileNames = buildBorderPackages(BORDER_SEGMENT, SEGMENT_WEIGHT);
+    std::pair<std::string, std::string> fileNames2 = buildBorderPackages(BORDER_SEGMENT, 2 * SEGMENT_WEIGHT);
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    Nuti::Routing::RouteFinder routeFinder(graph);
+    Nuti::Routing::RoutingQuery query(segmentCenter(10), segmentCenter(500));
+    Nuti::Routing::RoutingQuery reverseQuery(segmentCenter(500), segmentCenter(10));
+    Nuti::Routing::RoutingQuery westQuery(segmentCenter(10), segmentCenter(BORDER_SEGMENT));
+
+    // Copy of the border segment in the given package, and the check that the last west segment leads to it
+    auto findBorderNodeId = [&graph](int packageId)
+    {
+        for (const RoutingGraph::NearestNode& nearestNode : graph->findNearestNode(segmentCenter(BORDER_SEGMENT)))
+        {
+            if (nearestNode.nodeId.packageId() == packageId)
+            {
+                return nearestNode.nodeId;
+            }
+        }
+        return RoutingGraph::NodeId();
+    };
+    auto leadsToBorderNode = [&graph](RoutingGraph::NodeId westNodeId, RoutingGraph::NodeId borderNodeId)
+    {
+        RoutingGraph::NodePtr node = graph->getNode(westNodeId);
+        for (std::uint32_t edgeIndex = node->firstEdge; edgeIndex != node->lastEdge; edgeIndex++)
+        {
+            if (node.block().getEdgeTargetNodeId(edgeIndex) == borderNodeId)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Without the east package the border segment of the west package is a dead end, east targets snap to it
+    BOOST_REQUIRE(graph->import(fileNames.first));
+    RoutingGraph::NodeId westNodeId = graph->findNearestNode(segmentCenter(BORDER_SEGMENT - 1)).front().nodeId;
+    RoutingGraph::NodeId westBorderNodeId = findBorderNodeId(westNodeId.packageId());
+    BOOST_CHECK(leadsToBorderNode(westNodeId, westBorderNodeId));
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 290 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK_CLOSE(routeFinder.find(westQuery).getTotalTime(), 290 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    // Edges leading to the border segment resolve to the copy in the east package, both ways
+    BOOST_REQUIRE(graph->import(fileNames.second));
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK_CLOSE(routeFinder.find(reverseQuery).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK_CLOSE(routeFinder.find(westQuery).getTotalTime(), 290 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    BOOST_REQUIRE_EQUAL(graph->findNearestNode(segmentCenter(BORDER_SEGMENT)).size(), 2u);
+    RoutingGraph::NodeId eastBorderNodeId = findBorderNodeId(graph->findNearestNode(segmentCenter(BORDER_SEGMENT + 1)).front().nodeId.packageId());
+    BOOST_REQUIRE(eastBorderNodeId.valid());
+    BOOST_CHECK(leadsToBorderNode(westNodeId, eastBorderNodeId));
+    std::vector<RoutingGraph::NodeId> equivalentNodeIds = graph->getEquivalentNodeIds(westBorderNodeId);
+    BOOST_REQUIRE_EQUAL(equivalentNodeIds.size(), 1u);
+    BOOST_CHECK(equivalentNodeIds.front() == eastBorderNodeId);
+
+    // Replacing the east package re-resolves the links of the west package, cached west blocks must not keep the old copy
+    BOOST_REQUIRE(graph->import(fileNames2.second));
+    eastBorderNodeId = findBorderNodeId(graph->findNearestNode(segmentCenter(BORDER_SEGMENT + 1)).front().nodeId.packageId());
+    BOOST_CHECK(leadsToBorderNode(westNodeId, eastBorderNodeId));
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), (290 + 200 * 2) * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK_CLOSE(routeFinder.find(reverseQuery).getTotalTime(), (290 + 200 * 2) * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    // Unloading the east package falls back to the own copy of the border segment, which is a dead end again
+    BOOST_CHECK(graph->unload("east"));
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 290 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK_CLOSE(routeFinder.find(westQuery).getTotalTime(), 290 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK(leadsToBorderNode(westNodeId, westBorderNodeId));
+    BOOST_CHECK_EQUAL(graph->findNearestNode(segmentCenter(BORDER_SEGMENT)).size(), 1u);
+    BOOST_CHECK(graph->getEquivalentNodeIds(westBorderNodeId).empty());
+
+    BOOST_REQUIRE(graph->import(fileNames.second));
+    BOOST_CHECK_CLOSE(routeFinder.find(query).getTotalTime(), 490 * SEGMENT_WEIGHT / 10.0, 1.0);
+
+    graph.reset();
+    for (const std::string& fileName : { fileNames.first, fileNames.second, fileNames2.first, fileNames2.second })
+    {
+        boost::filesystem::remove(fileName);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snap_hint_test)
+{
+    std::string fileName = buildRoadPackage(PackageBuilder::NodeOrder::HILBERT);
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    BOOST_REQUIRE(graph->import(fileName));
+
+    // Position on the last segment of road segment 10, segment indices are the indices of the segment end vertices
+    const Nuti::Routing::WGSPos pos(45.0, 25.0 + (10 * SEGMENT_LENGTH + SEGMENT_LENGTH * 3 / 4) * 1.0e-6);
+    const FixedPointCoordinate coordinate(static_cast<int>(std::round(pos(0) * COORDINATE_PRECISION)), static_cast<int>(std::round(pos(1) * COORDINATE_PRECISION)));
+    std::vector<RoutingGraph::NearestNode> nearestNodes = graph->findNearestNode(pos);
+    BOOST_REQUIRE(!nearestNodes.empty());
+    const std::size_t geometrySize = graph->getNodeGeometryView(*graph->getNode(nearestNodes.front().nodeId)).size();
+    BOOST_REQUIRE_EQUAL(geometrySize, 3u);
+    BOOST_REQUIRE_EQUAL(nearestNodes.front().geometrySegmentIndex, 2u);
+
+    std::vector<RoutingGraph::NearestNode> hintedNodes;
+    BOOST_REQUIRE(DecodeNutiSnapHint(*graph, EncodeNutiSnapHint(*graph, coordinate, nearestNodes), coordinate, hintedNodes));
+    BOOST_REQUIRE_EQUAL(hintedNodes.size(), nearestNodes.size());
+    BOOST_CHECK(hintedNodes.front().nodeId == nearestNodes.front().nodeId);
+    BOOST_CHECK_EQUAL(hintedNodes.front().geometrySegmentIndex, nearestNodes.front().geometrySegmentIndex);
+
+    // Forged tokens with a valid checksum but a segment outside of the node geometry are rejected
+    for (unsigned int segmentIndex : { 0u, static_cast<unsigned int>(geometrySize), 1000u, 0xffffffffu })
+    {
+        std::vector<RoutingGraph::NearestNode> forgedNodes = nearestNodes;
+        forgedNodes.front().geometrySegmentIndex = segmentIndex;
+        BOOST_CHECK(!DecodeNutiSnapHint(*graph, EncodeNutiSnapHint(*graph, coordinate, forgedNodes), coordinate, hintedNodes));
+    }
+
+    // Routes start at the snapped point and continue forward along the road, also with out of range segment indices
+    Nuti::Routing::RouteFinder routeFinder(graph);
+    for (unsigned int segmentIndex : { nearestNodes.front().geometrySegmentIndex, 1000u })
+    {
+        std::vector<RoutingGraph::NearestNode> sourceNodes = nearestNodes;
+        sourceNodes.front().geometrySegmentIndex = segmentIndex;
+        Nuti::Routing::RoutingResult result = routeFinder.find(sourceNodes, graph->findNearestNode(segmentCenter(20)));
+        BOOST_REQUIRE(result.getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+        const std::vector<Nuti::Routing::WGSPos>& geometry = result.getGeometry();
+        BOOST_REQUIRE(geometry.size() >= 2);
+        BOOST_CHECK_CLOSE(geometry[0](1), nearestNodes.front().nodePos(1), 1.0e-6);
+        BOOST_CHECK_CLOSE(geometry[1](1), 25.0 + 11 * SEGMENT_LENGTH * 1.0e-6, 1.0e-6);
+        for (std::size_t i = 1; i < geometry.size(); i++)
+        {
+            BOOST_CHECK(geometry[i](1) >= geometry[i - 1](1));
+        }
+    }
+
+    graph.reset();
+    boost::filesystem::remove(fileName);
+}
+
+BOOST_AUTO_TEST_CASE(batch_snap_test)
+{
+    std::string fileName = buildRoadPackage(PackageBuilder::NodeOrder::HILBERT);
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    BOOST_REQUIRE(graph->import(fileName));
+
+    // Batch results are in input order and match single position snapping, also with several threads
+    std::vector<RoutingGraph::SnapQuery> queries;
+    for (int i = 0; i < SEGMENT_COUNT; i += 3)
+    {
+        queries.emplace_back(segmentCenter((i * 7) % SEGMENT_COUNT));
+    }
+    RoutingGraph::SnapOptions options;
+    options.threadCount = 4;
+    std::vector<std::vector<RoutingGraph::NearestNode>> nearestNodes = graph->findNearestNodes(queries, options);
+    BOOST_REQUIRE_EQUAL(nearestNodes.size(), queries.size());
+    for (std::size_t i = 0; i < queries.size(); i++)
+    {
+        std::vector<RoutingGraph::NearestNode> expectedNodes = graph->findNearestNode(queries[i].pos);
+        BOOST_REQUIRE(!nearestNodes[i].empty());
+        BOOST_REQUIRE_EQUAL(nearestNodes[i].size(), expectedNodes.size());
+        BOOST_CHECK(nearestNodes[i].front().nodeId == expectedNodes.front().nodeId);
+        BOOST_CHECK_SMALL(nearestNodes[i].front().distance, 0.5f);
+    }
+
+    // Caller provided executor runs every group once, instead of the engine threads
+    RoutingGraph::SnapOptions executorOptions;
+    std::vector<std::size_t> tasks;
+    executorOptions.executor = [&tasks](std::size_t taskCount, const std::function<void(std::size_t)>& task)
+    {
+        for (std::size_t i = taskCount; i-- > 0; )
+        {
+            tasks.push_back(i);
+            task(i);
+        }
+    };
+    std::vector<std::vector<RoutingGraph::NearestNode>> executorNearestNodes = graph->findNearestNodes(queries, executorOptions);
+    BOOST_CHECK_EQUAL(tasks.size(), (queries.size() + 63) / 64);
+    BOOST_REQUIRE_EQUAL(executorNearestNodes.size(), queries.size());
+    for (std::size_t i = 0; i < queries.size(); i++)
+    {
+        BOOST_REQUIRE(!executorNearestNodes[i].empty());
+        BOOST_CHECK(executorNearestNodes[i].front().nodeId == nearestNodes[i].front().nodeId);
+    }
+
+    // K nearest nodes, closest first
+    Nuti::Routing::WGSPos pos = segmentCenter(100) + Nuti::Routing::WGSPos(0.001, 0);
+    options.maxResults = 3;
+    std::vector<RoutingGraph::NearestNode> kNearestNodes = graph->findNearestNodes({ RoutingGraph::SnapQuery(pos) }, options).front();
+    BOOST_REQUIRE_EQUAL(kNearestNodes.size(), 3u);
+    BOOST_CHECK(kNearestNodes[0].nodeId == graph->findNearestNode(pos).front().nodeId);
+    BOOST_CHECK(kNearestNodes[0].distance <= kNearestNodes[1].distance && kNearestNodes[1].distance <= kNearestNodes[2].distance);
+    BOOST_CHECK_CLOSE(kNearestNodes[0].distance, 111.0f, 2.0);
+
+    // Radius, the road is about 111m away
+    options.maxResults = 1;
+    options.maxDistance = 100;
+    BOOST_CHECK(graph->findNearestNodes({ RoutingGraph::SnapQuery(pos) }, options).front().empty());
+    options.maxDistance = 150;
+    BOOST_CHECK_EQUAL(graph->findNearestNodes({ RoutingGraph::SnapQuery(pos) }, options).front().size(), 1u);
+
+    // Bearing, all nodes of the road point east
+    BOOST_CHECK_EQUAL(graph->findNearestNodes({ RoutingGraph::SnapQuery(pos, 90, 30) }, options).front().size(), 1u);
+    BOOST_CHECK_EQUAL(graph->findNearestNodes({ RoutingGraph::SnapQuery(pos, 80, 30) }, options).front().size(), 1u);
+    BOOST_CHECK(graph->findNearestNodes({ RoutingGraph::SnapQuery(pos, 270, 30) }, options).front().empty());
+
+    BOOST_CHECK(graph->findNearestNodes({}, options).empty());
+    boost::filesystem::remove(fileName);
+}
+
+BOOST_AUTO_TEST_CASE(alternative_route_test)
+{
+    // Two roads between the first and the last segment: the northern road is the shortest, the southern one is 5% longer
+    PackageBuilder builder("ring", PackageBuilder::Settings());
+    auto addNode = [&builder](int lat, int lon0, int lon1, const std::string& name, unsigned int weight)
+    {
+        PackageBuilder::Node node;
+        node.geometry.emplace_back(lat, lon0);
+        node.geometry.emplace_back(lat, lon1);
+        node.name = name;
+        node.weight = weight;
+        return builder.addNode(std::move(node));
+    };
+    auto addEdge = [&builder](std::uint32_t sourceNode, std::uint32_t targetNode, unsigned int weight)
+    {
+        PackageBuilder::Edge edge;
+        edge.weight = weight;
+        edge.forward = edge.backward = true;
+        edge.turnInstruction = 1;
+        edge.sourceNode = sourceNode;
+        edge.targetNode = targetNode;
+        builder.addEdge(edge);
+        std::swap(edge.sourceNode, edge.targetNode);
+        builder.addEdge(edge);
+    };
+    std::uint32_t firstNode = addNode(45000000, 25000000, 25000000 + SEGMENT_LENGTH, "First", 2 * SEGMENT_WEIGHT);
+    std::uint32_t lastNode = addNode(45000000, 25000000 + 4 * SEGMENT_LENGTH, 25000000 + 5 * SEGMENT_LENGTH, "Last", 2 * SEGMENT_WEIGHT);
+    for (int road = 0; road < 2; road++)
+    {
+        unsigned int weight = 2 * SEGMENT_WEIGHT + road;
+        std::uint32_t prevNode = firstNode;
+        for (int i = 1; i < 4; i++)
+        {
+            std::uint32_t node = addNode(45000000 + (road == 0 ? 1000 : -1000), 25000000 + i * SEGMENT_LENGTH, 25000000 + (i + 1) * SEGMENT_LENGTH, road == 0 ? "North" : "South", weight);
+            addEdge(prevNode, node, weight);
+            prevNode = node;
+        }
+        addEdge(prevNode, lastNode, weight);
+    }
+
+    std::string fileName = writePackage(builder);
+    auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+    BOOST_REQUIRE(graph->import(fileName));
+    Nuti::Routing::RouteFinder routeFinder(graph);
+    Nuti::Routing::RoutingQuery query(Nuti::Routing::WGSPos(45.0, 25.0005), Nuti::Routing::WGSPos(45.0, 25.0045));
+    auto usesStreet = [](const Nuti::Routing::RoutingResult& result, const std::string& name)
+    {
+        return std::any_of(result.getInstructions().begin(), result.getInstructions().end(), [&name](const Nuti::Routing::RoutingInstruction& instruction) { return instruction.getAddress() == name; });
+    };
+
+    // Shortest route first, same as the single route query
+    std::vector<Nuti::Routing::RoutingResult> results = routeFinder.findAlternatives(query, 2);
+    BOOST_REQUIRE_EQUAL(results.size(), 2u);
+    BOOST_REQUIRE(results[0].getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+    BOOST_CHECK_CLOSE(results[0].getTotalTime(), routeFinder.find(query).getTotalTime(), 0.01);
+    BOOST_CHECK_CLOSE(results[0].getTotalTime(), 8 * SEGMENT_WEIGHT / 10.0, 1.0);
+    BOOST_CHECK(usesStreet(results[0], "North") && !usesStreet(results[0], "South"));
+    BOOST_REQUIRE(results[1].getStatus() == Nuti::Routing::RoutingResult::Status::SUCCESS);
+    BOOST_CHECK_CLOSE(results[1].getTotalTime(), (8 * SEGMENT_WEIGHT + 4) / 10.0, 1.0);
+    BOOST_CHECK(usesStreet(results[1], "South") && !usesStreet(results[1], "North"));
+
+    // No alternatives requested, or none within the stretch limit
+    BOOST_CHECK_EQUAL(routeFinder.findAlternatives(query, 0).size(), 1u);
+    Nuti::Routing::RouteFinder::Settings settings;
+    settings.alternativeMaxStretch = 0.01;
+    BOOST_CHECK_EQUAL(Nuti::Routing::RouteFinder(graph, settings).findAlternatives(query, 2).size(), 1u);
+
+    graph.reset();
+    boost::filesystem::remove(fileName);
+}
+
+BOOST_AUTO_TEST_CASE(reachability_test)
+{
+    // Contracted package: the times come from the downward sweep
+    std::string shortcutFileName = buildShortcutPackage();
+    std::string fileName = buildRoadPackage(PackageBuilder::NodeOrder::HILBERT);
+    for (const std::string& packageFileName : { shortcutFileName, fileName })
+    {
+        auto graph = std::make_shared<RoutingGraph>(RoutingGraph::Settings());
+        BOOST_REQUIRE(graph->import(packageFileName));
+        Nuti::Routing::RouteFinder routeFinder(graph);
+        Nuti::Routing::ReachabilityFinder reachabilityFinder(graph);
+        reachabilityFinder.prepare();
+
+        // Both packages have segments 0..4 within 2 seconds. The route to the center of a reached segment takes half of
+        // the segment weight longer than reaching its start
+        Nuti::Routing::WGSPos sourcePos(45.0, 25.0025);
+        std::vector<Nuti::Routing::ReachabilityFinder::ReachedNode> reachedNodes = reachabilityFinder.find(graph->findNearestNode(sourcePos), 2.0);
+        BOOST_REQUIRE(!reachedNodes.empty());
+        BOOST_CHECK_EQUAL(reachedNodes.front().time, 0.0f);
+        for (std::size_t i = 0; i < reachedNodes.size(); i++)
+        {
+            BOOST_CHECK(reachedNodes[i].time <= 2.0f);
+            BOOST_CHECK(i == 0 || reachedNodes[i - 1].time <= reachedNodes[i].time);
+            if (i > 0)
+            {
+                RoutingGraph::NodePtr node = graph->getNode(reachedNodes[i].nodeId);
+                RoutingGraph::GeometryView geometry = graph->getNodeGeometryView(*node);
+                Nuti::Routing::WGSPos centerPos = (geometry.size() == 3 ? geometry[1] : (geometry.front() + geometry.back()) * 0.5);
+                Nuti::Routing::RoutingSummary summary = routeFinder.findSummary(Nuti::Routing::RoutingQuery(sourcePos, centerPos));
+                BOOST_REQUIRE(summary.getStatus() == Nuti::Routing::RoutingSummary::Status::SUCCESS);
+                BOOST_CHECK_CLOSE(summary.getTotalTime(), reachedNodes[i].time + SEGMENT_WEIGHT / 20.0, 0.1);
+            }
+        }
+        BOOST_CHECK_EQUAL(reachedNodes.size(), 5u);
+
+        // Isochrones grow with time, the longer one covers the package
+        std::vector<Nuti::Routing::ReachabilityFinder::Isochrone> isochrones = reachabilityFinder.findIsochrones(graph->findNearestNode(sourcePos), { 1.0, 10.0 });
+        BOOST_REQUIRE_EQUAL(isochrones.size(), 2u);
+        BOOST_CHECK_EQUAL(isochrones[0].time, 1.0);
+        for (const Nuti::Routing::ReachabilityFinder::Isochrone& isochrone : isochrones)
+        {
+            BOOST_REQUIRE(isochrone.polygon.size() >= 2);
+        }
+        auto getMaxLon = [](const std::vector<Nuti::Routing::WGSPos>& polygon)
+        {
+            return std::max_element(polygon.begin(), polygon.end(), [](const Nuti::Routing::WGSPos& pos1, const Nuti::Routing::WGSPos& pos2) { return pos1(1) < pos2(1); })->operator()(1);
+        };
+        BOOST_CHECK(getMaxLon(isochrones[0].polygon) < getMaxLon(isochrones[1].polygon));
+        if (packageFileName == shortcutFileName)
+        {
+            BOOST_CHECK_CLOSE(getMaxLon(isochrones[1].polygon), 25.005, 1.0e-6);
+        }
+
+        graph.reset();
+    }
+    boost::filesystem::remove(shortcutFileName);
+    boost::filesystem::remove(fileName);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_input_test)
+{
+    PackageBuilder builder("invalid", PackageBuilder::Settings());
+    BOOST_CHECK_THROW(builder.addNode(PackageBuilder::Node()), std::runtime_error);
+
+    PackageBuilder::Edge edge;
+    edge.targetNode = 1;
+    BOOST_CHECK_THROW(builder.addEdge(edge), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,83 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "Routing/RoutingGraph.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+
+BOOST_AUTO_TEST_SUITE(routing_graph)
+
+using Nuti::Routing::RoutingGraph;
+
+BOOST_AUTO_TEST_CASE(packed_node_id_test)
+{
+    RoutingGraph::NodeId invalid;
+    BOOST_CHECK(!invalid.valid());
+    BOOST_CHECK_EQUAL(invalid.packageId(), -1);
+    BOOST_CHECK(invalid == RoutingGraph::NodeId(RoutingGraph::BlockId(), 5));
+
+    RoutingGraph::NodeId nodeId(RoutingGraph::BlockId(RoutingGraph::NodeId::MAX_PACKAGE_ID, RoutingGraph::NodeId::MAX_BLOCK_INDEX), RoutingGraph::NodeId::MAX_ELEMENT_INDEX);
+    BOOST_CHECK(nodeId.valid());
+    BOOST_CHECK_EQUAL(nodeId.packageId(), RoutingGraph::NodeId::MAX_PACKAGE_ID);
+    BOOST_CHECK_EQUAL(nodeId.blockIndex(), RoutingGraph::NodeId::MAX_BLOCK_INDEX);
+    BOOST_CHECK_EQUAL(nodeId.elementIndex(), RoutingGraph::NodeId::MAX_ELEMENT_INDEX);
+
+    RoutingGraph::NodeId nodeId2(RoutingGraph::BlockId(3, 1234567), 4321);
+    BOOST_CHECK(nodeId2.blockId() == RoutingGraph::BlockId(3, 1234567));
+    BOOST_CHECK_EQUAL(nodeId2.elementIndex(), 4321);
+    BOOST_CHECK(nodeId2 != nodeId);
+    BOOST_CHECK_EQUAL(sizeof(RoutingGraph::NodeId), sizeof(std::uint64_t));
+}
+
+BOOST_AUTO_TEST_CASE(node_block_edge_test)
+{
+    RoutingGraph::NodeBlock nodeBlock;
+    nodeBlock.blockId = RoutingGraph::BlockId(1, 7);
+    nodeBlock.externalNodeIds.push_back(RoutingGraph::NodeId(RoutingGraph::BlockId(2, 9), 11));
+    nodeBlock.edgeTargets = { 3, RoutingGraph::NodeBlock::EXTERNAL_NODE_FLAG | 0 };
+    nodeBlock.edgeWeights = { 100, 200 };
+    nodeBlock.edgeFlags = { RoutingGraph::NodeBlock::FORWARD_FLAG, RoutingGraph::NodeBlock::BACKWARD_FLAG | RoutingGraph::NodeBlock::CONTRACTED_FLAG };
+    nodeBlock.edgeTurnInstructions = { 5, 0 };
+    nodeBlock.edgeContractedNodes = { 0, 2 };
+
+    RoutingGraph::Edge edge0 = nodeBlock.getEdge(0);
+    BOOST_CHECK(edge0.targetNodeId == RoutingGraph::NodeId(nodeBlock.blockId, 3));
+    BOOST_CHECK(edge0.forward && !edge0.backward && !edge0.contracted);
+    BOOST_CHECK(!edge0.contractedNodeId.valid());
+    BOOST_CHECK_EQUAL(edge0.edgeData.weight, 100u);
+    BOOST_CHECK_EQUAL(edge0.edgeData.turnInstruction, 5);
+
+    RoutingGraph::Edge edge1 = nodeBlock.getEdge(1);
+    BOOST_CHECK(edge1.targetNodeId == nodeBlock.externalNodeIds[0]);
+    BOOST_CHECK(!edge1.forward && edge1.backward && edge1.contracted);
+    BOOST_CHECK(edge1.contractedNodeId == RoutingGraph::NodeId(nodeBlock.blockId, 2));
+    BOOST_CHECK_EQUAL(edge1.edgeData.weight, 200u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,111 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "Routing/SearchWorkspace.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(search_workspace)
+
+using Nuti::Routing::RoutingGraph;
+using Nuti::Routing::SearchSpace;
+
+BOOST_AUTO_TEST_CASE(decrease_key_order_test)
+{
+    std::mt19937 mt_rand(13);
+    SearchSpace searchSpace;
+    for (int query = 0; query < 3; query++)
+    {
+        searchSpace.clear();
+        BOOST_CHECK(searchSpace.empty());
+        BOOST_CHECK_EQUAL(searchSpace.size(), 0u);
+
+        // Reference: minimal pushed weight per node
+        std::map<int, float> weights;
+        for (int i = 0; i < 20000; i++)
+        {
+            int key = std::uniform_int_distribution<int>(0, 5000)(mt_rand);
+            float weight = std::uniform_real_distribution<float>(0.0f, 1000.0f)(mt_rand);
+            RoutingGraph::NodeId nodeId(RoutingGraph::BlockId(key % 3, key / 3), key % 7);
+            bool improved = weights.count(key) == 0 || weight < weights[key];
+            BOOST_CHECK_EQUAL(searchSpace.push(nodeId, RoutingGraph::NodeId(), weight), improved);
+            if (improved)
+            {
+                weights[key] = weight;
+            }
+        }
+        BOOST_CHECK_EQUAL(searchSpace.size(), weights.size());
+
+        float lastWeight = -1.0f;
+        std::size_t popped = 0;
+        while (!searchSpace.empty())
+        {
+            const SearchSpace::Entry &entry = searchSpace.pop();
+            BOOST_CHECK(entry.settled);
+            BOOST_CHECK(entry.weight >= lastWeight);
+            lastWeight = entry.weight;
+            popped++;
+        }
+        BOOST_CHECK_EQUAL(popped, weights.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(find_and_clear_heap_test)
+{
+    SearchSpace searchSpace;
+    RoutingGraph::NodeId nodeId0(RoutingGraph::BlockId(0, 1), 2);
+    RoutingGraph::NodeId nodeId1(RoutingGraph::BlockId(0, 1), 3);
+    searchSpace.push(nodeId0, RoutingGraph::NodeId(), 5.0f);
+    searchSpace.push(nodeId1, nodeId0, 7.0f);
+    BOOST_CHECK(searchSpace.find(RoutingGraph::NodeId(RoutingGraph::BlockId(0, 1), 4)) == nullptr);
+
+    BOOST_CHECK(searchSpace.pop().nodeId == nodeId0);
+    searchSpace.clearHeap();
+    BOOST_CHECK(searchSpace.empty());
+
+    const SearchSpace::Entry *entry0 = searchSpace.find(nodeId0);
+    BOOST_REQUIRE(entry0 != nullptr);
+    BOOST_CHECK(entry0->settled);
+    const SearchSpace::Entry *entry1 = searchSpace.find(nodeId1);
+    BOOST_REQUIRE(entry1 != nullptr);
+    BOOST_CHECK(!entry1->settled);
+    BOOST_CHECK(entry1->prevNodeId == nodeId0);
+
+    // Entries dropped from the heap can be reopened with a smaller weight
+    BOOST_CHECK(searchSpace.push(nodeId1, RoutingGraph::NodeId(), 6.0f));
+    BOOST_CHECK(searchSpace.top().nodeId == nodeId1);
+
+    searchSpace.clear();
+    BOOST_CHECK(searchSpace.find(nodeId0) == nullptr);
+    BOOST_CHECK(searchSpace.find(nodeId1) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) 2015, Project OSRM contributors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "Routing/SegmentProjector.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(segment_projector)
+
+using Nuti::Routing::SegmentProjector;
+
+namespace
+{
+// Straightforward double precision projection, for reference
+void project_reference(const std::vector<std::int32_t> &coords,
+                       std::int32_t lat,
+                       std::int32_t lon,
+                       double lon_factor,
+                       std::vector<double> &dist2s,
+                       std::vector<double> &rel_poses)
+{
+    for (std::size_t i = 0; i + 1 < coords.size() / 2; i++)
+    {
+        double ax = coords[i * 2 + 0] - lat;
+        double ay = (coords[i * 2 + 1] - lon) * lon_factor;
+        double dx = coords[i * 2 + 2] - coords[i * 2 + 0];
+        double dy = (coords[i * 2 + 3] - coords[i * 2 + 1]) * lon_factor;
+        double len2 = dx * dx + dy * dy;
+        double t = len2 > 0 ? std::max(0.0, std::min(1.0, -(ax * dx + ay * dy) / len2)) : 0.0;
+        dist2s.push_back((ax + dx * t) * (ax + dx * t) + (ay + dy * t) * (ay + dy * t));
+        rel_poses.push_back(t);
+    }
+}
+}
+
+BOOST_AUTO_TEST_CASE(reference_test)
+{
+    std::mt19937 mt_rand(19);
+    std::uniform_int_distribution<std::int32_t> offset_dist(-20000, 20000);
+    const std::int32_t lat = 59437000;
+    const std::int32_t lon = 24745000;
+    const float lon_factor = static_cast<float>(std::cos(59.437 * M_PI / 180.0));
+
+    // Cover the vectorized loops and the scalar tails for all supported vector widths
+    for (std::size_t count = 2; count <= 40; count++)
+    {
+        std::vector<std::int32_t> coords;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            coords.push_back(lat + offset_dist(mt_rand));
+            coords.push_back(lon + offset_dist(mt_rand));
+        }
+        if (count > 3)
+        {
+            // Degenerate segment
+            coords[4] = coords[2];
+            coords[5] = coords[3];
+        }
+
+        std::vector<float> dist2s(count - 1), rel_poses(count - 1);
+        SegmentProjector projector(lat, lon, lon_factor);
+        std::size_t best =
+            projector.project(coords.data(), count, dist2s.data(), rel_poses.data());
+
+        std::vector<double> ref_dist2s, ref_rel_poses;
+        project_reference(coords, lat, lon, lon_factor, ref_dist2s, ref_rel_poses);
+        BOOST_REQUIRE_EQUAL(ref_dist2s.size(), count - 1);
+        for (std::size_t i = 0; i + 1 < count; i++)
+        {
+            // Distances in fixed-point units, 0.05 units is about 5mm
+            BOOST_CHECK_SMALL(std::sqrt(dist2s[i]) - std::sqrt(ref_dist2s[i]), 0.05);
+            BOOST_CHECK_SMALL(rel_poses[i] - ref_rel_poses[i], 1e-4);
+        }
+        if (count > 3)
+        {
+            BOOST_CHECK_EQUAL(rel_poses[1], 0.0f);
+        }
+        BOOST_CHECK_EQUAL(best, std::min_element(dist2s.begin(), dist2s.end()) - dist2s.begin());
+        BOOST_CHECK_SMALL(std::sqrt(dist2s[best]) -
+                              std::sqrt(*std::min_element(ref_dist2s.begin(), ref_dist2s.end())),
+                          0.05);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(on_segment_test)
+{
+    // Query point in the middle of the second segment
+    std::vector<std::int32_t> coords = {0, 0, 0, 1000, 1000, 1000, 1000, 2000};
+    SegmentProjector projector(500, 1000, 1.0f);
+    std::vector<float> dist2s(3), rel_poses(3);
+    BOOST_CHECK_EQUAL(projector.project(coords.data(), 4, dist2s.data(), rel_poses.data()), 1u);
+    BOOST_CHECK_EQUAL(dist2s[1], 0.0f);
+    BOOST_CHECK_CLOSE(rel_poses[1], 0.5f, 1e-4);
+    BOOST_CHECK_CLOSE(dist2s[0], 500.0f * 500.0f, 1e-4);
+    BOOST_CHECK_EQUAL(rel_poses[0], 1.0f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
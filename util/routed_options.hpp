@@ -148,7 +148,13 @@ GenerateServerProgramOptions(const int argc,
                              int &max_locations_trip,
                              int &max_locations_viaroute,
                              int &max_locations_distance_table,
-                             int &max_locations_map_matching)
+                             int &max_locations_map_matching,
+                             int &package_watch_interval,
+                             bool &package_reload_service,
+                             bool &collect_stats,
+                             int &route_cache_size,
+                             int &max_isochrone_times,
+                             int &max_isochrone_time)
 {
     using boost::program_options::value;
     using boost::filesystem::path;
@@ -194,7 +200,23 @@ GenerateServerProgramOptions(const int argc,
         ("max-table-size", value<int>(&max_locations_distance_table)->default_value(100),
          "Max. locations supported in distance table query") //
         ("max-matching-size", value<int>(&max_locations_map_matching)->default_value(100),
-         "Max. locations supported in map matching query");
+         "Max. locations supported in map matching query") //
+#ifdef NUTISERVER
+        ("package-watch-interval", value<int>(&package_watch_interval)->default_value(0),
+         "Seconds between rescans of the .nutigraph directory, 0 disables watching") //
+        ("package-reload-service", value<bool>(&package_reload_service)->implicit_value(true)->default_value(false),
+         "Enable the 'reloadpackages' admin service, which rescans the .nutigraph directory on request. "
+         "Only enable it when the server is not reachable by untrusted clients") //
+        ("stats", value<bool>(&collect_stats)->implicit_value(true)->default_value(false),
+         "Collect routing engine counters of all queries for the stats service") //
+        ("route-cache-size", value<int>(&route_cache_size)->default_value(64),
+         "Megabytes of viaroute results kept for repeated requests, 0 disables the cache") //
+        ("max-isochrone-times", value<int>(&max_isochrone_times)->default_value(10),
+         "Max. travel times supported in isochrone query") //
+        ("max-isochrone-time", value<int>(&max_isochrone_time)->default_value(3600),
+         "Max. travel time in isochrone query, in seconds")
+#endif
+        ;
 
     // hidden options, will be allowed both on command line and in config
     // file, but will not be shown to the user